@@ -0,0 +1,47 @@
+#pragma once
+#include <array>
+
+#include "helpers.hpp"
+
+class PICAShader;
+
+namespace PICA {
+	// Everything a renderer needs to fetch vertices and run the vertex shader for a draw itself, instead of getting vertices that were
+	// already shaded on the CPU
+	struct DrawAcceleration {
+		// A vertex attribute that's fetched from the vertex data and goes to vertex shader input register "inputRegister"
+		struct AttributeInfo {
+			u32 offset;  // Offset of the attribute for the first vertex we upload (vertex #minIndex), from the start of vertexData
+			u32 stride;
+			u8 type;  // 0 = s8, 1 = u8, 2 = s16, 3 = float
+			u8 componentCount;
+			u8 inputRegister;
+		};
+
+		// A fixed attribute, which has the same value for every vertex
+		struct FixedAttribute {
+			std::array<float, 4> value;
+			u8 inputRegister;
+		};
+
+		PICAShader* shader = nullptr;
+
+		// Vertex data for vertices [minIndex, maxIndex] of the draw
+		const u8* vertexData = nullptr;
+		u32 vertexDataSize = 0;
+
+		// Index buffer, only valid for indexed draws
+		const u8* indexData = nullptr;
+		bool indexed = false;
+		bool shortIndex = false;
+
+		u32 vertexCount = 0;
+		u32 minIndex = 0;
+		u32 maxIndex = 0;
+
+		u32 attributeCount = 0;
+		u32 fixedAttributeCount = 0;
+		std::array<AttributeInfo, 16> attributes;
+		std::array<FixedAttribute, 16> fixedAttributes;
+	};
+}  // namespace PICA
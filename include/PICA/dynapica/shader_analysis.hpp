@@ -0,0 +1,98 @@
+#pragma once
+#include <array>
+#include <bitset>
+#include <vector>
+
+#include "PICA/shader.hpp"
+#include "helpers.hpp"
+
+// Analysis that the shader JIT runs before compiling a shader
+// Starting from the entrypoint, we follow every CALL/IF/LOOP/JMP target to find which instructions can ever run, so the emitters only need
+// to compile those instead of the whole program memory. This errs on the side of marking too much as reachable, eg both sides of every branch
+// Then we find which components of the temporary and output registers actually get used, working backwards from the output components that
+// the output map sends to the rasterizer. This lets the emitters skip instructions whose results are never used, and only write the
+// components of the destination that are
+// Optionally, the analysis can be specialised on the current bool and int uniform values. Then only the taken side of uniform branches is
+// reachable, and short loops with a known trip count get unrolled by the emitters
+struct ShaderAnalysis {
+	static constexpr u32 maxInstructionCount = PICAShader::maxInstructionCount;
+	// Loops only get unrolled if the unrolled body is at most this many instructions
+	static constexpr u32 maxUnrolledInstructions = 128;
+
+	struct Uniforms {
+		u32 boolUniform = 0;
+		std::array<std::array<u8, 4>, 4> intUniforms{};
+	};
+
+	// Bitmasks of the bool and int uniforms that reachable flow control instructions look at
+	struct UniformUsage {
+		u32 boolUniforms = 0;
+		u32 intUniforms = 0;
+	};
+
+	std::bitset<maxInstructionCount> reachable;
+	// PCs that a subroutine called from reachable code returns at. The emitters need to check for returns there
+	std::bitset<maxInstructionCount> returnPCs;
+	u32 reachableCount = 0;  // How many instructions are reachable
+	u32 endPC = 0;           // One past the last reachable instruction
+
+	// Shows whether any reachable log2 and exp2 instructions exist
+	bool hasLog2 = false;
+	bool hasExp2 = false;
+
+	// For each instruction, which components of its destination are used afterwards, in the same format as operand descriptor write masks
+	// (bit 3 = x, bit 0 = w). Instructions with a mask of 0 don't need to be compiled at all. Instructions without a destination get 0xF
+	std::array<u8, maxInstructionCount> liveWriteMasks;
+	u32 deadInstructionCount = 0;
+
+	// Whether the analysis was specialised on uniform values, and which ones
+	bool specialised = false;
+	Uniforms uniforms;
+	// PCs that reachable jumps and calls can go to, plus the entrypoint. Code containing these can't be left out even if it's dead when
+	// specialised, as we might still jump into it
+	std::bitset<maxInstructionCount> branchTargets;
+	// LOOP instructions whose body the emitters compile once per iteration, and how many extra instructions that adds up to
+	std::bitset<maxInstructionCount> unrolledLoops;
+	u32 unrolledInstructionCount = 0;
+
+	// "liveOutputs" has a bit for each component of each output register that ends up in the vertex, see getLiveOutputs
+	// If "specialisation" is not null, the analysis assumes the uniforms will always have these values
+	void analyze(const PICAShader& shader, u32 entrypoint, u64 liveOutputs, const Uniforms* specialisation = nullptr);
+	// Finds which uniforms the reachable code branches on. Overwrites the results of the last analysis
+	UniformUsage getUniformUsage(const PICAShader& shader, u32 entrypoint);
+	// Only finds the reachable code, for the interpreter's decoder. Overwrites the results of the last analysis
+	void findReachableCode(const PICAShader& shader, u32 entrypoint) {
+		specialised = false;
+		findReachable(shader, entrypoint);
+	}
+
+	bool isReachable(u32 pc) const { return pc < maxInstructionCount && reachable[pc]; }
+	bool isReturnPC(u32 pc) const { return pc < maxInstructionCount && returnPCs[pc]; }
+	bool isUnrolledLoop(u32 pc) const { return pc < maxInstructionCount && unrolledLoops[pc]; }
+	// Only meaningful if specialised. Returns the value of the bool uniform that a JMPU/CALLU/IFU instruction checks
+	bool getBoolUniform(u32 instruction) const { return (uniforms.boolUniform >> Helpers::getBits<22, 4>(instruction)) & 1; }
+	// Whether any PC in [start, end) is a branch target or return PC
+	bool hasBranchTargets(u32 start, u32 end) const;
+	// How many instructions the emitters compile, counting unrolled loop bodies once per iteration
+	u32 getCompiledInstructionCount() const { return reachableCount + unrolledInstructionCount; }
+
+	// Returns which output components get copied to the vertex given the values of the ShaderOutputCount and ShaderOutmap0-6 registers
+	// Bit (4 * register + component) is set if the component is used, with component 0 being x
+	static u64 getLiveOutputs(u32 outputCount, const u32* outmaps);
+
+  private:
+	std::vector<u32> pendingPCs;  // Branch targets we still need to walk
+
+	// Successors of each reachable instruction, for the liveness pass. successors[successorStart[pc]...successorStart[pc + 1]) are pc's
+	std::vector<u16> successors;
+	std::array<u32, maxInstructionCount + 1> successorStart;
+	// For each return PC, the instructions that the subroutines returning there return to
+	std::vector<std::pair<u16, u16>> returnEdges;
+	// Live temporary register components at the start of each instruction. Bit (4 * register + component) like above
+	std::array<u64, maxInstructionCount> liveIn;
+
+	void findReachable(const PICAShader& shader, u32 entrypoint);
+	void findUnrolledLoops(const PICAShader& shader);
+	void buildSuccessors(const PICAShader& shader, u32 entrypoint);
+	void computeLiveness(const PICAShader& shader, u64 liveOutputs);
+};
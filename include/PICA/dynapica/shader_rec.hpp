@@ -1,8 +1,11 @@
 #pragma once
+#include "PICA/dynapica/shader_analysis.hpp"
 #include "PICA/shader.hpp"
 
 #if defined(PANDA3DS_DYNAPICA_SUPPORTED) && (defined(PANDA3DS_X64_HOST) || defined(PANDA3DS_ARM64_HOST))
 #define PANDA3DS_SHADER_JIT_SUPPORTED
+#include <list>
+#include <map>
 #include <memory>
 #include <unordered_map>
 
@@ -11,16 +14,104 @@
 #elif defined(PANDA3DS_ARM64_HOST)
 #include "shader_rec_emitter_arm64.hpp"
 #endif
+
+// A single block of executable memory that every compiled shader shares, so the shader JIT's memory use stays within a fixed budget
+// Shaders get carved out of it first-fit, and freed ranges get merged with their neighbours
+class ShaderCodeArena {
+#ifdef PANDA3DS_X64_HOST
+	std::unique_ptr<Xbyak::CodeGenerator> block;  // Only used for allocating the RWX memory
+#else
+	std::unique_ptr<oaknut::CodeBlock> block;
+#endif
+	u8* base = nullptr;
+	usize capacity = 0;
+	usize usedBytes = 0;
+	std::map<usize, usize> freeRanges;  // Offset -> size of every free range in the arena
+
+	static constexpr usize alignment = 64;
+	static constexpr usize alignSize(usize size) { return (size + alignment - 1) & ~(alignment - 1); }
+
+  public:
+	// Allocates the memory. Can be called again to resize the arena, as long as nothing is allocated from it
+	void init(usize size);
+	bool isInitialized() const { return base != nullptr; }
+	// Frees everything allocated from the arena
+	void clear();
+
+	// Returns nullptr if there's no free range big enough
+	u8* allocate(usize size);
+	void free(u8* pointer, usize size);
+	// Gives the end of an allocation back to the arena, for when we know how much of it we actually needed
+	void shrink(u8* pointer, usize oldSize, usize newSize);
+
+	// Call these around writing code to the arena. Makes the memory writable and flushes the icache after writing on platforms that need it
+	void beginWrite();
+	void endWrite(u8* pointer, usize size);
+
+	usize getCapacity() const { return capacity; }
+	usize getUsedBytes() const { return usedBytes; }
+};
 #endif
 
 class ShaderJIT {
+  public:
+	struct CacheStats {
+		u64 hits = 0;
+		u64 misses = 0;
+		u64 evictions = 0;
+		u64 compiledInstructions = 0;  // How many reachable instructions we've compiled in total
+		u64 deadInstructions = 0;      // How many of those we skipped because their results weren't used
+		u64 specialisedCompiles = 0;   // How many of the compiled shaders were specialised on uniform values
+		usize shaderCount = 0;         // How many shaders are currently cached
+		usize codeBytes = 0;           // How much of the arena the cached shaders take up
+		usize budget = 0;              // How big the arena is
+	};
+
+	// How much executable memory all compiled shaders can take up together by default
+	static constexpr usize defaultCacheBudget = 32_MB;
+	// How many variants specialised on uniform values we compile for a shader before deciding its uniforms change too often to be worth it.
+	// After that, new uniform values use the generic version of the shader, which reads them at runtime
+	static constexpr u32 maxSpecialisedVariants = 8;
+
+  private:
 #ifdef PANDA3DS_SHADER_JIT_SUPPORTED
 	using Hash = PICAShader::Hash;
-	using ShaderCache = std::unordered_map<Hash, std::unique_ptr<ShaderEmitter>>;
+
+	struct CachedShader {
+		Hash hash;
+		Hash baseHash;  // The hash of the shader without any specialisation, which is what shaderInfo is indexed by
+		bool specialised;  // Whether this is a variant specialised on uniform values rather than the generic shader
+		u8* code;
+		usize codeSize;
+		ShaderEmitter::PrologueCallback prologue;
+		ShaderEmitter::InstructionCallback entrypoint;
+	};
+
+	// What we know about each shader regardless of uniform values
+	struct ShaderInfo {
+		ShaderAnalysis::UniformUsage uniformUsage;
+		u32 variantCount = 0;  // How many specialised variants of the shader are in the cache
+		u32 cachedCount = 0;   // How many versions of the shader (specialised or not) are in the cache. We forget the shader when it hits 0
+	};
+
+	// Cached shaders, with the most recently used one at the front so we can evict from the back
+	using ShaderList = std::list<CachedShader>;
+	using ShaderCache = std::unordered_map<Hash, ShaderList::iterator>;
+
 	ShaderEmitter::PrologueCallback prologueCallback;
 	ShaderEmitter::InstructionCallback entrypointCallback;
 
+	ShaderList lruList;
 	ShaderCache cache;
+	std::unordered_map<Hash, ShaderInfo> shaderInfo;
+	ShaderCodeArena arena;
+	ShaderAnalysis analysis;
+	usize cacheBudget = defaultCacheBudget;
+	CacheStats stats;
+
+	// If "specialisation" is not null, the compiled shader is only valid for these uniform values
+	void compile(PICAShader& shaderUnit, Hash hash, Hash baseHash, u64 liveOutputs, const ShaderAnalysis::Uniforms* specialisation);
+	void evictLeastRecentlyUsed();
 #endif
 
   public:
@@ -29,13 +120,19 @@ class ShaderJIT {
 	// This will read the PICA config (uploaded shader and shader operand descriptors) and search if we've already compiled this shader
 	// If yes, it sets it as the active shader. if not, then it compiles it, adds it to the cache, and sets it as active,
 	// The caller must make sure the entrypoint has been properly set beforehand
-	void prepare(PICAShader& shaderUnit);
+	// liveOutputs says which output components end up in the vertex (see ShaderAnalysis::getLiveOutputs), so we can skip computing the rest
+	// Shaders that branch or loop on uniforms get compiled specialised on the current uniform values, up to maxSpecialisedVariants times
+	void prepare(PICAShader& shaderUnit, u64 liveOutputs = ~0ull);
 	void reset();
 	void run(PICAShader& shaderUnit) { prologueCallback(shaderUnit, entrypointCallback); }
 
+	// Sets how much executable memory compiled shaders can take up. Least recently used shaders get evicted to stay under it
+	void setCacheBudget(usize bytes);
+	const CacheStats& getCacheStats() const { return stats; }
+
 	static constexpr bool isAvailable() { return true; }
 #else
-	void prepare(PICAShader& shaderUnit) {
+	void prepare(PICAShader& shaderUnit, u64 liveOutputs = ~0ull) {
 		Helpers::panic("Vertex Loader JIT: Tried to run ShaderJIT::Prepare on platform that does not support shader jit");
 	}
 
@@ -48,6 +145,12 @@ class ShaderJIT {
 	Callback activeShaderCallback = nullptr;
 
 	void reset() {}
+	void setCacheBudget(usize bytes) {}
+	const CacheStats& getCacheStats() const {
+		static const CacheStats emptyStats;
+		return emptyStats;
+	}
+
 	static constexpr bool isAvailable() { return false; }
 #endif
-};
\ No newline at end of file
+};
@@ -6,14 +6,18 @@
 #include <oaknut/code_block.hpp>
 #include <oaknut/oaknut.hpp>
 
+#include "PICA/dynapica/shader_analysis.hpp"
 #include "PICA/shader.hpp"
 #include "helpers.hpp"
 #include "logger.hpp"
 
-class ShaderEmitter : private oaknut::CodeBlock, public oaknut::CodeGenerator {
-	static constexpr size_t executableMemorySize = PICAShader::maxInstructionCount * 96;  // How much executable memory to alloc for each shader
-	// Allocate some extra space as padding for security purposes in the extremely unlikely occasion we manage to overflow the above size
-	static constexpr size_t allocSize = executableMemorySize + 0x1000;
+class ShaderEmitter : public oaknut::CodeGenerator {
+	// Upper bounds on how much code we emit per PICA instruction, and for the constants, prologue and exp2/log2 functions
+	// The caller gives us a buffer big enough for the worst case, then gets back whatever we didn't use
+	static constexpr size_t maxBytesPerInstruction = 384;
+	static constexpr size_t fixedCodeSize = 0x1000;
+
+	u8* codeStart;  // Where the code buffer we were given starts
 
 	// If the swizzle field is this value then the swizzle pattern is .xyzw so we don't need a shuffle
 	static constexpr uint noSwizzle = 0x1B;
@@ -21,22 +25,19 @@ class ShaderEmitter : private oaknut::CodeBlock, public oaknut::CodeGenerator {
 	using f24 = Floats::f24;
 	using vec4f = std::array<f24, 4>;
 
-	// An array of labels (incl pointers) to each compiled (to x64) PICA instruction
+	// An array of labels (incl pointers) to each compiled (to arm64) PICA instruction. Instructions that can't be reached don't get compiled
 	std::array<oaknut::Label, PICAShader::maxInstructionCount> instructionLabels;
-	// A vector of PCs that can potentially return based on the state of the PICA callstack.
-	// Filled before compiling a shader by scanning the code for call instructions
-	std::vector<u32> returnPCs;
+	// Which instructions are reachable from the entrypoint, and which PCs can potentially return based on the state of the PICA callstack
+	const ShaderAnalysis* analysis = nullptr;
 
 	// An array of 128-bit masks for blending registers together to perform masked writes.
 	// Eg for writing only the x and y components, the mask is 0x00000000'00000000'FFFFFFFF'FFFF
 	oaknut::Label blendMasks;
 
 	u32 recompilerPC = 0;  // PC the recompiler is currently recompiling @
+	u32 liveWriteMask = 0xf;  // Which components of the current instruction's destination get used. Stores skip the rest
 	u32 loopLevel = 0;     // The current loop nesting level (0 = not in a loop)
-
-	// Shows whether the loaded shader has any log2 and exp2 instructions
-	bool codeHasLog2 = false;
-	bool codeHasExp2 = false;
+	bool bindLabels = true;  // Off while compiling the extra copies of an unrolled loop body, as a label can only be bound once
 
 	oaknut::Label log2Func, exp2Func;
 	oaknut::Label emitLog2Func();
@@ -47,24 +48,18 @@ class ShaderEmitter : private oaknut::CodeBlock, public oaknut::CodeGenerator {
 
 	template <typename T>
 	T getLabelPointer(const oaknut::Label& label) {
-		auto pointer = reinterpret_cast<u8*>(oaknut::CodeBlock::ptr()) + label.offset();
+		auto pointer = codeStart + label.offset();
 		return reinterpret_cast<T>(pointer);
 	}
 
-	// Compile all instructions from [current recompiler PC, end)
+	// Compile all reachable instructions from [current recompiler PC, end)
 	void compileUntil(const PICAShader& shaderUnit, u32 endPC);
+	// Skip [current recompiler PC, end) for code that a specialised branch never runs into. If something still jumps into it, it gets
+	// compiled out of the way instead
+	void skipUntil(const PICAShader& shaderUnit, u32 endPC);
 	// Compile instruction "instr"
 	void compileInstruction(const PICAShader& shaderUnit);
 
-	bool isCall(u32 instruction) {
-		const u32 opcode = instruction >> 26;
-		return (opcode == ShaderOpcodes::CALL) || (opcode == ShaderOpcodes::CALLC) || (opcode == ShaderOpcodes::CALLU);
-	}
-
-	// Scan the shader code for call instructions to fill up the returnPCs vector before starting compilation
-	// We also scan for log2/exp2 instructions to see whether to emit the relevant functions
-	void scanCode(const PICAShader& shaderUnit);
-
 	// Load register with number "srcReg" indexed by index "idx" into the arm64 register "reg"
 	template <int sourceIndex>
 	void loadRegister(oaknut::QReg dest, const PICAShader& shader, u32 src, u32 idx, u32 operandDescriptor);
@@ -122,14 +117,20 @@ class ShaderEmitter : private oaknut::CodeBlock, public oaknut::CodeGenerator {
 
 	PrologueCallback prologueCb = nullptr;
 
-	// Initialize our emitter with "allocSize" bytes of memory allocated for the code buffer
-	ShaderEmitter() : oaknut::CodeBlock(allocSize), oaknut::CodeGenerator(oaknut::CodeBlock::ptr()) {}
+	// Initialize our emitter to write code to the buffer at "code". The caller takes care of making it writable and executable
+	ShaderEmitter(u8* code, size_t size) : oaknut::CodeGenerator(reinterpret_cast<u32*>(code)), codeStart(code) {}
 
 	// PC must be a valid entrypoint here. It doesn't have that much overhead in this case, so we use std::array<>::at() to assert it does
 	InstructionCallback getInstructionCallback(u32 pc) { return getLabelPointer<InstructionCallback>(instructionLabels.at(pc)); }
 
 	PrologueCallback getPrologueCallback() { return prologueCb; }
-	void compile(const PICAShader& shaderUnit);
+	// How big of a buffer compiling a shader with the given analysis could need
+	static constexpr size_t maxCodeSize(u32 instructionCount) { return fixedCodeSize + instructionCount * maxBytesPerInstruction; }
+	static size_t maxCodeSize(const ShaderAnalysis& analysis) { return maxCodeSize(analysis.getCompiledInstructionCount()); }
+
+	// Compile the code reachable from the entrypoint the analysis was done with
+	void compile(const PICAShader& shaderUnit, const ShaderAnalysis& analysis);
+	size_t getCodeSize() { return size_t(ptr<u8*>() - codeStart); }
 };
 
 #endif  // arm64 recompiler check
@@ -4,6 +4,7 @@
 #if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_X64_HOST)
 #include <vector>
 
+#include "PICA/dynapica/shader_analysis.hpp"
 #include "PICA/shader.hpp"
 #include "helpers.hpp"
 #include "logger.hpp"
@@ -12,9 +13,10 @@
 #include "xbyak/xbyak_util.h"
 
 class ShaderEmitter : public Xbyak::CodeGenerator {
-	static constexpr size_t executableMemorySize = PICAShader::maxInstructionCount * 96;  // How much executable memory to alloc for each shader
-	// Allocate some extra space as padding for security purposes in the extremely unlikely occasion we manage to overflow the above size
-	static constexpr size_t allocSize = executableMemorySize + 0x1000;
+	// Upper bounds on how much code we emit per PICA instruction, and for the constants, prologue and exp2/log2 functions
+	// The caller gives us a buffer big enough for the worst case, then gets back whatever we didn't use
+	static constexpr size_t maxBytesPerInstruction = 256;
+	static constexpr size_t fixedCodeSize = 0x1000;
 
 	// If the swizzle field is this value then the swizzle pattern is .xyzw so we don't need a shuffle
 	static constexpr uint noSwizzle = 0x1B;
@@ -22,11 +24,10 @@ class ShaderEmitter : public Xbyak::CodeGenerator {
 	using f24 = Floats::f24;
 	using vec4f = std::array<f24, 4>;
 
-	// An array of labels (incl pointers) to each compiled (to x64) PICA instruction
+	// An array of labels (incl pointers) to each compiled (to x64) PICA instruction. Instructions that can't be reached don't get compiled
 	std::array<Xbyak::Label, PICAShader::maxInstructionCount> instructionLabels;
-	// A vector of PCs that can potentially return based on the state of the PICA callstack.
-	// Filled before compiling a shader by scanning the code for call instructions
-	std::vector<u32> returnPCs;
+	// Which instructions are reachable from the entrypoint, and which PCs can potentially return based on the state of the PICA callstack
+	const ShaderAnalysis* analysis = nullptr;
 
 	// Vector value of (-0.0, -0.0, -0.0, -0.0) for negating vectors via pxor
 	Label negateVector;
@@ -34,35 +35,27 @@ class ShaderEmitter : public Xbyak::CodeGenerator {
 	Label onesVector;
 
 	u32 recompilerPC = 0;  // PC the recompiler is currently recompiling @
+	u32 liveWriteMask = 0xf;  // Which components of the current instruction's destination get used. Stores skip the rest
 	u32 loopLevel = 0;     // The current loop nesting level (0 = not in a loop)
+	bool bindLabels = true;  // Off while compiling the extra copies of an unrolled loop body, as a label can only be bound once
 
 	bool haveSSE4_1 = false;  // Shows if the CPU supports SSE4.1
 	bool haveAVX = false;     // Shows if the CPU supports AVX (NOT AVX2, NOT AVX512. Regular AVX)
 	bool haveFMA3 = false;    // Shows if the CPU supports FMA3
 
-	// Shows whether the loaded shader has any log2 and exp2 instructions
-	bool codeHasLog2 = false;
-	bool codeHasExp2 = false;
-	
 	Xbyak::Label log2Func, exp2Func;
 	Xbyak::Label emitLog2Func();
 	Xbyak::Label emitExp2Func();
 	Xbyak::util::Cpu cpuCaps;
 
-	// Compile all instructions from [current recompiler PC, end)
+	// Compile all reachable instructions from [current recompiler PC, end)
 	void compileUntil(const PICAShader& shaderUnit, u32 endPC);
+	// Skip [current recompiler PC, end) for code that a specialised branch never runs into. If something still jumps into it, it gets
+	// compiled out of the way instead
+	void skipUntil(const PICAShader& shaderUnit, u32 endPC);
 	// Compile instruction "instr"
 	void compileInstruction(const PICAShader& shaderUnit);
 
-	bool isCall(u32 instruction) {
-		const u32 opcode = instruction >> 26;
-		return (opcode == ShaderOpcodes::CALL) || (opcode == ShaderOpcodes::CALLC) || (opcode == ShaderOpcodes::CALLU);
-	}
-
-	// Scan the shader code for call instructions to fill up the returnPCs vector before starting compilation
-	// We also scan for log2/exp2 instructions to see whether to emit the relevant functions
-	void scanCode(const PICAShader& shaderUnit);
-
 	// Load register with number "srcReg" indexed by index "idx" into the xmm register "reg"
 	template <int sourceIndex>
 	void loadRegister(Xmm dest, const PICAShader& shader, u32 src, u32 idx, u32 operandDescriptor);
@@ -124,8 +117,8 @@ class ShaderEmitter : public Xbyak::CodeGenerator {
 
 	PrologueCallback prologueCb = nullptr;
 
-	// Initialize our emitter with "allocSize" bytes of RWX memory
-	ShaderEmitter() : Xbyak::CodeGenerator(allocSize) {
+	// Initialize our emitter to write code to "size" bytes of RWX memory at "code"
+	ShaderEmitter(u8* code, size_t size) : Xbyak::CodeGenerator(size, code) {
 		cpuCaps = Xbyak::util::Cpu();
 
 		haveSSE4_1 = cpuCaps.has(Xbyak::util::Cpu::tSSE41);
@@ -137,7 +130,13 @@ class ShaderEmitter : public Xbyak::CodeGenerator {
 		}
 	}
 
-	void compile(const PICAShader& shaderUnit);
+	// How big of a buffer compiling a shader with the given analysis could need
+	static constexpr size_t maxCodeSize(u32 instructionCount) { return fixedCodeSize + instructionCount * maxBytesPerInstruction; }
+	static size_t maxCodeSize(const ShaderAnalysis& analysis) { return maxCodeSize(analysis.getCompiledInstructionCount()); }
+
+	// Compile the code reachable from the entrypoint the analysis was done with
+	void compile(const PICAShader& shaderUnit, const ShaderAnalysis& analysis);
+	size_t getCodeSize() { return getSize(); }
 
 	// PC must be a valid entrypoint here. It doesn't have that much overhead in this case, so we use std::array<>::at() to assert it does
 	InstructionCallback getInstructionCallback(u32 pc) {
@@ -1,28 +1,122 @@
 #pragma once
+#include <array>
+#include <vector>
+
+#include "PICA/float_types.hpp"
 #include "helpers.hpp"
-#include "renderer_gl/renderer_gl.hpp"
-#include "x64_regs.hpp"
 
 // Recompiler that takes the current vertex attribute configuration, ie the format of vertices (VAO in OpenGL) and emits optimized
-// code in our CPU's native architecture for loading vertices. Unimplemented at the moment, we've only got a skeleton of it here for later
+// code in our CPU's native architecture for loading vertices. The emitted code fetches every attribute of a vertex, converts it to f24
+// and writes it straight to the shader input register it's permuted to, replacing the per-component attribute decoding in drawArrays
+
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && (defined(PANDA3DS_X64_HOST) || defined(PANDA3DS_ARM64_HOST))
+#define PANDA3DS_VERTEX_LOADER_JIT_SUPPORTED
+#include <memory>
+#include <unordered_map>
+#endif
+
+class VertexLoaderEmitter;
 
 class VertexLoaderJIT {
-	using PICARegs = const std::array<u32, 0x300>&;
-	using Callback = void(*)(Vertex* output, size_t count);  // A function pointer to JIT-emitted code
-	Callback compileConfig(PICARegs regs);
+  public:
+	using vec4f = std::array<Floats::f24, 4>;
+	// Loads vertex #vertexIndex from the vertex buffer starting at vertexData into the shader input registers
+	// fixedAttributes are the fixed attribute registers of the shader unit, which get copied to the inputs like in hardware
+	using Callback = void (*)(vec4f* inputs, const vec4f* fixedAttributes, const u8* vertexData, u32 vertexIndex);
+
+	static constexpr u32 maxAttribCount = 12;
+
+	struct AttribBuffer {
+		u32 offset = 0;  // Offset from base vertex array
+		u32 stride = 0;  // Bytes per vertex
+		u64 config = 0;  // config1 | (config2 << 32)
+		u32 componentCount = 0;
+	};
+
+	// Everything that affects the layout of the emitted code. Compiled loaders are cached by the hash of this
+	struct Config {
+		u64 attribFormat = 0;      // AttribFormatLow | (AttribFormatHigh << 32)
+		u64 inputPermutation = 0;  // VertexShaderInputCfgLow | (VertexShaderInputCfgHigh << 32)
+		u32 totalAttribCount = 0;
+		u32 fixedAttribMask = 0;
+		std::array<AttribBuffer, maxAttribCount> buffers;
+
+		u64 getHash() const;
+	};
+
+	// A flattened description of the work a loader has to do for a given config, so the backends don't have to re-derive it
+	struct LoadOp {
+		enum class Type : u8 {
+			BeginBuffer,  // Set the current address to buffer.offset + vertexIndex * buffer.stride
+			Padding,      // Align the current address up to 4 bytes, then skip "size" bytes
+			Fetch,        // Load "size" components of type "attribType" and advance the current address past them
+			Fixed,        // Copy fixed attribute "attribute" to its input register
+		};
+
+		Type type;
+		u8 attribType = 0;   // 0 = s8, 1 = u8, 2 = s16, 3 = float
+		u8 size = 0;         // Component count for fetches, byte count for padding
+		u8 attribute = 0;    // Index of the attribute for fetches and fixed attributes
+		s8 destination = -1; // Shader input register to write to, or -1 if the attribute is overwritten/unused and only needs to be skipped
+		u32 offset = 0;      // Buffer offset for BeginBuffer
+		u32 stride = 0;      // Buffer stride for BeginBuffer
+	};
 
-public:
-#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_X64_HOST)
-	#define PANDA3DS_VERTEX_LOADER_JIT_SUPPORTED
+	// Bytes of a vertex buffer that the loader reads for vertex #0, relative to the vertex base. Vertex #i reads [start, end) + i * stride
+	struct BufferSpan {
+		u64 start;
+		u64 end;
+		u32 stride;
+	};
 
-	void loadVertices(Vertex* output, size_t count, PICARegs regs);
+	// Turns a config into a list of load ops. Returns false if the config is one we can't handle, in which case the caller should use the
+	// generic vertex loader
+	static bool buildLoadOps(const Config& config, std::vector<LoadOp>& ops);
+	static void getBufferSpans(const std::vector<LoadOp>& ops, std::vector<BufferSpan>& spans);
+
+	static constexpr u32 attribTypeSize(u32 attribType) {
+		constexpr u32 sizes[4] = {1, 1, 2, 4};
+		return sizes[attribType & 3];
+	}
+
+#ifdef PANDA3DS_VERTEX_LOADER_JIT_SUPPORTED
+	// Find or compile the loader for the given config. Returns false if the config can't be compiled
+	bool prepare(const Config& config);
+	void loadVertex(vec4f* inputs, const vec4f* fixedAttributes, const u8* vertexData, u32 vertexIndex) {
+		activeLoader(inputs, fixedAttributes, vertexData, vertexIndex);
+	}
+
+	// The loaders don't do any bounds checking, so before using one the caller has to make sure that the range of the vertex data
+	// it can read for vertices minIndex to maxIndex is valid. Returns false if the range doesn't fit in 32 bits
+	bool getVertexDataRange(u32 minIndex, u32 maxIndex, u32& start, u32& size) const;
+
+	void reset();
 	static constexpr bool isAvailable() { return true; }
 
+	VertexLoaderJIT();
+	~VertexLoaderJIT();
+
+  private:
+	struct CompiledLoader {
+		std::unique_ptr<VertexLoaderEmitter> emitter;
+		std::vector<BufferSpan> spans;
+	};
+
+	using LoaderCache = std::unordered_map<u64, CompiledLoader>;
+	LoaderCache cache;
+	Callback activeLoader = nullptr;
+	const std::vector<BufferSpan>* activeSpans = nullptr;
+	u64 activeHash = 0;
+	std::vector<LoadOp> ops;  // Kept around to avoid allocating on every compile
 #else
-	void loadVertices(Vertex* output, size_t count, PICARegs regs) {
+	bool prepare(const Config& config) { return false; }
+	void loadVertex(vec4f* inputs, const vec4f* fixedAttributes, const u8* vertexData, u32 vertexIndex) {
 		Helpers::panic("Vertex Loader JIT: Tried to load vertices with JIT on platform that does not support vertex loader jit");
 	}
 
+	bool getVertexDataRange(u32 minIndex, u32 maxIndex, u32& start, u32& size) const { return false; }
+
+	void reset() {}
 	static constexpr bool isAvailable() { return false; }
 #endif
-};
\ No newline at end of file
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+// Only do anything if we're on an arm64 target with JIT support enabled
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_ARM64_HOST)
+#include <oaknut/code_block.hpp>
+#include <oaknut/oaknut.hpp>
+#include <vector>
+
+#include "PICA/dynapica/vertex_loader_rec.hpp"
+#include "helpers.hpp"
+
+class VertexLoaderEmitter : private oaknut::CodeBlock, public oaknut::CodeGenerator {
+	// Even with 12 buffers of 15 components each, loaders stay way below this
+	static constexpr size_t allocSize = 0x8000;
+
+	using LoadOp = VertexLoaderJIT::LoadOp;
+	VertexLoaderJIT::Callback callback = nullptr;
+
+	void emitFetch(const LoadOp& op);
+	void emitFixed(const LoadOp& op);
+
+  public:
+	VertexLoaderEmitter() : oaknut::CodeBlock(allocSize), oaknut::CodeGenerator(oaknut::CodeBlock::ptr()) {}
+
+	void compile(const std::vector<LoadOp>& ops);
+	VertexLoaderJIT::Callback getCallback() { return callback; }
+};
+
+#endif  // arm64 recompiler check
@@ -0,0 +1,32 @@
+#pragma once
+
+// Only do anything if we're on an x64 target with JIT support enabled
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_X64_HOST)
+#include <vector>
+
+#include "PICA/dynapica/vertex_loader_rec.hpp"
+#include "helpers.hpp"
+#include "x64_regs.hpp"
+#include "xbyak/xbyak.h"
+#include "xbyak/xbyak_util.h"
+
+class VertexLoaderEmitter : public Xbyak::CodeGenerator {
+	// Even with 12 buffers of 15 components each, loaders stay way below this
+	static constexpr size_t allocSize = 0x8000;
+
+	using LoadOp = VertexLoaderJIT::LoadOp;
+	bool haveSSE4_1 = false;  // Shows if the CPU supports SSE4.1, which we use for sign/zero extending packed attributes
+
+	void emitFetch(const LoadOp& op);
+	void emitFixed(const LoadOp& op);
+
+  public:
+	VertexLoaderEmitter() : Xbyak::CodeGenerator(allocSize) {
+		haveSSE4_1 = Xbyak::util::Cpu().has(Xbyak::util::Cpu::tSSE41);
+	}
+
+	void compile(const std::vector<LoadOp>& ops);
+	VertexLoaderJIT::Callback getCallback() { return getCode<VertexLoaderJIT::Callback>(); }
+};
+
+#endif  // x64 recompiler check
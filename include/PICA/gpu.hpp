@@ -1,8 +1,14 @@
 #pragma once
 #include <array>
+#include <memory>
+#include <vector>
 
 #include "PICA/dynapica/shader_rec.hpp"
+#include "PICA/dynapica/vertex_loader_rec.hpp"
 #include "PICA/float_types.hpp"
+#include "PICA/gpu_thread.hpp"
+#include "PICA/gpu_trace.hpp"
+#include "PICA/lut_tracker.hpp"
 #include "PICA/pica_vertex.hpp"
 #include "PICA/regs.hpp"
 #include "PICA/shader_unit.hpp"
@@ -10,7 +16,9 @@
 #include "helpers.hpp"
 #include "logger.hpp"
 #include "memory.hpp"
+#include "profiler.hpp"
 #include "renderer.hpp"
+#include "thread_pool.hpp"
 
 class GPU {
 	static constexpr u32 regNum = 0x300;
@@ -24,14 +32,14 @@ class GPU {
 	EmulatorConfig& config;
 	ShaderUnit shaderUnit;
 	ShaderJIT shaderJIT;  // Doesn't do anything if JIT is disabled or not supported
+	VertexLoaderJIT vertexLoaderJIT;  // Same as above
 
 	u8* vram = nullptr;
 	MAKE_LOG_FUNCTION(log, gpuLogger)
 
 	static constexpr u32 maxAttribCount = 12;  // Up to 12 vertex attributes
 	static constexpr u32 vramSize = u32(6_MB);
-	Registers regs;                           // GPU internal registers
-	std::array<vec4f, 16> currentAttributes;  // Vertex attributes before being passed to the shader
+	Registers regs;  // GPU internal registers
 
 	std::array<vec4f, 16> immediateModeAttributes;  // Vertex attributes uploaded via immediate mode submission
 	std::array<PICA::Vertex, 3> immediateModeVertices;
@@ -58,6 +66,45 @@ class GPU {
 		return u64(regs[PICA::InternalRegs::VertexShaderInputCfgLow]) | (u64(regs[PICA::InternalRegs::VertexShaderInputCfgHigh]) << 32);
 	}
 
+	// Have the renderer fetch vertices and run the vertex shader on its own. Returns false if it can't, in which case we shade on the CPU
+	bool drawArraysAccelerated(PICA::PrimType primType, bool indexed, u32 vertexBase, u32 vertexCount, u32 indexBufferPointer, bool shortIndex);
+	std::vector<VertexLoaderJIT::LoadOp> acceleratedLoadOps;
+
+	// Smallest and largest vertex index used by a draw. indexData is only used for indexed draws
+	std::pair<u32, u32> getIndexRange(bool indexed, u32 vertexCount, const u8* indexData, bool shortIndex);
+	// Get a pointer to the vertex data for the vertex loader JIT, after checking that all the vertex data it can read is in bounds.
+	// Returns nullptr if it isn't, in which case the generic loader needs to be used
+	const u8* getVertexLoaderData(bool indexed, u32 vertexBase, u32 vertexCount, u32 indexBufferPointer, bool shortIndex);
+
+	// Fetch the attributes of a vertex and permute them into the vertex shader's input registers. Used when the vertex loader JIT can't be used
+	void loadVertexAttributes(PICAShader& shader, u32 vertexBase, u32 vertexIndex);
+
+	// Shade the vertices of a draw across the vertex processing threads, writing them to the same vertex buffer as the serial path
+	template <bool indexed, bool useShaderJIT>
+	void drawArraysParallel(u32 vertexBase, u32 vertexCount, u32 indexBufferPointer, bool shortIndex, const u8* vertexData, bool useVertexLoaderJIT);
+
+	// Fetch the attributes of a vertex, run the vertex shader on it with the given shader unit and write the result to "out"
+	template <bool useShaderJIT>
+	void processVertex(PICAShader& shader, u32 vertexBase, const u8* vertexData, bool useVertexLoaderJIT, u32 vertexIndex, PICA::Vertex& out);
+
+	// Draws with at least this many vertices get split across the vertex processing threads, if we have any
+	static constexpr u32 minParallelVertexCount = 256;
+	// Minimum amount of vertices each thread gets, so we don't wake up 16 threads for a handful of vertices each
+	static constexpr u32 minVerticesPerThread = 64;
+
+	std::unique_ptr<ThreadPool> vertexThreadPool;  // Null if parallel vertex processing is disabled
+	std::vector<std::unique_ptr<PICAShader>> workerShaders;  // A vertex shader unit for each vertex processing thread
+	// For deduplicating indices of indexed draws before shading them in parallel
+	std::vector<u32> uniqueIndices;        // Every vertex index that appears in the draw, in order of first appearance
+	std::vector<u32> uniqueSlots;          // For every vertex of the draw, the index of its vertex in uniqueIndices
+	std::vector<u32> indexSlot;            // Reverse mapping of uniqueIndices, indexed by vertex index
+	std::vector<u32> indexSlotGeneration;  // Which draw each entry of indexSlot is valid for
+	u32 dedupGeneration = 0;
+	std::vector<PICA::Vertex> uniqueVertices;
+
+	// Gather everything the vertex loader JIT specializes on
+	VertexLoaderJIT::Config getVertexLoaderConfig();
+
 	std::array<AttribInfo, maxAttribCount> attributeInfo;  // Info for each of the 12 attributes
 	u32 totalAttribCount = 0;                              // Number of vertex attributes to send to VS
 	u32 fixedAttribMask = 0;                               // Which attributes are fixed?
@@ -74,6 +121,32 @@ class GPU {
 	std::unique_ptr<Renderer> renderer;
 	PICA::Vertex getImmediateModeVertex();
 
+	// Renderer calls that do real work go through these, so the profiler can tell rendering apart from the rest of the GPU
+	void drawVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices) {
+		PROFILE_SCOPE(Renderer);
+		renderer->drawVertices(primType, vertices);
+	}
+
+	void flushPendingDraws() {
+		PROFILE_SCOPE(Renderer);
+		renderer->flushPendingDraws();
+	}
+	u32* getCommandListPointer(u32 addr, u32& size);
+	void runCommandList(u32* list, u32 size);
+
+	// With the threaded GPU enabled, GSP commands run on this thread. It's declared after the renderer so it gets stopped first
+	std::unique_ptr<GPUThread> thread;
+	GPUThread::ContextCallback makeContextCurrent;
+	GPUThread::ContextCallback doneContextCurrent;
+	bool threadingDecided = false;  // Whether to use the GPU thread gets decided on the first frame after a reset
+	void updateThreading();
+
+	// Traces get started and stopped on frame boundaries, where nothing's running on the GPU thread
+	std::unique_ptr<PICA::Trace::Recorder> traceRecorder;
+	void recordCommand(const GPUThread::Command& command, std::span<u32> payload);
+	std::filesystem::path pendingTracePath;
+	u32 pendingTraceFrames = 0;
+
   public:
 	// 256 entries per LUT with each LUT as its own row forming a 2D image 256 * LUT_COUNT
 	// Encoded in PICA native format
@@ -81,12 +154,19 @@ class GPU {
 	std::array<uint32_t, LightingLutSize> lightingLUT;
 
 	// Used to prevent uploading the lighting_lut on every draw call
-	// Set to true when the CPU writes to the lighting_lut
-	// Set to false by the renderer when the lighting_lut is uploaded ot the GPU
-	bool lightingLUTDirty = false;
+	// Marked when the CPU writes to the lighting_lut, consumed by the renderer when it uploads the parts that changed
+	PICA::LUTTracker<PICA::Lights::LUT_Count, 256> lightingLUTDirty;
+
+	// One bit per internal register, set whenever a register in the render state range changes value
+	// Renderers clear the bits once they've picked up the new values, eg by uploading them to the host GPU
+	std::array<u64, regNum / 64> dirtyRegs;
+	void markRegDirty(u32 index) { dirtyRegs[index / 64] |= 1ull << (index % 64); }
 
 	GPU(Memory& mem, EmulatorConfig& config);
-	void display() { renderer->display(); }
+	void display() {
+		PROFILE_SCOPE(Renderer);
+		renderer->display();
+	}
 	void screenshot(const std::string& name) { renderer->screenshot(name); }
 	void deinitGraphicsContext() { renderer->deinitGraphicsContext(); }
 
@@ -103,6 +183,34 @@ class GPU {
 	ExternalRegisters& getExtRegisters() { return externalRegs; }
 	void startCommandList(u32 addr, u32 size);
 
+	// Runs a GSP command on the GPU thread if the GPU is threaded, or right away otherwise
+	// Returns a sequence number that can be waited on, which is 0 for commands that already ran
+	u64 submitCommand(const GPUThread::Command& command);
+	bool isCommandDone(u64 sequence) const { return thread == nullptr || thread->isDone(sequence); }
+	void waitForCommand(u64 sequence);
+	// Waits for every submitted command to finish, for when the CPU needs to look at GPU state
+	void syncThread();
+	bool isThreaded() const { return thread != nullptr; }
+	// Wakes up the CPU thread if it's waiting on the GPU thread, so it can do what the GPU thread needs from it (eg watching memory)
+	void wakeThreadWaits();
+
+	// Called around running the emulated CPU for a frame. The GPU thread only runs in between these. Outside of them, everything
+	// (including the graphics context) belongs to the thread running the emulator
+	void beginFrame();
+	void endFrame();
+	// Frontends whose graphics context is bound to a thread have to provide these for the threaded GPU to be able to use it
+	void setContextCallbacks(GPUThread::ContextCallback makeCurrent, GPUThread::ContextCallback doneCurrent);
+	// Runs a GSP command right away, on the calling thread
+	void runCommand(const GPUThread::Command& command, std::span<u32> payload);
+
+	// Records the GSP commands of the next "frameCount" frames into a trace, starting with the next frame
+	void startTrace(const std::filesystem::path& path, u32 frameCount);
+	bool isTracing() const { return traceRecorder != nullptr || pendingTraceFrames != 0; }
+	void saveTraceState(PICA::Trace::State& state);
+	void loadTraceState(const PICA::Trace::State& state);
+	// If set, every draw appends the time it took on the CPU side in nanoseconds here. For benchmarking tools
+	std::vector<u64>* drawTimings = nullptr;
+
 	// Used by the GSP GPU service for readHwRegs/writeHwRegs/writeHwRegsMasked
 	u32 readReg(u32 address);
 	void writeReg(u32 address, u32 value);
@@ -113,21 +221,31 @@ class GPU {
 	// Used when processing GPU command lists
 	u32 readInternalReg(u32 index);
 	void writeInternalReg(u32 index, u32 value, u32 mask);
+	// Writes "count" values to the registers starting at "index", adding "increment" to the index after each one. This is how command list
+	// commands write registers, and it handles runs of registers without side effects and data port bursts in bulk
+	// Returns false if one of the writes made the command processor jump to another command list
+	bool writeInternalRegs(u32 index, const u32* values, u32 count, u32 mask, u32 increment);
 
 	// Used for setting the size of the window we'll be outputting graphics to
 	void setOutputSize(u32 width, u32 height) { renderer->setOutputSize(width, height); }
+	void setShaderCachePath(const std::optional<std::filesystem::path>& path) { renderer->setShaderCachePath(path); }
 
 	// TODO: Emulate the transfer engine & its registers
 	// Then this can be emulated by just writing the appropriate values there
-	void clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 control) { renderer->clearBuffer(startAddress, endAddress, value, control); }
+	void clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 control) {
+		PROFILE_SCOPE(Renderer);
+		renderer->clearBuffer(startAddress, endAddress, value, control);
+	}
 
 	// TODO: Emulate the transfer engine & its registers
 	// Then this can be emulated by just writing the appropriate values there
 	void displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) {
+		PROFILE_SCOPE(Renderer);
 		renderer->displayTransfer(inputAddr, outputAddr, inputSize, outputSize, flags);
 	}
 
 	void textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32 inputSize, u32 outputSize, u32 flags) {
+		PROFILE_SCOPE(Renderer);
 		renderer->textureCopy(inputAddr, outputAddr, totalBytes, inputSize, outputSize, flags);
 	}
 
@@ -145,6 +263,14 @@ class GPU {
 		}
 	}
 
+	// Check if [paddr, paddr + size) is all in FCRAM or all in VRAM, without panicking if it isn't
+	bool isPhysicalRangeValid(u32 paddr, u32 size) const {
+		// The end addresses are inclusive
+		const u64 end = u64(paddr) + size;
+		return (paddr >= PhysicalAddrs::FCRAM && end <= u64(PhysicalAddrs::FCRAMEnd) + 1) ||
+			   (paddr >= PhysicalAddrs::VRAM && end <= u64(PhysicalAddrs::VRAMEnd) + 1);
+	}
+
 	// Get a pointer of type T* to the data starting from physical address paddr
 	template <typename T>
 	T* getPointerPhys(u32 paddr, u32 size = 0) {
@@ -162,6 +288,8 @@ class GPU {
 	}
 
 	Renderer* getRenderer() { return renderer.get(); }
+	const ShaderJIT::CacheStats& getShaderJITStats() const { return shaderJIT.getCacheStats(); }
+	Memory& getMemory() { return mem; }
   private:
 	// GPU external registers
 	// We have them in the end of the struct for cache locality reasons. Tl;dr we want the more commonly used things to be packed in the start
@@ -0,0 +1,96 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "helpers.hpp"
+#include "ring_buffer.hpp"
+
+// Runs GSP commands (command lists, memory fills, transfers...) on a thread of its own, so the emulated CPU can keep going while the GPU
+// works on them. The CPU thread is the only producer and the GPU thread the only consumer, so commands go through lock-free SPSC rings
+// Every command gets a sequence number, which the CPU thread can wait on whenever it needs the results of a command
+// Renderers whose graphics context can only be current on one thread at a time get it handed over with the context callbacks. The CPU thread
+// lends the context out before it starts submitting work, the GPU thread makes it current once it gets some, and gives it back when the CPU
+// thread reclaims it. Commands can only be submitted while the context is lent out
+// The GPU thread can need the CPU thread to do things for it (eg watch memory), so whenever the CPU thread waits on the GPU thread, it
+// keeps calling the wait callback, and wakeWaiters wakes it up to do that
+class GPUThread {
+  public:
+	enum class CommandType : u32 {
+		Stop,             // Internal, makes the GPU thread exit
+		ReleaseContext,   // Internal, makes the GPU thread give up the graphics context
+		CommandList,      // Args: Address, size. The payload has a copy of the command list, if running on the GPU thread
+		MemoryFill,       // Args: Start, end, value, control
+		DisplayTransfer,  // Args: Input address, output address, input size, output size, flags
+		TextureCopy,      // Args: Input address, output address, total bytes, input size, output size, flags
+		DMA,              // Args: Destination, source, size
+		WriteReg,         // Args: Address, value, mask. The register gets read first if the mask isn't 0xFFFFFFFF
+	};
+
+	struct Command {
+		CommandType type;
+		std::array<u32, 6> args;
+		u32 payloadSize;  // In words
+	};
+
+	using Handler = std::function<void(const Command& command, std::span<u32> payload)>;
+	using ContextCallback = std::function<void()>;
+	using WaitCallback = std::function<void()>;
+
+	// Copies of command lists go through their own ring. Bigger lists than this get streamed through it in pieces
+	static constexpr usize payloadCapacity = 1 << 20;
+
+  private:
+	Common::RingBuffer<Command, 256> commands;
+	Common::RingBuffer<u32, payloadCapacity> payloads;
+	std::vector<u32> payloadScratch;  // Where the GPU thread collects the payload of the current command
+
+	Handler handler;
+	ContextCallback makeCurrent;
+	ContextCallback doneCurrent;
+	WaitCallback whileWaiting;
+	bool holdsContext = false;  // Only touched by the GPU thread
+	bool contextLent = false;   // Only touched by the CPU thread
+
+	std::thread thread;
+	std::atomic<u64> submitted = 0;
+	std::atomic<u64> completed = 0;
+	std::atomic<u32> waitEvents = 0;  // Changes when a command completes or someone wakes waiters up, which is what waits sleep on
+
+	void threadLoop();
+	void popPayload(u32 size);
+	void runWaitCallback() {
+		if (whileWaiting) {
+			whileWaiting();
+		}
+	}
+
+  public:
+	GPUThread() = default;
+	~GPUThread() { stop(); }
+
+	GPUThread(const GPUThread&) = delete;
+	GPUThread& operator=(const GPUThread&) = delete;
+
+	// The context callbacks can be empty if the renderer doesn't care which thread it runs on
+	void start(Handler handler, ContextCallback makeCurrent, ContextCallback doneCurrent, WaitCallback whileWaiting = {});
+	void stop();
+	bool isRunning() const { return thread.joinable(); }
+
+	// Queues up a command, and returns the sequence number it can be waited on with
+	u64 submit(const Command& command, std::span<const u32> payload = {});
+	bool isDone(u64 sequence) const { return completed.load(std::memory_order_acquire) >= sequence; }
+	void wait(u64 sequence);
+	void waitIdle() { wait(submitted.load(std::memory_order_relaxed)); }
+	// Makes the CPU thread run the wait callback if it's waiting on us. Call from the GPU thread
+	void wakeWaiters();
+
+	// Releases the graphics context on the calling thread, so the GPU thread can pick it up
+	void lendContext();
+	// Waits for all queued work to finish, makes the GPU thread give up the graphics context and makes it current on the calling thread again
+	void reclaimContext();
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include <array>
+#include <filesystem>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "PICA/gpu_thread.hpp"
+#include "PICA/regs.hpp"
+#include "helpers.hpp"
+#include "io_file.hpp"
+
+class GPU;
+
+// GPU traces capture the GSP commands a game sends over a number of frames, along with the GPU state and memory they depend on, so they can
+// be replayed through the GPU without the game, the CPU or the kernel. This is what the pica_replay tool uses for benchmarking the GPU
+// A trace is a FileHeader followed by a stream of records, each one being a RecordHeader followed by "size" bytes of data
+// Memory gets captured a page at a time. Every distinct page is stored once, and later references to it only store its hash
+namespace PICA::Trace {
+	static constexpr u32 magic = 0x54434950;  // "PICT"
+	static constexpr u32 version = 2;  // Version 1 traces could have command lists without their contents
+	static constexpr u32 pageSize = 4096;
+
+	enum class RecordType : u32 {
+		State,     // A State, always the first record
+		PageData,  // A u64 page hash followed by the page's contents, for the first page with these contents
+		PageMap,   // An array of PageEntry, for the pages that changed since the last PageMap. Goes right before a command
+		Command,   // A CommandHeader followed by the command's payload
+		EndFrame,  // No data
+	};
+
+	struct FileHeader {
+		u32 magic;
+		u32 version;
+	};
+
+	struct RecordHeader {
+		RecordType type;
+		u32 size;
+	};
+
+	struct PageEntry {
+		u32 paddr;
+		u32 padding;
+		u64 hash;
+	};
+
+	struct CommandHeader {
+		GPUThread::CommandType type;
+		std::array<u32, 6> args;
+		u32 payloadSize;  // In words
+	};
+
+	// The GPU state that command lists build on. Whatever the GPU derives from registers (eg vertex attribute config) gets rebuilt from them
+	struct State {
+		std::array<u32, 0x300> regs;
+		std::array<u32, 0x1000> externalRegs;
+		std::array<u32, Lights::LUT_Count * 256> lightingLUT;
+
+		// Vertex shader state that doesn't live in registers
+		std::array<u32, 4096> shaderCode;
+		std::array<u32, 128> operandDescriptors;
+		std::array<std::array<float, 4>, 96> floatUniforms;
+		std::array<std::array<float, 4>, 16> fixedAttributes;
+	};
+
+	class Recorder {
+		GPU& gpu;
+		IOFile file;
+		u32 framesLeft = 0;
+
+		u64 lastSyncTimestamp = 0;
+		std::unordered_set<u64> storedPages;  // Hashes of the pages that already have a PageData record
+		std::vector<u32> dirtyPages;
+		std::vector<PageEntry> pageMap;
+
+		void writeRecord(RecordType type, std::span<const u8> data);
+		void writeRecord(RecordType type, std::span<const u8> data, std::span<const u8> extraData);
+		// Stores the pages that changed since the last sync
+		void syncMemory();
+
+	  public:
+		Recorder(GPU& gpu) : gpu(gpu) {}
+
+		bool open(const std::filesystem::path& path, u32 frameCount);
+		void close();
+		bool isOpen() { return file.isOpen(); }
+
+		void recordCommand(const GPUThread::Command& command, std::span<const u32> payload);
+		// Returns whether there's more frames to record
+		bool endFrame();
+	};
+
+	class Player {
+		IOFile file;
+		State state;
+		u64 firstRecordOffset = 0;
+		std::unordered_map<u64, std::vector<u8>> pages;
+		std::vector<PageEntry> pageMap;
+		std::vector<u32> payload;
+
+	  public:
+		struct FrameInfo {
+			u32 commandCount = 0;
+			u32 commandListCount = 0;
+			u32 pagesLoaded = 0;
+			u32 skippedCommandLists = 0;
+			u64 commandTime = 0;  // Time spent running commands in nanoseconds, not counting loading memory in between them
+		};
+
+		bool open(const std::filesystem::path& path);
+		// Loads the GPU state from the start of the trace, and goes back to the first frame
+		void restart(GPU& gpu);
+		// Runs the records of the next frame. Returns false if the trace is over
+		bool runFrame(GPU& gpu, FrameInfo& info);
+	};
+}  // namespace PICA::Trace
@@ -0,0 +1,58 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#include "helpers.hpp"
+
+namespace PICA {
+	// Keeps track of which parts of a LUT changed since the renderer last uploaded it, so it can upload only those
+	// LUTs are made of "rowCount" rows of "rowSize" entries each (eg one row per lighting LUT). Each row has its own dirty bit and keeps
+	// the range of entries that changed, since games usually write a handful of consecutive entries at a time
+	template <usize rowCount, usize rowSize>
+	class LUTTracker {
+		static_assert(rowCount <= 64, "LUTTracker only supports up to 64 rows");
+
+		u64 dirtyRows = 0;
+		// Dirty entries of each row are [dirtyStart, dirtyEnd). Only valid for rows with their dirty bit set
+		std::array<u32, rowCount> dirtyStart;
+		std::array<u32, rowCount> dirtyEnd;
+
+	  public:
+		void markDirty(u32 row, u32 index) {
+			const u64 mask = 1ull << row;
+			if ((dirtyRows & mask) == 0) {
+				dirtyRows |= mask;
+				dirtyStart[row] = index;
+				dirtyEnd[row] = index + 1;
+			} else {
+				dirtyStart[row] = std::min(dirtyStart[row], index);
+				dirtyEnd[row] = std::max(dirtyEnd[row], index + 1);
+			}
+		}
+
+		void markAllDirty() {
+			for (u32 row = 0; row < rowCount; row++) {
+				dirtyStart[row] = 0;
+				dirtyEnd[row] = rowSize;
+			}
+
+			dirtyRows = rowCount == 64 ? ~0ull : (1ull << rowCount) - 1;
+		}
+
+		bool isDirty() const { return dirtyRows != 0; }
+
+		// Calls func(row, start, end) for the dirty range of every dirty row, then marks everything as clean
+		template <typename Func>
+		void consume(Func&& func) {
+			u64 rows = dirtyRows;
+			dirtyRows = 0;
+
+			while (rows != 0) {
+				const u32 row = u32(std::countr_zero(rows));
+				rows &= rows - 1;
+				func(row, dirtyStart[row], dirtyEnd[row]);
+			}
+		}
+	};
+}  // namespace PICA
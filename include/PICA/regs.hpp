@@ -4,6 +4,10 @@
 namespace PICA {
 	namespace InternalRegs {
 		enum : u32 {
+			// Registers in [RenderStateStart, RenderStateEnd) configure how draws get rendered, from face culling to the framebuffer and lighting
+			RenderStateStart = 0x40,
+			RenderStateEnd = 0x200,
+
 			// Rasterizer registers
 			ViewportWidth = 0x41,
 			ViewportInvw = 0x42,
@@ -28,8 +32,11 @@ namespace PICA {
 			// Texture registers
 			TexUnitCfg = 0x80,
 			Tex0BorderColor = 0x81,
+			Tex0Type = 0x8E,
 			Tex1BorderColor = 0x91,
+			Tex1Type = 0x96,
 			Tex2BorderColor = 0x99,
+			Tex2Type = 0x9E,
 			TexEnvUpdateBuffer = 0xE0,
 			TexEnvBufferColor = 0xFD,
 
@@ -68,6 +75,12 @@ namespace PICA {
 			FramebufferSize = 0x11E,
 
 			//LightingRegs
+			LightingEnable = 0x008F,
+			Light0Specular0 = 0x0140,  // Each light has 0x10 registers, starting from here
+			LightingAmbient = 0x01C0,
+			LightingNumLights = 0x01C2,
+			LightingConfig0 = 0x01C3,
+			LightingConfig1 = 0x01C4,
 			LightingLUTIndex =  0x01C5,
 			LightingLUTData0 =  0x01C8,
 			LightingLUTData1 =  0x01C9,
@@ -77,6 +90,10 @@ namespace PICA {
 			LightingLUTData5 =  0x01CD,
 			LightingLUTData6 =  0x01CE,
 			LightingLUTData7 =  0x01CF,
+			LightingLUTInputAbs = 0x01D0,
+			LightingLUTInputSelect = 0x01D1,
+			LightingLUTInputScale = 0x01D2,
+			LightingLightPermutation = 0x01D9,
 			
 			// Geometry pipeline registers
 			VertexAttribLoc = 0x200,
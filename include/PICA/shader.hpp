@@ -1,10 +1,16 @@
 #pragma once
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cstring>
+#include <list>
+#include <memory>
+#include <span>
+#include <unordered_map>
 
 #include "PICA/float_types.hpp"
 #include "PICA/pica_hash.hpp"
+#include "PICA/shader_decoder.hpp"
 #include "helpers.hpp"
 
 enum class ShaderType {
@@ -99,6 +105,9 @@ class PICAShader {
 	alignas(16) std::array<vec4f, 16> outputs;
 	alignas(16) vec4f dummy = vec4f({f24::zero(), f24::zero(), f24::zero(), f24::zero()});  // Dummy register used by the JIT
 
+	// Bit i is set if float uniform i was written since the renderer last consumed these, so hardware shaders only get the changed ones
+	std::array<u64, 2> floatUniformsDirty = {~0ull, ~0ull};
+
   protected:
 	std::array<u32, 128> operandDescriptors;
 	alignas(16) std::array<vec4f, 16> tempRegisters;  // General purpose registers the shader can use for temp values
@@ -130,93 +139,65 @@ class PICAShader {
 	// Add these as friend classes for the JIT so it has access to all important state
 	friend class ShaderJIT;
 	friend class ShaderEmitter;
+	friend struct ShaderAnalysis;
+	friend class ShaderDecompiler;
+	friend class ShaderDecoder;
+	friend class GPU;  // For saving and loading the shader state in GPU traces
 
 	vec4f getSource(u32 source);
 	vec4f& getDest(u32 dest);
 
   private:
-	// Interpreter functions for the various shader functions
-	void add(u32 instruction);
+	// Programs the interpreter has already decoded, keyed by code + operand descriptor hash and entrypoint, like the shader JIT's cache.
+	// The most recently used one is at the front of the list so we can evict from the back
+	struct CachedProgram {
+		Hash hash;
+		std::unique_ptr<DecodedProgram> program;
+	};
+
+	static constexpr usize maxDecodedPrograms = 8;
+	std::list<CachedProgram> decodedProgramList;
+	std::unordered_map<Hash, std::list<CachedProgram>::iterator> decodedPrograms;
+	const DecodedProgram* decodedProgram = nullptr;  // The program we ran last
+	Hash decodedProgramHash = 0;
+
+	const DecodedProgram& getDecodedProgram();
+
+	// Interpreter functions for flow control instructions. Everything else is handled by the ShaderDecoder
 	void call(u32 instruction);
 	void callc(u32 instruction);
 	void callu(u32 instruction);
-	void cmp(u32 instruction);
-	void dp3(u32 instruction);
-	void dp4(u32 instruction);
-	void dphi(u32 instruction);
-	void ex2(u32 instruction);
-	void flr(u32 instruction);
 	void ifc(u32 instruction);
 	void ifu(u32 instruction);
 	void jmpc(u32 instruction);
 	void jmpu(u32 instruction);
-	void lg2(u32 instruction);
 	void loop(u32 instruction);
-	void mad(u32 instruction);
-	void madi(u32 instruction);
-	void max(u32 instruction);
-	void min(u32 instruction);
-	void mov(u32 instruction);
-	void mova(u32 instruction);
-	void mul(u32 instruction);
-	void rcp(u32 instruction);
-	void rsq(u32 instruction);
-	void sge(u32 instruction);
-	void sgei(u32 instruction);
-	void slt(u32 instruction);
-	void slti(u32 instruction);
-
-	// src1, src2 and src3 have different negation & component swizzle bits in the operand descriptor
-	// https://problemkaputt.github.io/gbatek.htm#3dsgpushaderinstructionsetopcodesummary in the
-	// "Shader Operand Descriptors" section
-	template <int sourceIndex>
-	vec4f swizzle(vec4f& source, u32 opDescriptor) {
-		vec4f ret;
-		u32 compSwizzle;
-		bool negate;
 
-		using namespace Helpers;
-		if constexpr (sourceIndex == 1) {  // SRC1
-			negate = (getBit<4>(opDescriptor)) != 0;
-			compSwizzle = getBits<5, 8>(opDescriptor);
-		} else if constexpr (sourceIndex == 2) {  // SRC2
-			negate = (getBit<13>(opDescriptor)) != 0;
-			compSwizzle = getBits<14, 8>(opDescriptor);
-		} else if constexpr (sourceIndex == 3) {  // SRC3
-			negate = (getBit<22>(opDescriptor)) != 0;
-			compSwizzle = getBits<23, 8>(opDescriptor);
-		}
+	u8 getIndexedSource(u32 source, u32 index);
+	bool isCondTrue(u32 instruction);
 
-		// Iterate through every component of the swizzled vector in reverse order
-		// And get which source component's index to match it with
-		for (int comp = 0; comp < 4; comp++) {
-			int index = compSwizzle & 3;  // Get index for this component
-			compSwizzle >>= 2;            // Move to next component index
-			ret[3 - comp] = source[index];
+	// Converts one whole float uniform (4 words for f32 uniforms, 3 for f24 ones) into the current uniform and moves on to the next one
+	void writeFloatUniform(const u32* words) {
+		if (floatUniformIndex >= 96) {
+			Helpers::panic("[PICA] Tried to write float uniform %d", floatUniformIndex);
 		}
 
-		// Negate result if the negate bit is set
-		if (negate) {
-			ret[0] = -ret[0];
-			ret[1] = -ret[1];
-			ret[2] = -ret[2];
-			ret[3] = -ret[3];
+		floatUniformsDirty[floatUniformIndex / 64] |= 1ull << (floatUniformIndex % 64);
+		vec4f& uniform = floatUniforms[floatUniformIndex++];
+
+		if (f32UniformTransfer) {
+			uniform[0] = f24::fromFloat32(std::bit_cast<float>(words[3]));
+			uniform[1] = f24::fromFloat32(std::bit_cast<float>(words[2]));
+			uniform[2] = f24::fromFloat32(std::bit_cast<float>(words[1]));
+			uniform[3] = f24::fromFloat32(std::bit_cast<float>(words[0]));
+		} else {
+			uniform[0] = f24::fromRaw(words[2] & 0xffffff);
+			uniform[1] = f24::fromRaw(((words[1] & 0xffff) << 8) | (words[2] >> 24));
+			uniform[2] = f24::fromRaw(((words[0] & 0xff) << 16) | (words[1] >> 16));
+			uniform[3] = f24::fromRaw(words[0] >> 8);
 		}
-
-		return ret;
-	}
-
-	template <int sourceIndex>
-	vec4f getSourceSwizzled(u32 source, u32 opDescriptor) {
-		vec4f srcVector = getSource(source);
-		srcVector = swizzle<sourceIndex>(srcVector, opDescriptor);
-
-		return srcVector;
 	}
 
-	u8 getIndexedSource(u32 source, u32 index);
-	bool isCondTrue(u32 instruction);
-
   public:
 	static constexpr size_t maxInstructionCount = 4096;
 	std::array<u32, maxInstructionCount> loadedShader;    // Currently loaded & active shader
@@ -225,7 +206,10 @@ class PICAShader {
 	PICAShader(ShaderType type) : type(type) {}
 
 	// Theese functions are in the header to be inlined more easily, though with LTO I hope I'll be able to move them
-	void finalize() { std::memcpy(&loadedShader[0], &bufferedShader[0], 4096 * sizeof(u32)); }
+	void finalize() {
+		std::memcpy(&loadedShader[0], &bufferedShader[0], 4096 * sizeof(u32));
+		codeHashDirty = true;
+	}
 
 	void setBufferIndex(u32 index) { bufferIndex = index & 0xfff; }
 	void setOpDescriptorIndex(u32 index) { opDescriptorIndex = index & 0x7f; }
@@ -241,6 +225,20 @@ class PICAShader {
 		codeHashDirty = true;  // Signal the JIT if necessary that the program hash has potentially changed
 	}
 
+	// Same as calling uploadWord for each word, for long shader uploads from command lists
+	void uploadWords(std::span<const u32> words) {
+		if (bufferIndex + words.size() > 4095) [[unlikely]] {
+			for (u32 word : words) {
+				uploadWord(word);
+			}
+			return;
+		}
+
+		std::memcpy(&bufferedShader[bufferIndex], words.data(), words.size_bytes());
+		bufferIndex += int(words.size());
+		codeHashDirty = true;
+	}
+
 	void uploadDescriptor(u32 word) {
 		operandDescriptors[opDescriptorIndex++] = word;
 		opDescriptorIndex &= 0x7f;
@@ -248,6 +246,15 @@ class PICAShader {
 		opdescHashDirty = true;  // Signal the JIT if necessary that the program hash has potentially changed
 	}
 
+	void uploadDescriptors(std::span<const u32> words) {
+		for (u32 word : words) {
+			operandDescriptors[opDescriptorIndex] = word;
+			opDescriptorIndex = (opDescriptorIndex + 1) & 0x7f;
+		}
+
+		opdescHashDirty = true;
+	}
+
 	void setFloatUniformIndex(u32 word) {
 		floatUniformIndex = word & 0xff;
 		floatUniformWordCount = 0;
@@ -261,20 +268,29 @@ class PICAShader {
 		}
 
 		if ((f32UniformTransfer && floatUniformWordCount >= 4) || (!f32UniformTransfer && floatUniformWordCount >= 3)) {
-			vec4f& uniform = floatUniforms[floatUniformIndex++];
 			floatUniformWordCount = 0;
+			writeFloatUniform(floatUniformBuffer.data());
+		}
+	}
 
-			if (f32UniformTransfer) {
-				uniform[0] = f24::fromFloat32(*(float*)&floatUniformBuffer[3]);
-				uniform[1] = f24::fromFloat32(*(float*)&floatUniformBuffer[2]);
-				uniform[2] = f24::fromFloat32(*(float*)&floatUniformBuffer[1]);
-				uniform[3] = f24::fromFloat32(*(float*)&floatUniformBuffer[0]);
-			} else {
-				uniform[0] = f24::fromRaw(floatUniformBuffer[2] & 0xffffff);
-				uniform[1] = f24::fromRaw(((floatUniformBuffer[1] & 0xffff) << 8) | (floatUniformBuffer[2] >> 24));
-				uniform[2] = f24::fromRaw(((floatUniformBuffer[0] & 0xff) << 16) | (floatUniformBuffer[1] >> 16));
-				uniform[3] = f24::fromRaw(floatUniformBuffer[0] >> 8);
-			}
+	void uploadFloatUniforms(std::span<const u32> words) {
+		const usize wordsPerUniform = f32UniformTransfer ? 4 : 3;
+		usize i = 0;
+
+		// Finish the uniform that earlier writes started, if any
+		while (floatUniformWordCount != 0 && i < words.size()) {
+			uploadFloatUniform(words[i++]);
+		}
+
+		// Whole uniforms get converted straight from the command list, without going through the buffer
+		while (words.size() - i >= wordsPerUniform) {
+			writeFloatUniform(&words[i]);
+			i += wordsPerUniform;
+		}
+
+		// Buffer the start of the next uniform
+		while (i < words.size()) {
+			uploadFloatUniform(words[i++]);
 		}
 	}
 
@@ -291,6 +307,15 @@ class PICAShader {
 	void run();
 	void reset();
 
+	// Copy everything needed to execute the currently loaded shader from another shader unit
+	// Used for giving each vertex processing thread its own register file
+	void copyExecutionState(const PICAShader& other);
+
 	Hash getCodeHash();
 	Hash getOpdescHash();
+	// For when the code or operand descriptors get replaced without going through the upload functions
+	void invalidateHashes() {
+		codeHashDirty = true;
+		opdescHashDirty = true;
+	}
 };
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+#include <array>
+
+#include "PICA/float_types.hpp"
+#include "compiler_builtins.hpp"
+#include "helpers.hpp"
+
+class PICAShader;
+
+// The interpreter doesn't run the raw shader code. Instead, the program gets decoded once into an array of DecodedInstructions,
+// which have everything that the instruction handlers need already pulled out of the instruction and its operand descriptor
+struct DecodedInstruction {
+	using Handler = void (*)(PICAShader& shader, const DecodedInstruction& instruction);
+
+	Handler handler;  // Null for END
+	u32 instruction;  // The raw instruction, for flow control instructions, which decode it themselves
+
+	// Offsets of the source and destination registers from the start of the shader unit
+	std::array<u16, 3> sources;
+	u16 dest;
+
+	u8 writeMask;   // Bit i is set if component i of the destination (with 0 = x) gets written to
+	u8 negateMask;  // Bit i is set if source i gets negated
+	// Component of the source register that each component of each source reads, after swizzling
+	std::array<std::array<u8, 4>, 3> swizzles;
+
+	// The one source that can point to a float uniform can also use relative addressing, in which case we can't resolve it during decoding.
+	// This is its register number and address register index, and which source it is
+	u8 dynamicSource;
+	u8 dynamicRegister;
+	u8 index;
+};
+
+struct DecodedProgram {
+	std::array<DecodedInstruction, 4096> instructions;
+};
+
+class ShaderDecoder {
+	using f24 = Floats::f24;
+	using vec4f = std::array<f24, 4>;
+
+	// Handlers have a dynamic version, which resolves the dynamic source when the instruction runs, for when relative addressing is used
+	template <bool dynamic, u32 index>
+	ALWAYS_INLINE static inline vec4f getSource(PICAShader& shader, const DecodedInstruction& instruction);
+	ALWAYS_INLINE static inline void setDest(PICAShader& shader, const DecodedInstruction& instruction, const vec4f& value);
+
+	template <bool dynamic>
+	static void add(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void mul(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void flr(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void max(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void min(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void mov(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void mova(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void dp3(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void dp4(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void dph(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void rcp(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void rsq(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void ex2(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void lg2(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void mad(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void slt(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void sge(PICAShader& shader, const DecodedInstruction& instruction);
+	template <bool dynamic>
+	static void cmp(PICAShader& shader, const DecodedInstruction& instruction);
+
+	// Flow control goes through the interpreter's own functions, as it needs the raw instruction anyway
+	template <void (PICAShader::*function)(u32)>
+	static void flowControl(PICAShader& shader, const DecodedInstruction& instruction);
+	static void nop(PICAShader&, const DecodedInstruction&) {}
+	static void unimplemented(PICAShader& shader, const DecodedInstruction& instruction);
+	// MAX, MIN, RCP, RSQ and CMP with relative addressing
+	static void unimplementedIndexing(PICAShader& shader, const DecodedInstruction& instruction);
+
+	template <bool dynamic>
+	static DecodedInstruction::Handler getHandler(u32 opcode, u32 index);
+	static void decodeInstruction(const PICAShader& shader, u32 instruction, DecodedInstruction& decoded);
+
+  public:
+	// Only the code reachable from the entrypoint gets decoded. Everything else is decoded as END
+	static void decode(const PICAShader& shader, u32 entrypoint, DecodedProgram& program);
+};
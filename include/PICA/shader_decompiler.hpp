@@ -0,0 +1,47 @@
+#pragma once
+#include <array>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "PICA/shader.hpp"
+#include "helpers.hpp"
+
+// Translates the currently loaded PICA vertex shader into a GLSL vertex shader, so that vertex processing can be done on the host GPU
+// The emitted shader reads the PICA input registers from vertex attributes 0-15 and writes the mapped outputs to "o_vertex", an array
+// of 8 vec4s laid out exactly like PICA::Vertex, which the renderer captures with transform feedback
+// IFU/IFC/LOOP/CALL are turned into structured control flow. Shaders using anything we can't express (eg JMPC/JMPU) are rejected,
+// in which case the caller should keep running the shader on the CPU
+class ShaderDecompiler {
+	PICAShader& shader;
+	u32 outputCount;
+	const std::array<u32, 7>& outmaps;
+
+	std::string functions;  // Code for every subroutine called via CALL/CALLC/CALLU, emitted before main
+	std::set<std::pair<u32, u32>> compiledFunctions;
+	std::set<std::pair<u32, u32>> functionsInProgress;  // For detecting recursion, which GLSL doesn't allow
+	u32 loopDepth = 0;
+
+	bool compileRange(std::string& out, u32 begin, u32 end, u32 indent);
+	bool compileInstruction(std::string& out, u32 instruction, u32 indent);
+	bool compileFunction(u32 begin, u32 end);
+
+	std::string getSource(u32 source, u32 index, u32 operandDescriptor, int sourceIndex);
+	std::string getDest(u32 dest);
+	std::string getCondition(u32 instruction);
+	static std::string getBoolUniformCondition(u32 instruction);
+	static std::string getFunctionName(u32 begin, u32 end);
+
+	ShaderDecompiler(PICAShader& shader, u32 outputCount, const std::array<u32, 7>& outmaps)
+		: shader(shader), outputCount(outputCount), outmaps(outmaps) {}
+
+	std::optional<std::string> decompile();
+
+  public:
+	// outputCount and outmaps are the values of the ShaderOutputCount and ShaderOutmap0-6 registers
+	static std::optional<std::string> decompile(PICAShader& shader, u32 outputCount, const std::array<u32, 7>& outmaps) {
+		ShaderDecompiler decompiler(shader, outputCount, outmaps);
+		return decompiler.decompile();
+	}
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <array>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+#include "PICA/pica_hash.hpp"
+#include "PICA/regs.hpp"
+#include "helpers.hpp"
+
+namespace PICA {
+	// The parts of the fragment pipeline configuration that change the control flow of the fragment shader: The TEV stages, which texture
+	// units are on, the alpha test function and the lighting setup. Things that are just values (eg colours, light vectors, the alpha test
+	// reference) aren't part of it, generated shaders read those from the PICA registers like the ubershader does
+	// Fields that don't affect the shader (eg the lighting registers when lighting is off) are zeroed, so they don't cause extra shaders
+	struct FragmentConfig {
+		std::array<u32, 6> texEnvSource;
+		std::array<u32, 6> texEnvOperand;
+		std::array<u32, 6> texEnvCombiner;
+		std::array<u32, 6> texEnvScale;
+		u32 texEnvUpdateBuffer;  // Which TEV stages write to the combiner buffer
+		u32 texUnitConfig;       // Enabled texture units and which coordinates texture 2 uses
+
+		u32 alphaTestEnable;
+		u32 alphaTestFunction;
+
+		u32 lightingEnable;
+		u32 lightCount;
+		// For each enabled light in permutation order, the index of the light in bits 0-2 and the bits of GPUREG_LIGHTi_CONFIG we use above that
+		std::array<u32, 8> lights;
+		u32 lutDisable;      // Bit c is set if LUT c is disabled
+		u32 lutInputAbs;     // Only for enabled LUTs
+		u32 lutInputSelect;  // Only for enabled LUTs
+		u32 lutInputScale;   // Only for enabled LUTs
+		u32 fresnelOutput;   // Bit 0: Fresnel LUT replaces the primary colour alpha, bit 1: Same for the secondary colour
+
+		static FragmentConfig fromRegs(const std::array<u32, 0x300>& regs);
+		bool operator==(const FragmentConfig& other) const = default;
+	};
+
+	// The config gets hashed and compared as raw memory, so it must not have any padding
+	static_assert(std::has_unique_object_representations_v<FragmentConfig>, "FragmentConfig must not have padding");
+
+	// Generates a GLSL fragment shader that's specialised for a fragment configuration. It does exactly what the ubershader
+	// (opengl_fragment_shader.frag) does for that configuration, with every branch on the configuration resolved while generating the shader
+	// The shader has the same inputs, uniforms and PicaRegs uniform block as the ubershader, except for the TEV and depth uniforms
+	class FragmentShaderGenerator {
+		const FragmentConfig& config;
+		std::string out;
+
+		void emitLighting();
+		void emitTevStage(u32 stage);
+		void emitAlphaTest();
+		std::string generate();
+
+		explicit FragmentShaderGenerator(const FragmentConfig& config) : config(config) {}
+
+	  public:
+		static std::string generate(const FragmentConfig& config) {
+			FragmentShaderGenerator generator(config);
+			return generator.generate();
+		}
+	};
+}  // namespace PICA
+
+template <>
+struct std::hash<PICA::FragmentConfig> {
+	usize operator()(const PICA::FragmentConfig& config) const noexcept {
+		return usize(PICAHash::computeHash(reinterpret_cast<const char*>(&config), sizeof(config)));
+	}
+};
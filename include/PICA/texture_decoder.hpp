@@ -0,0 +1,53 @@
+#pragma once
+#include <span>
+#include <vector>
+
+#include "PICA/regs.hpp"
+#include "helpers.hpp"
+
+// Renderer-agnostic decoding of PICA textures into RGBA8
+// Decoded texels are returned as u32s with R in the low byte and A in the high byte, ie RGBA8 in memory order
+namespace PICA::TextureDecoder {
+	// Size of a width x height texture of the given format, in bytes
+	u64 sizeInBytes(TextureFmt format, u32 width, u32 height);
+
+	// Get the morton interleave offset of a texel based on its U and V values
+	u32 mortonInterleave(u32 u, u32 v);
+	// Get the byte offset of texel (u, v) in the texture
+	u32 getSwizzledOffset(u32 u, u32 v, u32 width, u32 bytesPerPixel);
+	u32 getSwizzledOffset_4bpp(u32 u, u32 v, u32 width);
+
+	// Get the texel at position (u, v) of a texture that's "width" texels wide
+	u32 decodeTexel(u32 u, u32 v, TextureFmt fmt, u32 width, std::span<const u8> data);
+
+	// Decode a whole texture into "output", which needs space for width * height texels. Texels are written line by line
+	// Textures are decoded one 8x8 tile at a time, using SIMD where the host supports it
+	void decodeTexture(TextureFmt fmt, u32 width, u32 height, std::span<const u8> data, u32* output);
+
+	// Memory for decoded textures that's reused between decodes, so that uploading a texture doesn't have to hit the allocator
+	class ScratchArena {
+		std::vector<u32> buffer;
+
+	  public:
+		// Returns space for at least texelCount texels. The pointer stays valid until the next call
+		u32* allocate(usize texelCount) {
+			if (buffer.size() < texelCount) {
+				buffer.resize(texelCount);
+			}
+
+			return buffer.data();
+		}
+
+		// Give the memory back, eg after decoding a huge texture
+		void release() {
+			buffer.clear();
+			buffer.shrink_to_fit();
+		}
+	};
+
+	// Returns the texel at coordinates (u, v) of an ETC1(A4) texture
+	u32 getTexelETC(bool hasAlpha, u32 u, u32 v, u32 width, std::span<const u8> data);
+	u32 decodeETC(u32 alpha, u32 u, u32 v, u64 colourData);
+	// Decodes a whole 4x4 ETC1 block into output, with "stride" texels between lines. For blocks without alpha, pass all ones as alphaData
+	void decodeETCBlock(u64 colourData, u64 alphaData, u32* output, u32 stride);
+}  // namespace PICA::TextureDecoder
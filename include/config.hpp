@@ -14,6 +14,20 @@ struct EmulatorConfig {
 #endif
 
 	bool shaderJitEnabled = shaderJitDefault;
+	int shaderJitCacheBudgetMB = 32;     // Executable memory the shader JIT can use for compiled shaders before evicting the least recently used
+	bool vertexLoaderJitEnabled = true;  // Only has an effect on platforms with a vertex loader JIT
+	bool accelerateShaders = false;      // Run vertex shaders on the host GPU when the renderer supports it
+	int vertexShaderThreadCount = 0;     // Extra threads to run the vertex shader on for big draws. 0 = shade vertices on the emulator thread
+	int softwareRendererThreadCount = 3;  // Extra threads the software renderer rasterizes tiles on. 0 = rasterize on the emulator thread
+	bool fragmentJitEnabled = true;       // Only has an effect with the software renderer on platforms with a fragment pipeline JIT
+	int textureCacheBudgetMB = 256;       // Host memory the OpenGL renderer's texture cache can take up before evicting textures
+	int textureDecodeThreadCount = 2;     // Threads the OpenGL renderer decodes textures on in the background. 0 = decode them when drawing
+	bool useUbershaders = false;          // Always draw with the OpenGL renderer's ubershader instead of generating specialised fragment shaders
+	bool shaderCacheEnabled = true;       // Save compiled host shaders to disk per title, so they don't need compiling again on the next run
+	bool threadedGPU = false;             // Run GSP commands on a GPU thread, in parallel with the emulated CPU
+	// Let the CPU JIT access guest memory directly through host page tables and a reserved host address space
+	// Disabling this routes every guest load/store through the Memory class' callbacks, which is slower but simpler to debug
+	bool fastmemEnabled = true;
 	bool discordRpcEnabled = false;
 	RendererType rendererType = RendererType::OpenGL;
 	Audio::DSPCore::Type dspType = Audio::DSPCore::Type::Null;
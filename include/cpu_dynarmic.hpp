@@ -182,4 +182,7 @@ class CPU {
 
     void clearCache() { jit->ClearCache(); }
     void runFrame();
+
+	// Makes the JIT return as soon as it can, so the CPU thread can do something other threads are waiting on. Can be called from any thread
+	void requestHalt() { jit->HaltExecution(Dynarmic::HaltReason::UserDefined1); }
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <span>
@@ -87,6 +88,8 @@ class Emulator {
 	bool frameDone = false;
 
 	Emulator();
+	// For running with settings other than the ones in the config file. Configs with an empty file path don't get saved
+	explicit Emulator(const EmulatorConfig& initialConfig);
 	~Emulator();
 
 	void step();
@@ -127,6 +130,13 @@ class Emulator {
 
 	RendererType getRendererType() const { return config.rendererType; }
 	Renderer* getRenderer() { return gpu.getRenderer(); }
+	GPU& getGPU() { return gpu; }
+	// Records the GPU commands of the next few frames into a trace in the app data folder, for replaying with pica_replay
+	void startGPUTrace(u32 frameCount);
+	// Lets the GPU thread take over the frontend's graphics context. Needed for the threaded GPU to work with OpenGL
+	void setGPUContextCallbacks(std::function<void()> makeCurrent, std::function<void()> doneCurrent) {
+		gpu.setContextCallbacks(std::move(makeCurrent), std::move(doneCurrent));
+	}
 	u64 getTicks() { return cpu.getTicks(); }
 
 	std::filesystem::path getConfigPath();
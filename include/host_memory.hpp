@@ -0,0 +1,61 @@
+#pragma once
+#include <map>
+
+#include "helpers.hpp"
+
+// Host-side backing for emulated physical memory, used for fastmem
+// The backing memory is a shared memory object that we can map into a reserved 4GB host region multiple times,
+// so that guest virtual address X lives at host address (arenaBase + X) and the CPU JIT can emit plain host loads/stores.
+// If the host does not support this (or fastmem is disabled) we fall back to a plain heap allocation and no arena.
+class HostMemory {
+	u8* backingBase = nullptr;  // Linear view of the whole backing memory
+	u8* arenaBase = nullptr;    // Base of the reserved 4GB guest address space, or nullptr if fastmem is unavailable
+	usize backingSize = 0;
+	bool sharedBacking = false;  // Whether backingBase comes from a shared memory object or from the heap
+
+#ifdef _WIN32
+	void* mappingHandle = nullptr;
+
+	// Windows can't map a view over part of a reservation, so the arena is made of placeholders (VirtualAlloc2/MapViewOfFile3)
+	// We split them and coalesce them as views come and go, so we need to know where every placeholder and every view is
+	struct View {
+		u64 end;
+		u64 offset;
+		bool writable;
+	};
+
+	std::map<u64, u64> placeholders;  // Start -> end of each placeholder, as offsets into the arena
+	std::map<u64, View> views;
+
+	void splitPlaceholder(u64 address);
+	void mapView(u64 start, u64 end, u64 offset, bool writable);
+	void unmapRange(u64 start, u64 end);
+#else
+	int fd = -1;
+#endif
+
+	bool createBacking();
+	bool reserveArena();
+	void freeArena();
+
+  public:
+	static constexpr u64 arenaSize = 1ull << 32;
+
+	HostMemory(usize backingSize, bool enableFastmem);
+	~HostMemory();
+
+	HostMemory(const HostMemory&) = delete;
+	HostMemory& operator=(const HostMemory&) = delete;
+
+	u8* backing() { return backingBase; }
+	u8* arena() { return arenaBase; }
+	bool fastmemAvailable() const { return arenaBase != nullptr; }
+
+	// Map "size" bytes of backing memory starting at "offset" to guest virtual address "vaddr" in the arena
+	// All parameters must be aligned to the host page size (which we assume is 4KB, like the guest's)
+	void map(u32 vaddr, usize offset, usize size, bool readable, bool writable);
+	// Remove the arena mapping for [vaddr, vaddr + size), making accesses to it fault and go through the slow path
+	void unmap(u32 vaddr, usize size);
+	// Unmap the whole arena
+	void unmapAll();
+};
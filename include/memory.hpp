@@ -1,15 +1,22 @@
 #pragma once
 #include <array>
+#include <atomic>
 #include <bitset>
+#include <condition_variable>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <mutex>
 #include <optional>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "config.hpp"
 #include "crypto/aes_engine.hpp"
 #include "handles.hpp"
 #include "helpers.hpp"
+#include "host_memory.hpp"
 #include "loader/ncsd.hpp"
 #include "loader/3dsx.hpp"
 #include "services/region_codes.hpp"
@@ -103,6 +110,9 @@ class Memory {
 	u8* dspRam;  // Provided to us by Audio
 	u8* vram;    // Provided to the memory class by the GPU class
 
+	// Backing for FCRAM. When fastmem is enabled, this also owns the host-reserved guest address space
+	HostMemory hostMemory;
+
 	u64& cpuTicks; // Reference to the CPU tick counter
 	using SharedMemoryBlock = KernelMemoryTypes::SharedMemoryBlock;
 
@@ -125,6 +135,7 @@ public:
 	static constexpr u32 pageSize = 1 << pageShift;
 	static constexpr u32 pageMask = pageSize - 1;
 	static constexpr u32 totalPageCount = 1 << (32 - pageShift);
+	using PageTable = std::array<u8*, totalPageCount>;
 	
 	static constexpr u32 FCRAM_SIZE = u32(128_MB);
 	static constexpr u32 FCRAM_APPLICATION_SIZE = u32(64_MB);
@@ -136,6 +147,68 @@ public:
 	static constexpr u32 DSP_DATA_MEMORY_OFFSET = u32(256_KB);
 
 private:
+	// Page table handed to the CPU JIT so it can access memory without going through our callbacks
+	// Only pages that are both readable and writable (and point to the same memory) are present here, everything else takes the slow path
+	std::unique_ptr<PageTable> cpuPageTable;
+	bool fastmemEnabled = false;
+
+	// Keep the CPU page table and the fastmem arena in sync with readTable/writeTable for "pageCount" pages starting at "page"
+	void updateCPUMappings(u32 page, u32 pageCount);
+	// Same for a list of pages in any order, which gets cleared afterwards
+	void updateCPUMappings(std::vector<u32>& pages);
+
+	// Page-granular write tracking for VRAM and FCRAM, so that the renderer can tell when guest data it cached (eg textures) got overwritten
+	// Tracked pages are indexed with all VRAM pages first, then all FCRAM pages
+	static constexpr u32 VRAM_PAGE_COUNT = VirtualAddrs::VramSize / pageSize;
+	static constexpr u32 TRACKED_PAGE_COUNT = VRAM_PAGE_COUNT + FCRAM_PAGE_COUNT;
+
+	u64 writeTimestamp = 1;
+	std::vector<u64> pageWriteTimestamps;  // For each tracked page, the value of writeTimestamp when a watched write last hit it
+	std::vector<bool> watchedPages;
+	// The virtual pages that map each FCRAM page, so that we can find the fast paths to disable when a page gets watched
+	std::vector<std::vector<u32>> fcramPageMappings;
+	// Watched FCRAM pages have their writeTable entries cleared so that writes to them hit the slow path. The original write pointers live here
+	std::unordered_map<u32, uintptr_t> suspendedWrites;
+	std::vector<u32> pagesToRemap;  // Virtual pages that watching or unwatching FCRAM pages changed the write pointers of
+	// With the threaded GPU, ranges get watched and invalidated from the GPU thread while the CPU thread writes to them
+	// Recursive as watching pages ends up remapping them
+	std::recursive_mutex trackingMutex;
+	std::atomic<usize> suspendedWriteCount = 0;  // Size of suspendedWrites, so writes can skip the lock when nothing's suspended
+
+	// The CPU JIT writes through the CPU page table without locking, so if another thread cleared a page's pointer to watch it, a store that
+	// already loaded the pointer would go unnoticed. So only the CPU thread watches FCRAM pages. Other threads queue their watches up and
+	// wait for the CPU thread to apply them while it isn't running guest code
+	struct WatchRequest {
+		u32 paddr;
+		u32 size;
+		u64 timestamp = 0;
+		bool done = false;
+	};
+
+	std::atomic<bool> concurrentTracking = false;  // Whether another thread watches ranges
+	std::thread::id cpuThread;
+	std::mutex watchRequestMutex;
+	std::condition_variable watchRequestApplied;
+	std::vector<WatchRequest*> watchRequests;
+	std::atomic<bool> hasWatchRequests = false;
+	std::function<void()> watchRequestCallback;
+
+	u64 watchPhysicalRangeNow(u32 paddr, u32 size);
+	bool hasUnwatchedFcramPages(u32 paddr, u32 size);
+
+	uintptr_t loadWritePointer(u32 page) { return std::atomic_ref(writeTable[page]).load(std::memory_order_acquire); }
+	void storeWritePointer(u32 page, uintptr_t pointer) { std::atomic_ref(writeTable[page]).store(pointer, std::memory_order_release); }
+	void updateSuspendedWriteCount() { suspendedWriteCount.store(suspendedWrites.size(), std::memory_order_release); }
+	// Get the pointer to write to a page through, resuming writes to it if they're suspended for write tracking
+	uintptr_t getPageWritePointer(u32 page);
+
+	std::optional<u32> getTrackedPage(u32 paddr);
+	void addFcramMapping(u32 fcramPage, u32 virtualPage);
+	void setFcramPageWatched(u32 fcramPage, bool watched);
+	void invalidateTrackedPage(u32 trackedPage);
+	// Called on slow path writes to a virtual page. If the page was suspended for write tracking, marks it as written and returns its write pointer
+	uintptr_t resumeWrites(u32 virtualPage);
+
 	std::bitset<FCRAM_PAGE_COUNT> usedFCRAMPages;
 	std::optional<u32> findPaddr(u32 size);
 	u64 timeSince3DSEpoch();
@@ -193,6 +266,23 @@ private:
 	u32 getLinearHeapVaddr();
 	u8* getFCRAM() { return fcram; }
 
+	// Write tracking for physical memory ranges in VRAM or FCRAM. Watching a range returns a timestamp, and the range is dirty as soon as
+	// something writes to one of its pages after that. Watched pages lose their CPU fast paths until the first write, so only watch ranges
+	// that are worth it. Writes that don't go through the CPU (DMA, renderer transfers) have to call invalidatePhysicalRange themselves
+	u64 watchPhysicalRange(u32 paddr, u32 size);
+	// Needs to be enabled while ranges get watched from a thread other than the one the CPU runs on. Call it from the CPU thread
+	void setConcurrentTracking(bool enabled);
+	// Called when another thread is waiting for the CPU thread to watch a range, so the CPU thread can get to it soon
+	void setWatchRequestCallback(std::function<void()> callback) { watchRequestCallback = std::move(callback); }
+	// Watches ranges other threads are waiting on. Only call this on the CPU thread, when it isn't running guest code
+	void applyWatchRequests();
+	bool isPhysicalRangeDirty(u32 paddr, u32 size, u64 timestamp);
+	void invalidatePhysicalRange(u32 paddr, u32 size);
+	// Appends the address of every page in the range that was written to after "timestamp" to "pages"
+	void getDirtyPages(u32 paddr, u32 size, u64 timestamp, std::vector<u32>& pages);
+	// The timestamp watching a range right now would return, without watching anything
+	u64 getWriteTimestamp();
+
 	// Total amount of OS-only FCRAM available (Can vary depending on how much FCRAM the app requests via the cart exheader)
 	u32 totalSysFCRAM() {
 		return FCRAM_SIZE - FCRAM_APPLICATION_SIZE;
@@ -277,6 +367,11 @@ private:
 
 	std::optional<u64> getProgramID();
 
+	// Returns the base of the host region mirroring the guest address space, or nullptr if fastmem is unavailable
+	u8* getFastmemArenaBase() { return fastmemEnabled ? hostMemory.arena() : nullptr; }
+	// Returns the page table for the CPU JIT, or nullptr if the JIT should go through the memory callbacks for everything
+	PageTable* getCPUPageTable() { return fastmemEnabled ? cpuPageTable.get() : nullptr; }
+
 	u8* getDSPMem() { return dspRam; }
 	u8* getDSPDataMem() { return &dspRam[DSP_DATA_MEMORY_OFFSET]; }
 	u8* getDSPCodeMem() { return &dspRam[DSP_CODE_MEMORY_OFFSET]; }
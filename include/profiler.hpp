@@ -0,0 +1,86 @@
+#pragma once
+#include <array>
+#include <chrono>
+
+#include "helpers.hpp"
+
+// Coarse per-subsystem profiler, for benchmarking tools. Time gets charged to whichever scope is innermost, so nested scopes (eg the
+// renderer drawing in the middle of a command list) take their time out of the scope around them
+// Scopes cost a branch when profiling is disabled. Only the thread running the emulator should profile, so profiling is meant to be
+// used with the threaded GPU disabled
+namespace Profiler {
+	enum class Category : u32 {
+		Other,          // Everything outside of a scope, eg frontend work
+		CPU,            // Running ARM11 code
+		SVC,            // Kernel SVCs, including IPC requests and the services handling them
+		PICA,           // GSP commands and PICA command list processing, not counting vertex shading or rendering
+		VertexShading,  // Fetching vertices and running the vertex shader for draws
+		Renderer,       // Everything the renderer does, including presenting
+		DSP,            // Running the DSP
+		Count,
+	};
+
+	static constexpr std::array<const char*, usize(Category::Count)> categoryNames = {
+		"other", "cpu", "svc", "pica", "vertex_shading", "renderer", "dsp",
+	};
+
+	struct State {
+		bool enabled = false;
+		Category current = Category::Other;
+		std::chrono::steady_clock::time_point lastTime;
+		std::array<u64, usize(Category::Count)> totals{};  // In nanoseconds
+	};
+
+	inline State state;
+
+	// Charges the time since the last switch to the current category, then switches to "category". Returns the category we switched from
+	inline Category switchTo(Category category) {
+		const auto now = std::chrono::steady_clock::now();
+		state.totals[usize(state.current)] += u64(std::chrono::duration_cast<std::chrono::nanoseconds>(now - state.lastTime).count());
+		state.lastTime = now;
+
+		const Category previous = state.current;
+		state.current = category;
+		return previous;
+	}
+
+	inline void enable() {
+		state.enabled = true;
+		state.current = Category::Other;
+		state.lastTime = std::chrono::steady_clock::now();
+		state.totals.fill(0);
+	}
+
+	inline void disable() {
+		switchTo(Category::Other);
+		state.enabled = false;
+	}
+
+	inline u64 getTotal(Category category) { return state.totals[usize(category)]; }
+
+	class Scope {
+		Category previous;
+		bool active;
+
+	  public:
+		Scope(Category category) : active(state.enabled) {
+			if (active) [[unlikely]] {
+				previous = switchTo(category);
+			}
+		}
+
+		~Scope() {
+			if (active) [[unlikely]] {
+				switchTo(previous);
+			}
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+}  // namespace Profiler
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+// Charges the rest of the enclosing block to the given Profiler::Category
+#define PROFILE_SCOPE(category) Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(Profiler::Category::category)
@@ -1,8 +1,10 @@
 #pragma once
 #include <array>
+#include <filesystem>
 #include <span>
 #include <optional>
 
+#include "PICA/draw_acceleration.hpp"
 #include "PICA/pica_vertex.hpp"
 #include "PICA/regs.hpp"
 #include "helpers.hpp"
@@ -60,6 +62,15 @@ class Renderer {
 	virtual void displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) = 0;  // Perform display transfer
 	virtual void textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32 inputSize, u32 outputSize, u32 flags) = 0;
 	virtual void drawVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices) = 0;  // Draw the given vertices
+	// Fetch and shade the vertices of a draw on the host GPU, then draw them. Returns false if the renderer can't do this for the current
+	// draw, in which case the vertices get shaded on the CPU and sent to drawVertices instead
+	virtual bool drawVerticesAccelerated(PICA::PrimType primType, const PICA::DrawAcceleration& accel) { return false; }
+	// Called once a texture unit has been configured, so renderers can start preparing the texture before it's used by a draw
+	virtual void prefetchTexture(u32 unit) {}
+	// Renderers that batch up draws have to submit them here. The GPU calls this before changing any state that affects how draws render
+	virtual void flushPendingDraws() {}
+	// Where the renderer can cache compiled host shaders for the current title. nullopt if they shouldn't be cached
+	virtual void setShaderCachePath(const std::optional<std::filesystem::path>& path) {}
 
 	virtual void screenshot(const std::string& name) = 0;
 	// Some frontends and platforms may require that we delete our GL or misc context and obtain a new one for things like exclusive fullscreen
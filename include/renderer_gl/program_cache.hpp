@@ -0,0 +1,75 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <thread>
+#include <unordered_map>
+
+#include "helpers.hpp"
+#include "memory_mapped_file.hpp"
+
+// On-disk cache of linked GL program binaries (from glGetProgramBinary), so programs we've compiled on a previous run don't need compiling again
+// Programs are keyed by a hash of their source code, which also takes care of invalidating them when the shader generators change. Binaries
+// are only valid for the driver that produced them, so every entry also has a hash of the driver's vendor/renderer/version strings
+// There's one cache file per title, which only ever gets appended to. When opened, it's memory mapped and indexed on a worker thread, which
+// also checks every entry's checksum. Corrupted or cut off entries (eg from a crash while writing) get truncated off the end of the file
+class ProgramCache {
+  public:
+	struct Binary {
+		u32 format;
+		std::span<const u8> data;
+	};
+
+  private:
+	struct FileHeader {
+		u32 magic;
+		u32 version;
+	};
+
+	struct EntryHeader {
+		u64 sourceHash;
+		u64 driverHash;
+		u64 checksum;  // Hash of the binary
+		u32 format;
+		u32 size;
+	};
+
+	static constexpr u32 magic = 0x48435350;  // "PSCH"
+	static constexpr u32 version = 1;
+
+	struct Entry {
+		u32 format;
+		usize offset;  // Offset of the binary in the file
+		u32 size;
+	};
+
+	std::filesystem::path path;
+	u64 driverHash = 0;
+	bool opened = false;
+
+	// Only touched by the loader thread until it's been joined
+	MemoryMappedFile file;
+	std::unordered_map<u64, Entry> entries;
+	std::thread loader;
+
+	std::ofstream writer;
+
+	void load();
+	bool createFile();
+	void waitForLoad();
+
+  public:
+	~ProgramCache() { close(); }
+
+	// Opens the cache file at "path", creating it if it doesn't exist, and starts indexing it in the background
+	void open(const std::filesystem::path& path, u64 driverHash);
+	void close();
+	bool isOpen() const { return opened; }
+
+	// Returns the binary for a program, if we have one for the current driver. The data stays valid until the cache is closed
+	std::optional<Binary> find(u64 sourceHash);
+	void store(u64 sourceHash, u32 format, std::span<const u8> binary);
+	// Stops handing out a binary that the driver refused to load
+	void discard(u64 sourceHash);
+};
@@ -1,16 +1,26 @@
 #pragma once
 
 #include <array>
+#include <filesystem>
+#include <optional>
 #include <span>
+#include <unordered_map>
+#include <vector>
 
 #include "PICA/float_types.hpp"
 #include "PICA/pica_vertex.hpp"
 #include "PICA/regs.hpp"
+#include "PICA/shader.hpp"
+#include "PICA/shader_gen.hpp"
+#include "PICA/texture_decoder.hpp"
 #include "gl_state.hpp"
 #include "helpers.hpp"
 #include "logger.hpp"
+#include "program_cache.hpp"
 #include "renderer.hpp"
+#include "stream_buffer.hpp"
 #include "surface_cache.hpp"
+#include "texture_decode_queue.hpp"
 #include "textures.hpp"
 
 // More circular dependencies!
@@ -19,21 +29,63 @@ class GPU;
 class RendererGL final : public Renderer {
 	GLStateManager gl = {};
 
-	OpenGL::Program triangleProgram;
+	OpenGL::Program triangleProgram;  // Ubershader that handles every fragment configuration
 	OpenGL::Program displayProgram;
-
+	OpenGL::Shader triangleVertexShader;  // Shared by the ubershader and the generated programs
+
+	// Fragment shaders specialised for one fragment configuration each, generated and compiled the first time we see the configuration
+	// We keep drawing with the ubershader until the program is linked. With (KHR|ARB)_parallel_shader_compile the driver compiles it on its
+	// own threads and we poll for completion, otherwise we give the driver a frame before using the program
+	struct GeneratedProgram {
+		enum class State { Compiling, Ready, Failed };
+
+		OpenGL::Program program;
+		GLuint fragmentShader = 0;  // Only kept around until the program is done linking
+		u64 sourceHash = 0;         // Key of the program in the program cache
+		u64 submitFrame = 0;
+		State state = State::Compiling;
+	};
+
+	static constexpr u32 maxProgramCompilesPerFrame = 8;
+	bool useUbershaders;
+	bool parallelShaderCompile = false;
+	u64 frameCount = 0;
+	u32 programCompilesThisFrame = 0;
+	std::unordered_map<PICA::FragmentConfig, GeneratedProgram> generatedPrograms;
+
+	// Linked generated programs and translated vertex shaders get saved to a per-title program cache on disk, so they don't need compiling
+	// again next time. Programs are keyed by a hash of their source code
+	ProgramCache programCache;
+	std::optional<std::filesystem::path> shaderCachePath;
+	u64 driverHash = 0;  // Binaries only work with the driver that made them
+	u64 triangleVertexShaderHash = 0;
+	bool programBinariesSupported = false;
+
+	// Vertices get streamed through a ring buffer, with every draw using its own part of it
+	// It's big enough for a couple of maximum size draws, so the GPU has time to consume vertices before we wrap around
+	static constexpr u32 vertexStreamSize = u32(sizeof(PICA::Vertex)) * vertexBufferSize * 2;
 	OpenGL::VertexArray vao;
-	OpenGL::VertexBuffer vbo;
+	StreamBuffer vertexStream;
+
+	// Consecutive draws with the same state get merged into one triangle list, which is drawn once the state changes
+	static constexpr usize maxBatchVertices = vertexBufferSize;
+	std::vector<PICA::Vertex> batchVertices;
 
 	// TEV configuration uniform locations
 	GLint textureEnvSourceLoc = -1;
 	GLint textureEnvOperandLoc = -1;
 	GLint textureEnvCombinerLoc = -1;
-	GLint textureEnvColorLoc = -1;
 	GLint textureEnvScaleLoc = -1;
 
-	// Uniform of PICA registers
-	GLint picaRegLoc = -1;
+	// The PICA registers shaders read (0x48 to 0x1FF) live in a uniform buffer, which only gets the registers that changed uploaded to it
+	// We alternate between 2 copies of the buffer so we don't update the one the previous draw uses. Each copy has its own dirty bits,
+	// as it only gets updated every other time
+	static constexpr u32 picaRegsBinding = 0;
+	static constexpr u32 picaRegsStart = 0x48;
+	static constexpr u32 picaRegsEnd = PICA::InternalRegs::RenderStateEnd;
+	std::array<GLuint, 2> picaRegsBuffers = {};
+	std::array<std::array<u64, regNum / 64>, 2> picaRegsDirty = {};
+	u32 currentPicaRegsBuffer = 0;
 
 	// Depth configuration uniform locations
 	GLint depthOffsetLoc = -1;
@@ -44,9 +96,28 @@ class RendererGL final : public Renderer {
 	float oldDepthOffset = 0.0;
 	bool oldDepthmapEnable = false;
 
-	SurfaceCache<DepthBuffer, 16, true> depthBufferCache;
-	SurfaceCache<ColourBuffer, 16, true> colourBufferCache;
-	SurfaceCache<Texture, 256, true> textureCache;
+	// Colour and depth buffers are few but big, and evicting one that's still in use loses its contents, so they get generous fixed budgets
+	static constexpr usize colourBufferBudget = 128_MB;
+	static constexpr usize depthBufferBudget = 64_MB;
+
+	SurfaceCache<DepthBuffer> depthBufferCache;
+	SurfaceCache<ColourBuffer> colourBufferCache;
+	SurfaceCache<Texture> textureCache;
+	// Decoded texels go here before getting uploaded, so texture uploads don't allocate
+	PICA::TextureDecoder::ScratchArena textureScratch;
+
+	// Textures start getting decoded in the background once a texture unit is configured, so draws only wait if decoding isn't done yet
+	// Decodes in flight are keyed by the address, format and size of the texture
+	static constexpr usize maxPendingTextureDecodes = 64;
+	// Prefetches watch the texture's pages before hashing it, so draws can use the prefetch's hash until something writes to those pages
+	struct PendingTextureDecode {
+		TextureDecodeQueue::JobPtr job;
+		u64 writeTimestamp;
+	};
+
+	TextureDecodeQueue textureDecodeQueue;
+	std::unordered_map<u64, PendingTextureDecode> pendingTextureDecodes;
+	GLuint textureUploadBuffer = 0;  // Pixel unpack buffer texture uploads go through
 
 	// Dummy VAO/VBO for blitting the final output
 	OpenGL::VertexArray dummyVAO;
@@ -57,8 +128,41 @@ class RendererGL final : public Renderer {
 	OpenGL::Framebuffer screenFramebuffer;
 	OpenGL::Texture blankTexture;
 
+	// For running vertex shaders on the GPU, we translate them to GLSL and run them with transform feedback, which writes the shaded
+	// vertices to our vertex buffer in the same layout as PICA::Vertex. Then they get drawn with the triangle program like CPU-shaded ones
+	// Float uniforms are shared by every translated shader through a uniform buffer, which is double buffered and only gets the uniforms
+	// that changed uploaded to it, like the PICA register buffer. Int and bool uniforms are tiny, so each program just remembers what it has
+	struct HardwareShader {
+		OpenGL::Program program;
+		GLint intUniformsLoc = -1;
+		GLint boolUniformLoc = -1;
+
+		std::array<GLuint, 16> intUniforms = {};
+		u32 boolUniform = 0;
+		bool uniformsValid = false;  // Whether the int and bool uniforms above have been uploaded at all
+	};
+
+	static constexpr u32 floatUniformsBinding = 1;
+	std::array<GLuint, 2> floatUniformsBuffers = {};
+	std::array<std::array<u64, 2>, 2> floatUniformsDirty = {};
+	u32 currentFloatUniformsBuffer = 0;
+
+	// Translated shaders, indexed by a hash of the shader code, operand descriptors, entrypoint and output mapping
+	// Shaders that couldn't be translated are stored as nullopt so we don't try again on every draw
+	std::unordered_map<u64, std::optional<HardwareShader>> hardwareShaderCache;
+	OpenGL::VertexArray hwVertexVao;
+	OpenGL::VertexBuffer hwVertexBuffer;  // Raw, unshaded vertex data
+	OpenGL::VertexBuffer hwIndexBuffer;
+	u32 hwEnabledAttributes = 0;  // Which attribute arrays are enabled in hwVertexVao
+
+	HardwareShader* getHardwareShader(PICAShader& shader);
+	std::optional<HardwareShader> compileHardwareShader(PICAShader& shader, u32 outputCount, const std::array<u32, 7>& outmaps);
+
 	OpenGL::Framebuffer getColourFBO();
 	OpenGL::Texture getTexture(Texture& tex);
+	Texture getUnitTexture(u32 unit);
+	void uploadTexture(Texture& tex, std::span<const u8> data);
+	u64 hashTexture(const Texture& tex, std::span<const u8> data);
 
 	MAKE_LOG_FUNCTION(log, rendererLogger)
 	void setupBlending();
@@ -68,10 +172,31 @@ class RendererGL final : public Renderer {
 	void bindTexturesToSlots();
 	void updateLightingLUT();
 	void initGraphicsContextInternal();
+	void prepareForDraw();
+	void uploadPicaRegs();
+	void uploadFloatUniforms(PICAShader& shader);
+	const OpenGL::Program& getTriangleProgram();
+	void compileGeneratedProgram(GeneratedProgram& generated, const PICA::FragmentConfig& config);
+	void pollGeneratedProgram(GeneratedProgram& generated);
+	void setupGeneratedProgram(OpenGL::Program& program);
+	void openProgramCache();
+	std::optional<GLuint> loadCachedProgram(u64 sourceHash);
+	void storeCachedProgram(GLuint program, u64 sourceHash);
+	void drawFromStream(OpenGL::Primitives primitive, std::span<const PICA::Vertex> vertices);
+
+	// Render targets only live on the host GPU, so before one gets evicted from its cache, its contents are written back to emulated memory
+	void writebackColourBuffer(ColourBuffer& buffer);
+	void writebackDepthBuffer(DepthBuffer& buffer);
+	void markColourBufferDirty(u32 address);
 
   public:
-	RendererGL(GPU& gpu, const std::array<u32, regNum>& internalRegs, const std::array<u32, extRegNum>& externalRegs)
-		: Renderer(gpu, internalRegs, externalRegs) {}
+	RendererGL(GPU& gpu, const std::array<u32, regNum>& internalRegs, const std::array<u32, extRegNum>& externalRegs, usize textureCacheBudget,
+		u32 textureDecodeThreads, bool useUbershaders)
+		: Renderer(gpu, internalRegs, externalRegs), useUbershaders(useUbershaders), depthBufferCache(depthBufferBudget),
+		  colourBufferCache(colourBufferBudget), textureCache(textureCacheBudget), textureDecodeQueue(textureDecodeThreads) {
+		colourBufferCache.setEvictionCallback([this](ColourBuffer& buffer) { writebackColourBuffer(buffer); });
+		depthBufferCache.setEvictionCallback([this](DepthBuffer& buffer) { writebackDepthBuffer(buffer); });
+	}
 	~RendererGL() override;
 
 	void reset() override;
@@ -81,6 +206,10 @@ class RendererGL final : public Renderer {
 	void displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) override;  // Perform display transfer
 	void textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32 inputSize, u32 outputSize, u32 flags) override;
 	void drawVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices) override;             // Draw the given vertices
+	bool drawVerticesAccelerated(PICA::PrimType primType, const PICA::DrawAcceleration& accel) override;
+	void prefetchTexture(u32 unit) override;
+	void flushPendingDraws() override;
+	void setShaderCachePath(const std::optional<std::filesystem::path>& path) override;
 	void deinitGraphicsContext() override;
 	
 	std::optional<ColourBuffer> getColourBuffer(u32 addr, PICA::ColorFmt format, u32 width, u32 height, bool createIfnotFound = true);
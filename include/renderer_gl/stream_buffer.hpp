@@ -0,0 +1,42 @@
+#pragma once
+#include <array>
+
+#include "helpers.hpp"
+#include "opengl.hpp"
+
+// Ring buffer for streaming data that changes every draw (eg vertices) to the GPU. Every allocation gets a fresh part of the buffer, so
+// we never write to memory the GPU might still be reading from and the driver never has to synchronize with previous draws
+// With buffer storage (GL 4.4 or ARB_buffer_storage), the buffer is mapped once for its whole lifetime and fences make sure we don't wrap
+// around onto data the GPU hasn't consumed yet. Otherwise (eg on GLES), the buffer storage gets orphaned every time we wrap around
+class StreamBuffer {
+	// The buffer is split into this many regions, each of which gets a fence once we're done writing to it
+	static constexpr u32 regionCount = 16;
+
+	GLuint handle = 0;
+	GLenum target = GL_ARRAY_BUFFER;
+	u32 size = 0;
+	u32 regionSize = 0;
+
+	u32 cursor = 0;       // Offset the next allocation starts from
+	u32 fenceStart = 0;   // First region that's been written since we last placed fences
+	u8* mapped = nullptr;  // Pointer to the buffer if it's persistently mapped
+	std::array<GLsync, regionCount> fences{};
+
+	u32 regionOf(u32 offset) const { return offset / regionSize; }
+	void fenceRegions(u32 start, u32 end);
+	void waitRegions(u32 start, u32 end);
+
+  public:
+	// Creates the buffer and binds it to "target"
+	void create(GLenum target, u32 size);
+	void free();
+
+	GLuint getHandle() const { return handle; }
+	bool isPersistent() const { return mapped != nullptr; }
+
+	// Reserves "bytes" bytes of the buffer and returns their offset, which is a multiple of "alignment"
+	// The space can be filled in with write, or by the GPU itself (eg via transform feedback). The buffer needs to be bound to its target
+	u32 allocate(u32 bytes, u32 alignment);
+	// Copies data to space returned by allocate
+	void write(u32 offset, const void* data, u32 bytes);
+};
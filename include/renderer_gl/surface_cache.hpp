@@ -1,109 +1,251 @@
 #pragma once
+#include <algorithm>
 #include <functional>
+#include <list>
 #include <optional>
+#include <set>
+#include <vector>
+
+#include "boost/icl/interval_map.hpp"
 #include "surfaces.hpp"
 #include "textures.hpp"
 
-// Surface cache class that can fit "capacity" instances of the "SurfaceType" class of surfaces
+// Counters for looking into how well a surface cache is doing
+struct SurfaceCacheStats {
+	u64 hits = 0;
+	u64 misses = 0;
+	u64 evictions = 0;
+	usize surfaceCount = 0;
+	usize hostBytes = 0;  // Estimated host GPU memory taken up by the cached surfaces
+};
+
+// Surface cache class for the "SurfaceType" class of surfaces. It's shared by colour buffers, depth buffers and textures
 // SurfaceType *must* have all of the following.
-// - An "allocate" function that allocates GL resources for the surfaces. On overflow it will panic
-//   if evictOnOverflow is false, or kick out the oldest item if it is true (like a ring buffer)
+// - An "allocate" function that allocates GL resources for the surfaces.
 // - A "free" function that frees up all resources the surface is taking up
 // - A "matches" function that, when provided with a SurfaceType object reference
 // Will tell us if the 2 surfaces match (Only as far as location in VRAM, format, dimensions, etc)
 // Are concerned. We could overload the == operator, but that implies full equality
 // Including equality of the allocated OpenGL resources, which we don't want
 // - A "valid" member that tells us whether the function is still valid or not
-// - A "location" member which tells us which location in 3DS memory this surface occupies
-template <typename SurfaceType, size_t capacity, bool evictOnOverflow = false>
+// - A "location" member which tells us which location in 3DS memory this surface occupies, and a "range" member with the whole range
+// - A "size" member with the dimensions of the surface
+//
+// Surfaces are indexed by the address range they cover, so lookups don't have to go through every surface. Once the surfaces take up more
+// host memory than the budget, the least recently used ones are evicted
+template <typename SurfaceType>
 class SurfaceCache {
-    // Vanilla std::optional can't hold actual references
-    using OptionalRef = std::optional<std::reference_wrapper<SurfaceType>>;
-    static_assert(std::is_same<SurfaceType, ColourBuffer>() || std::is_same<SurfaceType, DepthBuffer>()  ||
-        std::is_same<SurfaceType, Texture>(), "Invalid surface type");
-
-    size_t size;
-    size_t evictionIndex;
-    std::array<SurfaceType, capacity> buffer;
-
-public:
-    void reset() {
-        size = 0;
-        evictionIndex = 0;
-        for (auto& e : buffer) { // Free the VRAM of all surfaces
-            e.free();
-        }
-    }
-
-    OptionalRef find(SurfaceType& other) {
-        for (auto& e : buffer) {
-            if (e.matches(other) && e.valid)
-                return e;
-        }
-
-        return std::nullopt;
-    }
-
-    OptionalRef findFromAddress(u32 address) {
-        for (auto& e : buffer) {
-            if (e.location <= address && e.location + e.sizeInBytes() > address && e.valid)
-                return e;
-        }
-
-        return std::nullopt;
-    }
-
-    // Adds a surface object to the cache and returns it
-	SurfaceType& add(const SurfaceType& surface) {
-		if (size >= capacity) {
-			if constexpr (evictOnOverflow) {  // Do a ring buffer if evictOnOverflow is true
-				if constexpr (std::is_same<SurfaceType, ColourBuffer>() || std::is_same<SurfaceType, DepthBuffer>()) {
-					Helpers::panicDev("Colour/Depth buffer cache overflowed, currently stubbed to do a ring-buffer. This might snap in half");
-				}
+	// Vanilla std::optional can't hold actual references
+	using OptionalRef = std::optional<std::reference_wrapper<SurfaceType>>;
+	static_assert(
+		std::is_same<SurfaceType, ColourBuffer>() || std::is_same<SurfaceType, DepthBuffer>() || std::is_same<SurfaceType, Texture>(),
+		"Invalid surface type"
+	);
+
+	struct Entry {
+		SurfaceType surface;
+		usize hostBytes;
+		typename std::list<Entry>::iterator self;  // Position of the entry in the LRU list
+	};
+
+	// Entries in least to most recently used order. Entries in a list don't move in memory, so we can hand out references to surfaces
+	// and keep pointers to the entries in the index
+	using EntryList = std::list<Entry>;
+	EntryList entries;
+
+	// Maps every address covered by a surface to the entries covering it
+	using EntrySet = std::set<Entry*>;
+	using Index = boost::icl::interval_map<
+		u32, EntrySet, boost::icl::partial_absorber, std::less, boost::icl::inplace_plus, boost::icl::inter_section, Interval<u32>>;
+	Index index;
+
+	usize budget;
+	SurfaceCacheStats stats;
+	// Called on surfaces right before they get evicted to make room or replaced by a surface covering them, so render targets can write their
+	// contents back to emulated memory
+	std::function<void(SurfaceType&)> evictionCallback;
+
+	// All of our surfaces are backed by a 32-bit per pixel host texture
+	static usize getHostBytes(const SurfaceType& surface) {
+		auto size = surface.size;  // The vector accessors aren't const
+		return usize(size.x()) * usize(size.y()) * 4;
+	}
+
+	void touch(Entry* entry) { entries.splice(entries.end(), entries, entry->self); }
+
+	void remove(typename EntryList::iterator it) {
+		Entry* entry = &*it;
+		index -= std::make_pair(entry->surface.range, EntrySet{entry});
 
-				auto& e = buffer[evictionIndex];
-				evictionIndex = (evictionIndex + 1) % capacity;
+		stats.hostBytes -= entry->hostBytes;
+		stats.surfaceCount--;
 
-				e.valid = false;
-				e.free();
-				e = surface;
-				e.allocate();
-				return e;
-			} else {
-				Helpers::panic("Surface cache full! Add emptying!");
+		entry->surface.free();
+		entries.erase(it);
+	}
+
+	// Visits the entries overlapping [start, end) until the callback returns true
+	template <typename Func>
+	void forEachOverlapping(u32 start, u32 end, Func&& func) {
+		if (start >= end) {
+			return;
+		}
+
+		auto [first, last] = index.equal_range(Interval<u32>(start, end));
+		for (auto it = first; it != last; it++) {
+			for (Entry* entry : it->second) {
+				if (func(entry)) {
+					return;
+				}
 			}
 		}
+	}
 
-		size++;
+	Entry* lookup(SurfaceType& other) {
+		Entry* found = nullptr;
 
-		// Find an existing surface we completely invalidate and overwrite it with the new surface
-		for (auto& e : buffer) {
-			if (e.valid && e.range.lower() >= surface.range.lower() && e.range.upper() <= surface.range.upper()) {
-				e.free();
-				e = surface;
-				e.allocate();
-				return e;
+		forEachOverlapping(other.location, other.location + 1, [&](Entry* entry) {
+			if (entry->surface.valid && entry->surface.matches(other)) {
+				found = entry;
+				return true;
 			}
-		}
 
-		// Find an invalid entry in the cache and overwrite it with the new surface
-		for (auto& e : buffer) {
-			if (!e.valid) {
-				e = surface;
-				e.allocate();
-				return e;
+			return false;
+		});
+
+		return found;
+	}
+
+	Entry* lookupAddress(u32 address) {
+		Entry* found = nullptr;
+
+		forEachOverlapping(address, address + 1, [&](Entry* entry) {
+			if (entry->surface.valid) {
+				found = entry;
+				return true;
 			}
+
+			return false;
+		});
+
+		return found;
+	}
+
+  public:
+	SurfaceCache(usize budget) : budget(budget) {}
+
+	void reset() {
+		// Free the GPU memory of all surfaces
+		for (auto& entry : entries) {
+			entry.surface.free();
+		}
+
+		entries.clear();
+		index.clear();
+		stats = SurfaceCacheStats();
+	}
+
+	void setBudget(usize newBudget) { budget = newBudget; }
+	void setEvictionCallback(std::function<void(SurfaceType&)> callback) { evictionCallback = std::move(callback); }
+	const SurfaceCacheStats& getStats() const { return stats; }
+
+	OptionalRef find(SurfaceType& other) {
+		Entry* found = lookup(other);
+
+		if (found == nullptr) {
+			stats.misses++;
+			return std::nullopt;
 		}
 
-		// This should be unreachable but helps to panic anyways
-		Helpers::panic("Couldn't add surface to cache\n");
+		stats.hits++;
+		touch(found);
+		return found->surface;
 	}
 
-    SurfaceType& operator[](size_t i) {
-        return buffer[i];
-    }
+	// Same as find, except it doesn't count as a use of the surface, for looking at the cache without affecting what gets evicted
+	OptionalRef peek(SurfaceType& other) {
+		Entry* found = lookup(other);
+		if (found == nullptr) {
+			return std::nullopt;
+		}
+
+		return found->surface;
+	}
+
+	OptionalRef findFromAddress(u32 address) {
+		Entry* found = lookupAddress(address);
+
+		if (found == nullptr) {
+			stats.misses++;
+			return std::nullopt;
+		}
+
+		stats.hits++;
+		touch(found);
+		return found->surface;
+	}
+
+	// Same as findFromAddress, without counting as a use of the surface
+	OptionalRef peekFromAddress(u32 address) {
+		Entry* found = lookupAddress(address);
+		if (found == nullptr) {
+			return std::nullopt;
+		}
+
+		return found->surface;
+	}
+
+	// Adds a surface object to the cache and returns it
+	SurfaceType& add(const SurfaceType& surface) {
+		// Surfaces that lie completely inside the new one are stale now, so kick them out
+		std::vector<Entry*> covered;
+		forEachOverlapping(surface.range.lower(), surface.range.upper(), [&](Entry* entry) {
+			const auto& range = entry->surface.range;
+			if (range.lower() >= surface.range.lower() && range.upper() <= surface.range.upper()) {
+				covered.push_back(entry);
+			}
 
-    const SurfaceType& operator[](size_t i) const {
-        return buffer[i];
-    }
+			return false;
+		});
+
+		// An entry covering multiple intervals of the index shows up once per interval
+		std::sort(covered.begin(), covered.end());
+		covered.erase(std::unique(covered.begin(), covered.end()), covered.end());
+
+		// They might be render targets with contents that only exist on the host GPU, so they get written back first like evicted ones.
+		// Go from least to most recently used, so the newest contents win where covered surfaces overlap
+		if (evictionCallback && !covered.empty()) {
+			for (Entry& entry : entries) {
+				if (std::binary_search(covered.begin(), covered.end(), &entry)) {
+					evictionCallback(entry.surface);
+				}
+			}
+		}
+
+		for (Entry* entry : covered) {
+			remove(entry->self);
+		}
+
+		// Make room for the new surface. We never evict the surface we're adding, even if it's bigger than the whole budget on its own
+		const usize hostBytes = getHostBytes(surface);
+		while (!entries.empty() && stats.hostBytes + hostBytes > budget) {
+			if (evictionCallback) {
+				evictionCallback(entries.begin()->surface);
+			}
+
+			remove(entries.begin());
+			stats.evictions++;
+		}
+
+		Entry& entry = entries.emplace_back(Entry{surface, hostBytes, {}});
+		entry.self = std::prev(entries.end());
+		entry.surface.allocate();
+		if (surface.range.lower() < surface.range.upper()) {
+			index += std::make_pair(entry.surface.range, EntrySet{&entry});
+		}
+
+		stats.hostBytes += hostBytes;
+		stats.surfaceCount++;
+		return entry.surface;
+	}
 };
@@ -19,6 +19,8 @@ struct ColourBuffer {
 	// OpenGL resources allocated to buffer
 	OpenGL::Texture texture;
 	OpenGL::Framebuffer fbo;
+	// Set once the host GPU writes to the buffer, as its contents then only exist in the texture and not in emulated memory
+	bool dirty = false;
 
 	ColourBuffer() : valid(false) {}
 
@@ -103,6 +105,7 @@ struct DepthBuffer {
 	// OpenGL texture used for storing depth/stencil
 	OpenGL::Texture texture;
 	OpenGL::Framebuffer fbo;
+	bool dirty = false;  // Same as for colour buffers
 
 	DepthBuffer() : valid(false) {}
 
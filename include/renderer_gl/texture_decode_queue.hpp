@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "PICA/regs.hpp"
+#include "helpers.hpp"
+
+// Decodes textures on background threads, so that big textures (eg multi-megabyte ETC1 atlases) can be decoded while the emulator keeps going
+// Jobs decode their own copy of the texture data, so the guest is free to overwrite it in the meantime. It's up to the user to check that the
+// hash of the copy still matches guest memory before using the decoded texels
+class TextureDecodeQueue {
+  public:
+	struct Job {
+		enum class State : u32 { Queued, Decoding, Done };
+
+		PICA::TextureFmt format;
+		u32 width;
+		u32 height;
+		u64 hash;  // Hash of the source data
+
+		std::vector<u8> source;
+		std::vector<u32> decoded;
+		// Whoever moves the job out of the Queued state gets to decode it. Once it's Done, the decoded texels can be read without locking
+		std::atomic<State> state = State::Queued;
+	};
+
+	using JobPtr = std::shared_ptr<Job>;
+
+  private:
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable jobDone;
+	std::deque<JobPtr> queue;
+	bool stopping = false;
+
+	void workerLoop();
+	static bool claim(Job& job);
+	void finish(Job& job);
+
+  public:
+	// Create a queue with "threadCount" worker threads. With 0 threads, jobs get decoded when someone waits on them
+	explicit TextureDecodeQueue(u32 threadCount);
+	~TextureDecodeQueue();
+
+	TextureDecodeQueue(const TextureDecodeQueue&) = delete;
+	TextureDecodeQueue& operator=(const TextureDecodeQueue&) = delete;
+
+	bool isEnabled() const { return !workers.empty(); }
+
+	// Copies the texture data and queues it up for decoding
+	JobPtr submit(PICA::TextureFmt format, u32 width, u32 height, u64 hash, std::span<const u8> data);
+	// Returns the decoded texels of a job. If no worker has picked the job up yet, the calling thread decodes it instead of waiting around
+	const std::vector<u32>& wait(Job& job);
+	// Makes sure a job we don't need anymore doesn't get decoded, if it hasn't been already
+	void cancel(Job& job);
+	// Drops every job that hasn't started decoding yet
+	void clear();
+};
@@ -17,6 +17,10 @@ struct Texture {
     OpenGL::uvec2 size;
     bool valid;
 
+    // Write tracking timestamp from when we last checked the texture data against guest memory, and the hash of the data at that point
+    u64 writeTimestamp = 0;
+    u64 hash = 0;
+
     // Range of VRAM taken up by buffer
     Interval<u32> range;
     // OpenGL resources allocated to buffer
@@ -41,25 +45,13 @@ struct Texture {
 
     void allocate();
     void setNewConfig(u32 newConfig);
-    void decodeTexture(std::span<const u8> data);
+    // Uploads decoded RGBA8 texels to the texture through the given pixel unpack buffer
+    void upload(const u32* texels, GLuint uploadBuffer);
     void free();
     u64 sizeInBytes();
 
-    u32 decodeTexel(u32 u, u32 v, PICA::TextureFmt fmt, std::span<const u8> data);
-
-    // Get the morton interleave offset of a texel based on its U and V values
-    static u32 mortonInterleave(u32 u, u32 v);
-    // Get the byte offset of texel (u, v) in the texture
-    static u32 getSwizzledOffset(u32 u, u32 v, u32 width, u32 bytesPerPixel);
-    static u32 getSwizzledOffset_4bpp(u32 u, u32 v, u32 width);
-
     // Returns the format of this texture as a string
     std::string_view formatToString() {
         return PICA::textureFormatToString(format);
     }
-
-    // Returns the texel at coordinates (u, v) of an ETC1(A4) texture
-    // TODO: Make hasAlpha a template parameter
-    u32 getTexelETC(bool hasAlpha, u32 u, u32 v, u32 width, std::span<const u8> data);
-    u32 decodeETC(u32 alpha, u32 u, u32 v, u64 colourData);
 };
@@ -0,0 +1,147 @@
+#pragma once
+#include <array>
+
+#include "PICA/regs.hpp"
+#include "helpers.hpp"
+
+namespace SwRenderer {
+	using RGBA = std::array<u8, 4>;
+
+	// Indices of the vertex attributes we interpolate across triangles
+	namespace Attributes {
+		enum : u32 {
+			Colour = 0,  // 4 components
+			TexCoord0 = 4,  // 2 components each
+			TexCoord1 = 6,
+			TexCoord2 = 8,
+			Normal = 10,  // 3 components each, only used for fragment lighting
+			View = 13,
+			Count = 16,
+		};
+	}
+
+	using AttributeArray = std::array<float, Attributes::Count>;
+
+	// TEV input colours that differ per fragment, indexed by TEV source ID: The primary colour, the primary & secondary fragment lighting
+	// colours and the 3 texture units. Sources 6 and 7 (procedural texture and an invalid source) always read as 0
+	using FragmentSources = std::array<RGBA, 8>;
+
+	struct FragmentState;
+
+	// A batch of fragments from the same row of a triangle, which go through the fragment pipeline together
+	struct FragmentBatch {
+		static constexpr u32 maxSize = 64;
+
+		std::array<FragmentSources, maxSize> sources;
+		std::array<RGBA, maxSize> colours;  // Output of the TEV, then replaced with the output of blending
+		std::array<RGBA, maxSize> dest;     // Colours currently in the framebuffer, for blending
+		std::array<u8, maxSize> alive;      // Set by the alpha test and cleared by the depth/stencil tests if a fragment is discarded
+		std::array<u32, maxSize> x;
+		std::array<float, maxSize> depth;
+	};
+
+	// Runs a stage of the fragment pipeline on the first "count" fragments of a batch. Either points to JIT-compiled code or to one of the
+	// interpreter functions below
+	using FragmentCallback = void (*)(const FragmentState* state, FragmentBatch* batch, u32 count);
+
+	struct TextureUnit {
+		const u32* texels = nullptr;  // Decoded RGBA8 texels, top row first. nullptr if the unit samples from address 0
+		u32 width = 0;
+		u32 height = 0;
+		u32 wrapS = 0;
+		u32 wrapT = 0;
+		bool linearFilter = false;
+		RGBA borderColour = {0, 0, 0, 0};
+
+		RGBA sample(float s, float t) const;
+
+	  private:
+		RGBA fetch(s32 x, s32 y) const;
+	};
+
+	// All the state that fragment processing depends on, captured from the PICA registers once per draw so we don't have to
+	// decode registers per pixel
+	struct FragmentState {
+		struct TevStage {
+			u32 source;
+			u32 operand;
+			u32 combiner;
+			u32 scale;
+			RGBA constColour;
+		};
+
+		std::array<TevStage, 6> tevStages;
+		RGBA tevBufferColour;
+		u32 tevUpdateBuffer;
+
+		u32 textureConfig;
+		std::array<TextureUnit, 3> textures;
+
+		// Fragment lighting reads its (many) registers straight from the register file
+		bool lightingEnable;
+		const u32* regs = nullptr;
+		const u32* lightingLUT = nullptr;
+
+		float depthScale;
+		float depthOffset;
+		bool depthmapEnable;  // If false, we use W-buffering instead of Z-buffering
+
+		bool alphaTestEnable;
+		u32 alphaTestFunc;
+		u8 alphaTestReference;
+
+		bool stencilEnable;
+		u32 stencilFunc;
+		u8 stencilReference;
+		u8 stencilInputMask;
+		u8 stencilWriteMask;
+		u32 stencilFailOp;
+		u32 depthFailOp;
+		u32 stencilPassOp;
+
+		bool depthTestEnable;
+		u32 depthFunc;
+		bool depthWriteEnable;
+
+		u32 colourWriteMask;  // Bit 0 = red, 1 = green, 2 = blue, 3 = alpha
+		bool blendEnable;     // If blending is disabled, the logic op is used instead
+		u32 rgbEquation;
+		u32 alphaEquation;
+		u32 rgbSourceFunc;
+		u32 rgbDestFunc;
+		u32 alphaSourceFunc;
+		u32 alphaDestFunc;
+		RGBA blendColour;
+		u32 logicOp;
+
+		// Colour and depth buffers in emulated memory. The depth buffer is optional
+		u8* colourBuffer = nullptr;
+		u8* depthBuffer = nullptr;
+		PICA::ColorFmt colourFormat;
+		PICA::DepthFmt depthFormat;
+		u32 width;
+		u32 height;
+
+		// The register-configured stages of the pipeline, which can be JIT compiled. loadRegisters points them to the interpreter
+		FragmentCallback runTev = nullptr;    // TEV and alpha test. Reads sources, writes colours & alive
+		FragmentCallback runBlend = nullptr;  // Blending or logic op and the colour write mask. Reads colours & dest, writes colours
+
+		// Load everything except for the textures & buffers, which the renderer has to look up
+		void loadRegisters(const u32* regs);
+	};
+
+	void interpretTev(const FragmentState* state, FragmentBatch* batch, u32 count);
+	void interpretBlend(const FragmentState* state, FragmentBatch* batch, u32 count);
+
+	// Computes the TEV inputs of a fragment from its interpolated attributes
+	void getFragmentSources(const FragmentState& state, const AttributeArray& attributes, FragmentSources& sources);
+	// Runs a batch of fragments with sources, x and depth filled in through the pipeline and writes them to the framebuffer
+	// y is in window coordinates, with y = 0 at the bottom of the framebuffer
+	void processFragments(const FragmentState& state, FragmentBatch& batch, u32 y, u32 count);
+
+	// Offset of pixel (x, y) from the start of a tiled buffer, in pixels. Unlike processFragment's coordinates, y = 0 is the first row in memory
+	u32 getTiledPixelOffset(u32 x, u32 y, u32 width);
+
+	RGBA decodeColour(PICA::ColorFmt format, const u8* pixel);
+	void encodeColour(PICA::ColorFmt format, u8* pixel, const RGBA& colour);
+}  // namespace SwRenderer
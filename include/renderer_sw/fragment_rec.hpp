@@ -0,0 +1,46 @@
+#pragma once
+#include "helpers.hpp"
+#include "renderer_sw/fragment_pipeline.hpp"
+
+// Recompiler for the register-configured parts of the software renderer's fragment pipeline: The 6 TEV stages, the alpha test, blending or
+// logic ops and the colour write mask. Instead of decoding the configuration for every fragment, we emit code specialized for it once and
+// cache it by the hash of the registers it depends on. Constant colours and test references are read from the FragmentState at runtime, so
+// games changing them between draws doesn't trigger recompiles
+
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && (defined(PANDA3DS_X64_HOST) || defined(PANDA3DS_ARM64_HOST))
+#define PANDA3DS_FRAGMENT_JIT_SUPPORTED
+#include <memory>
+#include <unordered_map>
+#endif
+
+class FragmentEmitter;
+
+class FragmentJIT {
+  public:
+	// Hash of everything in the state that affects the emitted code
+	static u64 getHash(const SwRenderer::FragmentState& state);
+
+#ifdef PANDA3DS_FRAGMENT_JIT_SUPPORTED
+	// Find or compile the pipeline for the given state and point the state's callbacks to it. Returns false if the host CPU can't run our
+	// JIT code, in which case the state keeps using the interpreter
+	bool prepare(SwRenderer::FragmentState& state);
+	void reset();
+	static constexpr bool isAvailable() { return true; }
+
+	FragmentJIT();
+	~FragmentJIT();
+
+  private:
+	// Games with lots of materials can have many different configurations. Once we have this many, we start over
+	static constexpr usize maxCacheSize = 1024;
+
+	using PipelineCache = std::unordered_map<u64, std::unique_ptr<FragmentEmitter>>;
+	PipelineCache cache;
+	FragmentEmitter* activePipeline = nullptr;
+	u64 activeHash = 0;
+#else
+	bool prepare(SwRenderer::FragmentState& state) { return false; }
+	void reset() {}
+	static constexpr bool isAvailable() { return false; }
+#endif
+};
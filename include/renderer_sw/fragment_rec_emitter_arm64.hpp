@@ -0,0 +1,52 @@
+#pragma once
+
+// Only do anything if we're on an arm64 target with JIT support enabled
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_ARM64_HOST)
+#include <oaknut/code_block.hpp>
+#include <oaknut/oaknut.hpp>
+
+#include "helpers.hpp"
+#include "renderer_sw/fragment_pipeline.hpp"
+
+class FragmentEmitter : private oaknut::CodeBlock, public oaknut::CodeGenerator {
+	// 6 fully-featured TEV stages plus blending stay way below this
+	static constexpr size_t allocSize = 0x4000;
+
+	using FragmentState = SwRenderer::FragmentState;
+	using TevStage = SwRenderer::FragmentState::TevStage;
+
+	// Vector constants with the same value in all 4 lanes, plus a mask for the RGB lanes
+	oaknut::Label constants;
+
+	SwRenderer::FragmentCallback tevCallback = nullptr;
+	SwRenderer::FragmentCallback blendCallback = nullptr;
+
+	void emitConstants();
+	void loadConstants();
+
+	void emitTev(const FragmentState& state);
+	void emitTevStage(const FragmentState& state, u32 index, bool usesBuffer);
+	void loadRGBA(oaknut::QReg dest, oaknut::XReg pointer);
+	void loadSource(oaknut::QReg dest, u32 source, u32 stageIndex);
+	void emitOperand(oaknut::QReg dest, const TevStage& stage, u32 stageIndex, u32 index);
+	void emitCombine(oaknut::QReg dest, u32 mode);
+	void emitDot3(oaknut::QReg dest);
+	void emitDivideBy255(oaknut::QReg value, oaknut::QReg temp);
+
+	void emitBlend(const FragmentState& state);
+	void emitBlendFactor(oaknut::QReg dest, u32 func);
+	void emitBlendEquation(oaknut::QReg dest, u32 equation);
+	void emitLogicOp(u32 op);
+
+  public:
+	// Everything we use is part of baseline ASIMD
+	static bool isSupported() { return true; }
+
+	FragmentEmitter() : oaknut::CodeBlock(allocSize), oaknut::CodeGenerator(oaknut::CodeBlock::ptr()) {}
+	void compile(const FragmentState& state);
+
+	SwRenderer::FragmentCallback getTevCallback() { return tevCallback; }
+	SwRenderer::FragmentCallback getBlendCallback() { return blendCallback; }
+};
+
+#endif  // arm64 recompiler check
@@ -0,0 +1,52 @@
+#pragma once
+
+// Only do anything if we're on an x64 target with JIT support enabled
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_X64_HOST)
+#include "PICA/dynapica/x64_regs.hpp"
+#include "helpers.hpp"
+#include "renderer_sw/fragment_pipeline.hpp"
+#include "xbyak/xbyak.h"
+#include "xbyak/xbyak_util.h"
+
+class FragmentEmitter : public Xbyak::CodeGenerator {
+	// 6 fully-featured TEV stages plus blending stay way below this
+	static constexpr size_t allocSize = 0x4000;
+
+	using FragmentState = SwRenderer::FragmentState;
+	using TevStage = SwRenderer::FragmentState::TevStage;
+
+	// Vector constants with the same value in all 4 lanes, plus a mask for the RGB lanes
+	Xbyak::Label constant255, constant128, constant127, constantOne, maxProduct, maxDot, rgbMask;
+
+	SwRenderer::FragmentCallback tevCallback = nullptr;
+	SwRenderer::FragmentCallback blendCallback = nullptr;
+
+	void emitConstants();
+	void emitPrologue();
+	void emitEpilogue();
+
+	void emitTev(const FragmentState& state);
+	void emitTevStage(const FragmentState& state, u32 index, bool usesBuffer);
+	void loadSource(const Xbyak::Xmm& dest, u32 source, u32 stageIndex);
+	void emitOperand(const Xbyak::Xmm& dest, const TevStage& stage, u32 stageIndex, u32 index);
+	void emitCombine(const Xbyak::Xmm& dest, u32 mode);
+	void emitDot3(const Xbyak::Xmm& dest);
+	void emitDivideBy255(const Xbyak::Xmm& value, const Xbyak::Xmm& temp);
+
+	void emitBlend(const FragmentState& state);
+	void emitBlendFactor(const Xbyak::Xmm& dest, u32 func);
+	void emitBlendEquation(const Xbyak::Xmm& dest, u32 equation);
+	void emitLogicOp(u32 op);
+
+  public:
+	// We need SSE4.1 for 32-bit multiplies, signed min/max, lane blends and packing
+	static bool isSupported();
+
+	FragmentEmitter() : Xbyak::CodeGenerator(allocSize) {}
+	void compile(const FragmentState& state);
+
+	SwRenderer::FragmentCallback getTevCallback() { return tevCallback; }
+	SwRenderer::FragmentCallback getBlendCallback() { return blendCallback; }
+};
+
+#endif  // x64 recompiler check
@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+#include <span>
+
+#include "helpers.hpp"
+#include "renderer_sw/fragment_pipeline.hpp"
+
+namespace SwRenderer {
+	struct Vertex {
+		std::array<float, 4> position;  // Clip space position
+		AttributeArray attributes;
+	};
+
+	struct Viewport {
+		float x;
+		float y;
+		float halfWidth;
+		float halfHeight;
+	};
+
+	// A triangle after clipping, perspective division and the viewport transform, ready to be rasterized
+	struct Triangle {
+		// Edge functions E(x, y) = a * x + b * y + c, evaluated on 28.4 fixed point window coordinates
+		// Edge i is the edge opposite of vertex i, and E_i / (2 * area) is the barycentric weight of vertex i
+		std::array<s64, 3> a;
+		std::array<s64, 3> b;
+		std::array<s64, 3> c;
+		std::array<s64, 3> bias;  // 0 for top-left edges and -1 for the rest, so pixels on shared edges are only drawn once
+
+		float invArea;
+		std::array<float, 3> z;     // Normalized device depth of each vertex
+		std::array<float, 3> invW;  // 1 / w of each vertex, for perspective correct interpolation
+		std::array<AttributeArray, 3> attributes;  // Attributes of each vertex, premultiplied by 1 / w
+
+		// Bounding box of the triangle in pixels, inclusive and clamped to the framebuffer
+		s32 minX, minY, maxX, maxY;
+	};
+
+	// Clips a triangle against the view volume (and the user clipping plane, if enabled) and outputs the resulting polygon
+	// Returns the number of vertices of the polygon, which is either 0 or a convex fan with at least 3 vertices
+	static constexpr usize maxClippedVertices = 12;
+	usize clipTriangle(
+		const Vertex& v0, const Vertex& v1, const Vertex& v2, const std::array<float, 4>* userClipPlane,
+		std::array<Vertex, maxClippedVertices>& output
+	);
+
+	// Returns false if the triangle doesn't cover any pixels of the framebuffer
+	bool setupTriangle(Triangle& out, const Vertex& v0, const Vertex& v1, const Vertex& v2, const Viewport& viewport, u32 width, u32 height);
+
+	// Rasterizes the part of the triangle that lies in the [minX, maxX] x [minY, maxY] rectangle of the framebuffer
+	void rasterizeTriangle(const Triangle& triangle, const FragmentState& state, s32 minX, s32 minY, s32 maxX, s32 maxY);
+}  // namespace SwRenderer
@@ -1,10 +1,70 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 #include "renderer.hpp"
+#include "renderer_sw/fragment_pipeline.hpp"
+#include "renderer_sw/fragment_rec.hpp"
+#include "renderer_sw/rasterizer.hpp"
+#include "thread_pool.hpp"
 
 class GPU;
 
+// Software renderer that draws straight into the colour/depth buffers in emulated VRAM, so it doesn't need a host GPU at all
+// Triangles are binned into screen tiles and the tiles are rasterized in parallel on a thread pool. Every tile keeps the draw order
+// of its triangles, so the output doesn't depend on the number of threads
 class RendererSw final : public Renderer {
+	static constexpr s32 tileSize = 32;  // Size of a bin in pixels. A multiple of the 8x8 tiles framebuffers are stored in
+	// Draws where the bounding boxes of all triangles add up to less pixels than this get rasterized on the emulator thread, as waking
+	// up the pool would cost more than it saves
+	static constexpr u64 minParallelDrawArea = 64 * 64;
+	static constexpr usize maxCachedTextures = 256;
+
+	struct CachedTexture {
+		u64 hash;            // Hash of the texture data the texels were decoded from
+		u64 writeTimestamp;  // Write tracking timestamp from when we last checked the hash
+		std::vector<u32> texels;
+	};
+
+	std::unique_ptr<ThreadPool> threadPool;
+
+	SwRenderer::FragmentState fragmentState;
+	FragmentJIT fragmentJIT;
+	bool fragmentJitEnabled;
+	std::vector<SwRenderer::Vertex> clipVertices;
+	std::vector<SwRenderer::Triangle> triangles;
+	std::vector<std::vector<u32>> tileBins;  // Indices of the triangles overlapping each tile, in draw order
+	std::vector<u32> activeTiles;            // Tiles with at least 1 triangle
+
+	// Decoded textures, keyed by address, format and size. When write tracking says their memory was written to, they're validated against a
+	// hash of their data
+	std::unordered_map<u64, CachedTexture> textureCache;
+
+	// The 2 screens, composed into a 400x480 RGBA8 image by display() for presenting and screenshots. The top screen comes first
+	static constexpr u32 screenWidth = 400;
+	static constexpr u32 screenHeight = 480;
+	std::vector<u8> screenImage;
+
+	// If the frontend gave us a GL context, we present the screen image through it
+	bool presentWithGL = false;
+	u32 screenTexture = 0;
+	u32 screenFramebuffer = 0;
+
+	// Returns a pointer to "size" bytes of emulated memory at physical address paddr, or nullptr if the range isn't in FCRAM or VRAM
+	u8* getPointer(u32 paddr, u32 size);
+	// Same, for ranges we're about to write to. Tells the write tracking that the range is getting overwritten
+	u8* getWritePointer(u32 paddr, u32 size);
+	const u32* getTexture(u32 addr, PICA::TextureFmt format, u32 width, u32 height);
+	bool setupFragmentState();
+	// Copies one of the LCD framebuffers into the screen image, at (screenX, screenY) with the top-left corner being (0, 0)
+	void composeScreen(u32 addr, u32 config, u32 stride, u32 screenX, u32 screenY, u32 width);
+	void presentScreen();
+
   public:
-	RendererSw(GPU& gpu, const std::array<u32, regNum>& internalRegs, const std::array<u32, extRegNum>& externalRegs);
+	RendererSw(GPU& gpu, const std::array<u32, regNum>& internalRegs, const std::array<u32, extRegNum>& externalRegs, u32 threadCount,
+			   bool fragmentJitEnabled);
 	~RendererSw() override;
 
 	void reset() override;
@@ -18,6 +78,6 @@ class RendererSw final : public Renderer {
 	void deinitGraphicsContext() override;
 
 #ifdef PANDA3DS_FRONTEND_QT
-	virtual void initGraphicsContext([[maybe_unused]] GL::Context* context) override {}
+	virtual void initGraphicsContext([[maybe_unused]] GL::Context* context) override { presentWithGL = true; }
 #endif
 };
@@ -1,5 +1,6 @@
 #pragma once
 #include <cstring>
+#include <deque>
 #include <optional>
 #include "PICA/gpu.hpp"
 #include "helpers.hpp"
@@ -7,6 +8,7 @@
 #include "logger.hpp"
 #include "memory.hpp"
 #include "result/result.hpp"
+#include "scheduler.hpp"
 
 enum class GPUInterrupt : u8 {
 	PSC0 = 0, // Memory fill completed
@@ -37,6 +39,19 @@ class GPUService {
 	// Number of threads registered via RegisterInterruptRelayQueue
 	u32 gspThreadCount = 0;
 
+	// Interrupts of GSP commands that were sent to the GPU thread. They get sent a fixed amount of emulated time after the command was
+	// submitted, waiting for the command to finish first if needed, so games see the same timing no matter how fast the host is
+	struct PendingInterrupt {
+		u64 sequence;   // Sequence number of the command on the GPU thread
+		u64 timestamp;  // When to send the interrupt
+		GPUInterrupt type;
+	};
+
+	static constexpr u64 commandLatency = Scheduler::nsToCycles(100'000);
+	std::deque<PendingInterrupt> pendingInterrupts;
+	// Runs a GX command and sends "type" once it's done
+	void runCommand(const GPUThread::Command& command, GPUInterrupt type);
+
 	MAKE_LOG_FUNCTION(log, gspGPULogger)
 	void processCommandBuffer();
 
@@ -112,6 +127,7 @@ public:
 	void reset();
 	void handleSyncRequest(u32 messagePointer);
 	void requestInterrupt(GPUInterrupt type);
+	void sendPendingInterrupts();
 	void setSharedMem(u8* ptr) {
 		sharedMem = ptr;
 		if (ptr != nullptr) { // Zero-fill shared memory in case the process tries to read stale service data or vice versa
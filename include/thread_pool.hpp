@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "helpers.hpp"
+
+// Persistent pool of worker threads for splitting embarrassingly parallel work (eg vertex shading) into jobs
+// The thread calling parallelFor also runs jobs, so a pool with N workers processes up to N + 1 jobs at a time
+class ThreadPool {
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable workDone;
+
+	const std::function<void(u32)>* currentJob = nullptr;
+	u32 jobCount = 0;
+	std::atomic<u32> nextJob = 0;
+	u32 busyWorkers = 0;
+	u64 generation = 0;  // Incremented every time new work is submitted, so sleeping workers know to wake up
+	bool stopping = false;
+
+	void workerLoop();
+	void runJobs();
+
+  public:
+	// Create a pool with "threadCount" worker threads. 0 means the calling thread does all the work
+	explicit ThreadPool(u32 threadCount);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Number of threads that can process jobs at once, including the calling thread
+	u32 threadCount() const { return u32(workers.size()) + 1; }
+
+	// Runs func(0), func(1), ..., func(jobCount - 1) across the pool and returns once all of them are done
+	void parallelFor(u32 jobCount, const std::function<void(u32)>& func);
+};
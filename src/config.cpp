@@ -44,6 +44,15 @@ void EmulatorConfig::load() {
 		}
 	}
 
+	if (data.contains("CPU")) {
+		auto cpuResult = toml::expect<toml::value>(data.at("CPU"));
+		if (cpuResult.is_ok()) {
+			auto cpu = cpuResult.unwrap();
+
+			fastmemEnabled = toml::find_or<toml::boolean>(cpu, "EnableFastmem", true);
+		}
+	}
+
 	if (data.contains("GPU")) {
 		auto gpuResult = toml::expect<toml::value>(data.at("GPU"));
 		if (gpuResult.is_ok()) {
@@ -61,6 +70,24 @@ void EmulatorConfig::load() {
 			}
 
 			shaderJitEnabled = toml::find_or<toml::boolean>(gpu, "EnableShaderJIT", shaderJitDefault);
+			shaderJitCacheBudgetMB = toml::find_or<toml::integer>(gpu, "ShaderJITCacheBudgetMB", 32);
+			shaderJitCacheBudgetMB = std::clamp(shaderJitCacheBudgetMB, 4, 1024);
+			vertexLoaderJitEnabled = toml::find_or<toml::boolean>(gpu, "EnableVertexLoaderJIT", true);
+			accelerateShaders = toml::find_or<toml::boolean>(gpu, "AccelerateShaders", false);
+			vertexShaderThreadCount = toml::find_or<toml::integer>(gpu, "VertexShaderThreads", 0);
+			// Clamp the thread count to something sane
+			vertexShaderThreadCount = std::clamp(vertexShaderThreadCount, 0, 16);
+
+			softwareRendererThreadCount = toml::find_or<toml::integer>(gpu, "SoftwareRendererThreads", 3);
+			softwareRendererThreadCount = std::clamp(softwareRendererThreadCount, 0, 16);
+			fragmentJitEnabled = toml::find_or<toml::boolean>(gpu, "EnableFragmentJIT", true);
+			textureCacheBudgetMB = toml::find_or<toml::integer>(gpu, "TextureCacheBudgetMB", 256);
+			textureCacheBudgetMB = std::clamp(textureCacheBudgetMB, 16, 4096);
+			textureDecodeThreadCount = toml::find_or<toml::integer>(gpu, "TextureDecodeThreads", 2);
+			textureDecodeThreadCount = std::clamp(textureDecodeThreadCount, 0, 16);
+			useUbershaders = toml::find_or<toml::boolean>(gpu, "UseUbershaders", false);
+			shaderCacheEnabled = toml::find_or<toml::boolean>(gpu, "EnableShaderCache", true);
+			threadedGPU = toml::find_or<toml::boolean>(gpu, "ThreadedGPU", false);
 			vsyncEnabled = toml::find_or<toml::boolean>(gpu, "EnableVSync", true);
 		}
 	}
@@ -122,7 +149,19 @@ void EmulatorConfig::save() {
 	data["General"]["EnableDiscordRPC"] = discordRpcEnabled;
 	data["General"]["UsePortableBuild"] = usePortableBuild;
 	data["General"]["DefaultRomPath"] = defaultRomPath.string();
+	data["CPU"]["EnableFastmem"] = fastmemEnabled;
 	data["GPU"]["EnableShaderJIT"] = shaderJitEnabled;
+	data["GPU"]["ShaderJITCacheBudgetMB"] = shaderJitCacheBudgetMB;
+	data["GPU"]["EnableVertexLoaderJIT"] = vertexLoaderJitEnabled;
+	data["GPU"]["AccelerateShaders"] = accelerateShaders;
+	data["GPU"]["VertexShaderThreads"] = vertexShaderThreadCount;
+	data["GPU"]["SoftwareRendererThreads"] = softwareRendererThreadCount;
+	data["GPU"]["EnableFragmentJIT"] = fragmentJitEnabled;
+	data["GPU"]["TextureCacheBudgetMB"] = textureCacheBudgetMB;
+	data["GPU"]["TextureDecodeThreads"] = textureDecodeThreadCount;
+	data["GPU"]["UseUbershaders"] = useUbershaders;
+	data["GPU"]["EnableShaderCache"] = shaderCacheEnabled;
+	data["GPU"]["ThreadedGPU"] = threadedGPU;
 	data["GPU"]["Renderer"] = std::string(Renderer::typeToString(rendererType));
 	data["GPU"]["EnableVSync"] = vsyncEnabled;
 	data["Audio"]["DSPEmulation"] = std::string(Audio::DSPCore::typeToString(dspType));
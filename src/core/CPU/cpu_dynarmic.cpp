@@ -15,6 +15,19 @@ CPU::CPU(Memory& mem, Kernel& kernel, Emulator& emu) : mem(mem), emu(emu), sched
 	config.global_monitor = &exclusiveMonitor;
 	config.processor_id = 0;
 
+	// Fast path for memory accesses. Pages present in the page table are accessed inline by the JIT,
+	// and with fastmem the JIT can also emit plain host loads/stores into the mirrored guest address space.
+	// Accesses that fault (MMIO, unmapped or read-only pages) make Dynarmic recompile the block to use the page table/callbacks instead
+	if (auto pageTable = mem.getCPUPageTable(); pageTable != nullptr) {
+		config.page_table = pageTable;
+		config.absolute_offset_page_table = false;
+
+		if (u8* arena = mem.getFastmemArenaBase(); arena != nullptr) {
+			config.fastmem_pointer = reinterpret_cast<uintptr_t>(arena);
+			config.recompile_on_fastmem_failure = true;
+		}
+	}
+
 	jit = std::make_unique<Dynarmic::A32::Jit>(config);
 }
 
@@ -43,7 +56,14 @@ void CPU::runFrame() {
 		// Handle any scheduler events that need handling.
 		emu.pollScheduler();
 
-		if (static_cast<u32>(exitReason) != 0) [[unlikely]] {
+		// Another thread halted us to get the CPU thread to watch memory for it. Clear the halt before looking at the requests, so that a
+		// request that comes in after that halts the next run instead of getting lost
+		if (Dynarmic::Has(exitReason, Dynarmic::HaltReason::UserDefined1)) {
+			jit->ClearHalt(Dynarmic::HaltReason::UserDefined1);
+			mem.applyWatchRequests();
+		}
+
+		if ((static_cast<u32>(exitReason) & ~static_cast<u32>(Dynarmic::HaltReason::UserDefined1)) != 0) [[unlikely]] {
 			// Cache invalidation needs to exit the JIT so it returns a CacheInvalidation HaltReason. In our case, we just go back to executing
 			// The goto might be terrible but it does guarantee that this does not recursively call run and crash, instead getting optimized to a jump
 			if (Dynarmic::Has(exitReason, Dynarmic::HaltReason::CacheInvalidation)) {
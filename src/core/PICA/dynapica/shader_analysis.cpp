@@ -0,0 +1,570 @@
+#include "PICA/dynapica/shader_analysis.hpp"
+
+#include <algorithm>
+
+using namespace Helpers;
+
+namespace {
+	// What registers an instruction reads and writes, as far as the liveness pass is concerned
+	struct RegisterUsage {
+		enum class Lanes {
+			PerComponent,  // Each destination component only depends on the same component of the (swizzled) sources
+			Dot3,          // Reads xyz of both sources
+			Dot4,          // Reads xyzw of both sources
+			DotH,          // Reads xyz of the first source and xyzw of the second
+			Scalar,        // Reads x of the source
+			XY,            // Reads xy of both sources
+		};
+
+		bool hasDest = false;          // Writes a temporary or output register, and does nothing else, so it can be removed if the result isn't used
+		bool readsEverything = false;  // We don't know what this reads, so assume it reads every temporary
+		bool indexed = false;          // A source uses relative addressing, so it could read any register
+		Lanes lanes = Lanes::PerComponent;
+
+		u32 dest = 0;
+		u32 writeMask = 0;
+		u32 operandDescriptor = 0;
+		u32 sourceCount = 0;
+		std::array<u32, 3> sources = {0, 0, 0};
+	};
+}  // namespace
+
+// Converts between write masks (bit 3 = x) and component masks (bit 0 = x)
+static u32 reverseComponents(u32 mask) { return ((mask >> 3) & 0b1) | ((mask >> 1) & 0b10) | ((mask << 1) & 0b100) | ((mask << 3) & 0b1000); }
+
+static RegisterUsage getRegisterUsage(u32 instruction, const std::array<u32, 128>& operandDescriptors) {
+	using Lanes = RegisterUsage::Lanes;
+	RegisterUsage usage;
+	const u32 opcode = instruction >> 26;
+
+	// Most instructions share the same encoding. The inverted ones just give the first source 5 bits and the second source 7 bits
+	auto decodeCommon = [&](u32 sourceCount, Lanes lanes, bool hasDest, bool inverted = false) {
+		usage.operandDescriptor = operandDescriptors[instruction & 0x7f];
+		usage.sources[0] = inverted ? getBits<14, 5>(instruction) : getBits<12, 7>(instruction);
+		usage.sources[1] = inverted ? getBits<7, 7>(instruction) : getBits<7, 5>(instruction);
+		usage.sourceCount = sourceCount;
+		usage.indexed = getBits<19, 2>(instruction) != 0;
+		usage.lanes = lanes;
+		usage.hasDest = hasDest;
+		usage.dest = getBits<21, 5>(instruction);
+		usage.writeMask = usage.operandDescriptor & 0xf;
+	};
+
+	switch (opcode) {
+		case ShaderOpcodes::ADD:
+		case ShaderOpcodes::MUL:
+		case ShaderOpcodes::SGE:
+		case ShaderOpcodes::SLT:
+		case ShaderOpcodes::MAX:
+		case ShaderOpcodes::MIN: decodeCommon(2, Lanes::PerComponent, true); break;
+
+		case ShaderOpcodes::SGEI:
+		case ShaderOpcodes::SLTI: decodeCommon(2, Lanes::PerComponent, true, true); break;
+
+		case ShaderOpcodes::FLR:
+		case ShaderOpcodes::MOV: decodeCommon(1, Lanes::PerComponent, true); break;
+
+		case ShaderOpcodes::DP3: decodeCommon(2, Lanes::Dot3, true); break;
+		case ShaderOpcodes::DP4: decodeCommon(2, Lanes::Dot4, true); break;
+		case ShaderOpcodes::DPH: decodeCommon(2, Lanes::DotH, true); break;
+		case ShaderOpcodes::DPHI: decodeCommon(2, Lanes::DotH, true, true); break;
+
+		case ShaderOpcodes::EX2:
+		case ShaderOpcodes::LG2:
+		case ShaderOpcodes::RCP:
+		case ShaderOpcodes::RSQ: decodeCommon(1, Lanes::Scalar, true); break;
+
+		// MOVA writes the address register, using the write mask to pick which of x and y to write
+		case ShaderOpcodes::MOVA: decodeCommon(1, Lanes::PerComponent, false); break;
+		case ShaderOpcodes::CMP1:
+		case ShaderOpcodes::CMP2: decodeCommon(2, Lanes::XY, false); break;
+
+		// MADI gives the second source 5 bits and the third source 7 bits, while MAD does the opposite
+		case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x36: case 0x37:
+		case 0x38: case 0x39: case 0x3A: case 0x3B: case 0x3C: case 0x3D: case 0x3E: case 0x3F: {
+			const bool isMADI = opcode < ShaderOpcodes::MAD;
+			usage.operandDescriptor = operandDescriptors[instruction & 0x1f];
+			usage.sources[0] = getBits<17, 5>(instruction);
+			usage.sources[1] = isMADI ? getBits<12, 5>(instruction) : getBits<10, 7>(instruction);
+			usage.sources[2] = isMADI ? getBits<5, 7>(instruction) : getBits<5, 5>(instruction);
+			usage.sourceCount = 3;
+			usage.indexed = getBits<22, 2>(instruction) != 0;
+			usage.hasDest = true;
+			usage.dest = getBits<24, 5>(instruction);
+			usage.writeMask = usage.operandDescriptor & 0xf;
+			break;
+		}
+
+		// Flow control and other instructions that don't touch the float registers
+		case ShaderOpcodes::NOP:
+		case ShaderOpcodes::END:
+		case ShaderOpcodes::BREAK:
+		case ShaderOpcodes::BREAKC:
+		case ShaderOpcodes::CALL:
+		case ShaderOpcodes::CALLC:
+		case ShaderOpcodes::CALLU:
+		case ShaderOpcodes::IFU:
+		case ShaderOpcodes::IFC:
+		case ShaderOpcodes::LOOP:
+		case ShaderOpcodes::EMIT:
+		case ShaderOpcodes::SETEMIT:
+		case ShaderOpcodes::JMPC:
+		case ShaderOpcodes::JMPU: break;
+
+		default: usage.readsEverything = true; break;
+	}
+
+	return usage;
+}
+
+// Returns the temporary register components an instruction reads, given which components of its destination are used
+static u64 getUsedTemporaries(const RegisterUsage& usage, u32 liveWriteMask) {
+	using Lanes = RegisterUsage::Lanes;
+
+	if (usage.hasDest && liveWriteMask == 0) {
+		return 0;  // The instruction is dead, so it doesn't read anything
+	}
+
+	if (usage.readsEverything || usage.indexed) {
+		return ~0ull;
+	}
+
+	u64 used = 0;
+	for (u32 i = 0; i < usage.sourceCount; i++) {
+		const u32 source = usage.sources[i];
+		if (source < 0x10 || source >= 0x20) {
+			continue;  // Not a temporary register
+		}
+
+		// Which components of the swizzled source we read, with bit 0 = x
+		u32 lanes = 0;
+		switch (usage.lanes) {
+			case Lanes::PerComponent: lanes = reverseComponents(liveWriteMask); break;
+			case Lanes::Dot3: lanes = 0b0111; break;
+			case Lanes::Dot4: lanes = 0b1111; break;
+			case Lanes::DotH: lanes = (i == 0) ? 0b0111 : 0b1111; break;
+			case Lanes::Scalar: lanes = 0b0001; break;
+			case Lanes::XY: lanes = 0b0011; break;
+		}
+
+		// Swizzles are 8 bits per source starting at bit 5, 14 and 23 of the operand descriptor, with x in the top 2 bits
+		static constexpr std::array<u32, 3> swizzleShifts = {5, 14, 23};
+		const u32 swizzle = (usage.operandDescriptor >> swizzleShifts[i]) & 0xff;
+
+		for (u32 lane = 0; lane < 4; lane++) {
+			if (lanes & (1 << lane)) {
+				const u32 component = (swizzle >> (6 - lane * 2)) & 3;
+				used |= 1ull << ((source - 0x10) * 4 + component);
+			}
+		}
+	}
+
+	return used;
+}
+
+void ShaderAnalysis::analyze(const PICAShader& shader, u32 entrypoint, u64 liveOutputs, const Uniforms* specialisation) {
+	specialised = specialisation != nullptr;
+	uniforms = specialised ? *specialisation : Uniforms{};
+
+	findReachable(shader, entrypoint);
+	findUnrolledLoops(shader);
+	buildSuccessors(shader, entrypoint);
+	computeLiveness(shader, liveOutputs);
+}
+
+ShaderAnalysis::UniformUsage ShaderAnalysis::getUniformUsage(const PICAShader& shader, u32 entrypoint) {
+	specialised = false;
+	findReachable(shader, entrypoint);
+
+	UniformUsage usage;
+	for (u32 pc = 0; pc < endPC; pc++) {
+		if (!reachable[pc]) {
+			continue;
+		}
+
+		const u32 instruction = shader.loadedShader[pc];
+		switch (instruction >> 26) {
+			case ShaderOpcodes::CALLU:
+			case ShaderOpcodes::IFU:
+			case ShaderOpcodes::JMPU: usage.boolUniforms |= 1u << getBits<22, 4>(instruction); break;
+
+			case ShaderOpcodes::LOOP: usage.intUniforms |= 1u << getBits<22, 2>(instruction); break;
+			default: break;
+		}
+	}
+
+	return usage;
+}
+
+bool ShaderAnalysis::hasBranchTargets(u32 start, u32 end) const {
+	end = std::min(end, maxInstructionCount);
+	for (u32 pc = start; pc < end; pc++) {
+		if (branchTargets[pc] || returnPCs[pc]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ShaderAnalysis::findReachable(const PICAShader& shader, u32 entrypoint) {
+	reachable.reset();
+	returnPCs.reset();
+	branchTargets.reset();
+	reachableCount = 0;
+	endPC = 0;
+	hasLog2 = false;
+	hasExp2 = false;
+
+	pendingPCs.clear();
+	pendingPCs.push_back(entrypoint);
+	if (entrypoint < maxInstructionCount) {
+		branchTargets[entrypoint] = true;
+	}
+
+	auto addTarget = [this](u32 pc) {
+		if (pc < maxInstructionCount && !reachable[pc]) {
+			pendingPCs.push_back(pc);
+		}
+	};
+
+	// Same as addTarget, for targets that the emitters jump to with instruction labels rather than structured control flow
+	auto addBranchTarget = [&](u32 pc) {
+		if (pc < maxInstructionCount) {
+			branchTargets[pc] = true;
+		}
+		addTarget(pc);
+	};
+
+	auto addCall = [&](u32 dest, u32 num) {
+		addBranchTarget(dest);
+		if (dest + num < maxInstructionCount) {
+			returnPCs[dest + num] = true;
+		}
+	};
+
+	while (!pendingPCs.empty()) {
+		u32 pc = pendingPCs.back();
+		pendingPCs.pop_back();
+
+		// Walk straight-line code until we hit an END or something we've already visited
+		bool ended = false;
+		while (!ended && pc < maxInstructionCount && !reachable[pc]) {
+			reachable[pc] = true;
+			reachableCount++;
+			endPC = std::max(endPC, pc + 1);
+
+			const u32 instruction = shader.loadedShader[pc++];
+			const u32 opcode = instruction >> 26;
+			const u32 num = instruction & 0xff;
+			const u32 dest = getBits<10, 12>(instruction);
+
+			switch (opcode) {
+				case ShaderOpcodes::END: ended = true; break;
+
+				// The subroutine runs from dest to dest + num, then returns to the instruction after the call
+				case ShaderOpcodes::CALL:
+				case ShaderOpcodes::CALLC: addCall(dest, num); break;
+
+				case ShaderOpcodes::CALLU:
+					if (!specialised || getBoolUniform(instruction)) {
+						addCall(dest, num);
+					}
+					break;
+
+				// The if block runs until dest then skips to dest + num, while the else block runs from dest to dest + num
+				case ShaderOpcodes::IFC:
+					addTarget(dest);
+					addTarget(dest + num);
+					break;
+
+				case ShaderOpcodes::IFU:
+					if (!specialised) {
+						addTarget(dest);
+						addTarget(dest + num);
+					} else if (getBoolUniform(instruction)) {
+						addTarget(dest + num);
+					} else {
+						// Only the else block runs, so the if block is dead unless something else jumps into it
+						addTarget(dest);
+						ended = true;
+					}
+					break;
+
+				// The loop body goes up to and including dest
+				case ShaderOpcodes::LOOP: addTarget(dest + 1); break;
+
+				case ShaderOpcodes::JMPC: addBranchTarget(dest); break;
+
+				// JMPU jumps if the uniform is true, or if it's false when bit 0 of the instruction is set
+				case ShaderOpcodes::JMPU:
+					if (!specialised) {
+						addBranchTarget(dest);
+					} else if (getBoolUniform(instruction) != bool(instruction & 1)) {
+						addBranchTarget(dest);
+						ended = true;
+					}
+					break;
+
+				case ShaderOpcodes::EX2: hasExp2 = true; break;
+				case ShaderOpcodes::LG2: hasLog2 = true; break;
+				default: break;
+			}
+		}
+	}
+}
+
+void ShaderAnalysis::findUnrolledLoops(const PICAShader& shader) {
+	unrolledLoops.reset();
+	unrolledInstructionCount = 0;
+
+	if (!specialised) {
+		return;
+	}
+
+	for (u32 pc = 0; pc < endPC; pc++) {
+		const u32 instruction = shader.loadedShader[pc];
+		if (!reachable[pc] || (instruction >> 26) != ShaderOpcodes::LOOP) {
+			continue;
+		}
+
+		// The body runs from pc + 1 up to and including dest. We can only unroll it if we don't need labels inside it, and it has no
+		// flow control that would need to jump between the unrolled copies
+		const u32 dest = getBits<10, 12>(instruction);
+		if (dest <= pc || hasBranchTargets(pc + 1, dest + 1)) {
+			continue;
+		}
+
+		bool canUnroll = true;
+		u32 bodyLength = 0;
+		for (u32 bodyPC = pc + 1; bodyPC <= dest && canUnroll; bodyPC++) {
+			if (!reachable[bodyPC]) {
+				continue;
+			}
+
+			bodyLength++;
+			switch (shader.loadedShader[bodyPC] >> 26) {
+				case ShaderOpcodes::BREAK:
+				case ShaderOpcodes::BREAKC:
+				case ShaderOpcodes::CALL:
+				case ShaderOpcodes::CALLC:
+				case ShaderOpcodes::CALLU:
+				case ShaderOpcodes::LOOP:
+				case ShaderOpcodes::JMPC:
+				case ShaderOpcodes::JMPU: canUnroll = false; break;
+				default: break;
+			}
+		}
+
+		const u32 iterations = u32(uniforms.intUniforms[getBits<22, 2>(instruction)][0]) + 1;
+		// Also keep the total under the program memory size, so the shader still fits in the worst case code size the JIT budgets for
+		const u32 extraInstructions = (iterations - 1) * bodyLength;
+		if (canUnroll && iterations * bodyLength <= maxUnrolledInstructions &&
+			reachableCount + unrolledInstructionCount + extraInstructions <= maxInstructionCount) {
+			unrolledLoops[pc] = true;
+			unrolledInstructionCount += extraInstructions;
+		}
+	}
+}
+
+void ShaderAnalysis::buildSuccessors(const PICAShader& shader, u32 entrypoint) {
+	std::vector<std::pair<u16, u16>> edges;
+	returnEdges.clear();
+
+	auto addEdge = [&](u32 from, u32 to) {
+		if (from < maxInstructionCount && to < maxInstructionCount) {
+			edges.emplace_back(u16(from), u16(to));
+		}
+	};
+
+	for (u32 pc = 0; pc < endPC; pc++) {
+		if (!reachable[pc]) {
+			continue;
+		}
+
+		const u32 instruction = shader.loadedShader[pc];
+		const u32 opcode = instruction >> 26;
+		const u32 num = instruction & 0xff;
+		const u32 dest = getBits<10, 12>(instruction);
+
+		switch (opcode) {
+			// Temporaries keep their values between vertices, so whatever the start of the shader reads is still live at the end
+			case ShaderOpcodes::END: addEdge(pc, entrypoint); break;
+
+			case ShaderOpcodes::CALL:
+			case ShaderOpcodes::CALLC:
+			case ShaderOpcodes::CALLU:
+				addEdge(pc, dest);
+				addEdge(pc, pc + 1);
+				if (dest + num < maxInstructionCount) {
+					returnEdges.emplace_back(u16(dest + num), u16(pc + 1));
+				}
+				break;
+
+			case ShaderOpcodes::IFC:
+			case ShaderOpcodes::IFU:
+				addEdge(pc, pc + 1);
+				addEdge(pc, dest);
+				addEdge(pc, dest + num);
+				// The end of the if block jumps over the else block
+				if (num != 0 && dest > pc + 1) {
+					addEdge(dest - 1, dest + num);
+				}
+				break;
+
+			case ShaderOpcodes::LOOP:
+				addEdge(pc, pc + 1);
+				addEdge(dest, pc + 1);  // The end of the loop body goes back to the start
+				break;
+
+			case ShaderOpcodes::JMPC:
+			case ShaderOpcodes::JMPU:
+				addEdge(pc, pc + 1);
+				addEdge(pc, dest);
+				break;
+
+			// A break leaves the innermost loop around it, but we keep the edge to the next instruction too, as it's a no-op when
+			// there's no loop running. Loops nest, so the innermost one is the closest loop before us whose body we're in
+			case ShaderOpcodes::BREAK:
+			case ShaderOpcodes::BREAKC: {
+				addEdge(pc, pc + 1);
+
+				bool foundLoop = false;
+				for (u32 loopPC = pc; loopPC-- > 0;) {
+					const u32 loopInstruction = shader.loadedShader[loopPC];
+					if (reachable[loopPC] && (loopInstruction >> 26) == ShaderOpcodes::LOOP && getBits<10, 12>(loopInstruction) >= pc) {
+						addEdge(pc, getBits<10, 12>(loopInstruction) + 1);
+						foundLoop = true;
+						break;
+					}
+				}
+
+				// Not inside a loop body, eg a break in a subroutine called from a loop. It could leave any loop then
+				if (!foundLoop) {
+					for (u32 loopPC = 0; loopPC < endPC; loopPC++) {
+						const u32 loopInstruction = shader.loadedShader[loopPC];
+						if (reachable[loopPC] && (loopInstruction >> 26) == ShaderOpcodes::LOOP) {
+							addEdge(pc, getBits<10, 12>(loopInstruction) + 1);
+						}
+					}
+				}
+				break;
+			}
+
+			default: addEdge(pc, pc + 1); break;
+		}
+	}
+
+	std::sort(edges.begin(), edges.end());
+	std::sort(returnEdges.begin(), returnEdges.end());
+
+	successors.clear();
+	usize edgeIndex = 0;
+	for (u32 pc = 0; pc < maxInstructionCount; pc++) {
+		successorStart[pc] = u32(successors.size());
+		while (edgeIndex < edges.size() && edges[edgeIndex].first == pc) {
+			successors.push_back(edges[edgeIndex++].second);
+		}
+	}
+	successorStart[maxInstructionCount] = u32(successors.size());
+}
+
+void ShaderAnalysis::computeLiveness(const PICAShader& shader, u64 liveOutputs) {
+	liveIn.fill(0);
+	liveWriteMasks.fill(0xf);
+	deadInstructionCount = 0;
+
+	// Returns the live temporary components after an instruction, and which components of its destination are used
+	auto getLiveOut = [&](u32 pc) {
+		u64 liveOut = 0;
+		for (u32 i = successorStart[pc]; i < successorStart[pc + 1]; i++) {
+			liveOut |= liveIn[successors[i]];
+		}
+		return liveOut;
+	};
+
+	auto getLiveWriteMask = [&](const RegisterUsage& usage, u64 liveOut) {
+		if (!usage.hasDest) {
+			return usage.writeMask;
+		}
+
+		const u64 liveComponents = (usage.dest < 0x10) ? (liveOutputs >> (usage.dest * 4)) : (liveOut >> ((usage.dest - 0x10) * 4));
+		return usage.writeMask & reverseComponents(u32(liveComponents & 0xf));
+	};
+
+	// Iterate backwards until nothing changes. Loops and jumps backwards might take a few iterations to settle
+	bool changed = true;
+	while (changed) {
+		changed = false;
+
+		for (s32 pc = s32(endPC) - 1; pc >= 0; pc--) {
+			if (!reachable[pc] && !returnPCs[pc]) {
+				continue;
+			}
+
+			u64 live = 0;
+			if (reachable[pc]) {
+				const RegisterUsage usage = getRegisterUsage(shader.loadedShader[pc], shader.operandDescriptors);
+				const u64 liveOut = getLiveOut(pc);
+				const u32 liveWriteMask = getLiveWriteMask(usage, liveOut);
+
+				live = liveOut;
+				if (usage.hasDest && usage.dest >= 0x10) {
+					live &= ~(u64(reverseComponents(usage.writeMask)) << ((usage.dest - 0x10) * 4));
+				}
+				live |= getUsedTemporaries(usage, liveWriteMask);
+			}
+
+			// Returning from a subroutine happens before the instruction at the return PC runs
+			auto [begin, end] = std::equal_range(
+				returnEdges.begin(), returnEdges.end(), std::pair<u16, u16>(u16(pc), 0),
+				[](const auto& a, const auto& b) { return a.first < b.first; }
+			);
+			for (auto it = begin; it != end; it++) {
+				live |= liveIn[it->second];
+			}
+
+			if (live != liveIn[pc]) {
+				liveIn[pc] = live;
+				changed = true;
+			}
+		}
+	}
+
+	for (u32 pc = 0; pc < endPC; pc++) {
+		if (!reachable[pc]) {
+			continue;
+		}
+
+		const RegisterUsage usage = getRegisterUsage(shader.loadedShader[pc], shader.operandDescriptors);
+		if (usage.hasDest) {
+			liveWriteMasks[pc] = u8(getLiveWriteMask(usage, getLiveOut(pc)));
+			if (liveWriteMasks[pc] == 0) {
+				deadInstructionCount++;
+			}
+		}
+	}
+}
+
+u64 ShaderAnalysis::getLiveOutputs(u32 outputCount, const u32* outmaps) {
+	// Output components get copied to the vertex in order, so when several of them map to the same attribute only the last one matters
+	std::array<s32, 32> lastWriter;
+	lastWriter.fill(-1);
+
+	for (u32 i = 0; i < std::min<u32>(outputCount, 7); i++) {
+		for (u32 j = 0; j < 4; j++) {
+			const u32 mapping = (outmaps[i] >> (j * 8)) & 0x1f;
+			lastWriter[mapping] = s32(i * 4 + j);
+		}
+	}
+
+	// Attributes 0x18 and up aren't used by anything
+	u64 live = 0;
+	for (u32 mapping = 0; mapping < 0x18; mapping++) {
+		if (lastWriter[mapping] >= 0) {
+			live |= 1ull << lastWriter[mapping];
+		}
+	}
+
+	return live;
+}
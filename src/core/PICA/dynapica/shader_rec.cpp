@@ -1,32 +1,260 @@
 #include "PICA/dynapica/shader_rec.hpp"
+
+#include <algorithm>
 #include <bit>
 
 #ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+void ShaderCodeArena::init(usize size) {
+	if (usedBytes != 0) {
+		Helpers::panic("Shader JIT: Tried to resize the code arena while shaders are allocated from it");
+	}
+
+	capacity = alignSize(size);
+#ifdef PANDA3DS_X64_HOST
+	block = std::make_unique<Xbyak::CodeGenerator>(capacity);
+	base = const_cast<u8*>(block->getCode());
+#else
+	block = std::make_unique<oaknut::CodeBlock>(capacity);
+	base = reinterpret_cast<u8*>(block->ptr());
+#endif
+
+	clear();
+}
+
+void ShaderCodeArena::clear() {
+	freeRanges.clear();
+	freeRanges[0] = capacity;
+	usedBytes = 0;
+}
+
+u8* ShaderCodeArena::allocate(usize size) {
+	size = alignSize(size);
+
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); it++) {
+		auto [offset, rangeSize] = *it;
+		if (rangeSize < size) {
+			continue;
+		}
+
+		freeRanges.erase(it);
+		if (rangeSize > size) {
+			freeRanges[offset + size] = rangeSize - size;
+		}
+
+		usedBytes += size;
+		return base + offset;
+	}
+
+	return nullptr;
+}
+
+void ShaderCodeArena::free(u8* pointer, usize size) {
+	usize offset = usize(pointer - base);
+	size = alignSize(size);
+	usedBytes -= size;
+
+	// Merge with the free ranges right after and right before this one, if any
+	auto next = freeRanges.lower_bound(offset);
+	if (next != freeRanges.end() && next->first == offset + size) {
+		size += next->second;
+		next = freeRanges.erase(next);
+	}
+
+	if (next != freeRanges.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset) {
+			previous->second += size;
+			return;
+		}
+	}
+
+	freeRanges[offset] = size;
+}
+
+void ShaderCodeArena::shrink(u8* pointer, usize oldSize, usize newSize) {
+	oldSize = alignSize(oldSize);
+	newSize = alignSize(newSize);
+
+	if (newSize < oldSize) {
+		free(pointer + newSize, oldSize - newSize);
+	}
+}
+
+void ShaderCodeArena::beginWrite() {
+#ifdef PANDA3DS_ARM64_HOST
+	block->unprotect();
+#endif
+}
+
+void ShaderCodeArena::endWrite(u8* pointer, usize size) {
+#ifdef PANDA3DS_ARM64_HOST
+	block->protect();
+	block->invalidate(reinterpret_cast<u32*>(pointer), size);
+#endif
+}
+
 void ShaderJIT::reset() {
 	cache.clear();
+	lruList.clear();
+	shaderInfo.clear();
+	arena.clear();
+
+	stats = CacheStats{};
+	stats.budget = arena.getCapacity();
 }
 
-void ShaderJIT::prepare(PICAShader& shaderUnit) {
+void ShaderJIT::setCacheBudget(usize bytes) {
+	// The arena needs to at least fit a shader that uses all of the program memory
+	cacheBudget = std::max(bytes, ShaderEmitter::maxCodeSize(PICAShader::maxInstructionCount));
+
+	// Resize the arena if it's been allocated already. Otherwise it gets allocated with the new size on the first compile
+	if (arena.isInitialized()) {
+		reset();
+		arena.init(cacheBudget);
+		stats.budget = arena.getCapacity();
+	}
+}
+
+void ShaderJIT::prepare(PICAShader& shaderUnit, u64 liveOutputs) {
 	shaderUnit.pc = shaderUnit.entrypoint;
 	// We combine the code and operand descriptor hashes into a single hash
 	// This is so that if only one of them changes, we still properly recompile the shader
 	// The combine does rotl(x, 1) ^ y for the merging instead of x ^ y because xor is commutative, hence creating possible collisions
 	// re: https://github.com/wheremyfoodat/Panda3DS/pull/15#discussion_r1229925372
 	Hash hash = std::rotl(shaderUnit.getCodeHash(), 1) ^ shaderUnit.getOpdescHash();
-	auto it = cache.find(hash);
+	// We only compile the code reachable from the entrypoint, so different entrypoints into the same code need their own cache entries
+	hash = std::rotl(hash, 12) ^ shaderUnit.entrypoint;
+	// Same for output maps that use different outputs, as we skip computing outputs that aren't used
+	hash ^= liveOutputs * 0x9E3779B97F4A7C15ull;
+
+	auto infoIt = shaderInfo.find(hash);
+	if (infoIt == shaderInfo.end()) {
+		infoIt = shaderInfo.emplace(hash, ShaderInfo{.uniformUsage = analysis.getUniformUsage(shaderUnit, shaderUnit.entrypoint)}).first;
+	}
+	ShaderInfo& info = infoIt->second;
+
+	// If the shader branches on uniforms, look for a variant specialised on their current values. Uniforms the shader doesn't branch on are
+	// left as 0 so they don't create pointless variants
+	ShaderAnalysis::Uniforms uniforms;
+	Hash specialisedHash = hash;
+	const bool usesUniforms = info.uniformUsage.boolUniforms != 0 || info.uniformUsage.intUniforms != 0;
+	bool specialised = usesUniforms;
+
+	if (usesUniforms) {
+		uniforms.boolUniform = shaderUnit.boolUniform & info.uniformUsage.boolUniforms;
+		// Start from a nonzero value, so that the variant for all uniforms being 0 doesn't get the same hash as the generic shader
+		u64 signature = 0x243F6A8885A308D3ull ^ uniforms.boolUniform;
+
+		for (int i = 0; i < 4; i++) {
+			if (info.uniformUsage.intUniforms & (1u << i)) {
+				uniforms.intUniforms[i] = shaderUnit.intUniforms[i];
+			}
 
-	if (it == cache.end()) { // Block has not been compiled yet
-		auto emitter = std::make_unique<ShaderEmitter>();
-		emitter->compile(shaderUnit);
-		// Get pointer to callbacks
-		entrypointCallback = emitter->getInstructionCallback(shaderUnit.entrypoint);
-		prologueCallback = emitter->getPrologueCallback();
+			const auto& uniform = uniforms.intUniforms[i];
+			signature = (signature ^ (u32(uniform[0]) | (u32(uniform[1]) << 8) | (u32(uniform[2]) << 16))) * 0x9E3779B97F4A7C15ull;
+		}
 
-		cache.emplace_hint(it, hash, std::move(emitter));
-	} else { // Block has been compiled and found, use it
-		auto emitter = it->second.get();
-		entrypointCallback = emitter->getInstructionCallback(shaderUnit.entrypoint);
-		prologueCallback = emitter->getPrologueCallback();
+		specialisedHash = hash ^ std::rotl(signature, 32);
 	}
+
+	auto it = cache.find(specialisedHash);
+	if (it == cache.end() && usesUniforms && info.variantCount >= maxSpecialisedVariants) {
+		// The uniforms change too often, use the generic version instead
+		it = cache.find(hash);
+		specialisedHash = hash;
+		specialised = false;
+	}
+
+	if (it == cache.end()) {  // Block has not been compiled yet
+		stats.misses++;
+		// Count the new version before compiling, so evicting to make room for it can't make us forget the shader
+		info.cachedCount++;
+
+		if (specialised) {
+			info.variantCount++;
+			stats.specialisedCompiles++;
+			compile(shaderUnit, specialisedHash, hash, liveOutputs, &uniforms);
+		} else {
+			compile(shaderUnit, hash, hash, liveOutputs, nullptr);
+		}
+	} else {  // Block has been compiled and found, use it and mark it as the most recently used
+		stats.hits++;
+		lruList.splice(lruList.begin(), lruList, it->second);
+	}
+
+	const CachedShader& shader = lruList.front();
+	entrypointCallback = shader.entrypoint;
+	prologueCallback = shader.prologue;
+}
+
+void ShaderJIT::compile(PICAShader& shaderUnit, Hash hash, Hash baseHash, u64 liveOutputs, const ShaderAnalysis::Uniforms* specialisation) {
+	if (!arena.isInitialized()) {
+		arena.init(cacheBudget);
+		stats.budget = arena.getCapacity();
+	}
+
+	analysis.analyze(shaderUnit, shaderUnit.entrypoint, liveOutputs, specialisation);
+
+	// Reserve enough memory for the worst case, evicting shaders until it fits, and give back what we didn't use after compiling
+	const usize maxSize = ShaderEmitter::maxCodeSize(analysis);
+	u8* code = arena.allocate(maxSize);
+	while (code == nullptr) {
+		if (lruList.empty()) {
+			Helpers::panic("Shader JIT: Shader doesn't fit in the code arena");
+		}
+
+		evictLeastRecentlyUsed();
+		code = arena.allocate(maxSize);
+	}
+
+	arena.beginWrite();
+	auto emitter = std::make_unique<ShaderEmitter>(code, maxSize);
+	emitter->compile(shaderUnit, analysis);
+	const usize codeSize = emitter->getCodeSize();
+	arena.endWrite(code, codeSize);
+	arena.shrink(code, maxSize, codeSize);
+
+	// Get pointer to callbacks. The emitter itself isn't needed after this
+	lruList.push_front(CachedShader{
+		.hash = hash,
+		.baseHash = baseHash,
+		.specialised = specialisation != nullptr,
+		.code = code,
+		.codeSize = codeSize,
+		.prologue = emitter->getPrologueCallback(),
+		.entrypoint = emitter->getInstructionCallback(shaderUnit.entrypoint),
+	});
+	cache.emplace(hash, lruList.begin());
+
+	stats.compiledInstructions += analysis.reachableCount;
+	stats.deadInstructions += analysis.deadInstructionCount;
+	stats.shaderCount = cache.size();
+	stats.codeBytes = arena.getUsedBytes();
+}
+
+void ShaderJIT::evictLeastRecentlyUsed() {
+	const CachedShader& shader = lruList.back();
+	arena.free(shader.code, shader.codeSize);
+	cache.erase(shader.hash);
+
+	// Forget about shaders once none of their versions are cached, so shaderInfo doesn't keep growing with every shader we've ever seen.
+	// Evicted variants also stop counting towards the variant limit, so a shader gets to specialise on new values again
+	auto infoIt = shaderInfo.find(shader.baseHash);
+	if (infoIt != shaderInfo.end()) {
+		ShaderInfo& info = infoIt->second;
+		if (shader.specialised) {
+			info.variantCount--;
+		}
+
+		if (--info.cachedCount == 0) {
+			shaderInfo.erase(infoIt);
+		}
+	}
+
+	lruList.pop_back();
+
+	stats.evictions++;
+	stats.shaderCount = cache.size();
+	stats.codeBytes = arena.getUsedBytes();
 }
-#endif // PANDA3DS_SHADER_JIT_SUPPORTED
\ No newline at end of file
+#endif  // PANDA3DS_SHADER_JIT_SUPPORTED
@@ -1,6 +1,7 @@
 #if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_ARM64_HOST)
 #include "PICA/dynapica/shader_rec_emitter_arm64.hpp"
 
+#include <algorithm>
 #include <bit>
 
 using namespace Helpers;
@@ -26,8 +27,8 @@ static constexpr XReg scratch1 = X9;
 static constexpr XReg scratch2 = X10;
 static constexpr XReg statePointer = X15;
 
-void ShaderEmitter::compile(const PICAShader& shaderUnit) {
-	oaknut::CodeBlock::unprotect();  // Unprotect the memory before writing to it
+void ShaderEmitter::compile(const PICAShader& shaderUnit, const ShaderAnalysis& analysis) {
+	this->analysis = &analysis;
 
 	// Constants
 	align(16);
@@ -62,64 +63,53 @@ void ShaderEmitter::compile(const PICAShader& shaderUnit) {
 	// Jump to code with a tail call
 	BR(arg2);
 
-	// Scan the code for call, exp2, log2, etc instructions which need some special care
-	// After that, emit exp2 and log2 functions if the corresponding instructions are present
-	scanCode(shaderUnit);
-	if (codeHasExp2) {
+	// Emit exp2 and log2 functions if the corresponding instructions are reachable
+	if (analysis.hasExp2) {
 		exp2Func = emitExp2Func();
 	}
-	if (codeHasLog2) {
+	if (analysis.hasLog2) {
 		log2Func = emitLog2Func();
 	}
 
 	align(16);
-	// Compile every instruction in the shader
-	// This sounds horrible but the PICA instruction memory is tiny, and most of the time it's padded wtih nops that compile to nothing
+	// Compile every instruction that can be reached from the entrypoint, in program order
+	// Anything that can't be reached, like other entrypoints' code or the nops padding out the program memory, is skipped
 	recompilerPC = 0;
 	loopLevel = 0;
-	compileUntil(shaderUnit, PICAShader::maxInstructionCount);
-
-	// Protect the memory and invalidate icache before executing the code
-	oaknut::CodeBlock::protect();
-	oaknut::CodeBlock::invalidate_all();
+	compileUntil(shaderUnit, analysis.endPC);
 }
 
-void ShaderEmitter::scanCode(const PICAShader& shaderUnit) {
-	returnPCs.clear();
-
-	for (u32 i = 0; i < PICAShader::maxInstructionCount; i++) {
-		const u32 instruction = shaderUnit.loadedShader[i];
-		const u32 opcode = instruction >> 26;
-
-		if (isCall(instruction)) {
-			const u32 num = instruction & 0xff;
-			const u32 dest = getBits<10, 12>(instruction);
-			const u32 returnPC = num + dest;  // Add them to get the return PC
-
-			returnPCs.push_back(returnPC);
-		} else if (opcode == ShaderOpcodes::EX2) {
-			codeHasExp2 = true;
-		} else if (opcode == ShaderOpcodes::LG2) {
-			codeHasLog2 = true;
+void ShaderEmitter::compileUntil(const PICAShader& shaderUnit, u32 end) {
+	while (recompilerPC < end) {
+		// Return PCs still need their return check even if nothing else reaches them
+		if (analysis->isReachable(recompilerPC) || analysis->isReturnPC(recompilerPC)) {
+			compileInstruction(shaderUnit);
+		} else {
+			recompilerPC++;
 		}
 	}
-
-	// Sort return PCs so they can be binary searched
-	std::sort(returnPCs.begin(), returnPCs.end());
 }
 
-void ShaderEmitter::compileUntil(const PICAShader& shaderUnit, u32 end) {
-	while (recompilerPC < end) {
-		compileInstruction(shaderUnit);
+void ShaderEmitter::skipUntil(const PICAShader& shaderUnit, u32 end) {
+	if (!analysis->hasBranchTargets(recompilerPC, end)) {
+		recompilerPC = std::max(recompilerPC, end);
+		return;
 	}
+
+	Label skip;
+	B(skip);
+	compileUntil(shaderUnit, end);
+	l(skip);
 }
 
 void ShaderEmitter::compileInstruction(const PICAShader& shaderUnit) {
 	// Write current location to label for this instruction
-	l(instructionLabels[recompilerPC]);
+	if (bindLabels) {
+		l(instructionLabels[recompilerPC]);
+	}
 
 	// See if PC is a possible return PC and emit the proper code if so
-	if (std::binary_search(returnPCs.begin(), returnPCs.end(), recompilerPC)) {
+	if (analysis->isReturnPC(recompilerPC)) {
 		Label skipReturn;
 
 		LDP(X0, XZR, SP);       // W0 = Next return address
@@ -131,6 +121,14 @@ void ShaderEmitter::compileInstruction(const PICAShader& shaderUnit) {
 		l(skipReturn);
 	}
 
+	// If we only got here for the return check, the instruction itself can never run
+	// Same if the instruction only writes to register components that nothing uses afterwards
+	liveWriteMask = analysis->liveWriteMasks[recompilerPC];
+	if (!analysis->isReachable(recompilerPC) || liveWriteMask == 0) {
+		recompilerPC++;
+		return;
+	}
+
 	// Fetch instruction and inc PC
 	const u32 instruction = shaderUnit.loadedShader[recompilerPC++];
 	const u32 opcode = instruction >> 26;
@@ -413,7 +411,7 @@ void ShaderEmitter::storeRegister(QReg source, const PICAShader& shader, u32 des
 	const uintptr_t offset = uintptr_t(&destRef) - uintptr_t(&shader);  // Calculate offset of register from start of the state struct
 
 	// Mask of which lanes to write
-	u32 writeMask = operandDescriptor & 0xf;
+	u32 writeMask = operandDescriptor & liveWriteMask;
 	if (writeMask == 0xf) {  // No lanes are masked, just use STR
 		STR(source, statePointer, offset);
 	} else {
@@ -1043,6 +1041,13 @@ void ShaderEmitter::recCALLC(const PICAShader& shader, u32 instruction) {
 }
 
 void ShaderEmitter::recCALLU(const PICAShader& shader, u32 instruction) {
+	if (analysis->specialised) {
+		if (analysis->getBoolUniform(instruction)) {
+			recCALL(shader, instruction);
+		}
+		return;
+	}
+
 	Label skipCall;
 
 	// z is 0 if the call should be taken, 1 otherwise
@@ -1079,11 +1084,24 @@ void ShaderEmitter::recIFC(const PICAShader& shader, u32 instruction) {
 }
 
 void ShaderEmitter::recIFU(const PICAShader& shader, u32 instruction) {
-	// z is 0 if true, else 1
-	checkBoolUniform(shader, instruction);
 	const u32 num = instruction & 0xff;
 	const u32 dest = getBits<10, 12>(instruction);
 
+	// If we know the uniform's value, only compile the side that runs
+	if (analysis->specialised) {
+		if (analysis->getBoolUniform(instruction)) {
+			compileUntil(shader, dest);
+			skipUntil(shader, dest + num);
+		} else {
+			skipUntil(shader, dest);
+			compileUntil(shader, dest + num);
+		}
+		return;
+	}
+
+	// z is 0 if true, else 1
+	checkBoolUniform(shader, instruction);
+
 	if (dest < recompilerPC) {
 		Helpers::warn("Shader JIT: IFC instruction with dest < current PC\n");
 	}
@@ -1117,6 +1135,13 @@ void ShaderEmitter::recJMPU(const PICAShader& shader, u32 instruction) {
 	const u32 dest = getBits<10, 12>(instruction);
 
 	Label& l = instructionLabels[dest];
+	if (analysis->specialised) {
+		if (analysis->getBoolUniform(instruction) != jumpIfFalse) {
+			B(l);
+		}
+		return;
+	}
+
 	// Z is 0 if the uniform is true
 	checkBoolUniform(shader, instruction);
 
@@ -1152,14 +1177,37 @@ void ShaderEmitter::recLOOP(const PICAShader& shader, u32 instruction) {
 		Helpers::panic("[Shader JIT] Detected backwards loop\n");
 	}
 
-	loopLevel++;
-
 	// Offset of the uniform
 	const auto& uniform = shader.intUniforms[uniformIndex];
 	const uintptr_t uniformOffset = uintptr_t(&uniform[0]) - uintptr_t(&shader);
 	// Offset of the loop register
 	const uintptr_t loopRegOffset = uintptr_t(&shader.loopCounter) - uintptr_t(&shader);
 
+	// If the analysis knows the trip count and decided the loop is short enough, compile the body once per iteration with a constant aL
+	if (analysis->isUnrolledLoop(recompilerPC - 1)) {
+		const auto& values = analysis->uniforms.intUniforms[uniformIndex];
+		const u32 iterations = u32(values[0]) + 1;
+		const u32 bodyStart = recompilerPC;
+		u32 counter = values[1];
+
+		for (u32 i = 0; i < iterations; i++) {
+			MOV(W1, counter);
+			STR(W1, statePointer, loopRegOffset);
+			recompilerPC = bodyStart;
+			bindLabels = (i == 0);
+			compileUntil(shader, dest + 1);
+			counter += values[2];
+		}
+
+		// aL keeps its value after the loop is done
+		MOV(W1, counter);
+		STR(W1, statePointer, loopRegOffset);
+		bindLabels = true;
+		return;
+	}
+
+	loopLevel++;
+
 	LDRB(W0, statePointer, uniformOffset);                   // W0 = loop iteration count
 	LDRB(W1, statePointer, uniformOffset + sizeof(u8));      // W1 = initial loop counter value
 	LDRB(W2, statePointer, uniformOffset + 2 * sizeof(u8));  // W2 = Loop increment
@@ -37,7 +37,9 @@ static constexpr Reg64 statePointer = rdi;
 #error Unknown ABI for x86-64 shader JIT
 #endif
 
-void ShaderEmitter::compile(const PICAShader& shaderUnit) {
+void ShaderEmitter::compile(const PICAShader& shaderUnit, const ShaderAnalysis& analysis) {
+	this->analysis = &analysis;
+
 	// Constants
 	align(16);
 	L(negateVector);
@@ -62,56 +64,49 @@ void ShaderEmitter::compile(const PICAShader& shaderUnit) {
 	// Tail call to shader code entrypoint
 	jmp(arg2);
 
-	// Scan the code for call, exp2, log2, etc instructions which need some special care
-	// After that, emit exp2 and log2 functions if the corresponding instructions are present
-	scanCode(shaderUnit);
-	if (codeHasExp2) exp2Func = emitExp2Func();
-	if (codeHasLog2) log2Func = emitLog2Func();
+	// Emit exp2 and log2 functions if the corresponding instructions are reachable
+	if (analysis.hasExp2) exp2Func = emitExp2Func();
+	if (analysis.hasLog2) log2Func = emitLog2Func();
 
 	align(16);
-	// Compile every instruction in the shader
-	// This sounds horrible but the PICA instruction memory is tiny, and most of the time it's padded wtih nops that compile to nothing
+	// Compile every instruction that can be reached from the entrypoint, in program order
+	// Anything that can't be reached, like other entrypoints' code or the nops padding out the program memory, is skipped
 	recompilerPC = 0;
 	loopLevel = 0;
-	compileUntil(shaderUnit, PICAShader::maxInstructionCount);
+	compileUntil(shaderUnit, analysis.endPC);
 }
 
-void ShaderEmitter::scanCode(const PICAShader& shaderUnit) {
-	returnPCs.clear();
-
-	for (u32 i = 0; i < PICAShader::maxInstructionCount; i++) {
-		const u32 instruction = shaderUnit.loadedShader[i];
-		const u32 opcode = instruction >> 26;
-
-		if (isCall(instruction)) {
-			const u32 num = instruction & 0xff;
-			const u32 dest = getBits<10, 12>(instruction);
-			const u32 returnPC = num + dest; // Add them to get the return PC
-
-			returnPCs.push_back(returnPC);
-		} else if (opcode == ShaderOpcodes::EX2) {
-			codeHasExp2 = true;
-		} else if (opcode == ShaderOpcodes::LG2) {
-			codeHasLog2 = true;
+void ShaderEmitter::compileUntil(const PICAShader& shaderUnit, u32 end) {
+	while (recompilerPC < end) {
+		// Return PCs still need their return check even if nothing else reaches them
+		if (analysis->isReachable(recompilerPC) || analysis->isReturnPC(recompilerPC)) {
+			compileInstruction(shaderUnit);
+		} else {
+			recompilerPC++;
 		}
 	}
-
-	// Sort return PCs so they can be binary searched
-	std::sort(returnPCs.begin(), returnPCs.end());
 }
 
-void ShaderEmitter::compileUntil(const PICAShader& shaderUnit, u32 end) {
-	while (recompilerPC < end) {
-		compileInstruction(shaderUnit);
+void ShaderEmitter::skipUntil(const PICAShader& shaderUnit, u32 end) {
+	if (!analysis->hasBranchTargets(recompilerPC, end)) {
+		recompilerPC = std::max(recompilerPC, end);
+		return;
 	}
+
+	Label skip;
+	jmp(skip, T_NEAR);
+	compileUntil(shaderUnit, end);
+	L(skip);
 }
 
 void ShaderEmitter::compileInstruction(const PICAShader& shaderUnit) {
 	// Write current location to label for this instruction
-	L(instructionLabels[recompilerPC]);
+	if (bindLabels) {
+		L(instructionLabels[recompilerPC]);
+	}
 
 	// See if PC is a possible return PC and emit the proper code if so
-	if (std::binary_search(returnPCs.begin(), returnPCs.end(), recompilerPC)) {
+	if (analysis->isReturnPC(recompilerPC)) {
 		constexpr uintptr_t stackOffsetForPC = 8;
 
 		Label end;
@@ -123,6 +118,14 @@ void ShaderEmitter::compileInstruction(const PICAShader& shaderUnit) {
 		L(end);
 	}
 
+	// If we only got here for the return check, the instruction itself can never run
+	// Same if the instruction only writes to register components that nothing uses afterwards
+	liveWriteMask = analysis->liveWriteMasks[recompilerPC];
+	if (!analysis->isReachable(recompilerPC) || liveWriteMask == 0) {
+		recompilerPC++;
+		return;
+	}
+
 	// Fetch instruction and inc PC
 	const u32 instruction = shaderUnit.loadedShader[recompilerPC++];
 	const u32 opcode = instruction >> 26;
@@ -338,7 +341,7 @@ void ShaderEmitter::storeRegister(Xmm source, const PICAShader& shader, u32 dest
 	const uintptr_t offset = uintptr_t(&destRef) - uintptr_t(&shader); // Calculate offset of register from start of the state struct
 
 	// Mask of which lanes to write
-	u32 writeMask = operandDescriptor & 0xf;
+	u32 writeMask = operandDescriptor & liveWriteMask;
 	if (writeMask == 0xf) { // No lanes are masked, just movaps
 		movaps(xword[statePointer + offset], source);
 	} else if (std::popcount(writeMask) == 1) { // Only 1 register needs to be written back. This can be done with a simple shift right + movss
@@ -818,11 +821,24 @@ void ShaderEmitter::recIFC(const PICAShader& shader, u32 instruction) {
 }
 
 void ShaderEmitter::recIFU(const PICAShader& shader, u32 instruction) {
-	// z is 0 if true, else 1
-	checkBoolUniform(shader, instruction);
 	const u32 num = instruction & 0xff;
 	const u32 dest = getBits<10, 12>(instruction);
 
+	// If we know the uniform's value, only compile the side that runs
+	if (analysis->specialised) {
+		if (analysis->getBoolUniform(instruction)) {
+			compileUntil(shader, dest);
+			skipUntil(shader, dest + num);
+		} else {
+			skipUntil(shader, dest);
+			compileUntil(shader, dest + num);
+		}
+		return;
+	}
+
+	// z is 0 if true, else 1
+	checkBoolUniform(shader, instruction);
+
 	if (dest < recompilerPC) {
 		Helpers::warn("Shader JIT: IFC instruction with dest < current PC\n");
 	}
@@ -868,6 +884,13 @@ void ShaderEmitter::recCALLC(const PICAShader& shader, u32 instruction) {
 }
 
 void ShaderEmitter::recCALLU(const PICAShader& shader, u32 instruction) {
+	if (analysis->specialised) {
+		if (analysis->getBoolUniform(instruction)) {
+			recCALL(shader, instruction);
+		}
+		return;
+	}
+
 	Label skipCall;
 
 	// z is 0 if the call should be taken, 1 otherwise
@@ -892,6 +915,13 @@ void ShaderEmitter::recJMPU(const PICAShader& shader, u32 instruction) {
 	const u32 dest = getBits<10, 12>(instruction);
 
 	Label& l = instructionLabels[dest];
+	if (analysis->specialised) {
+		if (analysis->getBoolUniform(instruction) != jumpIfFalse) {
+			jmp(l, T_NEAR);
+		}
+		return;
+	}
+
 	// Z is 0 if the uniform is true
 	checkBoolUniform(shader, instruction);
 
@@ -914,14 +944,35 @@ void ShaderEmitter::recLOOP(const PICAShader& shader, u32 instruction) {
 		Helpers::panic("[Shader JIT] Detected backwards loop\n");
 	}
 
-	loopLevel++;
-
 	// Offset of the uniform
 	const auto& uniform = shader.intUniforms[uniformIndex];
 	const uintptr_t uniformOffset = uintptr_t(&uniform[0]) - uintptr_t(&shader);
 	// Offset of the loop register
 	const uintptr_t loopRegOffset = uintptr_t(&shader.loopCounter) - uintptr_t(&shader);
 
+	// If the analysis knows the trip count and decided the loop is short enough, compile the body once per iteration with a constant aL
+	if (analysis->isUnrolledLoop(recompilerPC - 1)) {
+		const auto& values = analysis->uniforms.intUniforms[uniformIndex];
+		const u32 iterations = u32(values[0]) + 1;
+		const u32 bodyStart = recompilerPC;
+		u32 counter = values[1];
+
+		for (u32 i = 0; i < iterations; i++) {
+			mov(dword[statePointer + loopRegOffset], counter);
+			recompilerPC = bodyStart;
+			bindLabels = (i == 0);
+			compileUntil(shader, dest + 1);
+			counter += values[2];
+		}
+
+		// aL keeps its value after the loop is done
+		mov(dword[statePointer + loopRegOffset], counter);
+		bindLabels = true;
+		return;
+	}
+
+	loopLevel++;
+
 	movzx(eax, byte[statePointer + uniformOffset]); // eax = loop iteration count
 	movzx(ecx, byte[statePointer + uniformOffset + sizeof(u8)]); // ecx = initial loop counter value
 	movzx(edx, byte[statePointer + uniformOffset + 2 * sizeof(u8)]); // edx = loop increment
@@ -0,0 +1,225 @@
+#include "PICA/dynapica/vertex_loader_rec.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include "PICA/pica_hash.hpp"
+
+#ifdef PANDA3DS_X64_HOST
+#include "PICA/dynapica/vertex_loader_rec_emitter_x64.hpp"
+#elif defined(PANDA3DS_ARM64_HOST)
+#include "PICA/dynapica/vertex_loader_rec_emitter_arm64.hpp"
+#endif
+
+u64 VertexLoaderJIT::Config::getHash() const {
+	// Serialize the config field by field so that struct padding doesn't end up in the hash
+	std::array<u32, 6 + maxAttribCount * 5> data;
+	usize i = 0;
+
+	data[i++] = u32(attribFormat);
+	data[i++] = u32(attribFormat >> 32);
+	data[i++] = u32(inputPermutation);
+	data[i++] = u32(inputPermutation >> 32);
+	data[i++] = totalAttribCount;
+	data[i++] = fixedAttribMask;
+
+	for (const auto& buffer : buffers) {
+		data[i++] = buffer.offset;
+		data[i++] = buffer.stride;
+		data[i++] = u32(buffer.config);
+		data[i++] = u32(buffer.config >> 32);
+		data[i++] = buffer.componentCount;
+	}
+
+	return PICAHash::computeHash(reinterpret_cast<const char*>(data.data()), sizeof(data));
+}
+
+void VertexLoaderJIT::getBufferSpans(const std::vector<LoadOp>& ops, std::vector<BufferSpan>& spans) {
+	spans.clear();
+	BufferSpan* span = nullptr;
+	// Padding aligns the address of each vertex separately, so we track the lowest and highest address the current attribute can start at
+	u64 lowAddress = 0;
+	u64 highAddress = 0;
+	u32 stride = 0;
+
+	for (const auto& op : ops) {
+		switch (op.type) {
+			case LoadOp::Type::BeginBuffer:
+				span = nullptr;
+				stride = op.stride;
+				lowAddress = highAddress = op.offset;
+				break;
+
+			case LoadOp::Type::Padding:
+				lowAddress += op.size;
+				highAddress += op.size + 3;
+				break;
+
+			case LoadOp::Type::Fetch: {
+				const u32 size = op.size * attribTypeSize(op.attribType);
+
+				// Skipped attributes don't get read
+				if (op.destination >= 0) {
+					if (span == nullptr) {
+						span = &spans.emplace_back(BufferSpan{.start = lowAddress, .end = highAddress + size, .stride = stride});
+					}
+
+					span->start = std::min(span->start, lowAddress);
+					span->end = std::max(span->end, highAddress + size);
+				}
+
+				lowAddress += size;
+				highAddress += size;
+				break;
+			}
+
+			case LoadOp::Type::Fixed: break;
+		}
+	}
+}
+
+// This mirrors the attribute fetching loop in GPU::drawArrays exactly, except we do it once per config instead of once per vertex
+bool VertexLoaderJIT::buildLoadOps(const Config& config, std::vector<LoadOp>& ops) {
+	ops.clear();
+	const u32 totalAttribCount = config.totalAttribCount;
+
+	// Attributes are permuted into shader input registers after being fetched. If multiple attributes map to the same register,
+	// the last one wins, so only that one needs to actually be written
+	std::array<s32, 16> registerOwner;
+	registerOwner.fill(-1);
+	for (u32 i = 0; i < totalAttribCount; i++) {
+		const u32 mapping = (config.inputPermutation >> (i * 4)) & 0xf;
+		registerOwner[mapping] = s32(i);
+	}
+
+	auto getDestination = [&](u32 attribute) -> s8 {
+		if (attribute >= totalAttribCount) {
+			return -1;
+		}
+
+		const u32 mapping = (config.inputPermutation >> (attribute * 4)) & 0xf;
+		return registerOwner[mapping] == s32(attribute) ? s8(mapping) : -1;
+	};
+
+	u32 attrCount = 0;
+	u32 buffer = 0;  // Vertex buffer index for non-fixed attributes
+
+	while (attrCount < totalAttribCount) {
+		if (config.fixedAttribMask & (1 << attrCount)) {
+			LoadOp op = {.type = LoadOp::Type::Fixed};
+			op.attribute = u8(attrCount);
+			op.destination = getDestination(attrCount);
+			ops.push_back(op);
+
+			attrCount++;
+			continue;
+		}
+
+		// Out of vertex buffers, this config is broken so leave it to the generic loader
+		if (buffer >= maxAttribCount) {
+			return false;
+		}
+
+		const auto& attr = config.buffers[buffer];
+		LoadOp begin = {.type = LoadOp::Type::BeginBuffer};
+		begin.offset = attr.offset;
+		begin.stride = attr.stride;
+		ops.push_back(begin);
+
+		for (u32 j = 0; j < attr.componentCount; j++) {
+			const u32 index = (attr.config >> (j * 4)) & 0xf;
+
+			// 12, 13, 14 and 15 are equivalent to 4, 8, 12 and 16 bytes of padding respectively
+			if (index >= 12) {
+				LoadOp padding = {.type = LoadOp::Type::Padding};
+				padding.size = u8((index - 11) << 2);
+				ops.push_back(padding);
+				continue;
+			}
+
+			// The generic loader only has room for 16 fetched attributes
+			if (attrCount >= 16) {
+				return false;
+			}
+
+			const u32 attribInfo = (config.attribFormat >> (index * 4)) & 0xf;
+			LoadOp fetch = {.type = LoadOp::Type::Fetch};
+			fetch.attribType = u8(attribInfo & 0x3);
+			fetch.size = u8((attribInfo >> 2) + 1);
+			fetch.attribute = u8(attrCount);
+			fetch.destination = getDestination(attrCount);
+			ops.push_back(fetch);
+
+			attrCount++;
+		}
+
+		buffer++;
+	}
+
+	return true;
+}
+
+#ifdef PANDA3DS_VERTEX_LOADER_JIT_SUPPORTED
+VertexLoaderJIT::VertexLoaderJIT() = default;
+VertexLoaderJIT::~VertexLoaderJIT() = default;
+
+void VertexLoaderJIT::reset() {
+	cache.clear();
+	activeLoader = nullptr;
+	activeSpans = nullptr;
+	activeHash = 0;
+}
+
+bool VertexLoaderJIT::prepare(const Config& config) {
+	const u64 hash = config.getHash();
+	// Consecutive draws very often share the same vertex format
+	if (activeLoader != nullptr && hash == activeHash) {
+		return true;
+	}
+
+	auto it = cache.find(hash);
+	if (it == cache.end()) {
+		if (!buildLoadOps(config, ops)) {
+			activeLoader = nullptr;
+			activeSpans = nullptr;
+			return false;
+		}
+
+		CompiledLoader loader;
+		loader.emitter = std::make_unique<VertexLoaderEmitter>();
+		loader.emitter->compile(ops);
+		getBufferSpans(ops, loader.spans);
+		it = cache.emplace_hint(it, hash, std::move(loader));
+	}
+
+	activeLoader = it->second.emitter->getCallback();
+	activeSpans = &it->second.spans;
+	activeHash = hash;
+	return true;
+}
+
+bool VertexLoaderJIT::getVertexDataRange(u32 minIndex, u32 maxIndex, u32& start, u32& size) const {
+	u64 rangeStart = std::numeric_limits<u64>::max();
+	u64 rangeEnd = 0;
+
+	for (const auto& span : *activeSpans) {
+		rangeStart = std::min(rangeStart, span.start + u64(minIndex) * span.stride);
+		rangeEnd = std::max(rangeEnd, span.end + u64(maxIndex) * span.stride);
+	}
+
+	// Every attribute is fixed or skipped, so nothing gets read
+	if (rangeEnd == 0) {
+		start = size = 0;
+		return true;
+	}
+
+	// The loaders calculate addresses in 32 bits, so anything bigger would wrap around
+	if (rangeEnd > std::numeric_limits<u32>::max()) {
+		return false;
+	}
+
+	start = u32(rangeStart);
+	size = u32(rangeEnd - rangeStart);
+	return true;
+}
+#endif  // PANDA3DS_VERTEX_LOADER_JIT_SUPPORTED
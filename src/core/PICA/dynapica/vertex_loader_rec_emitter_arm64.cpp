@@ -0,0 +1,160 @@
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_ARM64_HOST)
+#include "PICA/dynapica/vertex_loader_rec_emitter_arm64.hpp"
+
+using namespace oaknut;
+using namespace oaknut::util;
+
+// Register allocation. Arguments are passed in X0-X3 and everything else we touch is volatile
+static constexpr XReg inputsPointer = X0;
+static constexpr XReg fixedPointer = X1;
+static constexpr XReg dataPointer = X2;
+static constexpr WReg vertexIndex = W3;
+static constexpr WReg scratch1 = W9;
+static constexpr WReg address = W10;        // Offset of the current buffer position from the start of the vertex data
+static constexpr XReg addressPointer = X11;  // dataPointer + address
+static constexpr XReg fetchPointer = X12;    // Pointer to the attribute we're fetching
+static constexpr WReg scratch2 = W13;
+
+static constexpr u32 oneFloat = 0x3f800000;  // 1.0 in IEEE 754
+
+void VertexLoaderEmitter::compile(const std::vector<LoadOp>& ops) {
+	oaknut::CodeBlock::unprotect();  // Unprotect the memory before writing to it
+	callback = reinterpret_cast<VertexLoaderJIT::Callback>(oaknut::CodeBlock::ptr());
+
+	// Fetches within a buffer are at compile-time known offsets from addressPointer until we hit padding, which needs to align the
+	// address at runtime. So we only materialize the address when needed
+	u32 pendingOffset = 0;
+
+	for (const auto& op : ops) {
+		switch (op.type) {
+			case LoadOp::Type::BeginBuffer:
+				MOV(scratch1, op.stride);
+				MUL(address, vertexIndex, scratch1);
+				if (op.offset != 0) {
+					MOV(scratch1, op.offset);
+					ADD(address, address, scratch1);
+				}
+
+				ADD(addressPointer, dataPointer, address, UXTW);
+				pendingOffset = 0;
+				break;
+
+			case LoadOp::Type::Padding:
+				// Align attribute address up to a 4 byte boundary, then skip the padding
+				ADD(address, address, pendingOffset + 3);
+				AND(address, address, 0xFFFFFFFC);
+				ADD(address, address, op.size);
+				ADD(addressPointer, dataPointer, address, UXTW);
+				pendingOffset = 0;
+				break;
+
+			case LoadOp::Type::Fetch:
+				if (op.destination >= 0) {
+					if (pendingOffset != 0) {
+						ADD(fetchPointer, addressPointer, pendingOffset);
+					} else {
+						MOV(fetchPointer, addressPointer);
+					}
+
+					emitFetch(op);
+				}
+
+				pendingOffset += op.size * VertexLoaderJIT::attribTypeSize(op.attribType);
+				break;
+
+			case LoadOp::Type::Fixed: emitFixed(op); break;
+		}
+	}
+
+	RET();
+
+	// Protect the memory and invalidate icache before executing the code
+	oaknut::CodeBlock::protect();
+	oaknut::CodeBlock::invalidate_all();
+}
+
+void VertexLoaderEmitter::emitFetch(const LoadOp& op) {
+	const u32 typeSize = VertexLoaderJIT::attribTypeSize(op.attribType);
+	const u32 destOffset = u32(op.destination) * sizeof(VertexLoaderJIT::vec4f);
+
+	// Fast paths for full vec4 attributes, which read exactly as many bytes as the attribute takes up
+	if (op.size == 4) {
+		switch (op.attribType) {
+			case 0:
+				LDR(S0, fetchPointer);
+				SXTL(V0.H8(), V0.B8());
+				SXTL(V0.S4(), V0.H4());
+				SCVTF(V0.S4(), V0.S4());
+				break;
+
+			case 1:
+				LDR(S0, fetchPointer);
+				UXTL(V0.H8(), V0.B8());
+				UXTL(V0.S4(), V0.H4());
+				UCVTF(V0.S4(), V0.S4());
+				break;
+
+			case 2:
+				LDR(D0, fetchPointer);
+				SXTL(V0.S4(), V0.H4());
+				SCVTF(V0.S4(), V0.S4());
+				break;
+
+			case 3: LDR(Q0, fetchPointer); break;
+		}
+
+		STR(Q0, inputsPointer, destOffset);
+		return;
+	}
+
+	u32 component = 0;
+	for (; component < op.size; component++) {
+		const s32 srcOffset = s32(component * typeSize);
+		const u32 componentDest = destOffset + component * sizeof(float);
+
+		switch (op.attribType) {
+			case 0:
+				LDURSB(scratch2, fetchPointer, srcOffset);
+				SCVTF(S0, scratch2);
+				break;
+			case 1:
+				LDURB(scratch2, fetchPointer, srcOffset);
+				UCVTF(S0, scratch2);
+				break;
+			case 2:
+				LDURSH(scratch2, fetchPointer, srcOffset);
+				SCVTF(S0, scratch2);
+				break;
+			case 3: LDUR(scratch2, fetchPointer, srcOffset); break;
+		}
+
+		if (op.attribType == 3) {
+			STR(scratch2, inputsPointer, componentDest);
+		} else {
+			STR(S0, inputsPointer, componentDest);
+		}
+	}
+
+	// Fill the remaining attribute lanes with default parameters (1.0 for alpha/w, 0.0 for everything else)
+	for (; component < 4; component++) {
+		const u32 componentDest = destOffset + component * sizeof(float);
+
+		if (component == 3) {
+			MOV(scratch2, oneFloat);
+			STR(scratch2, inputsPointer, componentDest);
+		} else {
+			STR(WZR, inputsPointer, componentDest);
+		}
+	}
+}
+
+void VertexLoaderEmitter::emitFixed(const LoadOp& op) {
+	if (op.destination < 0) {
+		return;
+	}
+
+	LDR(Q0, fixedPointer, u32(op.attribute) * sizeof(VertexLoaderJIT::vec4f));
+	STR(Q0, inputsPointer, u32(op.destination) * sizeof(VertexLoaderJIT::vec4f));
+}
+
+#endif
@@ -0,0 +1,103 @@
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_X64_HOST)
+#include "PICA/dynapica/vertex_loader_rec_emitter_x64.hpp"
+
+using namespace Xbyak;
+using namespace Xbyak::util;
+
+// Register allocation. Everything here is volatile in both the SysV and MS ABIs so we don't need to save anything
+static const Reg64 inputsPointer = arg1.cvt64();
+static const Reg64 fixedPointer = arg2.cvt64();
+static const Reg64 dataPointer = arg3.cvt64();
+static const Reg32 vertexIndex = arg4;
+static constexpr Reg32 address = eax;  // Offset of the current attribute from the start of the vertex data
+static constexpr Reg32 scratch = r10d;
+
+static constexpr u32 oneFloat = 0x3f800000;  // 1.0 in IEEE 754
+
+void VertexLoaderEmitter::compile(const std::vector<LoadOp>& ops) {
+	for (const auto& op : ops) {
+		switch (op.type) {
+			case LoadOp::Type::BeginBuffer:
+				imul(address, vertexIndex, int(op.stride));
+				if (op.offset != 0) {
+					add(address, op.offset);
+				}
+				break;
+
+			case LoadOp::Type::Padding:
+				// Align attribute address up to a 4 byte boundary, then skip the padding
+				add(address, 3);
+				and_(address, -4);
+				add(address, op.size);
+				break;
+
+			case LoadOp::Type::Fetch: emitFetch(op); break;
+			case LoadOp::Type::Fixed: emitFixed(op); break;
+		}
+	}
+
+	ret();
+}
+
+void VertexLoaderEmitter::emitFetch(const LoadOp& op) {
+	const u32 typeSize = VertexLoaderJIT::attribTypeSize(op.attribType);
+
+	// Attributes that don't end up in an input register only need to be skipped over
+	if (op.destination >= 0) {
+		const auto src = dataPointer + address.cvt64();
+		const auto dest = inputsPointer + op.destination * sizeof(VertexLoaderJIT::vec4f);
+
+		// Fast paths for full vec4 attributes, which read exactly as many bytes as the attribute takes up
+		if (op.size == 4 && op.attribType == 3) {
+			movups(xmm0, xword[src]);
+			movaps(xword[dest], xmm0);
+		} else if (op.size == 4 && haveSSE4_1) {
+			switch (op.attribType) {
+				case 0: pmovsxbd(xmm0, dword[src]); break;
+				case 1: pmovzxbd(xmm0, dword[src]); break;
+				case 2: pmovsxwd(xmm0, qword[src]); break;
+			}
+
+			cvtdq2ps(xmm0, xmm0);
+			movaps(xword[dest], xmm0);
+		} else {
+			u32 component = 0;
+			for (; component < op.size; component++) {
+				const auto componentSrc = src + component * typeSize;
+				const auto componentDest = dest + component * sizeof(float);
+
+				switch (op.attribType) {
+					case 0: movsx(scratch, byte[componentSrc]); break;
+					case 1: movzx(scratch, byte[componentSrc]); break;
+					case 2: movsx(scratch, word[componentSrc]); break;
+					case 3: mov(scratch, dword[componentSrc]); break;
+				}
+
+				if (op.attribType == 3) {
+					mov(dword[componentDest], scratch);
+				} else {
+					cvtsi2ss(xmm0, scratch);
+					movss(dword[componentDest], xmm0);
+				}
+			}
+
+			// Fill the remaining attribute lanes with default parameters (1.0 for alpha/w, 0.0 for everything else)
+			for (; component < 4; component++) {
+				mov(dword[dest + component * sizeof(float)], component == 3 ? oneFloat : 0);
+			}
+		}
+	}
+
+	add(address, op.size * typeSize);
+}
+
+void VertexLoaderEmitter::emitFixed(const LoadOp& op) {
+	if (op.destination < 0) {
+		return;
+	}
+
+	movaps(xmm0, xword[fixedPointer + op.attribute * sizeof(VertexLoaderJIT::vec4f)]);
+	movaps(xword[inputsPointer + op.destination * sizeof(VertexLoaderJIT::vec4f)], xmm0);
+}
+
+#endif
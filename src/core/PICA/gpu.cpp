@@ -1,9 +1,13 @@
 #include "PICA/gpu.hpp"
 
+#include <algorithm>
 #include <array>
 #include <bitset>
+#include <chrono>
 #include <cstddef>
 #include <cstdio>
+#include <limits>
+#include <tuple>
 
 #include "PICA/float_types.hpp"
 #include "PICA/regs.hpp"
@@ -27,8 +31,10 @@ using namespace Floats;
 // Note: For when we have multiple backends, the GL state manager can stay here and have the constructor for the Vulkan-or-whatever renderer ignore it
 // Thus, our GLStateManager being here does not negatively impact renderer-agnosticness
 GPU::GPU(Memory& mem, EmulatorConfig& config) : mem(mem), config(config) {
+	dirtyRegs.fill(~0ull);
 	vram = new u8[vramSize];
 	mem.setVRAM(vram);  // Give the bus a pointer to our VRAM
+	shaderJIT.setCacheBudget(usize(config.shaderJitCacheBudgetMB) * 1_MB);
 
 	switch (config.rendererType) {
 		case RendererType::Null: {
@@ -37,13 +43,16 @@ GPU::GPU(Memory& mem, EmulatorConfig& config) : mem(mem), config(config) {
 		}
 
 		case RendererType::Software: {
-			renderer.reset(new RendererSw(*this, regs, externalRegs));
+			renderer.reset(new RendererSw(*this, regs, externalRegs, u32(config.softwareRendererThreadCount), config.fragmentJitEnabled));
 			break;
 		}
 
 #ifdef PANDA3DS_ENABLE_OPENGL
 		case RendererType::OpenGL: {
-			renderer.reset(new RendererGL(*this, regs, externalRegs));
+			renderer.reset(new RendererGL(
+				*this, regs, externalRegs, usize(config.textureCacheBudgetMB) * 1_MB, u32(config.textureDecodeThreadCount),
+				config.useUbershaders
+			));
 			break;
 		}
 #endif
@@ -58,15 +67,36 @@ GPU::GPU(Memory& mem, EmulatorConfig& config) : mem(mem), config(config) {
 			break;
 		}
 	}
+
+	if (config.vertexShaderThreadCount > 0) {
+		vertexThreadPool = std::make_unique<ThreadPool>(u32(config.vertexShaderThreadCount));
+
+		// The calling thread works on jobs too, so we need a shader unit for it as well
+		for (u32 i = 0; i < vertexThreadPool->threadCount(); i++) {
+			workerShaders.push_back(std::make_unique<PICAShader>(ShaderType::Vertex));
+		}
+
+		// Indices are at most 16-bit, so this covers every possible vertex index
+		indexSlot.resize(65536);
+		indexSlotGeneration.resize(65536, 0);
+		uniqueVertices.resize(Renderer::vertexBufferSize);
+	}
 }
 
 void GPU::reset() {
+	syncThread();
+	threadingDecided = false;
+	traceRecorder.reset();
+	pendingTraceFrames = 0;
+
 	regs.fill(0);
 	shaderUnit.reset();
 	shaderJIT.reset();
+	vertexLoaderJIT.reset();
 	std::memset(vram, 0, vramSize);
 	lightingLUT.fill(0);
-	lightingLUTDirty = true;
+	lightingLUTDirty.markAllDirty();
+	dirtyRegs.fill(~0ull);
 
 	totalAttribCount = 0;
 	fixedAttribMask = 0;
@@ -111,7 +141,9 @@ void GPU::reset() {
 // Call the correct version of drawArrays based on whether this is an indexed draw (first template parameter)
 // And whether we are going to use the shader JIT (second template parameter)
 void GPU::drawArrays(bool indexed) {
+	PROFILE_SCOPE(VertexShading);
 	const bool shaderJITEnabled = ShaderJIT::isAvailable() && config.shaderJitEnabled;
+	const auto startTime = drawTimings != nullptr ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
 
 	if (indexed) {
 		if (shaderJITEnabled)
@@ -124,14 +156,38 @@ void GPU::drawArrays(bool indexed) {
 		else
 			drawArrays<false, false>();
 	}
+
+	if (drawTimings != nullptr) [[unlikely]] {
+		const auto elapsed = std::chrono::steady_clock::now() - startTime;
+		drawTimings->push_back(u64(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+	}
 }
 
 static std::array<PICA::Vertex, Renderer::vertexBufferSize> vertices;
 
+VertexLoaderJIT::Config GPU::getVertexLoaderConfig() {
+	VertexLoaderJIT::Config config;
+	config.attribFormat = u64(regs[PICA::InternalRegs::AttribFormatLow]) | (u64(regs[PICA::InternalRegs::AttribFormatHigh]) << 32);
+	config.inputPermutation = getVertexShaderInputConfig();
+	config.totalAttribCount = totalAttribCount;
+	config.fixedAttribMask = fixedAttribMask;
+
+	for (u32 i = 0; i < maxAttribCount; i++) {
+		auto& buffer = config.buffers[i];
+		buffer.offset = attributeInfo[i].offset;
+		buffer.stride = u32(attributeInfo[i].size);
+		buffer.config = attributeInfo[i].getConfigFull();
+		buffer.componentCount = attributeInfo[i].componentCount;
+	}
+
+	return config;
+}
+
 template <bool indexed, bool useShaderJIT>
 void GPU::drawArrays() {
 	if constexpr (useShaderJIT) {
-		shaderJIT.prepare(shaderUnit.vs);
+		const u32 outputCount = regs[PICA::InternalRegs::ShaderOutputCount] & 7;
+		shaderJIT.prepare(shaderUnit.vs, ShaderAnalysis::getLiveOutputs(outputCount, &regs[PICA::InternalRegs::ShaderOutmap0]));
 	}
 
 	// Base address for vertex attributes
@@ -154,10 +210,6 @@ void GPU::drawArrays() {
 	u32 indexBufferPointer = vertexBase + (indexBufferConfig & 0xfffffff);
 	bool shortIndex = Helpers::getBit<31>(indexBufferConfig);  // Indicates whether vert indices are 16-bit or 8-bit
 
-	// Stuff the global attribute config registers in one u64 to make attr parsing easier
-	// TODO: Cache this when the vertex attribute format registers are written to
-	u64 vertexCfg = u64(regs[PICA::InternalRegs::AttribFormatLow]) | (u64(regs[PICA::InternalRegs::AttribFormatHigh]) << 32);
-
 	if constexpr (!indexed) {
 		u32 offset = regs[PICA::InternalRegs::VertexOffsetReg];
 		log("PICA::DrawArrays(vertex count = %d, vertexOffset = %d)\n", vertexCount, offset);
@@ -167,7 +219,31 @@ void GPU::drawArrays() {
 
 	// Total number of input attributes to shader. Differs between GS and VS. Currently stubbed to the VS one, as we don't have geometry shaders.
 	const u32 inputAttrCount = (regs[PICA::InternalRegs::VertexShaderInputBufferCfg] & 0xf) + 1;
-	const u64 inputAttrCfg = getVertexShaderInputConfig();
+
+	// Run the vertex shader on the host GPU if the renderer can translate it. Otherwise we shade vertices on the CPU like usual
+	if (config.accelerateShaders && drawArraysAccelerated(primType, indexed, vertexBase, vertexCount, indexBufferPointer, shortIndex)) {
+		return;
+	}
+
+	// Try to get a recompiled vertex loader for the current attribute config. If we can't, use the generic loader below
+	bool useVertexLoaderJIT = VertexLoaderJIT::isAvailable() && config.vertexLoaderJitEnabled && vertexLoaderJIT.prepare(getVertexLoaderConfig());
+	const u8* vertexData = nullptr;
+
+	if (useVertexLoaderJIT) {
+		// Only fetch the vertex data pointer if any attribute actually comes from a buffer, as the base address is garbage otherwise
+		const u32 attribMask = (1u << totalAttribCount) - 1;
+		if ((fixedAttribMask & attribMask) != attribMask) {
+			vertexData = getVertexLoaderData(indexed, vertexBase, vertexCount, indexBufferPointer, shortIndex);
+			useVertexLoaderJIT = vertexData != nullptr;
+		}
+	}
+
+	// Big draws get split up across the vertex processing threads, if we have any
+	if (vertexThreadPool != nullptr && vertexCount >= minParallelVertexCount) {
+		drawArraysParallel<indexed, useShaderJIT>(vertexBase, vertexCount, indexBufferPointer, shortIndex, vertexData, useVertexLoaderJIT);
+		drawVertices(primType, std::span(vertices).first(vertexCount));
+		return;
+	}
 
 	// When doing indexed rendering, we have a cache of vertices to avoid processing attributes and shaders for a single vertex many times
 	constexpr bool vertexCacheEnabled = true;
@@ -214,127 +290,374 @@ void GPU::drawArrays() {
 			}
 		}
 
-		int attrCount = 0;
-		int buffer = 0;  // Vertex buffer index for non-fixed attributes
+		processVertex<useShaderJIT>(shaderUnit.vs, vertexBase, vertexData, useVertexLoaderJIT, vertexIndex, vertices[i]);
+	}
 
-		while (attrCount < totalAttribCount) {
-			// Check if attribute is fixed or not
-			if (fixedAttribMask & (1 << attrCount)) {                         // Fixed attribute
-				vec4f& fixedAttr = shaderUnit.vs.fixedAttributes[attrCount];  // TODO: Is this how it works?
-				vec4f& inputAttr = currentAttributes[attrCount];
-				std::memcpy(&inputAttr, &fixedAttr, sizeof(vec4f));  // Copy fixed attr to input attr
-				attrCount++;
-			} else {                                 // Non-fixed attribute
-				auto& attr = attributeInfo[buffer];  // Get information for this attribute
-				u64 attrCfg = attr.getConfigFull();  // Get config1 | (config2 << 32)
-				u32 attrAddress = vertexBase + attr.offset + (vertexIndex * attr.size);
-
-				for (int j = 0; j < attr.componentCount; j++) {
-					uint index = (attrCfg >> (j * 4)) & 0xf;  // Get index of attribute in vertexCfg
-
-					// Vertex attributes used as padding
-					// 12, 13, 14 and 15 are equivalent to 4, 8, 12 and 16 bytes of padding respectively
-					if (index >= 12) [[unlikely]] {
-						// Align attribute address up to a 4 byte boundary
-						attrAddress = (attrAddress + 3) & -4;
-						attrAddress += (index - 11) << 2;
-						continue;
-					}
+	drawVertices(primType, std::span(vertices).first(vertexCount));
+}
 
-					u32 attribInfo = (vertexCfg >> (index * 4)) & 0xf;
-					u32 attribType = attribInfo & 0x3;  //  Type of attribute(sbyte/ubyte/short/float)
-					u32 size = (attribInfo >> 2) + 1;   // Total number of components
-
-					// printf("vertex_attribute_strides[%d] = %d\n", attrCount, attr.size);
-					vec4f& attribute = currentAttributes[attrCount];
-					uint component;  // Current component
-
-					switch (attribType) {
-						case 0: {  // Signed byte
-							s8* ptr = getPointerPhys<s8>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = static_cast<float>(*ptr++);
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(s8);
-							break;
-						}
+template <bool useShaderJIT>
+void GPU::processVertex(PICAShader& shader, u32 vertexBase, const u8* vertexData, bool useVertexLoaderJIT, u32 vertexIndex, PICA::Vertex& out) {
+	if (useVertexLoaderJIT) {
+		// The recompiled loader fetches the attributes and permutes them into the input registers in one go
+		vertexLoaderJIT.loadVertex(shader.inputs.data(), shader.fixedAttributes.data(), vertexData, vertexIndex);
+	} else {
+		loadVertexAttributes(shader, vertexBase, vertexIndex);
+	}
 
-						case 1: {  // Unsigned byte
-							u8* ptr = getPointerPhys<u8>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = static_cast<float>(*ptr++);
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(u8);
-							break;
-						}
+	if constexpr (useShaderJIT) {
+		shaderJIT.run(shader);
+	} else {
+		shader.run();
+	}
 
-						case 2: {  // Short
-							s16* ptr = getPointerPhys<s16>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = static_cast<float>(*ptr++);
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(s16);
-							break;
-						}
+	// Map shader outputs to fixed function properties
+	const u32 totalShaderOutputs = regs[PICA::InternalRegs::ShaderOutputCount] & 7;
+	for (int i = 0; i < totalShaderOutputs; i++) {
+		const u32 config = regs[PICA::InternalRegs::ShaderOutmap0 + i];
 
-						case 3: {  // Float
-							float* ptr = getPointerPhys<float>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = *ptr++;
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(float);
-							break;
-						}
+		for (int j = 0; j < 4; j++) {  // pls unroll
+			const u32 mapping = (config >> (j * 8)) & 0x1F;
+			out.raw[mapping] = shader.outputs[i][j];
+		}
+	}
+}
 
-						default: Helpers::panic("[PICA] Unimplemented attribute type %d", attribType);
-					}
+// Vertices are independent of each other, so we can shade them in any order on any thread as long as every thread has its own copy
+// of the shader unit. For indexed draws we first collect the unique indices, so that every vertex gets shaded exactly once no matter
+// how the index buffer is laid out, and then scatter the results to the final vertex buffer
+template <bool indexed, bool useShaderJIT>
+void GPU::drawArraysParallel(u32 vertexBase, u32 vertexCount, u32 indexBufferPointer, bool shortIndex, const u8* vertexData, bool useVertexLoaderJIT) {
+	u32 shadedCount = vertexCount;
+	PICA::Vertex* shadedVertices = vertices.data();
+
+	if constexpr (indexed) {
+		// Validate the whole index buffer once instead of on every index
+		const u8* indexBuffer = getPointerPhys<u8>(indexBufferPointer, vertexCount * (shortIndex ? 2 : 1));
+
+		// Bump the generation instead of clearing the slot table on every draw. On wraparound the stale entries could alias, so clear them
+		if (++dedupGeneration == 0) {
+			std::fill(indexSlotGeneration.begin(), indexSlotGeneration.end(), 0);
+			dedupGeneration = 1;
+		}
+
+		uniqueIndices.clear();
+		uniqueSlots.resize(vertexCount);
+
+		for (u32 i = 0; i < vertexCount; i++) {
+			u32 vertexIndex;
+			if (shortIndex) {
+				u16 index;
+				std::memcpy(&index, indexBuffer + i * sizeof(u16), sizeof(u16));
+				vertexIndex = index;
+			} else {
+				vertexIndex = indexBuffer[i];
+			}
+
+			if (indexSlotGeneration[vertexIndex] != dedupGeneration) {
+				indexSlotGeneration[vertexIndex] = dedupGeneration;
+				indexSlot[vertexIndex] = u32(uniqueIndices.size());
+				uniqueIndices.push_back(vertexIndex);
+			}
+
+			uniqueSlots[i] = indexSlot[vertexIndex];
+		}
+
+		shadedCount = u32(uniqueIndices.size());
+		shadedVertices = uniqueVertices.data();
+	}
+
+	const u32 maxJobs = std::max<u32>(1, shadedCount / minVerticesPerThread);
+	const u32 jobCount = std::min<u32>(u32(workerShaders.size()), maxJobs);
+	const u32 verticesPerJob = (shadedCount + jobCount - 1) / jobCount;
+	const u32 vertexOffset = regs[PICA::InternalRegs::VertexOffsetReg];
+
+	vertexThreadPool->parallelFor(jobCount, [&](u32 job) {
+		PICAShader& shader = *workerShaders[job];
+		shader.copyExecutionState(shaderUnit.vs);
+
+		const u32 begin = job * verticesPerJob;
+		const u32 end = std::min(begin + verticesPerJob, shadedCount);
+
+		for (u32 i = begin; i < end; i++) {
+			const u32 vertexIndex = indexed ? uniqueIndices[i] : (i + vertexOffset);
+			processVertex<useShaderJIT>(shader, vertexBase, vertexData, useVertexLoaderJIT, vertexIndex, shadedVertices[i]);
+		}
+	});
+
+	if constexpr (indexed) {
+		for (u32 i = 0; i < vertexCount; i++) {
+			vertices[i] = uniqueVertices[uniqueSlots[i]];
+		}
+	}
+}
+
+std::pair<u32, u32> GPU::getIndexRange(bool indexed, u32 vertexCount, const u8* indexData, bool shortIndex) {
+	if (!indexed) {
+		const u32 minIndex = regs[PICA::InternalRegs::VertexOffsetReg];
+		return {minIndex, minIndex + vertexCount - 1};
+	}
+
+	u32 minIndex = 0xffff;
+	u32 maxIndex = 0;
+
+	for (u32 i = 0; i < vertexCount; i++) {
+		u32 index;
+		if (shortIndex) {
+			u16 shortValue;
+			std::memcpy(&shortValue, indexData + i * sizeof(u16), sizeof(u16));
+			index = shortValue;
+		} else {
+			index = indexData[i];
+		}
+
+		minIndex = std::min(minIndex, index);
+		maxIndex = std::max(maxIndex, index);
+	}
+
+	return {minIndex, maxIndex};
+}
+
+const u8* GPU::getVertexLoaderData(bool indexed, u32 vertexBase, u32 vertexCount, u32 indexBufferPointer, bool shortIndex) {
+	if (vertexCount == 0) {
+		return nullptr;
+	}
+
+	const u8* indexData = nullptr;
+	if (indexed) {
+		const u32 indexBufferSize = vertexCount * (shortIndex ? 2 : 1);
+		if (!isPhysicalRangeValid(indexBufferPointer, indexBufferSize)) {
+			return nullptr;
+		}
 
-					// Fill the remaining attribute lanes with default parameters (1.0 for alpha/w, 0.0) for everything else
-					// Corgi does this although I'm not sure if it's actually needed for anything.
-					// TODO: Find out
-					while (component < 4) {
-						attribute[component] = (component == 3) ? f24::fromFloat32(1.0) : f24::fromFloat32(0.0);
-						component++;
+		indexData = getPointerPhys<u8>(indexBufferPointer, indexBufferSize);
+	}
+
+	const auto [minIndex, maxIndex] = getIndexRange(indexed, vertexCount, indexData, shortIndex);
+	u32 start, size;
+	if (!vertexLoaderJIT.getVertexDataRange(minIndex, maxIndex, start, size) || u64(vertexBase) + start > std::numeric_limits<u32>::max() ||
+		!isPhysicalRangeValid(vertexBase + start, size)) {
+		return nullptr;
+	}
+
+	// The loader addresses vertices relative to the vertex base, which is in the same region as the range we validated
+	return getPointerPhys<u8>(vertexBase + start, size) - start;
+}
+
+bool GPU::drawArraysAccelerated(PICA::PrimType primType, bool indexed, u32 vertexBase, u32 vertexCount, u32 indexBufferPointer, bool shortIndex) {
+	// Reuse the vertex loader JIT's analysis of the attribute config to figure out where each attribute lives in the vertex data
+	if (!VertexLoaderJIT::buildLoadOps(getVertexLoaderConfig(), acceleratedLoadOps)) {
+		return false;
+	}
+
+	PICA::DrawAcceleration accel;
+	accel.shader = &shaderUnit.vs;
+	accel.indexed = indexed;
+	accel.shortIndex = shortIndex;
+	accel.vertexCount = vertexCount;
+
+	if (indexed) {
+		// Bad index buffer pointers fall back to the CPU path, which skips the draw instead of crashing
+		const u32 indexBufferSize = vertexCount * (shortIndex ? 2 : 1);
+		if (!isPhysicalRangeValid(indexBufferPointer, indexBufferSize)) {
+			return false;
+		}
+
+		accel.indexData = getPointerPhys<u8>(indexBufferPointer, indexBufferSize);
+	}
+
+	std::tie(accel.minIndex, accel.maxIndex) = getIndexRange(indexed, vertexCount, accel.indexData, shortIndex);
+
+	// Offsets of the attributes from the vertex base, for vertex #0
+	std::array<u32, 16> attributeOffsets;
+	u32 bufferOffset = 0;
+	u32 bufferStride = 0;
+	u32 offset = 0;  // Offset of the current attribute from the start of the vertex in the current buffer
+	// Range of the vertex data we need to upload, relative to the vertex base. 64-bit so garbage indices and strides can't wrap around
+	u64 dataStart = std::numeric_limits<u64>::max();
+	u64 dataEnd = 0;
+
+	for (const auto& op : acceleratedLoadOps) {
+		switch (op.type) {
+			case VertexLoaderJIT::LoadOp::Type::BeginBuffer:
+				bufferOffset = op.offset;
+				bufferStride = op.stride;
+				offset = 0;
+				break;
+
+			case VertexLoaderJIT::LoadOp::Type::Padding:
+				// Padding aligns the attribute address, so we can only turn it into a fixed offset if every vertex is aligned the same way
+				if ((bufferOffset & 3) != 0 || (bufferStride & 3) != 0) {
+					return false;
+				}
+
+				offset = ((offset + 3) & ~3u) + op.size;
+				break;
+
+			case VertexLoaderJIT::LoadOp::Type::Fetch: {
+				const u32 size = op.size * VertexLoaderJIT::attribTypeSize(op.attribType);
+
+				if (op.destination >= 0) {
+					// A stride of 0 means every vertex reads the same data, which host vertex attributes can't express
+					if (bufferStride == 0) {
+						return false;
 					}
 
-					attrCount++;
+					auto& attribute = accel.attributes[accel.attributeCount];
+					attribute.stride = bufferStride;
+					attribute.type = op.attribType;
+					attribute.componentCount = op.size;
+					attribute.inputRegister = u8(op.destination);
+					attributeOffsets[accel.attributeCount++] = bufferOffset + offset;
+
+					dataStart = std::min(dataStart, u64(bufferOffset) + offset + u64(accel.minIndex) * bufferStride);
+					dataEnd = std::max(dataEnd, u64(bufferOffset) + offset + u64(accel.maxIndex) * bufferStride + size);
 				}
-				buffer++;
+
+				offset += size;
+				break;
 			}
+
+			case VertexLoaderJIT::LoadOp::Type::Fixed:
+				if (op.destination >= 0) {
+					auto& attribute = accel.fixedAttributes[accel.fixedAttributeCount++];
+					attribute.inputRegister = u8(op.destination);
+					for (int i = 0; i < 4; i++) {
+						attribute.value[i] = shaderUnit.vs.fixedAttributes[op.attribute][i].toFloat32();
+					}
+				}
+				break;
 		}
+	}
 
-		// Before running the shader, the PICA maps the fetched attributes from the attribute registers to the shader input registers
-		// Based on the SH_ATTRIBUTES_PERMUTATION registers.
-		// Ie it might attribute #0 to v2, #1 to v7, etc
-		for (int j = 0; j < totalAttribCount; j++) {
-			const u32 mapping = (inputAttrCfg >> (j * 4)) & 0xf;
-			std::memcpy(&shaderUnit.vs.inputs[mapping], &currentAttributes[j], sizeof(vec4f));
+	if (accel.attributeCount != 0) {
+		// Same checks as the vertex loader JIT does on the CPU path. Vertex data that's out of bounds goes through the CPU path instead
+		const u64 dataAddress = u64(vertexBase) + dataStart;
+		const u64 dataSize = dataEnd - dataStart;
+		if (dataAddress + dataSize > u64(std::numeric_limits<u32>::max()) + 1 || !isPhysicalRangeValid(u32(dataAddress), u32(dataSize))) {
+			return false;
 		}
 
-		if constexpr (useShaderJIT) {
-			shaderJIT.run(shaderUnit.vs);
-		} else {
-			shaderUnit.vs.run();
+		accel.vertexDataSize = u32(dataSize);
+		accel.vertexData = getPointerPhys<u8>(u32(dataAddress), accel.vertexDataSize);
+
+		for (u32 i = 0; i < accel.attributeCount; i++) {
+			auto& attribute = accel.attributes[i];
+			attribute.offset = u32(attributeOffsets[i] + u64(accel.minIndex) * attribute.stride - dataStart);
 		}
+	}
+
+	PROFILE_SCOPE(Renderer);
+	return renderer->drawVerticesAccelerated(primType, accel);
+}
+
+// Generic vertex loader, used when the vertex loader JIT is unavailable or disabled
+void GPU::loadVertexAttributes(PICAShader& shader, u32 vertexBase, u32 vertexIndex) {
+	std::array<vec4f, 16> currentAttributes;  // Vertex attributes before being passed to the shader
+	// Stuff the global attribute config registers in one u64 to make attr parsing easier
+	const u64 vertexCfg = u64(regs[PICA::InternalRegs::AttribFormatLow]) | (u64(regs[PICA::InternalRegs::AttribFormatHigh]) << 32);
+	const u64 inputAttrCfg = getVertexShaderInputConfig();
+
+	int attrCount = 0;
+	int buffer = 0;  // Vertex buffer index for non-fixed attributes
+
+	while (attrCount < totalAttribCount) {
+		// Check if attribute is fixed or not
+		if (fixedAttribMask & (1 << attrCount)) {                         // Fixed attribute
+			vec4f& fixedAttr = shader.fixedAttributes[attrCount];  // TODO: Is this how it works?
+			vec4f& inputAttr = currentAttributes[attrCount];
+			std::memcpy(&inputAttr, &fixedAttr, sizeof(vec4f));  // Copy fixed attr to input attr
+			attrCount++;
+		} else {                                 // Non-fixed attribute
+			auto& attr = attributeInfo[buffer];  // Get information for this attribute
+			u64 attrCfg = attr.getConfigFull();  // Get config1 | (config2 << 32)
+			u32 attrAddress = vertexBase + attr.offset + (vertexIndex * attr.size);
+
+			for (int j = 0; j < attr.componentCount; j++) {
+				uint index = (attrCfg >> (j * 4)) & 0xf;  // Get index of attribute in vertexCfg
+
+				// Vertex attributes used as padding
+				// 12, 13, 14 and 15 are equivalent to 4, 8, 12 and 16 bytes of padding respectively
+				if (index >= 12) [[unlikely]] {
+					// Align attribute address up to a 4 byte boundary
+					attrAddress = (attrAddress + 3) & -4;
+					attrAddress += (index - 11) << 2;
+					continue;
+				}
+
+				u32 attribInfo = (vertexCfg >> (index * 4)) & 0xf;
+				u32 attribType = attribInfo & 0x3;  //  Type of attribute(sbyte/ubyte/short/float)
+				u32 size = (attribInfo >> 2) + 1;   // Total number of components
+
+				// printf("vertex_attribute_strides[%d] = %d\n", attrCount, attr.size);
+				vec4f& attribute = currentAttributes[attrCount];
+				uint component;  // Current component
+
+				switch (attribType) {
+					case 0: {  // Signed byte
+						s8* ptr = getPointerPhys<s8>(attrAddress);
+						for (component = 0; component < size; component++) {
+							float val = static_cast<float>(*ptr++);
+							attribute[component] = f24::fromFloat32(val);
+						}
+						attrAddress += size * sizeof(s8);
+						break;
+					}
+
+					case 1: {  // Unsigned byte
+						u8* ptr = getPointerPhys<u8>(attrAddress);
+						for (component = 0; component < size; component++) {
+							float val = static_cast<float>(*ptr++);
+							attribute[component] = f24::fromFloat32(val);
+						}
+						attrAddress += size * sizeof(u8);
+						break;
+					}
 
-		PICA::Vertex& out = vertices[i];
-		// Map shader outputs to fixed function properties
-		const u32 totalShaderOutputs = regs[PICA::InternalRegs::ShaderOutputCount] & 7;
-		for (int i = 0; i < totalShaderOutputs; i++) {
-			const u32 config = regs[PICA::InternalRegs::ShaderOutmap0 + i];
+					case 2: {  // Short
+						s16* ptr = getPointerPhys<s16>(attrAddress);
+						for (component = 0; component < size; component++) {
+							float val = static_cast<float>(*ptr++);
+							attribute[component] = f24::fromFloat32(val);
+						}
+						attrAddress += size * sizeof(s16);
+						break;
+					}
+
+					case 3: {  // Float
+						float* ptr = getPointerPhys<float>(attrAddress);
+						for (component = 0; component < size; component++) {
+							float val = *ptr++;
+							attribute[component] = f24::fromFloat32(val);
+						}
+						attrAddress += size * sizeof(float);
+						break;
+					}
+
+					default: Helpers::panic("[PICA] Unimplemented attribute type %d", attribType);
+				}
 
-			for (int j = 0; j < 4; j++) {  // pls unroll
-				const u32 mapping = (config >> (j * 8)) & 0x1F;
-				out.raw[mapping] = shaderUnit.vs.outputs[i][j];
+				// Fill the remaining attribute lanes with default parameters (1.0 for alpha/w, 0.0) for everything else
+				// Corgi does this although I'm not sure if it's actually needed for anything.
+				// TODO: Find out
+				while (component < 4) {
+					attribute[component] = (component == 3) ? f24::fromFloat32(1.0) : f24::fromFloat32(0.0);
+					component++;
+				}
+
+				attrCount++;
 			}
+			buffer++;
 		}
 	}
 
-	renderer->drawVertices(primType, std::span(vertices).first(vertexCount));
+	// Before running the shader, the PICA maps the fetched attributes from the attribute registers to the shader input registers
+	// Based on the SH_ATTRIBUTES_PERMUTATION registers.
+	// Ie it might attribute #0 to v2, #1 to v7, etc
+	for (int j = 0; j < totalAttribCount; j++) {
+		const u32 mapping = (inputAttrCfg >> (j * 4)) & 0xf;
+		std::memcpy(&shader.inputs[mapping], &currentAttributes[j], sizeof(vec4f));
+	}
 }
 
 PICA::Vertex GPU::getImmediateModeVertex() {
@@ -388,6 +711,7 @@ void GPU::fireDMA(u32 dest, u32 source, u32 size) {
 		// Valid, optimized FCRAM->VRAM DMA. TODO: Is VRAM->VRAM DMA allowed?
 		u8* fcram = mem.getFCRAM();
 		std::memcpy(&vram[dest - vramStart], &fcram[source - fcramStart], size);
+		mem.invalidatePhysicalRange(PhysicalAddrs::VRAM + (dest - vramStart), size);
 	} else {
 		printf("Non-trivially optimizable GPU DMA. Falling back to byte-by-byte transfer\n");
 
@@ -396,3 +720,240 @@ void GPU::fireDMA(u32 dest, u32 source, u32 size) {
 		}
 	}
 }
+
+void GPU::setContextCallbacks(GPUThread::ContextCallback makeCurrent, GPUThread::ContextCallback doneCurrent) {
+	makeContextCurrent = std::move(makeCurrent);
+	doneContextCurrent = std::move(doneCurrent);
+	threadingDecided = false;
+}
+
+void GPU::updateThreading() {
+	threadingDecided = true;
+	bool useThread = config.threadedGPU;
+
+	// GL contexts can only be current on one thread at a time, so we need the frontend's help to move the context between threads
+	if (useThread && config.rendererType == RendererType::OpenGL && !makeContextCurrent) {
+		Helpers::warn("GPU: This frontend doesn't support the threaded GPU with OpenGL, running the GPU on the emulator thread");
+		useThread = false;
+	}
+
+	if (useThread && thread == nullptr) {
+		thread = std::make_unique<GPUThread>();
+		// Whenever we wait on the GPU thread, it might be waiting on us to watch the memory it's about to read
+		thread->start(
+			[this](const GPUThread::Command& command, std::span<u32> payload) { runCommand(command, payload); }, makeContextCurrent,
+			doneContextCurrent, [this]() { mem.applyWatchRequests(); }
+		);
+	} else if (!useThread && thread != nullptr) {
+		// Finish the queued work while the thread can still wake us up to watch memory for it
+		thread->waitIdle();
+		thread.reset();
+	}
+
+	// Write tracking needs to know if textures get watched from another thread, and which thread is the CPU thread
+	mem.setConcurrentTracking(thread != nullptr);
+}
+
+void GPU::wakeThreadWaits() {
+	if (thread != nullptr) {
+		thread->wakeWaiters();
+	}
+}
+
+void GPU::beginFrame() {
+	if (!threadingDecided) {
+		updateThreading();
+	}
+
+	if (pendingTraceFrames != 0) {
+		traceRecorder = std::make_unique<PICA::Trace::Recorder>(*this);
+		if (!traceRecorder->open(pendingTracePath, pendingTraceFrames)) {
+			traceRecorder.reset();
+		}
+
+		pendingTraceFrames = 0;
+	}
+
+	if (thread != nullptr) {
+		thread->lendContext();
+	}
+}
+
+void GPU::endFrame() {
+	if (thread != nullptr) {
+		thread->reclaimContext();
+	}
+
+	if (traceRecorder != nullptr && !traceRecorder->endFrame()) {
+		traceRecorder.reset();
+	}
+}
+
+void GPU::startTrace(const std::filesystem::path& path, u32 frameCount) {
+	if (isTracing()) {
+		Helpers::warn("GPU: Already recording a trace");
+		return;
+	}
+
+	pendingTracePath = path;
+	pendingTraceFrames = frameCount;
+}
+
+void GPU::saveTraceState(PICA::Trace::State& state) {
+	static_assert(sizeof(state.regs) == sizeof(regs) && sizeof(state.externalRegs) == sizeof(externalRegs));
+	static_assert(sizeof(state.lightingLUT) == sizeof(lightingLUT) && sizeof(state.shaderCode) == sizeof(shaderUnit.vs.loadedShader));
+
+	PICAShader& vs = shaderUnit.vs;
+	state.regs = regs;
+	state.externalRegs = externalRegs;
+	state.lightingLUT = lightingLUT;
+	state.shaderCode = vs.loadedShader;
+	state.operandDescriptors = vs.operandDescriptors;
+
+	for (int i = 0; i < 96; i++) {
+		for (int j = 0; j < 4; j++) {
+			state.floatUniforms[i][j] = vs.floatUniforms[i][j].toFloat32();
+		}
+	}
+
+	for (int i = 0; i < 16; i++) {
+		for (int j = 0; j < 4; j++) {
+			state.fixedAttributes[i][j] = vs.fixedAttributes[i][j].toFloat32();
+		}
+	}
+}
+
+void GPU::loadTraceState(const PICA::Trace::State& state) {
+	using namespace PICA::InternalRegs;
+	flushPendingDraws();
+
+	PICAShader& vs = shaderUnit.vs;
+	regs = state.regs;
+	externalRegs = state.externalRegs;
+	lightingLUT = state.lightingLUT;
+	vs.loadedShader = state.shaderCode;
+	vs.bufferedShader = state.shaderCode;
+	vs.operandDescriptors = state.operandDescriptors;
+	vs.invalidateHashes();
+
+	for (int i = 0; i < 96; i++) {
+		for (int j = 0; j < 4; j++) {
+			vs.floatUniforms[i][j] = f24::fromFloat32(state.floatUniforms[i][j]);
+		}
+	}
+	vs.floatUniformsDirty.fill(~0ull);
+
+	for (int i = 0; i < 16; i++) {
+		for (int j = 0; j < 4; j++) {
+			vs.fixedAttributes[i][j] = f24::fromFloat32(state.fixedAttributes[i][j]);
+		}
+	}
+
+	lightingLUTDirty.markAllDirty();
+	dirtyRegs.fill(~0ull);
+
+	// Write the registers the GPU and renderer derive state from again, so the derived state matches them
+	for (u32 index : {
+			 AttribFormatHigh, ColourBufferLoc, ColourBufferFormat, DepthBufferLoc, DepthBufferFormat, FramebufferSize, VertexBoolUniform,
+			 VertexIntUniform0, VertexIntUniform1, VertexIntUniform2, VertexIntUniform3, VertexShaderEntrypoint,
+		 }) {
+		writeInternalReg(index, regs[index], 0xffffffff);
+	}
+
+	for (u32 index = AttribInfoStart; index <= AttribInfoEnd; index++) {
+		writeInternalReg(index, regs[index], 0xffffffff);
+	}
+}
+
+u64 GPU::submitCommand(const GPUThread::Command& command) {
+	if (thread == nullptr) {
+		runCommand(command, {});
+		return 0;
+	}
+
+	if (command.type == GPUThread::CommandType::CommandList) {
+		// Give the GPU thread its own copy of the command list, so it doesn't depend on the list staying intact until it gets to it
+		u32 size = command.args[1];
+		const u32* list = getCommandListPointer(command.args[0], size);
+		if (list == nullptr) {
+			return 0;
+		}
+
+		GPUThread::Command copy = command;
+		copy.args[1] = size;
+		copy.payloadSize = size / sizeof(u32);
+		return thread->submit(copy, std::span<const u32>(list, copy.payloadSize));
+	}
+
+	return thread->submit(command);
+}
+
+void GPU::waitForCommand(u64 sequence) {
+	if (thread != nullptr) {
+		thread->wait(sequence);
+	}
+}
+
+void GPU::syncThread() {
+	if (thread != nullptr) {
+		thread->waitIdle();
+	}
+}
+
+void GPU::recordCommand(const GPUThread::Command& command, std::span<u32> payload) {
+	// Without the GPU thread, command lists get run straight from memory, but the trace needs their contents, as replays don't have the
+	// virtual address space the list address is in
+	if (command.type == GPUThread::CommandType::CommandList && payload.empty()) {
+		u32 size = command.args[1];
+		const u32* list = getCommandListPointer(command.args[0], size);
+		if (list == nullptr) {
+			return;
+		}
+
+		GPUThread::Command copy = command;
+		copy.args[1] = size;
+		copy.payloadSize = size / sizeof(u32);
+		traceRecorder->recordCommand(copy, std::span<const u32>(list, copy.payloadSize));
+		return;
+	}
+
+	traceRecorder->recordCommand(command, payload);
+}
+
+void GPU::runCommand(const GPUThread::Command& command, std::span<u32> payload) {
+	PROFILE_SCOPE(PICA);
+	using Type = GPUThread::CommandType;
+	const auto& args = command.args;
+
+	if (traceRecorder != nullptr) [[unlikely]] {
+		recordCommand(command, payload);
+	}
+
+	switch (command.type) {
+		case Type::CommandList:
+			if (payload.empty()) {
+				startCommandList(args[0], args[1]);
+			} else {
+				runCommandList(payload.data(), u32(payload.size_bytes()));
+			}
+			break;
+
+		case Type::MemoryFill: clearBuffer(args[0], args[1], args[2], args[3]); break;
+		case Type::DisplayTransfer: displayTransfer(args[0], args[1], args[2], args[3], args[4]); break;
+		case Type::TextureCopy: textureCopy(args[0], args[1], args[2], args[3], args[4], args[5]); break;
+		case Type::DMA: fireDMA(args[0], args[1], args[2]); break;
+
+		case Type::WriteReg: {
+			const u32 mask = args[2];
+			u32 value = args[1];
+			if (mask != 0xffffffff) {
+				value = (readReg(args[0]) & ~mask) | (value & mask);
+			}
+
+			writeReg(args[0], value);
+			break;
+		}
+
+		default: Helpers::panic("GPU: Unknown GPU thread command %d", static_cast<int>(command.type)); break;
+	}
+}
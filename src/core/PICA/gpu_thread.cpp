@@ -0,0 +1,158 @@
+#include "PICA/gpu_thread.hpp"
+
+void GPUThread::start(
+	Handler commandHandler, ContextCallback makeContextCurrent, ContextCallback doneContextCurrent, WaitCallback waitCallback
+) {
+	stop();
+
+	handler = std::move(commandHandler);
+	makeCurrent = std::move(makeContextCurrent);
+	doneCurrent = std::move(doneContextCurrent);
+	whileWaiting = std::move(waitCallback);
+	holdsContext = false;
+	contextLent = false;
+	submitted = 0;
+	completed = 0;
+	thread = std::thread(&GPUThread::threadLoop, this);
+}
+
+void GPUThread::stop() {
+	if (!thread.joinable()) {
+		return;
+	}
+
+	// The thread finishes all work queued before the stop command, and gives up the context if it had it
+	// Wait for that work here rather than in join, as the thread might need us to do something for it before it can finish
+	waitIdle();
+	submit(Command{.type = CommandType::Stop});
+	thread.join();
+
+	if (contextLent && makeCurrent) {
+		makeCurrent();
+	}
+	contextLent = false;
+}
+
+u64 GPUThread::submit(const Command& command, std::span<const u32> payload) {
+	if (makeCurrent && !contextLent && command.type != CommandType::ReleaseContext &&
+		command.type != CommandType::Stop) [[unlikely]] {
+		Helpers::panic("GPUThread: Submitted work without lending out the graphics context");
+	}
+
+	while (commands.push(&command, 1) == 0) {
+		runWaitCallback();
+		std::this_thread::yield();
+	}
+
+	// Publish the command before its payload, so the GPU thread can start draining payloads that don't fit in the ring in one go
+	const u64 sequence = submitted.fetch_add(1, std::memory_order_release) + 1;
+	submitted.notify_one();
+
+	while (!payload.empty()) {
+		const usize pushed = payloads.push(payload);
+		payload = payload.subspan(pushed);
+
+		if (pushed == 0) {
+			runWaitCallback();
+			std::this_thread::yield();
+		}
+	}
+
+	return sequence;
+}
+
+void GPUThread::wait(u64 sequence) {
+	while (completed.load(std::memory_order_acquire) < sequence) {
+		// Read the events before running the callback, so that if the GPU thread wakes us up after we ran it, we don't go to sleep
+		const u32 events = waitEvents.load(std::memory_order_acquire);
+		runWaitCallback();
+
+		if (completed.load(std::memory_order_acquire) >= sequence) {
+			break;
+		}
+		waitEvents.wait(events, std::memory_order_acquire);
+	}
+}
+
+void GPUThread::wakeWaiters() {
+	waitEvents.fetch_add(1, std::memory_order_release);
+	waitEvents.notify_all();
+}
+
+void GPUThread::lendContext() {
+	if (!thread.joinable() || contextLent) {
+		return;
+	}
+
+	if (doneCurrent) {
+		doneCurrent();
+	}
+	contextLent = true;
+}
+
+void GPUThread::reclaimContext() {
+	if (!thread.joinable() || !contextLent) {
+		return;
+	}
+
+	wait(submit(Command{.type = CommandType::ReleaseContext}));
+	if (makeCurrent) {
+		makeCurrent();
+	}
+	contextLent = false;
+}
+
+void GPUThread::popPayload(u32 size) {
+	payloadScratch.resize(size);
+	u32* out = payloadScratch.data();
+
+	while (size > 0) {
+		const usize popped = payloads.pop(out, size);
+		out += popped;
+		size -= u32(popped);
+
+		if (popped == 0) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void GPUThread::threadLoop() {
+	u64 processed = 0;
+
+	while (true) {
+		if (submitted.load(std::memory_order_acquire) == processed) {
+			submitted.wait(processed, std::memory_order_acquire);
+			continue;
+		}
+
+		Command command;
+		commands.pop(&command, 1);
+		popPayload(command.payloadSize);
+
+		if (command.type == CommandType::Stop) {
+			break;
+		} else if (command.type == CommandType::ReleaseContext) {
+			if (holdsContext) {
+				doneCurrent();
+				holdsContext = false;
+			}
+		} else {
+			if (!holdsContext && makeCurrent) {
+				makeCurrent();
+				holdsContext = true;
+			}
+
+			handler(command, std::span<u32>(payloadScratch.data(), command.payloadSize));
+		}
+
+		processed++;
+		completed.store(processed, std::memory_order_release);
+		wakeWaiters();
+	}
+
+	if (holdsContext) {
+		doneCurrent();
+		holdsContext = false;
+	}
+}
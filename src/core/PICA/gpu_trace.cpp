@@ -0,0 +1,238 @@
+#include "PICA/gpu_trace.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <system_error>
+#include <tuple>
+
+#include "PICA/gpu.hpp"
+#include "PICA/pica_hash.hpp"
+
+using namespace PICA::Trace;
+
+static constexpr u32 vramSize = u32(6_MB);
+static constexpr u32 fcramSize = u32(128_MB);
+
+bool Recorder::open(const std::filesystem::path& path, u32 frameCount) {
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+
+	if (!file.open(path, "wb")) {
+		Helpers::warn("GPU trace: Failed to create %s", path.string().c_str());
+		return false;
+	}
+
+	const FileHeader header = {magic, version};
+	file.writeBytes(&header, sizeof(header));
+
+	auto state = std::make_unique<State>();
+	gpu.saveTraceState(*state);
+	writeRecord(RecordType::State, std::span(reinterpret_cast<const u8*>(state.get()), sizeof(State)));
+
+	// Watch all of memory, so we can tell which pages the next commands might see differently. The first sync stores every page
+	Memory& mem = gpu.getMemory();
+	mem.watchPhysicalRange(PhysicalAddrs::VRAM, vramSize);
+	mem.watchPhysicalRange(PhysicalAddrs::FCRAM, fcramSize);
+	lastSyncTimestamp = 0;
+
+	framesLeft = frameCount;
+	printf("Recording GPU trace to %s\n", path.string().c_str());
+	return true;
+}
+
+void Recorder::close() {
+	file.close();
+	storedPages.clear();
+}
+
+void Recorder::writeRecord(RecordType type, std::span<const u8> data) { writeRecord(type, data, {}); }
+
+void Recorder::writeRecord(RecordType type, std::span<const u8> data, std::span<const u8> extraData) {
+	const RecordHeader header = {type, u32(data.size() + extraData.size())};
+	file.writeBytes(&header, sizeof(header));
+	file.writeBytes(data.data(), data.size());
+	file.writeBytes(extraData.data(), extraData.size());
+}
+
+void Recorder::syncMemory() {
+	Memory& mem = gpu.getMemory();
+
+	// Anything written after this point gets a newer timestamp, so it'll be picked up by the next sync
+	const u64 timestamp = mem.getWriteTimestamp();
+	dirtyPages.clear();
+
+	if (lastSyncTimestamp == 0) {
+		for (u32 offset = 0; offset < vramSize; offset += pageSize) {
+			dirtyPages.push_back(PhysicalAddrs::VRAM + offset);
+		}
+
+		for (u32 offset = 0; offset < fcramSize; offset += pageSize) {
+			dirtyPages.push_back(PhysicalAddrs::FCRAM + offset);
+		}
+	} else {
+		mem.getDirtyPages(PhysicalAddrs::VRAM, vramSize, lastSyncTimestamp, dirtyPages);
+		mem.getDirtyPages(PhysicalAddrs::FCRAM, fcramSize, lastSyncTimestamp, dirtyPages);
+	}
+
+	if (dirtyPages.empty()) {
+		return;
+	}
+
+	pageMap.clear();
+	for (u32 paddr : dirtyPages) {
+		const u8* data = gpu.getPointerPhys<u8>(paddr);
+		const u64 hash = PICAHash::computeHash(reinterpret_cast<const char*>(data), pageSize);
+
+		if (storedPages.insert(hash).second) {
+			writeRecord(RecordType::PageData, std::span(reinterpret_cast<const u8*>(&hash), sizeof(hash)), std::span(data, pageSize));
+		}
+
+		pageMap.push_back(PageEntry{.paddr = paddr, .padding = 0, .hash = hash});
+		// Pages stop being watched when they get written to, so watch them again for the next sync
+		mem.watchPhysicalRange(paddr, pageSize);
+	}
+
+	writeRecord(RecordType::PageMap, std::span(reinterpret_cast<const u8*>(pageMap.data()), pageMap.size() * sizeof(PageEntry)));
+	lastSyncTimestamp = timestamp;
+}
+
+void Recorder::recordCommand(const GPUThread::Command& command, std::span<const u32> payload) {
+	syncMemory();
+
+	const CommandHeader header = {.type = command.type, .args = command.args, .payloadSize = u32(payload.size())};
+	writeRecord(
+		RecordType::Command, std::span(reinterpret_cast<const u8*>(&header), sizeof(header)),
+		std::span(reinterpret_cast<const u8*>(payload.data()), payload.size_bytes())
+	);
+}
+
+bool Recorder::endFrame() {
+	writeRecord(RecordType::EndFrame, {});
+
+	if (--framesLeft == 0) {
+		printf("Finished recording GPU trace\n");
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+bool Player::open(const std::filesystem::path& path) {
+	if (!file.open(path, "rb")) {
+		Helpers::warn("GPU trace: Failed to open %s", path.string().c_str());
+		return false;
+	}
+
+	FileHeader header;
+	RecordHeader stateHeader;
+	auto [success, bytesRead] = file.readBytes(&header, sizeof(header));
+	if (!success || bytesRead != sizeof(header) || header.magic != magic || header.version != version) {
+		Helpers::warn("GPU trace: %s is not a GPU trace or is from a different version", path.string().c_str());
+		return false;
+	}
+
+	std::tie(success, bytesRead) = file.readBytes(&stateHeader, sizeof(stateHeader));
+	if (!success || bytesRead != sizeof(stateHeader) || stateHeader.type != RecordType::State || stateHeader.size != sizeof(State)) {
+		Helpers::warn("GPU trace: %s doesn't start with the GPU state", path.string().c_str());
+		return false;
+	}
+
+	std::tie(success, bytesRead) = file.readBytes(&state, sizeof(State));
+	if (!success || bytesRead != sizeof(State)) {
+		Helpers::warn("GPU trace: %s is truncated", path.string().c_str());
+		return false;
+	}
+
+	firstRecordOffset = sizeof(FileHeader) + sizeof(RecordHeader) + sizeof(State);
+	return true;
+}
+
+void Player::restart(GPU& gpu) {
+	file.seek(std::int64_t(firstRecordOffset));
+	gpu.loadTraceState(state);
+}
+
+bool Player::runFrame(GPU& gpu, FrameInfo& info) {
+	info = FrameInfo{};
+	Memory& mem = gpu.getMemory();
+
+	while (true) {
+		RecordHeader header;
+		auto [success, bytesRead] = file.readBytes(&header, sizeof(header));
+		if (!success || bytesRead != sizeof(header)) {
+			return false;
+		}
+
+		switch (header.type) {
+			case RecordType::PageData: {
+				u64 hash;
+				std::vector<u8> data(pageSize);
+				if (header.size != sizeof(hash) + pageSize) {
+					Helpers::warn("GPU trace: Invalid page record");
+					return false;
+				}
+
+				file.readBytes(&hash, sizeof(hash));
+				file.readBytes(data.data(), pageSize);
+				pages.try_emplace(hash, std::move(data));
+				break;
+			}
+
+			case RecordType::PageMap: {
+				pageMap.resize(header.size / sizeof(PageEntry));
+				file.readBytes(pageMap.data(), pageMap.size() * sizeof(PageEntry));
+
+				for (const PageEntry& entry : pageMap) {
+					auto it = pages.find(entry.hash);
+					if (it == pages.end()) {
+						Helpers::warn("GPU trace: Missing page %016llX", (unsigned long long)entry.hash);
+						continue;
+					}
+
+					std::memcpy(gpu.getPointerPhys<u8>(entry.paddr), it->second.data(), pageSize);
+					// Let the renderer's caches know that the memory changed from under them
+					mem.invalidatePhysicalRange(entry.paddr, pageSize);
+				}
+
+				info.pagesLoaded += u32(pageMap.size());
+				break;
+			}
+
+			case RecordType::Command: {
+				CommandHeader commandHeader;
+				file.readBytes(&commandHeader, sizeof(commandHeader));
+				payload.resize(commandHeader.payloadSize);
+				file.readBytes(payload.data(), payload.size() * sizeof(u32));
+
+				// We don't have the game's virtual memory, so command lists can only run from the copy in the trace
+				if (commandHeader.type == GPUThread::CommandType::CommandList && payload.empty()) {
+					Helpers::warn("GPU trace: Command list without its contents");
+					info.skippedCommandLists++;
+					break;
+				}
+
+				const GPUThread::Command command = {.type = commandHeader.type, .args = commandHeader.args, .payloadSize = commandHeader.payloadSize};
+				const auto startTime = std::chrono::steady_clock::now();
+				gpu.runCommand(command, payload);
+				const auto elapsed = std::chrono::steady_clock::now() - startTime;
+
+				info.commandTime += u64(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+				info.commandCount++;
+				if (command.type == GPUThread::CommandType::CommandList) {
+					info.commandListCount++;
+				}
+				break;
+			}
+
+			case RecordType::EndFrame: return true;
+
+			default:
+				// Skip records we don't know about
+				file.seek(header.size, SEEK_CUR);
+				break;
+		}
+	}
+}
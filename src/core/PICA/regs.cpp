@@ -5,6 +5,53 @@
 using namespace Floats;
 using namespace Helpers;
 
+namespace {
+	// How the command processor handles writes to each internal register
+	enum class RegClass : u8 {
+		Plain,        // No side effects, the value just gets stored
+		SideEffect,   // Has its own case in writeInternalReg
+		CommandJump,  // Can make the command processor jump to another command list
+		// Data ports, which get sent a stream of values. Writing to any of the 8 registers of a port does the same thing
+		LightingLUTPort,
+		FloatUniformPort,
+		ShaderCodePort,
+		OpDescriptorPort,
+	};
+
+	// Every register that writeInternalReg has a case for needs to be classified here, everything else is Plain
+	constexpr std::array<RegClass, 0x300> regClasses = [] {
+		using namespace PICA::InternalRegs;
+
+		std::array<RegClass, 0x300> classes;
+		classes.fill(RegClass::Plain);
+
+		auto set = [&](u32 first, u32 last, RegClass regClass) {
+			for (u32 i = first; i <= last; i++) {
+				classes[i] = regClass;
+			}
+		};
+
+		for (u32 index : {
+				 SignalDrawArrays, SignalDrawElements, AttribFormatHigh, ColourBufferLoc, ColourBufferFormat, DepthBufferLoc, DepthBufferFormat,
+				 Tex0Type, Tex1Type, Tex2Type, FramebufferSize, VertexFloatUniformIndex, FixedAttribIndex, PrimitiveRestart,
+				 VertexShaderOpDescriptorIndex, VertexBoolUniform, VertexShaderEntrypoint, VertexShaderTransferEnd, VertexShaderTransferIndex,
+			 }) {
+			classes[index] = RegClass::SideEffect;
+		}
+
+		set(FixedAttribData0, FixedAttribData2, RegClass::SideEffect);
+		set(VertexIntUniform0, VertexIntUniform3, RegClass::SideEffect);
+		set(AttribInfoStart, AttribInfoEnd, RegClass::SideEffect);
+		set(CmdBufTrigger0, CmdBufTrigger1, RegClass::CommandJump);
+
+		set(LightingLUTData0, LightingLUTData7, RegClass::LightingLUTPort);
+		set(VertexFloatUniformData0, VertexFloatUniformData7, RegClass::FloatUniformPort);
+		set(VertexShaderData0, VertexShaderData7, RegClass::ShaderCodePort);
+		set(VertexShaderOpDescriptorData0, VertexShaderOpDescriptorData7, RegClass::OpDescriptorPort);
+		return classes;
+	}();
+}  // namespace
+
 u32 GPU::readReg(u32 address) {
 	if (address >= 0x1EF01000 && address < 0x1EF01C00) {  // Internal registers
 		const u32 index = (address - 0x1EF01000) / sizeof(u32);
@@ -52,7 +99,7 @@ void GPU::writeExternalReg(u32 index, u32 value) {
 u32 GPU::readInternalReg(u32 index) {
 	using namespace PICA::InternalRegs;
 
-	if (index > regNum) [[unlikely]] {
+	if (index >= regNum) [[unlikely]] {
 		Helpers::panic("Tried to read invalid GPU register. Index: %X\n", index);
 		return 0;
 	}
@@ -70,6 +117,7 @@ u32 GPU::readInternalReg(u32 index) {
 		// Increment the bottom 8 bits of the lighting LUT index register
 		lutIndex += 1;
 		regs[LightingLUTIndex] = (index & ~0xff) | (lutIndex & 0xff);
+		markRegDirty(LightingLUTIndex);
 		return value;
 	}
 
@@ -79,13 +127,20 @@ u32 GPU::readInternalReg(u32 index) {
 void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
 	using namespace PICA::InternalRegs;
 
-	if (index > regNum) [[unlikely]] {
+	if (index >= regNum) [[unlikely]] {
 		Helpers::panic("Tried to write to invalid GPU register. Index: %X, value: %08X\n", index, value);
 		return;
 	}
 
 	u32 currentValue = regs[index];
 	u32 newValue = (currentValue & ~mask) | (value & mask);  // Only overwrite the bits specified by "mask"
+
+	// Registers between the rasterizer and the geometry pipeline configure how draws render, so draws the renderer batched up with the old
+	// state have to go out before we change any of them
+	if (index >= RenderStateStart && index < RenderStateEnd && newValue != currentValue) {
+		flushPendingDraws();
+		markRegDirty(index);
+	}
 	regs[index] = newValue;
 
 	// TODO: Figure out if things like the shader index use the unmasked value or the masked one
@@ -128,6 +183,11 @@ void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
 			break;
 		}
 
+		// The texture type is the last register games write when setting up a texture unit, so the rest of the unit's config is ready by now
+		case Tex0Type: renderer->prefetchTexture(0); break;
+		case Tex1Type: renderer->prefetchTexture(1); break;
+		case Tex2Type: renderer->prefetchTexture(2); break;
+
 		case FramebufferSize: {
 			const u32 width = value & 0x7ff;
 			const u32 height = getBits<12, 10>(value) + 1;
@@ -143,18 +203,22 @@ void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
 		case LightingLUTData5:
 		case LightingLUTData6:
 		case LightingLUTData7: {
+			// Batched draws have to use the LUT as it was before this write, even if the register value doesn't change
+			flushPendingDraws();
+
 			const uint32_t index = regs[LightingLUTIndex];  // Get full LUT index register
 			const uint32_t lutID = getBits<8, 5>(index);    // Get which LUT we're actually writing to
 			uint32_t lutIndex = getBits<0, 8>(index);       // And get the index inside the LUT we're writing to
 
 			if (lutID < PICA::Lights::LUT_Count) {
 				lightingLUT[lutID * 256 + lutIndex] = newValue;
-				lightingLUTDirty = true;
+				lightingLUTDirty.markDirty(lutID, lutIndex);
 			}
 
 			// Increment the bottom 8 bits of the lighting LUT index register
 			lutIndex += 1;
 			regs[LightingLUTIndex] = (index & ~0xff) | (lutIndex & 0xff);
+			markRegDirty(LightingLUTIndex);
 
 			break;
 		}
@@ -234,7 +298,7 @@ void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
 						// If we've reached 3 verts, issue a draw call
 						// Handle rendering depending on the primitive type
 						if (immediateModeVertIndex == 3) {
-							renderer->drawVertices(PICA::PrimType::TriangleList, immediateModeVertices);
+							drawVertices(PICA::PrimType::TriangleList, immediateModeVertices);
 
 							switch (primType) {
 								// Triangle or geometry primitive. Draw a triangle and discard all vertices
@@ -330,7 +394,7 @@ void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
 				u32 size = (regs[CmdBufSize0 + bufferIndex] & 0xfffff) << 3;
 
 				// Set command buffer state to execute the new buffer
-				cmdBuffStart = getPointerPhys<u32>(addr);
+				cmdBuffStart = getPointerPhys<u32>(addr, size);
 				cmdBuffCurr = cmdBuffStart;
 				cmdBuffEnd = cmdBuffStart + (size / sizeof(u32));
 			}
@@ -360,11 +424,171 @@ void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
 	}
 }
 
+bool GPU::writeInternalRegs(u32 index, const u32* values, u32 count, u32 mask, u32 increment) {
+	using namespace PICA::InternalRegs;
+
+	while (count > 0) {
+		if (index >= regNum) [[unlikely]] {
+			writeInternalReg(index, *values, mask);  // Panics
+			return true;
+		}
+
+		const RegClass regClass = regClasses[index];
+		u32 run = 1;  // How many of the values we handled this iteration
+
+		// Data port bursts can write to the port's registers in consecutive mode too, as all 8 of them do the same thing
+		auto portRun = [&](u32 portStart) { return increment == 0 ? count : std::min(count, portStart + 8 - index); };
+		const bool fullMask = mask == 0xffffffff;
+
+		switch (regClass) {
+			case RegClass::Plain: {
+				if (increment == 0) {
+					// Nothing can observe the values in between, so only the last one matters
+					run = count;
+					writeInternalReg(index, values[count - 1], mask);
+					break;
+				}
+
+				while (run < count && index + run < regNum && regClasses[index + run] == RegClass::Plain) {
+					run++;
+				}
+
+				u32* regPointer = &regs[index];
+				const bool renderState = index < RenderStateEnd && index + run > RenderStateStart;
+
+				if (fullMask) {
+					if (renderState && std::memcmp(regPointer, values, run * sizeof(u32)) != 0) {
+						flushPendingDraws();
+						for (u32 i = std::max<u32>(index, RenderStateStart); i < std::min<u32>(index + run, RenderStateEnd); i++) {
+							markRegDirty(i);
+						}
+					}
+					std::memcpy(regPointer, values, run * sizeof(u32));
+				} else {
+					bool flushed = false;
+					for (u32 i = 0; i < run; i++) {
+						const u32 newValue = (regPointer[i] & ~mask) | (values[i] & mask);
+						const u32 reg = index + i;
+
+						if (reg >= RenderStateStart && reg < RenderStateEnd && newValue != regPointer[i]) {
+							if (!flushed) {
+								flushPendingDraws();
+								flushed = true;
+							}
+							markRegDirty(reg);
+						}
+						regPointer[i] = newValue;
+					}
+				}
+				break;
+			}
+
+			case RegClass::LightingLUTPort: {
+				if (!fullMask) {
+					writeInternalReg(index, *values, mask);
+					break;
+				}
+
+				run = portRun(LightingLUTData0);
+				// Batched draws have to use the LUT as it was before this write, even if the register value doesn't change
+				flushPendingDraws();
+
+				const u32 lutConfig = regs[LightingLUTIndex];
+				const u32 lutID = getBits<8, 5>(lutConfig);
+				u32 lutIndex = getBits<0, 8>(lutConfig);
+
+				for (u32 i = 0; i < run; i++) {
+					if (lutID < PICA::Lights::LUT_Count) {
+						lightingLUT[lutID * 256 + lutIndex] = values[i];
+						lightingLUTDirty.markDirty(lutID, lutIndex);
+					}
+
+					const u32 port = index + i * increment;
+					regs[port] = values[i];
+					markRegDirty(port);
+					lutIndex = (lutIndex + 1) & 0xff;
+				}
+
+				regs[LightingLUTIndex] = (lutConfig & ~0xff) | lutIndex;
+				markRegDirty(LightingLUTIndex);
+				break;
+			}
+
+			case RegClass::FloatUniformPort:
+			case RegClass::ShaderCodePort:
+			case RegClass::OpDescriptorPort: {
+				// These use the unmasked value, like writeInternalReg does
+				if (!fullMask) {
+					writeInternalReg(index, *values, mask);
+					break;
+				}
+
+				if (regClass == RegClass::FloatUniformPort) {
+					run = portRun(VertexFloatUniformData0);
+					shaderUnit.vs.uploadFloatUniforms({values, run});
+				} else if (regClass == RegClass::ShaderCodePort) {
+					run = portRun(VertexShaderData0);
+					shaderUnit.vs.uploadWords({values, run});
+				} else {
+					run = portRun(VertexShaderOpDescriptorData0);
+					shaderUnit.vs.uploadDescriptors({values, run});
+				}
+
+				for (u32 i = 0; i < run; i++) {
+					regs[index + i * increment] = values[i];
+				}
+				break;
+			}
+
+			case RegClass::SideEffect: writeInternalReg(index, *values, mask); break;
+
+			case RegClass::CommandJump:
+				writeInternalReg(index, *values, mask);
+				if (*values != 0) {
+					return false;
+				}
+				break;
+		}
+
+		values += run;
+		count -= run;
+		index += run * increment;
+	}
+
+	return true;
+}
+
+// Gets a pointer to a command list at virtual address "addr". Command lists get read straight out of emulated memory, so make sure all of it
+// is mapped and contiguous in host memory, and cut it off where that stops being the case
+u32* GPU::getCommandListPointer(u32 addr, u32& size) {
+	u8* start = static_cast<u8*>(mem.getReadPointer(addr));
+	if (start == nullptr) {
+		Helpers::warn("[GPU] Command list at %08X isn't mapped", addr);
+		size = 0;
+		return nullptr;
+	}
+
+	// Check the start of every page after the first one
+	for (u32 offset = Memory::pageSize - (addr & Memory::pageMask); offset < size; offset += Memory::pageSize) {
+		if (static_cast<u8*>(mem.getReadPointer(addr + offset)) != start + offset) {
+			Helpers::warn("[GPU] Command list at %08X isn't contiguous, cutting it off after %08X bytes", addr, offset);
+			size = offset;
+			break;
+		}
+	}
+
+	return reinterpret_cast<u32*>(start);
+}
+
 void GPU::startCommandList(u32 addr, u32 size) {
-	cmdBuffStart = static_cast<u32*>(mem.getReadPointer(addr));
-	if (!cmdBuffStart) Helpers::panic("Couldn't get buffer for command list");
-	// TODO: This is very memory unsafe. We get a pointer to FCRAM and just keep writing without checking if we're gonna go OoB
+	u32* list = getCommandListPointer(addr, size);
+	if (list != nullptr) {
+		runCommandList(list, size);
+	}
+}
 
+void GPU::runCommandList(u32* list, u32 size) {
+	cmdBuffStart = list;
 	cmdBuffCurr = cmdBuffStart;
 	cmdBuffEnd = cmdBuffStart + (size / sizeof(u32));
 
@@ -386,6 +610,10 @@ void GPU::startCommandList(u32 addr, u32 size) {
 			cmdBuffCurr++;
 		}
 
+		if (cmdBuffEnd - cmdBuffCurr < 2) {
+			break;
+		}
+
 		// The first word of a command is the command parameter and the second one is the header
 		u32 param1 = *cmdBuffCurr++;
 		u32 header = *cmdBuffCurr++;
@@ -402,11 +630,21 @@ void GPU::startCommandList(u32 addr, u32 size) {
 		// Increment the ID by 1 after each write if we're in consecutive mode, or 0 otherwise
 		u32 idIncrement = (consecutiveWritingMode) ? 1 : 0;
 
-		writeInternalReg(id, param1, mask);
-		for (u32 i = 0; i < paramCount; i++) {
-			id += idIncrement;
-			u32 param = *cmdBuffCurr++;
-			writeInternalReg(id, param, mask);
+		const u32 availableParams = u32(cmdBuffEnd - cmdBuffCurr);
+		if (paramCount > availableParams) [[unlikely]] {
+			Helpers::warn("[GPU] Command list command has %d parameters, but only %d words are left", paramCount, availableParams);
+			paramCount = availableParams;
+		}
+
+		// The parameters get consumed before writing them, as writing to the command buffer trigger registers replaces the command list
+		const u32* params = cmdBuffCurr;
+		cmdBuffCurr += paramCount;
+
+		if (writeInternalRegs(id, &param1, 1, mask, idIncrement)) {
+			writeInternalRegs(id + idIncrement, params, paramCount, mask, idIncrement);
 		}
 	}
+
+	// The CPU can overwrite textures and such once the command list is done, so don't keep draws batched past this point
+	flushPendingDraws();
 }
@@ -0,0 +1,397 @@
+#include "PICA/shader_decoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "PICA/dynapica/shader_analysis.hpp"
+#include "PICA/shader.hpp"
+
+using namespace Helpers;
+using f24 = Floats::f24;
+using vec4f = std::array<f24, 4>;
+
+static vec4f& getRegister(PICAShader& shader, u16 offset) { return *reinterpret_cast<vec4f*>(reinterpret_cast<u8*>(&shader) + offset); }
+
+template <bool dynamic, u32 index>
+vec4f ShaderDecoder::getSource(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f* source;
+	vec4f dynamicValue;
+
+	if (dynamic && index == instruction.dynamicSource) {
+		dynamicValue = shader.getSource(shader.getIndexedSource(instruction.dynamicRegister, instruction.index));
+		source = &dynamicValue;
+	} else {
+		source = &getRegister(shader, instruction.sources[index]);
+	}
+
+	const auto& swizzle = instruction.swizzles[index];
+	vec4f ret = {(*source)[swizzle[0]], (*source)[swizzle[1]], (*source)[swizzle[2]], (*source)[swizzle[3]]};
+
+	if (instruction.negateMask & (1u << index)) {
+		ret[0] = -ret[0];
+		ret[1] = -ret[1];
+		ret[2] = -ret[2];
+		ret[3] = -ret[3];
+	}
+
+	return ret;
+}
+
+void ShaderDecoder::setDest(PICAShader& shader, const DecodedInstruction& instruction, const vec4f& value) {
+	vec4f& dest = getRegister(shader, instruction.dest);
+
+	if (instruction.writeMask == 0xf) [[likely]] {
+		dest = value;
+	} else {
+		for (int i = 0; i < 4; i++) {
+			if (instruction.writeMask & (1 << i)) {
+				dest[i] = value[i];
+			}
+		}
+	}
+}
+
+template <bool dynamic>
+void ShaderDecoder::add(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src1 = getSource<dynamic, 0>(shader, instruction);
+	const vec4f src2 = getSource<dynamic, 1>(shader, instruction);
+	setDest(shader, instruction, {src1[0] + src2[0], src1[1] + src2[1], src1[2] + src2[2], src1[3] + src2[3]});
+}
+
+template <bool dynamic>
+void ShaderDecoder::mul(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src1 = getSource<dynamic, 0>(shader, instruction);
+	const vec4f src2 = getSource<dynamic, 1>(shader, instruction);
+	setDest(shader, instruction, {src1[0] * src2[0], src1[1] * src2[1], src1[2] * src2[2], src1[3] * src2[3]});
+}
+
+template <bool dynamic>
+void ShaderDecoder::flr(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src = getSource<dynamic, 0>(shader, instruction);
+	vec4f result;
+	for (int i = 0; i < 4; i++) {
+		result[i] = f24::fromFloat32(std::floor(src[i].toFloat32()));
+	}
+
+	setDest(shader, instruction, result);
+}
+
+template <bool dynamic>
+void ShaderDecoder::max(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src1 = getSource<dynamic, 0>(shader, instruction);
+	const vec4f src2 = getSource<dynamic, 1>(shader, instruction);
+	vec4f result;
+
+	for (int i = 0; i < 4; i++) {
+		const float inputA = src1[i].toFloat32();
+		const float inputB = src2[i].toFloat32();
+		// max(NaN, 2.f) -> NaN
+		// max(2.f, NaN) -> 2
+		const auto& maximum = std::isinf(inputB) ? inputB : std::max(inputB, inputA);
+		result[i] = f24::fromFloat32(maximum);
+	}
+
+	setDest(shader, instruction, result);
+}
+
+template <bool dynamic>
+void ShaderDecoder::min(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src1 = getSource<dynamic, 0>(shader, instruction);
+	const vec4f src2 = getSource<dynamic, 1>(shader, instruction);
+	vec4f result;
+
+	for (int i = 0; i < 4; i++) {
+		const float inputA = src1[i].toFloat32();
+		const float inputB = src2[i].toFloat32();
+		// min(NaN, 2.f) -> NaN
+		// min(2.f, NaN) -> 2
+		const auto& minimum = std::min(inputB, inputA);
+		result[i] = f24::fromFloat32(minimum);
+	}
+
+	setDest(shader, instruction, result);
+}
+
+template <bool dynamic>
+void ShaderDecoder::mov(PICAShader& shader, const DecodedInstruction& instruction) {
+	setDest(shader, instruction, getSource<dynamic, 0>(shader, instruction));
+}
+
+template <bool dynamic>
+void ShaderDecoder::mova(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src = getSource<dynamic, 0>(shader, instruction);
+
+	if (instruction.writeMask & 0b0001)  // x component
+		shader.addrRegister[0] = static_cast<s32>(src[0].toFloat32());
+	if (instruction.writeMask & 0b0010)  // y component
+		shader.addrRegister[1] = static_cast<s32>(src[1].toFloat32());
+}
+
+template <bool dynamic>
+void ShaderDecoder::dp3(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src1 = getSource<dynamic, 0>(shader, instruction);
+	const vec4f src2 = getSource<dynamic, 1>(shader, instruction);
+	const f24 dot = src1[0] * src2[0] + src1[1] * src2[1] + src1[2] * src2[2];
+	setDest(shader, instruction, {dot, dot, dot, dot});
+}
+
+template <bool dynamic>
+void ShaderDecoder::dp4(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src1 = getSource<dynamic, 0>(shader, instruction);
+	const vec4f src2 = getSource<dynamic, 1>(shader, instruction);
+	const f24 dot = src1[0] * src2[0] + src1[1] * src2[1] + src1[2] * src2[2] + src1[3] * src2[3];
+	setDest(shader, instruction, {dot, dot, dot, dot});
+}
+
+template <bool dynamic>
+void ShaderDecoder::dph(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src1 = getSource<dynamic, 0>(shader, instruction);
+	const vec4f src2 = getSource<dynamic, 1>(shader, instruction);
+	// src1.w is supposed to be replaced with 1.0 in the dot product, so we just add src2.w without multiplying it with anything
+	const f24 dot = src1[0] * src2[0] + src1[1] * src2[1] + src1[2] * src2[2] + src2[3];
+	setDest(shader, instruction, {dot, dot, dot, dot});
+}
+
+template <bool dynamic>
+void ShaderDecoder::rcp(PICAShader& shader, const DecodedInstruction& instruction) {
+	float input = getSource<dynamic, 0>(shader, instruction)[0].toFloat32();
+	if (input == -0.0f) {
+		input = 0.0f;
+	}
+
+	const f24 result = f24::fromFloat32(1.0f / input);
+	setDest(shader, instruction, {result, result, result, result});
+}
+
+template <bool dynamic>
+void ShaderDecoder::rsq(PICAShader& shader, const DecodedInstruction& instruction) {
+	float input = getSource<dynamic, 0>(shader, instruction)[0].toFloat32();
+	if (input == -0.0f) {
+		input = 0.0f;
+	}
+
+	const f24 result = f24::fromFloat32(1.0f / std::sqrt(input));
+	setDest(shader, instruction, {result, result, result, result});
+}
+
+template <bool dynamic>
+void ShaderDecoder::ex2(PICAShader& shader, const DecodedInstruction& instruction) {
+	const f24 result = f24::fromFloat32(std::exp2(getSource<dynamic, 0>(shader, instruction)[0].toFloat32()));
+	setDest(shader, instruction, {result, result, result, result});
+}
+
+template <bool dynamic>
+void ShaderDecoder::lg2(PICAShader& shader, const DecodedInstruction& instruction) {
+	const f24 result = f24::fromFloat32(std::log2(getSource<dynamic, 0>(shader, instruction)[0].toFloat32()));
+	setDest(shader, instruction, {result, result, result, result});
+}
+
+template <bool dynamic>
+void ShaderDecoder::mad(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src1 = getSource<dynamic, 0>(shader, instruction);
+	const vec4f src2 = getSource<dynamic, 1>(shader, instruction);
+	const vec4f src3 = getSource<dynamic, 2>(shader, instruction);
+	vec4f result;
+
+	for (int i = 0; i < 4; i++) {
+		result[i] = src1[i] * src2[i] + src3[i];
+	}
+
+	setDest(shader, instruction, result);
+}
+
+template <bool dynamic>
+void ShaderDecoder::slt(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src1 = getSource<dynamic, 0>(shader, instruction);
+	const vec4f src2 = getSource<dynamic, 1>(shader, instruction);
+	vec4f result;
+
+	for (int i = 0; i < 4; i++) {
+		result[i] = src1[i] < src2[i] ? f24::fromFloat32(1.0) : f24::zero();
+	}
+
+	setDest(shader, instruction, result);
+}
+
+template <bool dynamic>
+void ShaderDecoder::sge(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src1 = getSource<dynamic, 0>(shader, instruction);
+	const vec4f src2 = getSource<dynamic, 1>(shader, instruction);
+	vec4f result;
+
+	for (int i = 0; i < 4; i++) {
+		result[i] = src1[i] >= src2[i] ? f24::fromFloat32(1.0) : f24::zero();
+	}
+
+	setDest(shader, instruction, result);
+}
+
+template <bool dynamic>
+void ShaderDecoder::cmp(PICAShader& shader, const DecodedInstruction& instruction) {
+	const vec4f src1 = getSource<dynamic, 0>(shader, instruction);
+	const vec4f src2 = getSource<dynamic, 1>(shader, instruction);
+	const u32 cmpY = getBits<21, 3>(instruction.instruction);
+	const u32 cmpX = getBits<24, 3>(instruction.instruction);
+	const u32 cmpOperations[2] = {cmpX, cmpY};
+
+	for (int i = 0; i < 2; i++) {
+		switch (cmpOperations[i]) {
+			case 0: shader.cmpRegister[i] = src1[i] == src2[i]; break;  // Equal
+			case 1: shader.cmpRegister[i] = src1[i] != src2[i]; break;  // Not equal
+			case 2: shader.cmpRegister[i] = src1[i] < src2[i]; break;   // Less than
+			case 3: shader.cmpRegister[i] = src1[i] <= src2[i]; break;  // Less than or equal
+			case 4: shader.cmpRegister[i] = src1[i] > src2[i]; break;   // Greater than
+			case 5: shader.cmpRegister[i] = src1[i] >= src2[i]; break;  // Greater than or equal
+			default: shader.cmpRegister[i] = true; break;
+		}
+	}
+}
+
+template <void (PICAShader::*function)(u32)>
+void ShaderDecoder::flowControl(PICAShader& shader, const DecodedInstruction& instruction) {
+	(shader.*function)(instruction.instruction);
+}
+
+void ShaderDecoder::unimplemented(PICAShader&, const DecodedInstruction& instruction) {
+	Helpers::panic("Unimplemented PICA instruction %08X (Opcode = %02X)", instruction.instruction, instruction.instruction >> 26);
+}
+
+void ShaderDecoder::unimplementedIndexing(PICAShader&, const DecodedInstruction& instruction) {
+	Helpers::panic("[PICA] Opcode %02X: idx != 0", instruction.instruction >> 26);
+}
+
+template <bool dynamic>
+DecodedInstruction::Handler ShaderDecoder::getHandler(u32 opcode, u32 index) {
+	switch (opcode) {
+		case ShaderOpcodes::ADD: return &add<dynamic>;
+		case ShaderOpcodes::DP3: return &dp3<dynamic>;
+		case ShaderOpcodes::DP4: return &dp4<dynamic>;
+		case ShaderOpcodes::DPHI: return &dph<dynamic>;
+		case ShaderOpcodes::EX2: return &ex2<dynamic>;
+		case ShaderOpcodes::FLR: return &flr<dynamic>;
+		case ShaderOpcodes::LG2: return &lg2<dynamic>;
+		case ShaderOpcodes::MOV: return &mov<dynamic>;
+		case ShaderOpcodes::MOVA: return &mova<dynamic>;
+		case ShaderOpcodes::MUL: return &mul<dynamic>;
+		case ShaderOpcodes::SGE:
+		case ShaderOpcodes::SGEI: return &sge<dynamic>;
+		case ShaderOpcodes::SLT:
+		case ShaderOpcodes::SLTI: return &slt<dynamic>;
+
+		// These don't support relative addressing
+		case ShaderOpcodes::MAX: return index != 0 ? &unimplementedIndexing : &max<dynamic>;
+		case ShaderOpcodes::MIN: return index != 0 ? &unimplementedIndexing : &min<dynamic>;
+		case ShaderOpcodes::RCP: return index != 0 ? &unimplementedIndexing : &rcp<dynamic>;
+		case ShaderOpcodes::RSQ: return index != 0 ? &unimplementedIndexing : &rsq<dynamic>;
+		case ShaderOpcodes::CMP1:
+		case ShaderOpcodes::CMP2: return index != 0 ? &unimplementedIndexing : &cmp<dynamic>;
+
+		default:
+			// Everything from 0x30 to 0x3F is a MADI or MAD
+			if (opcode >= 0x30) {
+				return &mad<dynamic>;
+			}
+			return &unimplemented;
+	}
+}
+
+void ShaderDecoder::decodeInstruction(const PICAShader& shader, u32 instruction, DecodedInstruction& decoded) {
+	decoded = DecodedInstruction{};
+	decoded.instruction = instruction;
+	const u32 opcode = instruction >> 26;
+
+	switch (opcode) {
+		case ShaderOpcodes::END: decoded.handler = nullptr; return;
+		case ShaderOpcodes::NOP: decoded.handler = &nop; return;
+		case ShaderOpcodes::CALL: decoded.handler = &flowControl<&PICAShader::call>; return;
+		case ShaderOpcodes::CALLC: decoded.handler = &flowControl<&PICAShader::callc>; return;
+		case ShaderOpcodes::CALLU: decoded.handler = &flowControl<&PICAShader::callu>; return;
+		case ShaderOpcodes::IFC: decoded.handler = &flowControl<&PICAShader::ifc>; return;
+		case ShaderOpcodes::IFU: decoded.handler = &flowControl<&PICAShader::ifu>; return;
+		case ShaderOpcodes::JMPC: decoded.handler = &flowControl<&PICAShader::jmpc>; return;
+		case ShaderOpcodes::JMPU: decoded.handler = &flowControl<&PICAShader::jmpu>; return;
+		case ShaderOpcodes::LOOP: decoded.handler = &flowControl<&PICAShader::loop>; return;
+		default: break;
+	}
+
+	// Pull the registers out of the instruction. Only one source can be 7 bits wide and point to a float uniform, which is also the one
+	// that relative addressing applies to
+	std::array<u32, 3> sources = {0, 0, 0};
+	u32 operandDescriptor, dest, index, wideSource;
+
+	if (opcode >= 0x30) {
+		operandDescriptor = shader.operandDescriptors[instruction & 0x1f];
+		index = getBits<22, 2>(instruction);
+		dest = getBits<24, 5>(instruction);
+
+		if (opcode >= 0x38) {  // MAD
+			sources = {getBits<17, 5>(instruction), getBits<10, 7>(instruction), getBits<5, 5>(instruction)};
+			wideSource = 1;
+		} else {  // MADI
+			sources = {getBits<17, 5>(instruction), getBits<12, 5>(instruction), getBits<5, 7>(instruction)};
+			wideSource = 2;
+		}
+	} else {
+		operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+		index = getBits<19, 2>(instruction);
+		dest = getBits<21, 5>(instruction);
+
+		// The inverted instructions swap the widths of src1 and src2
+		if (opcode == ShaderOpcodes::DPHI || opcode == ShaderOpcodes::SGEI || opcode == ShaderOpcodes::SLTI) {
+			sources = {getBits<14, 5>(instruction), getBits<7, 7>(instruction), 0};
+			wideSource = 1;
+		} else {
+			sources = {getBits<12, 7>(instruction), getBits<7, 5>(instruction), 0};
+			wideSource = 0;
+		}
+	}
+
+	auto getOffset = [&](const vec4f& reg) { return u16(reinterpret_cast<const u8*>(&reg) - reinterpret_cast<const u8*>(&shader)); };
+
+	for (u32 i = 0; i < 3; i++) {
+		const u32 source = sources[i];
+		if (source < 0x10) {
+			decoded.sources[i] = getOffset(shader.inputs[source]);
+		} else if (source < 0x20) {
+			decoded.sources[i] = getOffset(shader.tempRegisters[source - 0x10]);
+		} else {
+			decoded.sources[i] = getOffset(shader.floatUniforms[source - 0x20]);
+		}
+	}
+
+	decoded.dest = (dest < 0x10) ? getOffset(shader.outputs[dest]) : getOffset(shader.tempRegisters[dest - 0x10]);
+
+	// Float uniforms with relative addressing need to be looked up when the instruction runs, as the address registers can change
+	const bool dynamic = index != 0 && sources[wideSource] >= 0x20;
+	decoded.dynamicSource = u8(wideSource);
+	decoded.dynamicRegister = u8(sources[wideSource]);
+	decoded.index = u8(index);
+
+	// The write mask has x in bit 3, flip it around so component i is in bit i
+	const u32 mask = operandDescriptor & 0xf;
+	decoded.writeMask = u8(((mask >> 3) & 1) | ((mask >> 1) & 2) | ((mask << 1) & 4) | ((mask << 3) & 8));
+	decoded.negateMask = u8(getBit<4>(operandDescriptor) | (getBit<13>(operandDescriptor) << 1) | (getBit<22>(operandDescriptor) << 2));
+
+	const std::array<u32, 3> swizzles = {getBits<5, 8>(operandDescriptor), getBits<14, 8>(operandDescriptor), getBits<23, 8>(operandDescriptor)};
+	for (u32 i = 0; i < 3; i++) {
+		for (u32 component = 0; component < 4; component++) {
+			decoded.swizzles[i][component] = u8((swizzles[i] >> (6 - component * 2)) & 3);
+		}
+	}
+
+	decoded.handler = dynamic ? getHandler<true>(opcode, index) : getHandler<false>(opcode, index);
+}
+
+void ShaderDecoder::decode(const PICAShader& shader, u32 entrypoint, DecodedProgram& program) {
+	// Shaders are usually a small part of the program memory, so find what can actually run instead of decoding all of it
+	static thread_local ShaderAnalysis analysis;
+	analysis.findReachableCode(shader, entrypoint);
+
+	for (u32 pc = 0; pc < PICAShader::maxInstructionCount; pc++) {
+		if (analysis.isReachable(pc)) {
+			decodeInstruction(shader, shader.loadedShader[pc], program.instructions[pc]);
+		} else {
+			program.instructions[pc] = DecodedInstruction{};
+		}
+	}
+}
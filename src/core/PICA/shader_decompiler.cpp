@@ -0,0 +1,394 @@
+#include "PICA/shader_decompiler.hpp"
+
+using namespace Helpers;
+
+static void addLine(std::string& out, u32 indent, const std::string& line) {
+	out.append(indent, '\t');
+	out += line;
+	out += '\n';
+}
+
+static constexpr char componentNames[] = "xyzw";
+
+std::string ShaderDecompiler::getFunctionName(u32 begin, u32 end) { return "sub_" + std::to_string(begin) + "_" + std::to_string(end); }
+
+std::string ShaderDecompiler::getSource(u32 source, u32 index, u32 operandDescriptor, int sourceIndex) {
+	std::string reg;
+
+	if (source < 0x10) {
+		reg = "v" + std::to_string(source);
+	} else if (source < 0x20) {
+		reg = "r[" + std::to_string(source - 0x10) + "]";
+	} else {
+		// Relative addressing only applies to float uniforms, same as PICAShader::getIndexedSource
+		const std::string uniform = std::to_string(source - 0x20);
+		switch (index) {
+			case 0: reg = "u_floatUniforms[" + uniform + "]"; break;
+			case 1: reg = "readFloatUniform(" + uniform + " + addrOffset(a0.x))"; break;
+			case 2: reg = "readFloatUniform(" + uniform + " + addrOffset(a0.y))"; break;
+			default: reg = "readFloatUniform(" + uniform + " + aL)"; break;
+		}
+	}
+
+	// src1, src2 and src3 have their negation and swizzle bits in different places of the operand descriptor
+	const u32 negateBit = (sourceIndex == 1) ? 4 : (sourceIndex == 2) ? 13 : 22;
+	const bool negate = (operandDescriptor >> negateBit) & 1;
+	const u32 swizzle = (operandDescriptor >> (negateBit + 1)) & 0xff;
+
+	// 0x1B is the identity swizzle (.xyzw)
+	if (swizzle != 0x1B) {
+		reg += '.';
+		for (int comp = 0; comp < 4; comp++) {
+			reg += componentNames[(swizzle >> (2 * (3 - comp))) & 3];
+		}
+	}
+
+	return negate ? "(-" + reg + ")" : reg;
+}
+
+std::string ShaderDecompiler::getDest(u32 dest) {
+	if (dest < 0x10) {
+		return "o[" + std::to_string(dest) + "]";
+	} else {
+		return "r[" + std::to_string(dest - 0x10) + "]";
+	}
+}
+
+std::string ShaderDecompiler::getCondition(u32 instruction) {
+	const u32 condition = getBits<22, 2>(instruction);
+	const bool refY = getBit<24>(instruction) != 0;
+	const bool refX = getBit<25>(instruction) != 0;
+	const std::string x = refX ? "cmp.x" : "!cmp.x";
+	const std::string y = refY ? "cmp.y" : "!cmp.y";
+
+	switch (condition) {
+		case 0: return "(" + x + " || " + y + ")";  // Either cmp register matches
+		case 1: return "(" + x + " && " + y + ")";  // Both cmp registers match
+		case 2: return x;                           // At least cmp.x matches
+		default: return y;                          // At least cmp.y matches
+	}
+}
+
+std::string ShaderDecompiler::getBoolUniformCondition(u32 instruction) {
+	const u32 bit = getBits<22, 4>(instruction);  // Bit of the bool uniform to check
+	return "(u_boolUniform & " + std::to_string(1u << bit) + "u) != 0u";
+}
+
+bool ShaderDecompiler::compileInstruction(std::string& out, u32 instruction, u32 indent) {
+	const u32 opcode = instruction >> 26;
+	std::string value;  // Value to write to the destination register
+	u32 operandDescriptor;
+	u32 dest;
+
+	// Writes "value" to the components of the destination register that are enabled in the operand descriptor
+	auto writeDest = [&]() {
+		const u32 componentMask = operandDescriptor & 0xf;
+		if (componentMask == 0) {
+			return;
+		}
+
+		std::string mask;
+		for (int comp = 0; comp < 4; comp++) {
+			if (componentMask & (1 << (3 - comp))) {
+				mask += componentNames[comp];
+			}
+		}
+
+		addLine(out, indent, getDest(dest) + "." + mask + " = (" + value + ")." + mask + ";");
+	};
+
+	// MAD and MADI have their own encoding with 3 sources
+	if (opcode >= 0x30) {
+		const bool isMADI = opcode < 0x38;
+		operandDescriptor = shader.operandDescriptors[instruction & 0x1f];
+		const u32 idx = getBits<22, 2>(instruction);
+		dest = getBits<24, 5>(instruction);
+
+		const std::string src1 = getSource(getBits<17, 5>(instruction), 0, operandDescriptor, 1);
+		std::string src2, src3;
+		if (isMADI) {
+			src2 = getSource(getBits<12, 5>(instruction), 0, operandDescriptor, 2);
+			src3 = getSource(getBits<5, 7>(instruction), idx, operandDescriptor, 3);
+		} else {
+			src2 = getSource(getBits<10, 7>(instruction), idx, operandDescriptor, 2);
+			src3 = getSource(getBits<5, 5>(instruction), 0, operandDescriptor, 3);
+		}
+
+		value = src1 + " * " + src2 + " + " + src3;
+		writeDest();
+		return true;
+	}
+
+	operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+	const u32 idx = getBits<19, 2>(instruction);
+	dest = getBits<21, 5>(instruction);
+
+	// The inverted instructions swap the sizes of src1 and src2 and apply relative addressing to src2 instead
+	std::string src1, src2;
+	if (opcode == ShaderOpcodes::DPHI || opcode == ShaderOpcodes::SGEI || opcode == ShaderOpcodes::SLTI) {
+		src1 = getSource(getBits<14, 5>(instruction), 0, operandDescriptor, 1);
+		src2 = getSource(getBits<7, 7>(instruction), idx, operandDescriptor, 2);
+	} else {
+		src1 = getSource(getBits<12, 7>(instruction), idx, operandDescriptor, 1);
+		src2 = getSource(getBits<7, 5>(instruction), 0, operandDescriptor, 2);
+	}
+
+	switch (opcode) {
+		case ShaderOpcodes::ADD: value = src1 + " + " + src2; break;
+		case ShaderOpcodes::MUL: value = src1 + " * " + src2; break;
+		case ShaderOpcodes::DP3: value = "vec4(dot(" + src1 + ".xyz, " + src2 + ".xyz))"; break;
+		case ShaderOpcodes::DP4: value = "vec4(dot(" + src1 + ", " + src2 + "))"; break;
+		case ShaderOpcodes::DPH:
+		case ShaderOpcodes::DPHI: value = "vec4(dot(vec4(" + src1 + ".xyz, 1.0), " + src2 + "))"; break;
+		case ShaderOpcodes::SGE:
+		case ShaderOpcodes::SGEI: value = "vec4(greaterThanEqual(" + src1 + ", " + src2 + "))"; break;
+		case ShaderOpcodes::SLT:
+		case ShaderOpcodes::SLTI: value = "vec4(lessThan(" + src1 + ", " + src2 + "))"; break;
+		case ShaderOpcodes::FLR: value = "floor(" + src1 + ")"; break;
+		case ShaderOpcodes::MAX: value = "max(" + src1 + ", " + src2 + ")"; break;
+		case ShaderOpcodes::MIN: value = "min(" + src1 + ", " + src2 + ")"; break;
+		case ShaderOpcodes::RCP: value = "vec4(1.0 / " + src1 + ".x)"; break;
+		case ShaderOpcodes::RSQ: value = "vec4(inversesqrt(" + src1 + ".x))"; break;
+		case ShaderOpcodes::EX2: value = "vec4(exp2(" + src1 + ".x))"; break;
+		case ShaderOpcodes::LG2: value = "vec4(log2(" + src1 + ".x))"; break;
+		case ShaderOpcodes::MOV: value = src1; break;
+		case ShaderOpcodes::NOP: return true;
+
+		case ShaderOpcodes::MOVA: {
+			if (operandDescriptor & 0b1000) {
+				addLine(out, indent, "a0.x = int(" + src1 + ".x);");
+			}
+			if (operandDescriptor & 0b0100) {
+				addLine(out, indent, "a0.y = int(" + src1 + ".y);");
+			}
+			return true;
+		}
+
+		case ShaderOpcodes::CMP1:
+		case ShaderOpcodes::CMP2: {
+			static constexpr const char* operations[] = {"==", "!=", "<", "<=", ">", ">="};
+			const u32 cmpOperations[2] = {getBits<24, 3>(instruction), getBits<21, 3>(instruction)};
+
+			for (int i = 0; i < 2; i++) {
+				const std::string reg = std::string("cmp.") + componentNames[i];
+				if (cmpOperations[i] < 6) {
+					const std::string comp = std::string(".") + componentNames[i];
+					addLine(out, indent, reg + " = " + src1 + comp + " " + operations[cmpOperations[i]] + " " + src2 + comp + ";");
+				} else {
+					addLine(out, indent, reg + " = true;");
+				}
+			}
+			return true;
+		}
+
+		// Anything else (JMPC, JMPU, BREAK, geometry shader instructions...) can't be translated
+		default: return false;
+	}
+
+	writeDest();
+	return true;
+}
+
+// Compile the instructions in [begin, end). Nested control flow has to end inside this range, otherwise the shader can't be
+// expressed with structured control flow and we bail out
+bool ShaderDecompiler::compileRange(std::string& out, u32 begin, u32 end, u32 indent) {
+	u32 pc = begin;
+
+	while (pc < end) {
+		const u32 instruction = shader.loadedShader[pc];
+		const u32 opcode = instruction >> 26;
+		const u32 dest = getBits<10, 12>(instruction);
+		const u32 num = instruction & 0xff;
+
+		switch (opcode) {
+			case ShaderOpcodes::END:
+				addLine(out, indent, "return false;");
+				return true;  // Anything after the END in this block is unreachable
+
+			case ShaderOpcodes::IFU:
+			case ShaderOpcodes::IFC: {
+				// The if body is [pc + 1, dest) and the else body is [dest, dest + num)
+				if (dest <= pc || dest + num > end) {
+					return false;
+				}
+
+				const std::string condition = (opcode == ShaderOpcodes::IFU) ? getBoolUniformCondition(instruction) : getCondition(instruction);
+				addLine(out, indent, "if (" + condition + ") {");
+				if (!compileRange(out, pc + 1, dest, indent + 1)) {
+					return false;
+				}
+
+				if (num != 0) {
+					addLine(out, indent, "} else {");
+					if (!compileRange(out, dest, dest + num, indent + 1)) {
+						return false;
+					}
+				}
+
+				addLine(out, indent, "}");
+				pc = dest + num;
+				break;
+			}
+
+			case ShaderOpcodes::LOOP: {
+				// The loop body is [pc + 1, dest], inclusive. It runs (uniform.x + 1) times and the loop counter starts at uniform.y,
+				// getting incremented by uniform.z after each iteration
+				if (dest <= pc || dest + 1 > end) {
+					return false;
+				}
+
+				const std::string uniform = "u_intUniforms[" + std::to_string(getBits<22, 2>(instruction)) + "]";
+				const std::string counter = "loop" + std::to_string(loopDepth);
+				addLine(out, indent, "aL = int(" + uniform + ".y);");
+				addLine(out, indent, "for (uint " + counter + " = 0u; " + counter + " <= " + uniform + ".x; " + counter + "++) {");
+
+				loopDepth++;
+				const bool success = compileRange(out, pc + 1, dest + 1, indent + 1);
+				loopDepth--;
+
+				if (!success) {
+					return false;
+				}
+
+				addLine(out, indent + 1, "aL += int(" + uniform + ".z);");
+				addLine(out, indent, "}");
+				pc = dest + 1;
+				break;
+			}
+
+			case ShaderOpcodes::CALL:
+			case ShaderOpcodes::CALLC:
+			case ShaderOpcodes::CALLU: {
+				// Subroutines become GLSL functions that return false if they hit an END
+				if (num != 0) {
+					if (dest + num > PICAShader::maxInstructionCount || !compileFunction(dest, dest + num)) {
+						return false;
+					}
+
+					const std::string call = "if (!" + getFunctionName(dest, dest + num) + "()) return false;";
+					if (opcode == ShaderOpcodes::CALL) {
+						addLine(out, indent, call);
+					} else {
+						const std::string condition = (opcode == ShaderOpcodes::CALLU) ? getBoolUniformCondition(instruction) : getCondition(instruction);
+						addLine(out, indent, "if (" + condition + ") {");
+						addLine(out, indent + 1, call);
+						addLine(out, indent, "}");
+					}
+				}
+
+				pc++;
+				break;
+			}
+
+			default:
+				if (!compileInstruction(out, instruction, indent)) {
+					return false;
+				}
+
+				pc++;
+				break;
+		}
+	}
+
+	return true;
+}
+
+bool ShaderDecompiler::compileFunction(u32 begin, u32 end) {
+	const auto range = std::make_pair(begin, end);
+	if (compiledFunctions.contains(range)) {
+		return true;
+	}
+
+	// GLSL doesn't allow recursion
+	if (functionsInProgress.contains(range)) {
+		return false;
+	}
+
+	functionsInProgress.insert(range);
+	const u32 oldLoopDepth = loopDepth;
+	loopDepth = 0;
+
+	std::string body;
+	const bool success = compileRange(body, begin, end, 1);
+
+	loopDepth = oldLoopDepth;
+	functionsInProgress.erase(range);
+
+	if (!success) {
+		return false;
+	}
+
+	// Functions are only appended once all the functions they call have been, so GLSL sees every function before its first use
+	functions += "bool " + getFunctionName(begin, end) + "() {\n" + body + "\treturn true;\n}\n\n";
+	compiledFunctions.insert(range);
+	return true;
+}
+
+std::optional<std::string> ShaderDecompiler::decompile() {
+	std::string mainBody;
+	if (!compileRange(mainBody, shader.entrypoint, PICAShader::maxInstructionCount, 1)) {
+		return std::nullopt;
+	}
+
+	std::string source = "#version 410 core\n\n";
+	for (int i = 0; i < 16; i++) {
+		source += "layout(location = " + std::to_string(i) + ") in vec4 v" + std::to_string(i) + ";\n";
+	}
+
+	source += R"(
+// Shader outputs, laid out like PICA::Vertex
+out vec4 o_vertex[8];
+
+layout(std140) uniform FloatUniforms { vec4 u_floatUniforms[96]; };
+uniform uvec4 u_intUniforms[4];
+uniform uint u_boolUniform;
+
+vec4 r[16];
+vec4 o[16];
+ivec2 a0;
+int aL;
+bvec2 cmp;
+
+vec4 readFloatUniform(int index) {
+	index &= 0x7f;
+	return (index < 96) ? u_floatUniforms[index] : vec4(1.0);
+}
+
+// Offsets from the address registers are ignored if they're outside of the [-128, 127] range
+int addrOffset(int offset) { return (offset < -128 || offset > 127) ? 0 : offset; }
+
+)";
+
+	source += functions;
+	source += "bool execShader() {\n" + mainBody + "\treturn true;\n}\n\n";
+	source += R"(void main() {
+	for (int i = 0; i < 16; i++) {
+		r[i] = vec4(0.0);
+		o[i] = vec4(0.0);
+	}
+
+	a0 = ivec2(0);
+	aL = 0;
+	cmp = bvec2(false);
+	execShader();
+
+	for (int i = 0; i < 8; i++) {
+		o_vertex[i] = vec4(0.0);
+	}
+
+)";
+
+	// Map shader outputs to fixed function properties
+	for (u32 i = 0; i < outputCount; i++) {
+		for (u32 j = 0; j < 4; j++) {
+			const u32 mapping = (outmaps[i] >> (j * 8)) & 0x1F;
+			addLine(
+				source, 1, "o_vertex[" + std::to_string(mapping / 4) + "]." + componentNames[mapping % 4] + " = o[" + std::to_string(i) + "]." +
+							   componentNames[j] + ";"
+			);
+		}
+	}
+
+	source += "}\n";
+	return source;
+}
@@ -0,0 +1,452 @@
+#include <cstdio>
+#include <optional>
+
+#include "PICA/shader_gen.hpp"
+
+using namespace PICA;
+using namespace Helpers;
+
+FragmentConfig FragmentConfig::fromRegs(const std::array<u32, 0x300>& regs) {
+	static constexpr std::array<u32, 6> ioBases = {
+		InternalRegs::TexEnv0Source, InternalRegs::TexEnv1Source, InternalRegs::TexEnv2Source,
+		InternalRegs::TexEnv3Source, InternalRegs::TexEnv4Source, InternalRegs::TexEnv5Source,
+	};
+
+	FragmentConfig config = {};
+
+	// Only keep the bits the TEV actually looks at
+	for (int i = 0; i < 6; i++) {
+		const u32 ioBase = ioBases[i];
+		config.texEnvSource[i] = regs[ioBase] & 0x0FFF0FFF;
+		config.texEnvOperand[i] = regs[ioBase + 1] & 0x00777FFF;
+		config.texEnvCombiner[i] = regs[ioBase + 2] & 0x000F000F;
+		config.texEnvScale[i] = regs[ioBase + 4] & 0x00030003;
+	}
+
+	config.texEnvUpdateBuffer = regs[InternalRegs::TexEnvUpdateBuffer] & 0xFF00;
+	config.texUnitConfig = regs[InternalRegs::TexUnitCfg] & 0x2007;
+
+	const u32 alphaControl = regs[InternalRegs::AlphaTestConfig];
+	config.alphaTestEnable = alphaControl & 1;
+	if (config.alphaTestEnable) {
+		config.alphaTestFunction = getBits<4, 3>(alphaControl);
+	}
+
+	config.lightingEnable = regs[InternalRegs::LightingEnable] & 1;
+	if (config.lightingEnable) {
+		config.lightCount = (regs[InternalRegs::LightingNumLights] & 7) + 1;
+		const u32 permutation = regs[InternalRegs::LightingLightPermutation];
+
+		for (u32 i = 0; i < config.lightCount; i++) {
+			const u32 lightID = (permutation >> (i * 3)) & 7;
+			const u32 lightConfig = regs[InternalRegs::Light0Specular0 + 0x10 * lightID + 9];  // GPUREG_LIGHTi_CONFIG
+			// Bit 0: Directional light, bit 1: Two sided diffuse, bits 4-7: LUT configuration
+			config.lights[i] = lightID | ((lightConfig & 0xF3) << 3);
+		}
+
+		config.lutDisable = getBits<16, 7>(regs[InternalRegs::LightingConfig1]);
+		for (u32 lut = 0; lut < 7; lut++) {
+			if ((config.lutDisable & (1u << lut)) == 0) {
+				config.lutInputAbs |= regs[InternalRegs::LightingLUTInputAbs] & (1u << (lut * 2));
+				config.lutInputSelect |= regs[InternalRegs::LightingLUTInputSelect] & (7u << (lut * 4));
+				config.lutInputScale |= regs[InternalRegs::LightingLUTInputScale] & (7u << (lut * 4));
+			}
+		}
+
+		config.fresnelOutput = getBits<2, 2>(regs[InternalRegs::LightingConfig0]);
+	}
+
+	return config;
+}
+
+static constexpr char shaderHeader[] = R"(#version 410 core
+
+in vec3 v_tangent;
+in vec3 v_normal;
+in vec3 v_bitangent;
+in vec4 v_colour;
+in vec3 v_texcoord0;
+in vec2 v_texcoord1;
+in vec3 v_view;
+in vec2 v_texcoord2;
+flat in vec4 v_textureEnvColor[6];
+flat in vec4 v_textureEnvBufferColor;
+
+out vec4 fragColour;
+
+uniform sampler2D u_tex0;
+uniform sampler2D u_tex1;
+uniform sampler2D u_tex2;
+uniform sampler1DArray u_tex_lighting_lut;
+
+layout(std140) uniform PicaRegs { uvec4 u_picaRegs[(0x200 - 0x48) / 4]; };
+
+uint readPicaReg(uint reg_addr) {
+	uint index = reg_addr - 0x48u;
+	return u_picaRegs[index >> 2][index & 3u];
+}
+
+vec3 regToColor(uint reg) {
+	const float scale = 1.0 / 255.0;
+	return scale * vec3(float(bitfieldExtract(reg, 20, 8)), float(bitfieldExtract(reg, 10, 8)), float(bitfieldExtract(reg, 00, 8)));
+}
+
+float decodeFP(uint hex, uint E, uint M) {
+	uint width = M + E + 1u;
+	uint bias = 128u - (1u << (E - 1u));
+	uint exponent = (hex >> M) & ((1u << E) - 1u);
+	uint mantissa = hex & ((1u << M) - 1u);
+	uint sign = (hex >> (E + M)) << 31u;
+
+	if ((hex & ((1u << (width - 1u)) - 1u)) != 0u) {
+		if (exponent == (1u << E) - 1u)
+			exponent = 255u;
+		else
+			exponent += bias;
+		hex = sign | (mantissa << (23u - M)) | (exponent << 23u);
+	} else {
+		hex = sign;
+	}
+
+	return uintBitsToFloat(hex);
+}
+
+)";
+
+// Indices into the d array of the lighting code, same as in the ubershader
+enum : u32 { D0 = 0, D1, SP, FR, RB, RG, RR };
+
+static std::string regLiteral(u32 reg) {
+	char buffer[16];
+	std::snprintf(buffer, sizeof(buffer), "0x%03Xu", reg);
+	return buffer;
+}
+
+static std::string readReg(u32 reg) { return "readPicaReg(" + regLiteral(reg) + ")"; }
+
+static std::string floatLiteral(float value) {
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%.8f", value);
+	return buffer;
+}
+
+// Decodes a vector of 3 floats, split over 2 registers like the light vector and the spotlight direction
+static std::string decodeVector(u32 reg, u32 exponentBits, u32 mantissaBits) {
+	const std::string format = std::to_string(exponentBits) + "u, " + std::to_string(mantissaBits) + "u)";
+	const std::string low = readReg(reg);
+	const std::string high = readReg(reg + 1);
+
+	return "normalize(vec3(decodeFP(bitfieldExtract(" + low + ", 0, 16), " + format + ", decodeFP(bitfieldExtract(" + low + ", 16, 16), " + format +
+		   ", decodeFP(bitfieldExtract(" + high + ", 0, 16), " + format + "))";
+}
+
+void FragmentShaderGenerator::emitLighting() {
+	out += "void calcLighting(out vec4 primaryColour, out vec4 secondaryColour) {\n";
+
+	if (!config.lightingEnable) {
+		out += "\tprimaryColour = secondaryColour = vec4(1.0);\n}\n\n";
+		return;
+	}
+
+	out += "\tvec3 normal = normalize(v_normal);\n";
+	out += "\tvec3 view = normalize(v_view);\n";
+	out += "\tprimaryColour = vec4(regToColor(" + readReg(InternalRegs::LightingAmbient) + "), 1.0);\n";
+	out += "\tsecondaryColour = vec4(vec3(0.0), 1.0);\n\n";
+	out += "\tfloat d[7];\n";
+	out += "\tvec3 lightVector;\n";
+	out += "\tvec3 halfVector;\n";
+	out += "\tfloat NdotL;\n";
+
+	for (u32 i = 0; i < config.lightCount; i++) {
+		const u32 lightID = config.lights[i] & 7;
+		const u32 lightConfig = config.lights[i] >> 3;
+		const bool directional = (lightConfig & 1) != 0;
+		const bool twoSidedDiffuse = (lightConfig & 2) != 0;
+		const u32 lookupConfig = getBits<4, 4>(lightConfig);
+		const u32 base = InternalRegs::Light0Specular0 + 0x10 * lightID;
+
+		out += "\n\t// Light " + std::to_string(lightID) + "\n";
+		out += "\tlightVector = " + decodeVector(base + 4, 5, 10) + ";\n";
+		if (directional) {
+			out += "\thalfVector = normalize(normalize(lightVector) + view);\n";
+		} else {
+			out += "\thalfVector = normalize(normalize(lightVector + v_view) + view);\n";
+		}
+
+		// The LUT configuration forces some of the LUT values to constants or to the value of the RR LUT
+		std::array<std::optional<std::string>, 7> forced;
+		bool copyRR = false;
+		switch (lookupConfig) {
+			case 0:
+				forced[D1] = forced[FR] = "0.0";
+				copyRR = true;
+				break;
+			case 1:
+				forced[D0] = forced[D1] = "0.0";
+				copyRR = true;
+				break;
+			case 2:
+				forced[FR] = forced[SP] = "0.0";
+				copyRR = true;
+				break;
+			case 3:
+				forced[SP] = "0.0";
+				forced[RG] = forced[RB] = forced[RR] = "1.0";
+				break;
+			case 4: forced[FR] = "0.0"; break;
+			case 5: forced[D1] = "0.0"; break;
+			case 6: copyRR = true; break;
+			default: break;
+		}
+
+		for (u32 lut = 0; lut < 7; lut++) {
+			const std::string value = "\td[" + std::to_string(lut) + "] = ";
+
+			if (forced[lut].has_value()) {
+				out += value + forced[lut].value() + ";\n";
+				continue;
+			} else if (copyRR && (lut == RB || lut == RG)) {
+				continue;  // Copied over once we have the RR value
+			} else if ((config.lutDisable & (1u << lut)) != 0) {
+				out += value + "1.0;\n";
+				continue;
+			}
+
+			std::string input;
+			switch ((config.lutInputSelect >> (lut * 4)) & 7) {
+				case 0: input = "dot(normal, halfVector)"; break;
+				case 1: input = "dot(view, halfVector)"; break;
+				case 2: input = "dot(normal, view)"; break;
+				case 3: input = "dot(lightVector, normal)"; break;
+				case 4: input = "dot(-lightVector, " + decodeVector(base + 6, 1, 11) + ")"; break;  // -L dot P (aka Spotlight aka SP)
+				default: input = "1.0"; break;  // TODO: cos <greek symbol> (aka CP)
+			}
+
+			static constexpr std::array<u32, 7> lutIDs = {
+				Lights::LUT_D0, Lights::LUT_D1, Lights::LUT_SP0, Lights::LUT_FR, Lights::LUT_RB, Lights::LUT_RG, Lights::LUT_RR,
+			};
+			const u32 lutID = (lut == SP) ? lutIDs[lut] + lightID : lutIDs[lut];
+			std::string lookup = "texture(u_tex_lighting_lut, vec2(" + input + " * 0.5 + 0.5, " + std::to_string(lutID) + ".0)).r";
+
+			const u32 scaleID = (config.lutInputScale >> (lut * 4)) & 7;
+			if (scaleID != 0) {
+				const float scale = (scaleID >= 6) ? float(1u << scaleID) / 256.0f : float(1u << scaleID);
+				lookup += " * " + floatLiteral(scale);
+			}
+
+			if ((config.lutInputAbs & (1u << (lut * 2))) != 0) {
+				lookup = "abs(" + lookup + ")";
+			}
+
+			out += value + lookup + ";\n";
+		}
+
+		if (copyRR) {
+			out += "\td[4] = d[5] = d[6];\n";
+		}
+
+		out += twoSidedDiffuse ? "\tNdotL = abs(dot(normal, lightVector));\n" : "\tNdotL = max(0.0, dot(normal, lightVector));\n";
+		out += "\tprimaryColour.rgb += d[2] * (regToColor(" + readReg(base + 3) + ") + regToColor(" + readReg(base + 2) + ") * NdotL);\n";
+		out += "\tsecondaryColour.rgb += d[2] * (regToColor(" + readReg(base) + ") * d[0] + regToColor(" + readReg(base + 1) +
+			   ") * d[1] * vec3(d[6], d[5], d[4]));\n";
+	}
+
+	if (config.fresnelOutput & 1) {
+		out += "\n\tprimaryColour.a = d[3];\n";
+	}
+
+	if (config.fresnelOutput & 2) {
+		out += "\n\tsecondaryColour.a = d[3];\n";
+	}
+
+	out += "}\n\n";
+}
+
+static std::string getSource(u32 source, u32 stage) {
+	switch (source) {
+		case 0: return "v_colour";
+		case 1: return "primaryColour";
+		case 2: return "secondaryColour";
+		case 3: return "texColour0";
+		case 4: return "texColour1";
+		case 5: return "texColour2";
+		case 13: return "previousBuffer";
+		case 14: return "v_textureEnvColor[" + std::to_string(stage) + "]";
+		case 15: return "previous";
+		default: return "vec4(0.0)";  // TODO: What do the unimplemented sources read as?
+	}
+}
+
+static std::string getColourOperand(u32 operand, const std::string& source) {
+	switch (operand) {
+		case 0: return source + ".rgb";                     // Source color
+		case 1: return "(vec3(1.0) - " + source + ".rgb)";  // One minus source color
+		case 2: return "vec3(" + source + ".a)";            // Source alpha
+		case 3: return "vec3(1.0 - " + source + ".a)";      // One minus source alpha
+		case 4: return "vec3(" + source + ".r)";            // Source red
+		case 5: return "vec3(1.0 - " + source + ".r)";      // One minus source red
+		case 8: return "vec3(" + source + ".g)";            // Source green
+		case 9: return "vec3(1.0 - " + source + ".g)";      // One minus source green
+		case 12: return "vec3(" + source + ".b)";           // Source blue
+		case 13: return "vec3(1.0 - " + source + ".b)";     // One minus source blue
+		default: return "vec3(0.0)";                        // TODO: figure out what the undocumented values do
+	}
+}
+
+static std::string getAlphaOperand(u32 operand, const std::string& source) {
+	switch (operand) {
+		case 0: return source + ".a";                  // Source alpha
+		case 1: return "(1.0 - " + source + ".a)";  // One minus source alpha
+		case 2: return source + ".r";                  // Source red
+		case 3: return "(1.0 - " + source + ".r)";  // One minus source red
+		case 4: return source + ".g";                  // Source green
+		case 5: return "(1.0 - " + source + ".g)";  // One minus source green
+		case 6: return source + ".b";                  // Source blue
+		default: return "(1.0 - " + source + ".b)";  // One minus source blue
+	}
+}
+
+void FragmentShaderGenerator::emitTevStage(u32 stage) {
+	const u32 source = config.texEnvSource[stage];
+	const u32 operand = config.texEnvOperand[stage];
+	const u32 colourCombine = config.texEnvCombiner[stage] & 0xF;
+	const u32 alphaCombine = config.texEnvCombiner[stage] >> 16;
+	const u32 colourScale = config.texEnvScale[stage] & 3;
+	const u32 alphaScale = config.texEnvScale[stage] >> 16;
+
+	// Stages that replace the previous colour with itself are very common, as games only use as many stages as they need
+	const bool passthrough = colourCombine == 0 && alphaCombine == 0 && (source & 0xF000F) == 0xF000F && (operand & 0x700F) == 0 &&
+							 colourScale == 0 && alphaScale == 0;
+
+	out += "\t// TEV stage " + std::to_string(stage) + "\n";
+	if (!passthrough) {
+		std::array<std::string, 3> colours;
+		std::array<std::string, 3> alphas;
+		for (u32 i = 0; i < 3; i++) {
+			colours[i] = getColourOperand((operand >> (i * 4)) & 0xF, getSource((source >> (i * 4)) & 0xF, stage));
+			alphas[i] = getAlphaOperand((operand >> (12 + i * 4)) & 7, getSource((source >> (16 + i * 4)) & 0xF, stage));
+		}
+
+		const auto& [c0, c1, c2] = colours;
+		const auto& [a0, a1, a2] = alphas;
+		std::string colour;
+		std::string alpha;
+
+		// TODO: figure out what the undocumented values do
+		switch (colourCombine) {
+			case 0: colour = c0; break;                                                       // Replace
+			case 1: colour = c0 + " * " + c1; break;                                          // Modulate
+			case 2: colour = "min(vec3(1.0), " + c0 + " + " + c1 + ")"; break;                // Add
+			case 3: colour = "clamp(" + c0 + " + " + c1 + " - 0.5, 0.0, 1.0)"; break;         // Add signed
+			case 4: colour = "mix(" + c1 + ", " + c0 + ", " + c2 + ")"; break;                // Interpolate
+			case 5: colour = "max(" + c0 + " - " + c1 + ", 0.0)"; break;                      // Subtract
+			case 6:                                                                           // Dot3 RGB
+			case 7: colour = "vec3(4.0 * dot(" + c0 + " - 0.5, " + c1 + " - 0.5))"; break;  // Dot3 RGBA
+			case 8: colour = "min(" + c0 + " * " + c1 + " + " + c2 + ", 1.0)"; break;         // Multiply then add
+			case 9: colour = "min((" + c0 + " + " + c1 + ") * " + c2 + ", 1.0)"; break;       // Add then multiply
+			default: colour = "vec3(1.0)"; break;
+		}
+
+		switch (alphaCombine) {
+			case 0: alpha = a0; break;                                                    // Replace
+			case 1: alpha = a0 + " * " + a1; break;                                       // Modulate
+			case 2: alpha = "min(1.0, " + a0 + " + " + a1 + ")"; break;                   // Add
+			case 3: alpha = "clamp(" + a0 + " + " + a1 + " - 0.5, 0.0, 1.0)"; break;      // Add signed
+			case 4: alpha = "mix(" + a1 + ", " + a0 + ", " + a2 + ")"; break;             // Interpolate
+			case 5: alpha = "max(0.0, " + a0 + " - " + a1 + ")"; break;                   // Subtract
+			case 8: alpha = "min(1.0, " + a0 + " * " + a1 + " + " + a2 + ")"; break;      // Multiply then add
+			case 9: alpha = "min(1.0, (" + a0 + " + " + a1 + ") * " + a2 + ")"; break;    // Add then multiply
+			default: alpha = "1.0"; break;
+		}
+
+		// The color combiner also writes the alpha channel in the "Dot3 RGBA" mode
+		if (colourCombine == 7) {
+			alpha = "(4.0 * dot(" + c0 + " - 0.5, " + c1 + " - 0.5))";
+		}
+
+		if (colourScale != 0) {
+			colour = "(" + colour + ") * " + std::to_string(1 << colourScale) + ".0";
+		}
+
+		if (alphaScale != 0) {
+			alpha = "(" + alpha + ") * " + std::to_string(1 << alphaScale) + ".0";
+		}
+
+		out += "\tprevious = vec4(" + colour + ", " + alpha + ");\n";
+	}
+
+	out += "\tpreviousBuffer = nextPreviousBuffer;\n";
+	if (stage < 4) {
+		if (config.texEnvUpdateBuffer & (0x100u << stage)) {
+			out += "\tnextPreviousBuffer.rgb = previous.rgb;\n";
+		}
+
+		if (config.texEnvUpdateBuffer & (0x1000u << stage)) {
+			out += "\tnextPreviousBuffer.a = previous.a;\n";
+		}
+	}
+
+	out += "\n";
+}
+
+void FragmentShaderGenerator::emitAlphaTest() {
+	if (!config.alphaTestEnable) {
+		return;
+	}
+
+	const std::string reference = "float((" + readReg(InternalRegs::AlphaTestConfig) + " >> 8u) & 0xffu) / 255.0";
+	std::string failCondition;
+
+	switch (config.alphaTestFunction) {
+		case 0: out += "\tdiscard;\n"; return;  // Never pass alpha test
+		case 1: return;                          // Always pass alpha test
+		case 2: failCondition = "!="; break;     // Pass if equal
+		case 3: failCondition = "=="; break;     // Pass if not equal
+		case 4: failCondition = ">="; break;     // Pass if less than
+		case 5: failCondition = ">"; break;      // Pass if less than or equal
+		case 6: failCondition = "<="; break;     // Pass if greater than
+		default: failCondition = "<"; break;     // Pass if greater than or equal
+	}
+
+	out += "\tif (fragColour.a " + failCondition + " " + reference + ") discard;\n";
+}
+
+std::string FragmentShaderGenerator::generate() {
+	out = shaderHeader;
+	emitLighting();
+
+	out += "void main() {\n";
+	out += "\tvec4 primaryColour;\n";
+	out += "\tvec4 secondaryColour;\n";
+	out += "\tcalcLighting(primaryColour, secondaryColour);\n\n";
+
+	// Disabled texture units read as 0
+	const u32 texUnitConfig = config.texUnitConfig;
+	const char* tex2UV = (texUnitConfig & (1u << 13)) ? "v_texcoord1" : "v_texcoord2";
+	out += (texUnitConfig & 1) ? "\tvec4 texColour0 = texture(u_tex0, v_texcoord0.xy);\n" : "\tvec4 texColour0 = vec4(0.0);\n";
+	out += (texUnitConfig & 2) ? "\tvec4 texColour1 = texture(u_tex1, v_texcoord1);\n" : "\tvec4 texColour1 = vec4(0.0);\n";
+	out += (texUnitConfig & 4) ? std::string("\tvec4 texColour2 = texture(u_tex2, ") + tex2UV + ");\n" : "\tvec4 texColour2 = vec4(0.0);\n";
+
+	out += "\n\tvec4 previous = v_colour;\n";
+	out += "\tvec4 previousBuffer = vec4(0.0);\n";
+	out += "\tvec4 nextPreviousBuffer = v_textureEnvBufferColor;\n\n";
+
+	for (u32 stage = 0; stage < 6; stage++) {
+		emitTevStage(stage);
+	}
+
+	out += "\tfragColour = previous;\n\n";
+
+	// Same depth calculation as the ubershader, except it reads the depth registers directly instead of going through uniforms
+	out += "\tfloat z_over_w = gl_FragCoord.z * 2.0f - 1.0f;\n";
+	out += "\tfloat depthScale = decodeFP(" + readReg(InternalRegs::DepthScale) + " & 0xffffffu, 7u, 16u);\n";
+	out += "\tfloat depthOffset = decodeFP(" + readReg(InternalRegs::DepthOffset) + " & 0xffffffu, 7u, 16u);\n";
+	out += "\tfloat depth = z_over_w * depthScale + depthOffset;\n";
+	out += "\tif ((" + readReg(InternalRegs::DepthmapEnable) + " & 1u) == 0u) depth /= gl_FragCoord.w;\n";
+	out += "\tgl_FragDepth = depth;\n\n";
+
+	emitAlphaTest();
+	out += "}\n";
+
+	return std::move(out);
+}
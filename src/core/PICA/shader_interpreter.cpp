@@ -1,81 +1,57 @@
-#include <cmath>
+#include <bit>
 
 #include "PICA/shader.hpp"
 
 using namespace Helpers;
 
+const DecodedProgram& PICAShader::getDecodedProgram() {
+	// Same hash combination as the shader JIT, see ShaderJIT::prepare. We only decode the code reachable from the entrypoint, so different
+	// entrypoints into the same code need their own programs
+	const Hash hash = std::rotl(std::rotl(getCodeHash(), 1) ^ getOpdescHash(), 12) ^ entrypoint;
+	if (decodedProgram != nullptr && hash == decodedProgramHash) [[likely]] {
+		return *decodedProgram;
+	}
+
+	auto it = decodedPrograms.find(hash);
+	if (it != decodedPrograms.end()) {
+		// Mark it as the most recently used one
+		decodedProgramList.splice(decodedProgramList.begin(), decodedProgramList, it->second);
+	} else {
+		std::unique_ptr<DecodedProgram> program;
+
+		// Reuse the least recently used program's memory if the cache is full
+		if (decodedProgramList.size() >= maxDecodedPrograms) {
+			program = std::move(decodedProgramList.back().program);
+			decodedPrograms.erase(decodedProgramList.back().hash);
+			decodedProgramList.pop_back();
+		} else {
+			program = std::make_unique<DecodedProgram>();
+		}
+
+		ShaderDecoder::decode(*this, entrypoint, *program);
+		decodedProgramList.push_front(CachedProgram{.hash = hash, .program = std::move(program)});
+		decodedPrograms.emplace(hash, decodedProgramList.begin());
+	}
+
+	decodedProgram = decodedProgramList.front().program.get();
+	decodedProgramHash = hash;
+	return *decodedProgram;
+}
+
 void PICAShader::run() {
 	pc = entrypoint;
 	loopIndex = 0;
 	ifIndex = 0;
 	callIndex = 0;
 
-	while (true) {
-		const u32 instruction = loadedShader[pc++];
-		const u32 opcode = instruction >> 26;  // Top 6 bits are the opcode
-
-		switch (opcode) {
-			case ShaderOpcodes::ADD: add(instruction); break;
-			case ShaderOpcodes::CALL: call(instruction); break;
-			case ShaderOpcodes::CALLC: callc(instruction); break;
-			case ShaderOpcodes::CALLU: callu(instruction); break;
-			case ShaderOpcodes::CMP1:
-			case ShaderOpcodes::CMP2: {
-				cmp(instruction);
-				break;
-			}
+	const DecodedProgram& program = getDecodedProgram();
 
-			case ShaderOpcodes::DP3: dp3(instruction); break;
-			case ShaderOpcodes::DP4: dp4(instruction); break;
-			case ShaderOpcodes::DPHI: dphi(instruction); break;
-			case ShaderOpcodes::END: return;  // Stop running shader
-			case ShaderOpcodes::EX2: ex2(instruction); break;
-			case ShaderOpcodes::FLR: flr(instruction); break;
-			case ShaderOpcodes::IFC: ifc(instruction); break;
-			case ShaderOpcodes::IFU: ifu(instruction); break;
-			case ShaderOpcodes::JMPC: jmpc(instruction); break;
-			case ShaderOpcodes::JMPU: jmpu(instruction); break;
-			case ShaderOpcodes::LG2: lg2(instruction); break;
-			case ShaderOpcodes::LOOP: loop(instruction); break;
-			case ShaderOpcodes::MAX: max(instruction); break;
-			case ShaderOpcodes::MIN: min(instruction); break;
-			case ShaderOpcodes::MOV: mov(instruction); break;
-			case ShaderOpcodes::MOVA: mova(instruction); break;
-			case ShaderOpcodes::MUL: mul(instruction); break;
-			case ShaderOpcodes::NOP: break;  // Do nothing
-			case ShaderOpcodes::RCP: rcp(instruction); break;
-			case ShaderOpcodes::RSQ: rsq(instruction); break;
-			case ShaderOpcodes::SGE: sge(instruction); break;
-			case ShaderOpcodes::SGEI: sgei(instruction); break;
-			case ShaderOpcodes::SLT: slt(instruction); break;
-			case ShaderOpcodes::SLTI: slti(instruction); break;
-
-			case 0x30:
-			case 0x31:
-			case 0x32:
-			case 0x33:
-			case 0x34:
-			case 0x35:
-			case 0x36:
-			case 0x37: {
-				madi(instruction);
-				break;
-			}
-
-			case 0x38:
-			case 0x39:
-			case 0x3A:
-			case 0x3B:
-			case 0x3C:
-			case 0x3D:
-			case 0x3E:
-			case 0x3F: {
-				mad(instruction);
-				break;
-			}
-
-			default: Helpers::panic("Unimplemented PICA instruction %08X (Opcode = %02X)", instruction, opcode);
+	while (true) {
+		const DecodedInstruction& instruction = program.instructions[pc++];
+		if (instruction.handler == nullptr) [[unlikely]] {  // END
+			return;
 		}
+		instruction.handler(*this, instruction);
 
 		// Handle control flow statements. The ordering is important as the priority goes: LOOP > IF > CALL
 		// Handle loop
@@ -83,11 +59,13 @@ void PICAShader::run() {
 			auto& loop = loopInfo[loopIndex - 1];
 			if (pc == loop.endingPC) {  // Check if the loop needs to start over
 				loop.iterations -= 1;
-				if (loop.iterations == 0)  // If the loop ended, go one level down on the loop stack
-					loopIndex -= 1;
-
 				loopCounter += loop.increment;
-				pc = loop.startingPC;
+
+				if (loop.iterations == 0) {  // If the loop ended, go one level down on the loop stack
+					loopIndex -= 1;
+				} else {
+					pc = loop.startingPC;
+				}
 			}
 		}
 
@@ -177,481 +155,6 @@ bool PICAShader::isCondTrue(u32 instruction) {
 	}
 }
 
-void PICAShader::add(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction);  // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src1 = getIndexedSource(src1, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] + srcVec2[3 - i];
-		}
-	}
-}
-
-void PICAShader::mul(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction);  // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src1 = getIndexedSource(src1, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] * srcVec2[3 - i];
-		}
-	}
-}
-
-void PICAShader::flr(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src = getIndexedSource(src, idx);
-	vec4f srcVector = getSourceSwizzled<1>(src, operandDescriptor);
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = f24::fromFloat32(std::floor(srcVector[3 - i].toFloat32()));
-		}
-	}
-}
-
-void PICAShader::max(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction);  // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	if (idx) Helpers::panic("[PICA] MAX: idx != 0");
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			const float inputA = srcVec1[3 - i].toFloat32();
-			const float inputB = srcVec2[3 - i].toFloat32();
-			// max(NaN, 2.f) -> NaN
-			// max(2.f, NaN) -> 2
-			const auto& maximum = std::isinf(inputB) ? inputB : std::max(inputB, inputA);
-			destVector[3 - i] = f24::fromFloat32(maximum);
-		}
-	}
-}
-
-void PICAShader::min(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction);  // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	if (idx) Helpers::panic("[PICA] MIN: idx != 0");
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			const float inputA = srcVec1[3 - i].toFloat32();
-			const float inputB = srcVec2[3 - i].toFloat32();
-			// min(NaN, 2.f) -> NaN
-			// min(2.f, NaN) -> 2
-			const auto& mininum = std::min(inputB, inputA);
-			destVector[3 - i] = f24::fromFloat32(mininum);
-		}
-	}
-}
-
-void PICAShader::mov(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src = getIndexedSource(src, idx);
-	vec4f srcVector = getSourceSwizzled<1>(src, operandDescriptor);
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVector[3 - i];
-		}
-	}
-}
-
-void PICAShader::mova(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-
-	src = getIndexedSource(src, idx);
-	vec4f srcVector = getSourceSwizzled<1>(src, operandDescriptor);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	if (componentMask & 0b1000)  // x component
-		addrRegister[0] = static_cast<s32>(srcVector[0].toFloat32());
-	if (componentMask & 0b0100)  // y component
-		addrRegister[1] = static_cast<s32>(srcVector[1].toFloat32());
-}
-
-void PICAShader::dp3(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction);  // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src1 = getIndexedSource(src1, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-	f24 dot = srcVec1[0] * srcVec2[0] + srcVec1[1] * srcVec2[1] + srcVec1[2] * srcVec2[2];
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = dot;
-		}
-	}
-}
-
-void PICAShader::dp4(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction);  // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src1 = getIndexedSource(src1, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-	f24 dot = srcVec1[0] * srcVec2[0] + srcVec1[1] * srcVec2[1] + srcVec1[2] * srcVec2[2] + srcVec1[3] * srcVec2[3];
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = dot;
-		}
-	}
-}
-
-void PICAShader::dphi(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<14, 5>(instruction);
-	u32 src2 = getBits<7, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src2 = getIndexedSource(src2, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-	// srcVec1[3] is supposed to be replaced with 1.0 in the dot product, so we just add srcVec2[3] without multiplying it with anything
-	f24 dot = srcVec1[0] * srcVec2[0] + srcVec1[1] * srcVec2[1] + srcVec1[2] * srcVec2[2] + srcVec2[3];
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = dot;
-		}
-	}
-}
-
-void PICAShader::rcp(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	if (idx) Helpers::panic("[PICA] RCP: idx != 0");
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-	float input = srcVec1[0].toFloat32();
-	if (input == -0.0f) {
-		input = 0.0f;
-	}
-	const f24 res = f24::fromFloat32(1.0f / input);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = res;
-		}
-	}
-}
-
-void PICAShader::rsq(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	if (idx) Helpers::panic("[PICA] RSQ: idx != 0");
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-	float input = srcVec1[0].toFloat32();
-	if (input == -0.0f) {
-		input = 0.0f;
-	}
-	const f24 res = f24::fromFloat32(1.0f / std::sqrt(input));
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = res;
-		}
-	}
-}
-
-void PICAShader::ex2(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src = getIndexedSource(src, idx);
-	vec4f srcVec = getSourceSwizzled<1>(src, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-	f24 res = f24::fromFloat32(std::exp2(srcVec[0].toFloat32()));
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = res;
-		}
-	}
-}
-
-void PICAShader::lg2(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src = getIndexedSource(src, idx);
-	vec4f srcVec = getSourceSwizzled<1>(src, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-	f24 res = f24::fromFloat32(std::log2(srcVec[0].toFloat32()));
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = res;
-		}
-	}
-}
-
-void PICAShader::mad(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x1f];
-	const u32 src1 = getBits<17, 5>(instruction);
-	u32 src2 = getBits<10, 7>(instruction);
-	const u32 src3 = getBits<5, 5>(instruction);
-	const u32 idx = getBits<22, 2>(instruction);
-	const u32 dest = getBits<24, 5>(instruction);
-
-	src2 = getIndexedSource(src2, idx);
-
-	auto srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	auto srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-	auto srcVec3 = getSourceSwizzled<3>(src3, operandDescriptor);
-	auto& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] * srcVec2[3 - i] + srcVec3[3 - i];
-		}
-	}
-}
-
-void PICAShader::madi(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x1f];
-	const u32 src1 = getBits<17, 5>(instruction);
-	const u32 src2 = getBits<12, 5>(instruction);
-	u32 src3 = getBits<5, 7>(instruction);
-	const u32 idx = getBits<22, 2>(instruction);
-	const u32 dest = getBits<24, 5>(instruction);
-
-	src3 = getIndexedSource(src3, idx);
-
-	auto srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	auto srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-	auto srcVec3 = getSourceSwizzled<3>(src3, operandDescriptor);
-	auto& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] * srcVec2[3 - i] + srcVec3[3 - i];
-		}
-	}
-}
-
-void PICAShader::slt(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction);  // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src1 = getIndexedSource(src1, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-	auto& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] < srcVec2[3 - i] ? f24::fromFloat32(1.0) : f24::zero();
-		}
-	}
-}
-
-void PICAShader::sge(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction);  // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src1 = getIndexedSource(src1, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-	auto& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] >= srcVec2[3 - i] ? f24::fromFloat32(1.0) : f24::zero();
-		}
-	}
-}
-
-void PICAShader::sgei(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<14, 5>(instruction);
-	u32 src2 = getBits<7, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src2 = getIndexedSource(src2, idx);
-
-	auto srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	auto srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-	auto& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] >= srcVec2[3 - i] ? f24::fromFloat32(1.0) : f24::zero();
-		}
-	}
-}
-
-void PICAShader::slti(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<14, 5>(instruction);
-	u32 src2 = getBits<7, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src2 = getIndexedSource(src2, idx);
-
-	auto srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	auto srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-	auto& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] < srcVec2[3 - i] ? f24::fromFloat32(1.0) : f24::zero();
-		}
-	}
-}
-
-void PICAShader::cmp(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction);  // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 cmpY = getBits<21, 3>(instruction);
-	const u32 cmpX = getBits<24, 3>(instruction);
-	const u32 cmpOperations[2] = {cmpX, cmpY};
-
-	if (idx) Helpers::panic("[PICA] CMP: idx != 0");
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	for (int i = 0; i < 2; i++) {
-		switch (cmpOperations[i]) {
-			case 0:  // Equal
-				cmpRegister[i] = srcVec1[i] == srcVec2[i];
-				break;
-
-			case 1:  // Not equal
-				cmpRegister[i] = srcVec1[i] != srcVec2[i];
-				break;
-
-			case 2:  // Less than
-				cmpRegister[i] = srcVec1[i] < srcVec2[i];
-				break;
-
-			case 3:  // Less than or equal
-				cmpRegister[i] = srcVec1[i] <= srcVec2[i];
-				break;
-
-			case 4:  // Greater than
-				cmpRegister[i] = srcVec1[i] > srcVec2[i];
-				break;
-
-			case 5:  // Greater than or equal
-				cmpRegister[i] = srcVec1[i] >= srcVec2[i];
-				break;
-
-			default: {
-				cmpRegister[i] = true;
-				break;
-			}
-		}
-	}
-}
-
 void PICAShader::ifc(u32 instruction) {
 	const u32 dest = getBits<10, 12>(instruction);
 
@@ -22,6 +22,7 @@ void PICAShader::reset() {
 	const vec4f zero = vec4f({f24::zero(), f24::zero(), f24::zero(), f24::zero()});
 	inputs.fill(zero);
 	floatUniforms.fill(zero);
+	floatUniformsDirty.fill(~0ull);
 	outputs.fill(zero);
 	tempRegisters.fill(zero);
 
@@ -35,4 +36,24 @@ void PICAShader::reset() {
 
 	codeHashDirty = true;
 	opdescHashDirty = true;
-}
\ No newline at end of file
+}
+
+void PICAShader::copyExecutionState(const PICAShader& other) {
+	entrypoint = other.entrypoint;
+	boolUniform = other.boolUniform;
+	intUniforms = other.intUniforms;
+	floatUniforms = other.floatUniforms;
+	fixedAttributes = other.fixedAttributes;
+	inputs = other.inputs;
+	tempRegisters = other.tempRegisters;
+	addrRegister = other.addrRegister;
+	loopCounter = other.loopCounter;
+	operandDescriptors = other.operandDescriptors;
+	loadedShader = other.loadedShader;
+
+	// The hashes match the code and operand descriptors we just copied, so there's no need to hash them again
+	lastCodeHash = other.lastCodeHash;
+	lastOpdescHash = other.lastOpdescHash;
+	codeHashDirty = other.codeHashDirty;
+	opdescHashDirty = other.opdescHashDirty;
+}
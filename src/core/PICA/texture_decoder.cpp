@@ -0,0 +1,747 @@
+#include "PICA/texture_decoder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "colour.hpp"
+
+#if defined(PANDA3DS_X64_HOST)
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#elif defined(PANDA3DS_ARM64_HOST)
+#include <arm_neon.h>
+#endif
+
+using namespace Helpers;
+
+namespace {
+	static constexpr u32 etcModifiers[8][2] = {
+		{2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183},
+	};
+
+	// Thin wrapper over 4 lanes of u32, so that every texel format only needs to be written once for all hosts
+	namespace Lanes {
+#if defined(PANDA3DS_X64_HOST)
+		// SSE2 is baseline on x64, so we don't need any runtime checks
+		using Vec = __m128i;
+
+		inline Vec splat(u32 value) { return _mm_set1_epi32(s32(value)); }
+		inline Vec bitAnd(Vec a, Vec b) { return _mm_and_si128(a, b); }
+		inline Vec bitOr(Vec a, Vec b) { return _mm_or_si128(a, b); }
+
+		template <int n>
+		inline Vec shiftLeft(Vec v) {
+			return _mm_slli_epi32(v, n);
+		}
+
+		template <int n>
+		inline Vec shiftRight(Vec v) {
+			return _mm_srli_epi32(v, n);
+		}
+
+		// Load 4 texels of 4, 2 or 1 bytes each, zero-extending them to 32 bits
+		inline Vec load32(const u8* data) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)); }
+		inline Vec load16(const u8* data) {
+			return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data)), _mm_setzero_si128());
+		}
+
+		inline Vec load8(const u8* data) {
+			u32 word;
+			std::memcpy(&word, data, sizeof(word));
+
+			const Vec zero = _mm_setzero_si128();
+			return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(s32(word)), zero), zero);
+		}
+
+		inline void store(u32* output, Vec v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(output), v); }
+
+		inline Vec byteSwap(Vec v) {
+#if defined(__SSSE3__)
+			return _mm_shuffle_epi8(v, _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+#else
+			const Vec middle = bitOr(bitAnd(shiftRight<8>(v), splat(0xff00)), bitAnd(shiftLeft<8>(v), splat(0xff0000)));
+			return bitOr(bitOr(shiftRight<24>(v), shiftLeft<24>(v)), middle);
+#endif
+		}
+#elif defined(PANDA3DS_ARM64_HOST)
+		// ASIMD is baseline on arm64
+		using Vec = uint32x4_t;
+
+		inline Vec splat(u32 value) { return vdupq_n_u32(value); }
+		inline Vec bitAnd(Vec a, Vec b) { return vandq_u32(a, b); }
+		inline Vec bitOr(Vec a, Vec b) { return vorrq_u32(a, b); }
+
+		template <int n>
+		inline Vec shiftLeft(Vec v) {
+			return vshlq_n_u32(v, n);
+		}
+
+		// Immediate right shifts can't be 0 on arm64
+		template <int n>
+		inline Vec shiftRight(Vec v) {
+			if constexpr (n == 0) {
+				return v;
+			} else {
+				return vshrq_n_u32(v, n);
+			}
+		}
+
+		inline Vec load32(const u8* data) { return vreinterpretq_u32_u8(vld1q_u8(data)); }
+		inline Vec load16(const u8* data) { return vmovl_u16(vreinterpret_u16_u8(vld1_u8(data))); }
+		inline Vec load8(const u8* data) {
+			u32 word;
+			std::memcpy(&word, data, sizeof(word));
+			return vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(word)))));
+		}
+
+		inline void store(u32* output, Vec v) { vst1q_u8(reinterpret_cast<u8*>(output), vreinterpretq_u8_u32(v)); }
+		inline Vec byteSwap(Vec v) { return vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(v))); }
+#else
+		// Plain C++ fallback for other hosts. Compilers will generally vectorize these loops on their own
+		struct Vec {
+			u32 lanes[4];
+		};
+
+		template <typename Func>
+		inline Vec map(Vec v, Func&& func) {
+			for (u32& lane : v.lanes) {
+				lane = func(lane);
+			}
+			return v;
+		}
+
+		inline Vec splat(u32 value) { return Vec{{value, value, value, value}}; }
+		inline Vec bitAnd(Vec a, Vec b) {
+			for (int i = 0; i < 4; i++) a.lanes[i] &= b.lanes[i];
+			return a;
+		}
+
+		inline Vec bitOr(Vec a, Vec b) {
+			for (int i = 0; i < 4; i++) a.lanes[i] |= b.lanes[i];
+			return a;
+		}
+
+		template <int n>
+		inline Vec shiftLeft(Vec v) {
+			return map(v, [](u32 lane) { return lane << n; });
+		}
+
+		template <int n>
+		inline Vec shiftRight(Vec v) {
+			return map(v, [](u32 lane) { return lane >> n; });
+		}
+
+		inline Vec load32(const u8* data) {
+			Vec v;
+			for (int i = 0; i < 4; i++, data += 4) {
+				v.lanes[i] = u32(data[0]) | (u32(data[1]) << 8) | (u32(data[2]) << 16) | (u32(data[3]) << 24);
+			}
+			return v;
+		}
+
+		inline Vec load16(const u8* data) {
+			Vec v;
+			for (int i = 0; i < 4; i++, data += 2) {
+				v.lanes[i] = u32(data[0]) | (u32(data[1]) << 8);
+			}
+			return v;
+		}
+
+		inline Vec load8(const u8* data) { return Vec{{data[0], data[1], data[2], data[3]}}; }
+		inline void store(u32* output, Vec v) { std::memcpy(output, v.lanes, sizeof(v.lanes)); }
+		inline Vec byteSwap(Vec v) {
+			return map(v, [](u32 lane) { return (lane >> 24) | ((lane >> 8) & 0xff00) | ((lane << 8) & 0xff0000) | (lane << 24); });
+		}
+#endif
+
+		// Extract a bitfield from every lane
+		template <int start, int size>
+		inline Vec getBits(Vec v) {
+			return bitAnd(shiftRight<start>(v), splat((1u << size) - 1));
+		}
+
+		// Expand 1, 4, 5 and 6-bit channels to 8 bits. Same as the Colour:: helpers
+		inline Vec expand1(Vec v) {
+			v = bitOr(v, shiftLeft<1>(v));
+			v = bitOr(v, shiftLeft<2>(v));
+			return bitOr(v, shiftLeft<4>(v));
+		}
+
+		inline Vec expand4(Vec v) { return bitOr(v, shiftLeft<4>(v)); }
+		inline Vec expand5(Vec v) { return bitOr(shiftLeft<3>(v), shiftRight<2>(v)); }
+		inline Vec expand6(Vec v) { return bitOr(shiftLeft<2>(v), shiftRight<4>(v)); }
+
+		inline Vec packRGBA(Vec r, Vec g, Vec b, Vec a) {
+			return bitOr(bitOr(r, shiftLeft<8>(g)), bitOr(shiftLeft<16>(b), shiftLeft<24>(a)));
+		}
+
+		// Intensity formats copy the intensity value to every colour channel
+		inline Vec packIntensity(Vec i, Vec a) { return packRGBA(i, i, i, a); }
+	}  // namespace Lanes
+
+	// Index of each texel of an 8x8 tile in Morton order, with the texels going line by line
+	static constexpr std::array<u8, 64> tileTexelOrder = [] {
+		std::array<u8, 64> order{};
+		for (u32 y = 0; y < 8; y++) {
+			for (u32 x = 0; x < 8; x++) {
+				u32 index = 0;
+				for (u32 bit = 0; bit < 3; bit++) {
+					index |= ((x >> bit) & 1) << (bit * 2);
+					index |= ((y >> bit) & 1) << (bit * 2 + 1);
+				}
+
+				order[y * 8 + x] = u8(index);
+			}
+		}
+		return order;
+	}();
+
+	// Decodes a full tile into output, with "stride" texels between lines
+	using TileDecoder = void (*)(const u8* data, u32* output, u32 stride);
+
+	// Move a tile that was decoded in Morton order to its spot in the output
+	void storeTile(const u32* tile, u32* output, u32 stride) {
+		for (u32 y = 0; y < 8; y++) {
+			const u8* order = &tileTexelOrder[y * 8];
+			for (u32 x = 0; x < 8; x++) {
+				output[x] = tile[order[x]];
+			}
+
+			output += stride;
+		}
+	}
+
+	// The texels of a tile are stored contiguously in Morton order, so we decode them 4 at a time as-is and only fix up the order at the end
+	template <u32 bytesPerTexel, typename Func>
+	void decodeTileLanes(const u8* data, u32* output, u32 stride, Func&& convert) {
+		using namespace Lanes;
+		alignas(16) u32 tile[64];
+
+		for (u32 i = 0; i < 64; i += 4) {
+			Vec texels;
+			if constexpr (bytesPerTexel == 4) {
+				texels = load32(data + i * 4);
+			} else if constexpr (bytesPerTexel == 2) {
+				texels = load16(data + i * 2);
+			} else {
+				texels = load8(data + i);
+			}
+
+			store(&tile[i], convert(texels));
+		}
+
+		storeTile(tile, output, stride);
+	}
+
+	void decodeTileRGBA8(const u8* data, u32* output, u32 stride) {
+		// Texels are stored as ABGR, so all we need is to reverse the bytes of each one
+		decodeTileLanes<4>(data, output, stride, [](Lanes::Vec t) { return Lanes::byteSwap(t); });
+	}
+
+	void decodeTileRGB8(const u8* data, u32* output, u32 stride) {
+		// 3 byte texels don't fit into lanes nicely, but this is still a lot cheaper than going texel by texel
+		alignas(16) u32 tile[64];
+		for (u32 i = 0; i < 64; i++, data += 3) {
+			tile[i] = 0xff000000 | (u32(data[0]) << 16) | (u32(data[1]) << 8) | u32(data[2]);
+		}
+
+		storeTile(tile, output, stride);
+	}
+
+	void decodeTileRGBA5551(const u8* data, u32* output, u32 stride) {
+		using namespace Lanes;
+		decodeTileLanes<2>(data, output, stride, [](Vec t) {
+			return packRGBA(expand5(getBits<11, 5>(t)), expand5(getBits<6, 5>(t)), expand5(getBits<1, 5>(t)), expand1(getBits<0, 1>(t)));
+		});
+	}
+
+	void decodeTileRGB565(const u8* data, u32* output, u32 stride) {
+		using namespace Lanes;
+		decodeTileLanes<2>(data, output, stride, [](Vec t) {
+			return packRGBA(expand5(getBits<11, 5>(t)), expand6(getBits<5, 6>(t)), expand5(getBits<0, 5>(t)), splat(0xff));
+		});
+	}
+
+	void decodeTileRGBA4(const u8* data, u32* output, u32 stride) {
+		using namespace Lanes;
+		decodeTileLanes<2>(data, output, stride, [](Vec t) {
+			return packRGBA(expand4(getBits<12, 4>(t)), expand4(getBits<8, 4>(t)), expand4(getBits<4, 4>(t)), expand4(getBits<0, 4>(t)));
+		});
+	}
+
+	void decodeTileRG8(const u8* data, u32* output, u32 stride) {
+		using namespace Lanes;
+		decodeTileLanes<2>(data, output, stride, [](Vec t) { return packRGBA(shiftRight<8>(t), getBits<0, 8>(t), splat(0), splat(0xff)); });
+	}
+
+	void decodeTileIA8(const u8* data, u32* output, u32 stride) {
+		using namespace Lanes;
+		decodeTileLanes<2>(data, output, stride, [](Vec t) { return packIntensity(shiftRight<8>(t), getBits<0, 8>(t)); });
+	}
+
+	void decodeTileI8(const u8* data, u32* output, u32 stride) {
+		using namespace Lanes;
+		decodeTileLanes<1>(data, output, stride, [](Vec t) { return packIntensity(t, splat(0xff)); });
+	}
+
+	void decodeTileA8(const u8* data, u32* output, u32 stride) {
+		// A8 sets RGB to 0
+		decodeTileLanes<1>(data, output, stride, [](Lanes::Vec t) { return Lanes::shiftLeft<24>(t); });
+	}
+
+	void decodeTileIA4(const u8* data, u32* output, u32 stride) {
+		using namespace Lanes;
+		decodeTileLanes<1>(data, output, stride, [](Vec t) { return packIntensity(expand4(shiftRight<4>(t)), expand4(getBits<0, 4>(t))); });
+	}
+
+	// For 4bpp formats, even texels are in the low 4 bits of each byte and odd texels in the top 4 bits
+	template <bool isAlpha>
+	void decodeTile4bpp(const u8* data, u32* output, u32 stride) {
+		alignas(16) u32 tile[64];
+		for (u32 i = 0; i < 64; i += 2, data++) {
+			const u32 low = Colour::convert4To8Bit(*data & 0xf);
+			const u32 high = Colour::convert4To8Bit(*data >> 4);
+
+			if constexpr (isAlpha) {
+				// A4 sets RGB to 0
+				tile[i] = low << 24;
+				tile[i + 1] = high << 24;
+			} else {
+				tile[i] = 0xff000000 | (low * 0x010101);
+				tile[i + 1] = 0xff000000 | (high * 0x010101);
+			}
+		}
+
+		storeTile(tile, output, stride);
+	}
+
+	// ETC1(A4) tiles are made of 4 4x4 blocks, which go top-left, top-right, bottom-left, bottom-right
+	// Each block is 8 bytes of colour data, preceded by 8 bytes of alpha data for ETC1A4
+	template <bool hasAlpha>
+	void decodeTileETC(const u8* data, u32* output, u32 stride) {
+		for (u32 block = 0; block < 4; block++) {
+			u64 alphaData = ~0ull;  // ETC1 without alpha uses ff for every pixel
+			if constexpr (hasAlpha) {
+				std::memcpy(&alphaData, data, sizeof(u64));
+				data += sizeof(u64);
+			}
+
+			u64 colourData;
+			std::memcpy(&colourData, data, sizeof(u64));
+			data += sizeof(u64);
+
+			u32* blockOutput = output + (block & 1) * 4 + (block >> 1) * 4 * stride;
+			PICA::TextureDecoder::decodeETCBlock(colourData, alphaData, blockOutput, stride);
+		}
+	}
+
+	TileDecoder getTileDecoder(PICA::TextureFmt fmt) {
+		using PICA::TextureFmt;
+
+		switch (fmt) {
+			case TextureFmt::RGBA8: return decodeTileRGBA8;
+			case TextureFmt::RGB8: return decodeTileRGB8;
+			case TextureFmt::RGBA5551: return decodeTileRGBA5551;
+			case TextureFmt::RGB565: return decodeTileRGB565;
+			case TextureFmt::RGBA4: return decodeTileRGBA4;
+			case TextureFmt::IA8: return decodeTileIA8;
+			case TextureFmt::RG8: return decodeTileRG8;
+			case TextureFmt::I8: return decodeTileI8;
+			case TextureFmt::A8: return decodeTileA8;
+			case TextureFmt::IA4: return decodeTileIA4;
+			case TextureFmt::I4: return decodeTile4bpp<false>;
+			case TextureFmt::A4: return decodeTile4bpp<true>;
+			case TextureFmt::ETC1: return decodeTileETC<false>;
+			case TextureFmt::ETC1A4: return decodeTileETC<true>;
+			default: return nullptr;
+		}
+	}
+}  // namespace
+
+u64 PICA::TextureDecoder::sizeInBytes(TextureFmt format, u32 width, u32 height) {
+	u64 pixelCount = u64(width) * u64(height);
+
+	switch (format) {
+		case TextureFmt::RGBA8:  // 4 bytes per pixel
+			return pixelCount * 4;
+
+		case TextureFmt::RGB8:  // 3 bytes per pixel
+			return pixelCount * 3;
+
+		case TextureFmt::RGBA5551:  // 2 bytes per pixel
+		case TextureFmt::RGB565:
+		case TextureFmt::RGBA4:
+		case TextureFmt::RG8:
+		case TextureFmt::IA8: return pixelCount * 2;
+
+		case TextureFmt::A8:  // 1 byte per pixel
+		case TextureFmt::I8:
+		case TextureFmt::IA4: return pixelCount;
+
+		case TextureFmt::I4:  // 4 bits per pixel
+		case TextureFmt::A4: return pixelCount / 2;
+
+		case TextureFmt::ETC1:  // Compressed formats
+		case TextureFmt::ETC1A4: {
+			// Number of 4x4 tiles
+			const u64 tileCount = pixelCount / 16;
+			// Tiles are 8 bytes each on ETC1 and 16 bytes each on ETC1A4
+			const u64 tileSize = format == TextureFmt::ETC1 ? 8 : 16;
+			return tileCount * tileSize;
+		}
+
+		default: Helpers::panic("[PICA] Attempted to get size of invalid texture type");
+	}
+}
+
+// u and v are the UVs of the relevant texel
+// Texture data is stored interleaved in Morton order, ie in a Z - order curve as shown here
+// https://en.wikipedia.org/wiki/Z-order_curve
+// Textures are split into 8x8 tiles.This function returns the in - tile offset depending on the u & v of the texel
+// The in - tile offset is the sum of 2 offsets, one depending on the value of u % 8 and the other on the value of y % 8
+// As documented in this picture https ://en.wikipedia.org/wiki/File:Moser%E2%80%93de_Bruijn_addition.svg
+u32 PICA::TextureDecoder::mortonInterleave(u32 u, u32 v) {
+	static constexpr u32 xOffsets[] = {0, 1, 4, 5, 16, 17, 20, 21};
+	static constexpr u32 yOffsets[] = {0, 2, 8, 10, 32, 34, 40, 42};
+
+	return xOffsets[u & 7] + yOffsets[v & 7];
+}
+
+// Get the byte offset of texel (u, v) in the texture
+u32 PICA::TextureDecoder::getSwizzledOffset(u32 u, u32 v, u32 width, u32 bytesPerPixel) {
+	u32 offset = ((u & ~7) * 8) + ((v & ~7) * width);  // Offset of the 8x8 tile the texel belongs to
+	offset += mortonInterleave(u, v);                    // Add the in-tile offset of the texel
+
+	return offset * bytesPerPixel;
+}
+
+// Same as the above code except we need to divide by 2 because 4 bits is smaller than a byte
+u32 PICA::TextureDecoder::getSwizzledOffset_4bpp(u32 u, u32 v, u32 width) {
+	u32 offset = ((u & ~7) * 8) + ((v & ~7) * width);  // Offset of the 8x8 tile the texel belongs to
+	offset += mortonInterleave(u, v);                    // Add the in-tile offset of the texel
+
+	return offset / 2;
+}
+
+// Get the texel at position (u, v)
+// fmt: format of the texture
+// data: texture data of the texture
+u32 PICA::TextureDecoder::decodeTexel(u32 u, u32 v, TextureFmt fmt, u32 width, std::span<const u8> data) {
+	switch (fmt) {
+		case TextureFmt::RGBA4: {
+			u32 offset = getSwizzledOffset(u, v, width, 2);
+			u16 texel = u16(data[offset]) | (u16(data[offset + 1]) << 8);
+
+			u8 alpha = Colour::convert4To8Bit(getBits<0, 4, u8>(texel));
+			u8 b = Colour::convert4To8Bit(getBits<4, 4, u8>(texel));
+			u8 g = Colour::convert4To8Bit(getBits<8, 4, u8>(texel));
+			u8 r = Colour::convert4To8Bit(getBits<12, 4, u8>(texel));
+
+			return (alpha << 24) | (b << 16) | (g << 8) | r;
+		}
+
+		case TextureFmt::RGBA5551: {
+			const u32 offset = getSwizzledOffset(u, v, width, 2);
+			const u16 texel = u16(data[offset]) | (u16(data[offset + 1]) << 8);
+
+			u8 alpha = getBit<0>(texel) ? 0xff : 0;
+			u8 b = Colour::convert5To8Bit(getBits<1, 5, u8>(texel));
+			u8 g = Colour::convert5To8Bit(getBits<6, 5, u8>(texel));
+			u8 r = Colour::convert5To8Bit(getBits<11, 5, u8>(texel));
+
+			return (alpha << 24) | (b << 16) | (g << 8) | r;
+		}
+
+		case TextureFmt::RGB565: {
+			const u32 offset = getSwizzledOffset(u, v, width, 2);
+			const u16 texel = u16(data[offset]) | (u16(data[offset + 1]) << 8);
+
+			const u8 b = Colour::convert5To8Bit(getBits<0, 5, u8>(texel));
+			const u8 g = Colour::convert6To8Bit(getBits<5, 6, u8>(texel));
+			const u8 r = Colour::convert5To8Bit(getBits<11, 5, u8>(texel));
+
+			return (0xff << 24) | (b << 16) | (g << 8) | r;
+		}
+
+		case TextureFmt::RG8: {
+			u32 offset = getSwizzledOffset(u, v, width, 2);
+			constexpr u8 b = 0;
+			const u8 g = data[offset];
+			const u8 r = data[offset + 1];
+
+			return (0xff << 24) | (b << 16) | (g << 8) | r;
+		}
+
+		case TextureFmt::RGB8: {
+			const u32 offset = getSwizzledOffset(u, v, width, 3);
+			const u8 b = data[offset];
+			const u8 g = data[offset + 1];
+			const u8 r = data[offset + 2];
+
+			return (0xff << 24) | (b << 16) | (g << 8) | r;
+		}
+
+		case TextureFmt::RGBA8: {
+			const u32 offset = getSwizzledOffset(u, v, width, 4);
+			const u8 alpha = data[offset];
+			const u8 b = data[offset + 1];
+			const u8 g = data[offset + 2];
+			const u8 r = data[offset + 3];
+
+			return (alpha << 24) | (b << 16) | (g << 8) | r;
+		}
+
+		case TextureFmt::IA4: {
+			const u32 offset = getSwizzledOffset(u, v, width, 1);
+			const u8 texel = data[offset];
+			const u8 alpha = Colour::convert4To8Bit(texel & 0xf);
+			const u8 intensity = Colour::convert4To8Bit(texel >> 4);
+
+			// Intensity formats just copy the intensity value to every colour channel
+			return (alpha << 24) | (intensity << 16) | (intensity << 8) | intensity;
+		}
+
+		case TextureFmt::A4: {
+			const u32 offset = getSwizzledOffset_4bpp(u, v, width);
+
+			// For odd U coordinates, grab the top 4 bits, and the low 4 bits for even coordinates
+			u8 alpha = data[offset] >> ((u % 2) ? 4 : 0);
+			alpha = Colour::convert4To8Bit(getBits<0, 4>(alpha));
+
+			// A8 sets RGB to 0
+			return (alpha << 24) | (0 << 16) | (0 << 8) | 0;
+		}
+
+		case TextureFmt::A8: {
+			u32 offset = getSwizzledOffset(u, v, width, 1);
+			const u8 alpha = data[offset];
+
+			// A8 sets RGB to 0
+			return (alpha << 24) | (0 << 16) | (0 << 8) | 0;
+		}
+
+		case TextureFmt::I4: {
+			u32 offset = getSwizzledOffset_4bpp(u, v, width);
+
+			// For odd U coordinates, grab the top 4 bits, and the low 4 bits for even coordinates
+			u8 intensity = data[offset] >> ((u % 2) ? 4 : 0);
+			intensity = Colour::convert4To8Bit(getBits<0, 4>(intensity));
+
+			// Intensity formats just copy the intensity value to every colour channel
+			return (0xff << 24) | (intensity << 16) | (intensity << 8) | intensity;
+		}
+
+		case TextureFmt::I8: {
+			u32 offset = getSwizzledOffset(u, v, width, 1);
+			const u8 intensity = data[offset];
+
+			// Intensity formats just copy the intensity value to every colour channel
+			return (0xff << 24) | (intensity << 16) | (intensity << 8) | intensity;
+		}
+
+		case TextureFmt::IA8: {
+			u32 offset = getSwizzledOffset(u, v, width, 2);
+
+			// Same as I8 except each pixel gets its own alpha value too
+			const u8 alpha = data[offset];
+			const u8 intensity = data[offset + 1];
+			return (alpha << 24) | (intensity << 16) | (intensity << 8) | intensity;
+		}
+
+		case TextureFmt::ETC1: return getTexelETC(false, u, v, width, data);
+		case TextureFmt::ETC1A4: return getTexelETC(true, u, v, width, data);
+
+		default: Helpers::panic("[Texture::DecodeTexel] Unimplemented format = %d", static_cast<int>(fmt));
+	}
+}
+
+void PICA::TextureDecoder::decodeTexture(TextureFmt fmt, u32 width, u32 height, std::span<const u8> data, u32* output) {
+	const TileDecoder decodeTile = getTileDecoder(fmt);
+
+	// Textures should always be made of whole 8x8 tiles. If that's not the case, go texel by texel so we don't read out of bounds
+	if (decodeTile == nullptr || (width % 8) != 0 || (height % 8) != 0 || data.size() < sizeInBytes(fmt, width, height)) {
+		for (u32 v = 0; v < height; v++) {
+			for (u32 u = 0; u < width; u++) {
+				*output++ = decodeTexel(u, v, fmt, width, data);
+			}
+		}
+
+		return;
+	}
+
+	// Tiles are stored one after the other, going left to right and then top to bottom
+	const usize tileSize = sizeInBytes(fmt, 8, 8);
+	const u8* tileData = data.data();
+
+	for (u32 y = 0; y < height; y += 8) {
+		u32* tileLine = output + usize(y) * width;
+
+		for (u32 x = 0; x < width; x += 8) {
+			decodeTile(tileData, tileLine + x, width);
+			tileData += tileSize;
+		}
+	}
+}
+
+static constexpr u32 signExtend3To32(u32 val) { return (u32)(s32(val) << 29 >> 29); }
+
+u32 PICA::TextureDecoder::getTexelETC(bool hasAlpha, u32 u, u32 v, u32 width, std::span<const u8> data) {
+	// Pixel offset of the 8x8 tile based on u, v and the width of the texture
+	u32 offs = ((u & ~7) * 8) + ((v & ~7) * width);
+	if (!hasAlpha) offs >>= 1;
+
+	// In-tile offsets for u/v
+	u &= 7;
+	v &= 7;
+
+	// ETC1(A4) also subdivide the 8x8 tile to 4 4x4 tiles
+	// Each tile is 8 bytes for ETC1, but since ETC1A4 has 4 alpha bits per pixel, that becomes 16 bytes
+	const u32 subTileSize = hasAlpha ? 16 : 8;
+	const u32 subTileIndex = (u / 4) + 2 * (v / 4);  // Which of the 4 subtiles is this texel in?
+
+	// In-subtile offsets for u/v
+	u &= 3;
+	v &= 3;
+	offs += subTileSize * subTileIndex;
+
+	u32 alpha;
+	const u64* ptr = reinterpret_cast<const u64*>(data.data() + offs);  // Cast to u64*
+
+	if (hasAlpha) {
+		// First 64 bits of the 4x4 subtile are alpha data
+		const u64 alphaData = *ptr++;
+		alpha = Colour::convert4To8Bit((alphaData >> (4 * (u * 4 + v))) & 0xf);
+	} else {
+		alpha = 0xff;  // ETC1 without alpha uses ff for every pixel
+	}
+
+	// Next 64 bits of the subtile are colour data
+	u64 colourData = *ptr;
+	return decodeETC(alpha, u, v, colourData);
+}
+
+u32 PICA::TextureDecoder::decodeETC(u32 alpha, u32 u, u32 v, u64 colourData) {
+	// Parse colour data for 4x4 block
+	const u32 subindices = getBits<0, 16, u32>(colourData);
+	const u32 negationFlags = getBits<16, 16, u32>(colourData);
+	const bool flip = getBit<32>(colourData);
+	const bool diffMode = getBit<33>(colourData);
+
+	// Note: index1 is indeed stored on the higher bits, with index2 in the lower bits
+	const u32 tableIndex1 = getBits<37, 3, u32>(colourData);
+	const u32 tableIndex2 = getBits<34, 3, u32>(colourData);
+	const u32 texelIndex = u * 4 + v;  // Index of the texel in the block
+
+	if (flip) std::swap(u, v);
+
+	s32 r, g, b;
+	if (diffMode) {
+		r = getBits<59, 5, s32>(colourData);
+		g = getBits<51, 5, s32>(colourData);
+		b = getBits<43, 5, s32>(colourData);
+
+		if (u >= 2) {
+			r += signExtend3To32(getBits<56, 3, u32>(colourData));
+			g += signExtend3To32(getBits<48, 3, u32>(colourData));
+			b += signExtend3To32(getBits<40, 3, u32>(colourData));
+		}
+
+		// Expand from 5 to 8 bits per channel
+		r = Colour::convert5To8Bit(r);
+		g = Colour::convert5To8Bit(g);
+		b = Colour::convert5To8Bit(b);
+	} else {
+		if (u < 2) {
+			r = getBits<60, 4, s32>(colourData);
+			g = getBits<52, 4, s32>(colourData);
+			b = getBits<44, 4, s32>(colourData);
+		} else {
+			r = getBits<56, 4, s32>(colourData);
+			g = getBits<48, 4, s32>(colourData);
+			b = getBits<40, 4, s32>(colourData);
+		}
+
+		// Expand from 4 to 8 bits per channel
+		r = Colour::convert4To8Bit(r);
+		g = Colour::convert4To8Bit(g);
+		b = Colour::convert4To8Bit(b);
+	}
+
+	const u32 index = (u < 2) ? tableIndex1 : tableIndex2;
+	s32 modifier = etcModifiers[index][(subindices >> texelIndex) & 1];
+
+	if (((negationFlags >> texelIndex) & 1) != 0) {
+		modifier = -modifier;
+	}
+
+	r = std::clamp(r + modifier, 0, 255);
+	g = std::clamp(g + modifier, 0, 255);
+	b = std::clamp(b + modifier, 0, 255);
+
+	return (alpha << 24) | (u32(b) << 16) | (u32(g) << 8) | u32(r);
+}
+
+void PICA::TextureDecoder::decodeETCBlock(u64 colourData, u64 alphaData, u32* output, u32 stride) {
+	const u32 subindices = getBits<0, 16, u32>(colourData);
+	const u32 negationFlags = getBits<16, 16, u32>(colourData);
+	const bool flip = getBit<32>(colourData);
+	const bool diffMode = getBit<33>(colourData);
+
+	// Base colours of the 2 subblocks. Subblocks are the left/right halves of the block, or the top/bottom halves if the flip bit is set
+	s32 base[2][3];
+	if (diffMode) {
+		const s32 r = getBits<59, 5, s32>(colourData);
+		const s32 g = getBits<51, 5, s32>(colourData);
+		const s32 b = getBits<43, 5, s32>(colourData);
+
+		base[0][0] = Colour::convert5To8Bit(r);
+		base[0][1] = Colour::convert5To8Bit(g);
+		base[0][2] = Colour::convert5To8Bit(b);
+		base[1][0] = Colour::convert5To8Bit(r + signExtend3To32(getBits<56, 3, u32>(colourData)));
+		base[1][1] = Colour::convert5To8Bit(g + signExtend3To32(getBits<48, 3, u32>(colourData)));
+		base[1][2] = Colour::convert5To8Bit(b + signExtend3To32(getBits<40, 3, u32>(colourData)));
+	} else {
+		base[0][0] = Colour::convert4To8Bit(getBits<60, 4, u8>(colourData));
+		base[0][1] = Colour::convert4To8Bit(getBits<52, 4, u8>(colourData));
+		base[0][2] = Colour::convert4To8Bit(getBits<44, 4, u8>(colourData));
+		base[1][0] = Colour::convert4To8Bit(getBits<56, 4, u8>(colourData));
+		base[1][1] = Colour::convert4To8Bit(getBits<48, 4, u8>(colourData));
+		base[1][2] = Colour::convert4To8Bit(getBits<40, 4, u8>(colourData));
+	}
+
+	// Every texel ends up as one of 4 colours of its subblock, picked by its subindex and negation bits. So work those out once per block
+	// Note: index1 is indeed stored on the higher bits, with index2 in the lower bits
+	const u32 tableIndices[2] = {getBits<37, 3, u32>(colourData), getBits<34, 3, u32>(colourData)};
+	u32 palette[2][4];
+
+	for (int subblock = 0; subblock < 2; subblock++) {
+		for (int select = 0; select < 4; select++) {
+			s32 modifier = etcModifiers[tableIndices[subblock]][select & 1];
+			if (select & 2) {
+				modifier = -modifier;
+			}
+
+			const u32 r = u32(std::clamp(base[subblock][0] + modifier, 0, 255));
+			const u32 g = u32(std::clamp(base[subblock][1] + modifier, 0, 255));
+			const u32 b = u32(std::clamp(base[subblock][2] + modifier, 0, 255));
+			palette[subblock][select] = (b << 16) | (g << 8) | r;
+		}
+	}
+
+	for (u32 v = 0; v < 4; v++) {
+		for (u32 u = 0; u < 4; u++) {
+			// Texels are stored column by column in the block
+			const u32 texelIndex = u * 4 + v;
+			const u32 subblock = ((flip ? v : u) >= 2) ? 1 : 0;
+			const u32 select = ((subindices >> texelIndex) & 1) | (((negationFlags >> texelIndex) & 1) << 1);
+			const u32 alpha = Colour::convert4To8Bit((alphaData >> (4 * texelIndex)) & 0xf);
+
+			output[u] = (alpha << 24) | palette[subblock][select];
+		}
+
+		output += stride;
+	}
+}
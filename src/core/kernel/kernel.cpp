@@ -2,6 +2,7 @@
 #include "kernel.hpp"
 #include "kernel_types.hpp"
 #include "cpu.hpp"
+#include "profiler.hpp"
 
 Kernel::Kernel(CPU& cpu, Memory& mem, GPU& gpu, const EmulatorConfig& config)
 	: cpu(cpu), regs(cpu.regs()), mem(mem), handleCounter(0), serviceManager(regs, mem, gpu, currentProcess, *this, config) {
@@ -27,6 +28,8 @@ Kernel::Kernel(CPU& cpu, Memory& mem, GPU& gpu, const EmulatorConfig& config)
 }
 
 void Kernel::serviceSVC(u32 svc) {
+	PROFILE_SCOPE(SVC);
+
 	switch (svc) {
 		case 0x01: controlMemory(); break;
 		case 0x02: queryMemory(); break;
@@ -208,6 +211,8 @@ void Kernel::svcCloseHandle() {
 	regs[0] = Result::Success;
 }
 
+Scheduler& Kernel::getScheduler() { return cpu.getScheduler(); }
+
 // u64 GetSystemTick()
 void Kernel::getSystemTick() {
 	logSVC("GetSystemTick()\n");
@@ -1,9 +1,11 @@
 #include "memory.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>  // For time since epoch
 #include <cmrc/cmrc.hpp>
 #include <ctime>
+#include <thread>
 
 #include "config_mem.hpp"
 #include "resource_limits.hpp"
@@ -13,12 +15,19 @@ CMRC_DECLARE(ConsoleFonts);
 
 using namespace KernelMemoryTypes;
 
-Memory::Memory(u64& cpuTicks, const EmulatorConfig& config) : cpuTicks(cpuTicks), config(config) {
-	fcram = new uint8_t[FCRAM_SIZE]();
+Memory::Memory(u64& cpuTicks, const EmulatorConfig& config)
+	: hostMemory(FCRAM_SIZE, config.fastmemEnabled), cpuTicks(cpuTicks), config(config), fastmemEnabled(config.fastmemEnabled) {
+	fcram = hostMemory.backing();
 
 	readTable.resize(totalPageCount, 0);
 	writeTable.resize(totalPageCount, 0);
+	cpuPageTable = std::make_unique<PageTable>();
+	cpuPageTable->fill(nullptr);
 	memoryInfo.reserve(32);  // Pre-allocate some room for memory allocation info to avoid dynamic allocs
+
+	pageWriteTimestamps.resize(TRACKED_PAGE_COUNT, 0);
+	watchedPages.resize(TRACKED_PAGE_COUNT, false);
+	fcramPageMappings.resize(FCRAM_PAGE_COUNT);  // Pre-allocate some room for memory allocation info to avoid dynamic allocs
 }
 
 void Memory::reset() {
@@ -33,6 +42,19 @@ void Memory::reset() {
 		writeTable[i] = 0;
 	}
 
+	cpuPageTable->fill(nullptr);
+	hostMemory.unmapAll();
+
+	// Everything we were tracking counts as overwritten
+	writeTimestamp++;
+	std::fill(pageWriteTimestamps.begin(), pageWriteTimestamps.end(), writeTimestamp);
+	std::fill(watchedPages.begin(), watchedPages.end(), false);
+	for (auto& mappings : fcramPageMappings) {
+		mappings.clear();
+	}
+	suspendedWrites.clear();
+	updateSuspendedWriteCount();
+
 	// Map (32 * 4) KB of FCRAM before the stack for the TLS of each thread
 	std::optional<u32> tlsBaseOpt = findPaddr(32 * 4_KB);
 	if (!tlsBaseOpt.has_value()) {  // Should be unreachable but still good to have
@@ -68,6 +90,7 @@ void Memory::reset() {
 		readTable[i + initialPage] = pointer;
 		writeTable[i + initialPage] = pointer;
 	}
+	updateCPUMappings(initialPage, dspRamPages);
 
 	// Later adjusted based on ROM header when possible
 	region = Regions::USA;
@@ -210,13 +233,14 @@ void Memory::write8(u32 vaddr, u8 value) {
 	const u32 page = vaddr >> pageShift;
 	const u32 offset = vaddr & pageMask;
 
-	uintptr_t pointer = writeTable[page];
+	const uintptr_t pointer = getPageWritePointer(page);
+
 	if (pointer != 0) [[likely]] {
 		*(u8*)(pointer + offset) = value;
 	} else {
 		// VRAM write
 		if (vaddr >= VirtualAddrs::VramStart && vaddr < VirtualAddrs::VramStart + VirtualAddrs::VramSize) {
-			// TODO: Invalidate renderer caches here
+			invalidatePhysicalRange(PhysicalAddrs::VRAM + (vaddr - VirtualAddrs::VramStart), 1);
 			vram[vaddr - VirtualAddrs::VramStart] = value;
 		}
 
@@ -230,7 +254,8 @@ void Memory::write16(u32 vaddr, u16 value) {
 	const u32 page = vaddr >> pageShift;
 	const u32 offset = vaddr & pageMask;
 
-	uintptr_t pointer = writeTable[page];
+	const uintptr_t pointer = getPageWritePointer(page);
+
 	if (pointer != 0) [[likely]] {
 		*(u16*)(pointer + offset) = value;
 	} else {
@@ -242,7 +267,8 @@ void Memory::write32(u32 vaddr, u32 value) {
 	const u32 page = vaddr >> pageShift;
 	const u32 offset = vaddr & pageMask;
 
-	uintptr_t pointer = writeTable[page];
+	const uintptr_t pointer = getPageWritePointer(page);
+
 	if (pointer != 0) [[likely]] {
 		*(u32*)(pointer + offset) = value;
 	} else {
@@ -268,7 +294,8 @@ void* Memory::getWritePointer(u32 address) {
 	const u32 page = address >> pageShift;
 	const u32 offset = address & pageMask;
 
-	uintptr_t pointer = writeTable[page];
+	// Callers write through the pointer we return right away, so treat this as a write to the page
+	const uintptr_t pointer = getPageWritePointer(page);
 	if (pointer == 0) return nullptr;
 	return (void*)(pointer + offset);
 }
@@ -343,10 +370,17 @@ std::optional<u32> Memory::allocateMemory(u32 vaddr, u32 paddr, u32 size, bool l
 		usedUserMemory += size;
 	}
 
+	// The GPU thread can unwatch pages while we map them, which goes through the mappings and the CPU page tables we're changing here
+	std::scoped_lock lock(trackingMutex);
+
 	// Do linear mapping
 	u32 virtualPage = vaddr >> pageShift;
 	u32 physPage = paddr >> pageShift;  // TODO: Special handle when non-linear mapping is necessary
+	bool mapsWatchedPages = false;
 	for (u32 i = 0; i < neededPageCount; i++) {
+		addFcramMapping(physPage, virtualPage);
+		mapsWatchedPages |= watchedPages[VRAM_PAGE_COUNT + physPage];
+
 		if (r) {
 			readTable[virtualPage] = uintptr_t(&fcram[physPage * pageSize]);
 		}
@@ -360,6 +394,18 @@ std::optional<u32> Memory::allocateMemory(u32 vaddr, u32 paddr, u32 size, bool l
 		physPage++;
 	}
 
+	// For the common R/W case the whole range is backed by contiguous FCRAM, so map it into the fastmem arena in one go
+	// Watched pages need their fast paths disabled, so they take the page-by-page path
+	if (r && w && !mapsWatchedPages) {
+		hostMemory.map(vaddr, paddr, size, true, true);
+		for (u32 i = 0; i < neededPageCount; i++) {
+			const u32 page = (vaddr >> pageShift) + i;
+			(*cpuPageTable)[page] = reinterpret_cast<u8*>(readTable[page]);
+		}
+	} else {
+		updateCPUMappings(vaddr >> pageShift, neededPageCount);
+	}
+
 	// Back up the info for this allocation in our memoryInfo vector
 	u32 perms = (r ? PERMISSION_R : 0) | (w ? PERMISSION_W : 0) | (x ? PERMISSION_X : 0);
 	memoryInfo.push_back(std::move(MemoryInfo(vaddr, size, perms, KernelMemoryTypes::Reserved)));
@@ -479,6 +525,7 @@ void Memory::mirrorMapping(u32 destAddress, u32 sourceAddress, u32 size) {
 	assert(isAligned(destAddress) && isAligned(sourceAddress) && isAligned(size));
 
 	const u32 pageCount = size / pageSize;  // How many pages we need to mirror
+	std::scoped_lock lock(trackingMutex);
 	for (u32 i = 0; i < pageCount; i++) {
 		// Redo the shift here to "properly" handle wrapping around the address space instead of reading OoB
 		const u32 sourcePage = sourceAddress / pageSize;
@@ -486,12 +533,302 @@ void Memory::mirrorMapping(u32 destAddress, u32 sourceAddress, u32 size) {
 
 		readTable[destPage] = readTable[sourcePage];
 		writeTable[destPage] = writeTable[sourcePage];
+		updateCPUMappings(destPage, 1);
 
 		sourceAddress += pageSize;
 		destAddress += pageSize;
 	}
 }
 
+void Memory::updateCPUMappings(u32 page, u32 pageCount) {
+	std::scoped_lock lock(trackingMutex);
+	const uintptr_t fcramStart = uintptr_t(fcram);
+	const uintptr_t fcramEnd = fcramStart + FCRAM_SIZE;
+
+	// Consecutive pages that map consecutive FCRAM with the same permissions, or that are all unmapped, get remapped in the arena together
+	struct ArenaRun {
+		u32 vaddr = 0;
+		usize offset = 0;
+		usize size = 0;
+		bool mapped = false;
+		bool readable = false;
+		bool writable = false;
+	} run;
+
+	auto flushRun = [&]() {
+		if (run.mapped) {
+			hostMemory.map(run.vaddr, run.offset, run.size, run.readable, run.writable);
+		} else {
+			hostMemory.unmap(run.vaddr, run.size);
+		}
+		run.size = 0;
+	};
+
+	auto addToRun = [&](u32 vaddr, usize offset, bool mapped, bool readable, bool writable) {
+		const bool extendsRun = run.size != 0 && vaddr == run.vaddr + run.size && mapped == run.mapped &&
+								(!mapped || (offset == run.offset + run.size && readable == run.readable && writable == run.writable));
+		if (!extendsRun) {
+			flushRun();
+			run = {.vaddr = vaddr, .offset = offset, .size = 0, .mapped = mapped, .readable = readable, .writable = writable};
+		}
+		run.size += pageSize;
+	};
+
+	for (u32 i = 0; i < pageCount; i++, page++) {
+		// A new writable mapping replaces whatever write we had suspended for this page. If it maps a watched FCRAM page, suspend it again
+		if (writeTable[page] != 0) {
+			suspendedWrites.erase(page);
+			updateSuspendedWriteCount();
+		}
+
+		const uintptr_t mappedPointer = writeTable[page] != 0 ? writeTable[page] : readTable[page];
+		if (mappedPointer >= fcramStart && mappedPointer < fcramEnd) {
+			const u32 fcramPage = u32((mappedPointer - fcramStart) >> pageShift);
+			addFcramMapping(fcramPage, page);
+
+			if (writeTable[page] != 0 && watchedPages[VRAM_PAGE_COUNT + fcramPage]) {
+				suspendedWrites[page] = writeTable[page];
+				updateSuspendedWriteCount();
+				storeWritePointer(page, 0);
+			}
+		}
+
+		const uintptr_t readPointer = readTable[page];
+		const uintptr_t writePointer = writeTable[page];
+		const bool sameMapping = readPointer != 0 && readPointer == writePointer;
+		(*cpuPageTable)[page] = sameMapping ? reinterpret_cast<u8*>(readPointer) : nullptr;
+
+		// Only FCRAM lives in our shared memory backing. Everything else (eg DSP RAM) is served by the page table
+		const uintptr_t pointer = readPointer != 0 ? readPointer : writePointer;
+		const u32 vaddr = page << pageShift;
+
+		if (pointer >= fcramStart && pointer < fcramEnd && (readPointer == 0 || writePointer == 0 || sameMapping)) {
+			addToRun(vaddr, pointer - fcramStart, true, readPointer != 0, writePointer != 0);
+		} else {
+			addToRun(vaddr, 0, false, false, false);
+		}
+	}
+
+	flushRun();
+}
+
+void Memory::updateCPUMappings(std::vector<u32>& pages) {
+	std::sort(pages.begin(), pages.end());
+	pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+	// Remap runs of consecutive pages together, so that eg watching all of FCRAM doesn't take one mmap per page
+	for (usize i = 0; i < pages.size();) {
+		usize runEnd = i + 1;
+		while (runEnd < pages.size() && pages[runEnd] == pages[runEnd - 1] + 1) {
+			runEnd++;
+		}
+
+		updateCPUMappings(pages[i], u32(runEnd - i));
+		i = runEnd;
+	}
+
+	pages.clear();
+}
+
+std::optional<u32> Memory::getTrackedPage(u32 paddr) {
+	if (paddr >= PhysicalAddrs::VRAM && paddr <= PhysicalAddrs::VRAMEnd) {
+		return (paddr - PhysicalAddrs::VRAM) >> pageShift;
+	} else if (paddr >= PhysicalAddrs::FCRAM && paddr <= PhysicalAddrs::FCRAMEnd) {
+		return VRAM_PAGE_COUNT + ((paddr - PhysicalAddrs::FCRAM) >> pageShift);
+	}
+
+	return std::nullopt;
+}
+
+void Memory::addFcramMapping(u32 fcramPage, u32 virtualPage) {
+	auto& mappings = fcramPageMappings[fcramPage];
+	if (std::find(mappings.begin(), mappings.end(), virtualPage) == mappings.end()) {
+		mappings.push_back(virtualPage);
+	}
+}
+
+void Memory::setFcramPageWatched(u32 fcramPage, bool watched) {
+	const uintptr_t pointer = uintptr_t(&fcram[fcramPage * pageSize]);
+
+	// Mappings are never removed from the list, so skip the virtual pages that have been remapped to something else since
+	// The CPU mappings of the pages we change get updated by the caller, through pagesToRemap
+	for (u32 virtualPage : fcramPageMappings[fcramPage]) {
+		if (watched && writeTable[virtualPage] == pointer) {
+			// The page has to count as suspended before its write pointer goes away, so that writes that see the null pointer resume it
+			suspendedWrites[virtualPage] = pointer;
+			updateSuspendedWriteCount();
+			storeWritePointer(virtualPage, 0);
+			pagesToRemap.push_back(virtualPage);
+		} else if (!watched) {
+			auto it = suspendedWrites.find(virtualPage);
+			if (it != suspendedWrites.end() && it->second == pointer) {
+				suspendedWrites.erase(it);
+				updateSuspendedWriteCount();
+				storeWritePointer(virtualPage, pointer);
+				pagesToRemap.push_back(virtualPage);
+			}
+		}
+	}
+}
+
+void Memory::invalidateTrackedPage(u32 trackedPage) {
+	pageWriteTimestamps[trackedPage] = ++writeTimestamp;
+	watchedPages[trackedPage] = false;
+
+	// Give the CPU its fast paths back until someone watches the page again
+	if (trackedPage >= VRAM_PAGE_COUNT) {
+		setFcramPageWatched(trackedPage - VRAM_PAGE_COUNT, false);
+		updateCPUMappings(pagesToRemap);
+	}
+}
+
+uintptr_t Memory::getPageWritePointer(u32 page) {
+	const uintptr_t pointer = loadWritePointer(page);
+	if (pointer == 0 && suspendedWriteCount.load(std::memory_order_acquire) != 0) {
+		return resumeWrites(page);
+	}
+
+	return pointer;
+}
+
+uintptr_t Memory::resumeWrites(u32 virtualPage) {
+	std::scoped_lock lock(trackingMutex);
+	auto it = suspendedWrites.find(virtualPage);
+	if (it == suspendedWrites.end()) {
+		return 0;
+	}
+
+	const uintptr_t pointer = it->second;
+	invalidateTrackedPage(VRAM_PAGE_COUNT + u32((pointer - uintptr_t(fcram)) >> pageShift));
+	return pointer;
+}
+
+void Memory::setConcurrentTracking(bool enabled) {
+	cpuThread = std::this_thread::get_id();
+	concurrentTracking = enabled;
+}
+
+u64 Memory::watchPhysicalRange(u32 paddr, u32 size) {
+	if (!concurrentTracking.load(std::memory_order_relaxed) || std::this_thread::get_id() == cpuThread) {
+		return watchPhysicalRangeNow(paddr, size);
+	}
+
+	// Watching VRAM or FCRAM pages that are watched already doesn't touch anything the CPU JIT uses, so that's fine to do from here
+	{
+		std::scoped_lock lock(trackingMutex);
+		if (!hasUnwatchedFcramPages(paddr, size)) {
+			return watchPhysicalRangeNow(paddr, size);
+		}
+	}
+
+	WatchRequest request{.paddr = paddr, .size = size};
+	{
+		std::scoped_lock lock(watchRequestMutex);
+		watchRequests.push_back(&request);
+		hasWatchRequests.store(true, std::memory_order_release);
+	}
+
+	if (watchRequestCallback) {
+		watchRequestCallback();
+	}
+
+	std::unique_lock lock(watchRequestMutex);
+	watchRequestApplied.wait(lock, [&]() { return request.done; });
+	return request.timestamp;
+}
+
+void Memory::applyWatchRequests() {
+	if (!hasWatchRequests.load(std::memory_order_acquire)) {
+		return;
+	}
+
+	std::scoped_lock lock(watchRequestMutex);
+	for (WatchRequest* request : watchRequests) {
+		request->timestamp = watchPhysicalRangeNow(request->paddr, request->size);
+		request->done = true;
+	}
+
+	watchRequests.clear();
+	hasWatchRequests.store(false, std::memory_order_release);
+	watchRequestApplied.notify_all();
+}
+
+bool Memory::hasUnwatchedFcramPages(u32 paddr, u32 size) {
+	const u64 end = u64(paddr) + size;
+	for (u64 addr = paddr & ~pageMask; addr < end; addr += pageSize) {
+		auto page = getTrackedPage(u32(addr));
+		if (page.has_value() && *page >= VRAM_PAGE_COUNT && !watchedPages[*page]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+u64 Memory::watchPhysicalRangeNow(u32 paddr, u32 size) {
+	std::scoped_lock lock(trackingMutex);
+	const u64 end = u64(paddr) + size;
+
+	for (u64 addr = paddr & ~pageMask; addr < end; addr += pageSize) {
+		auto page = getTrackedPage(u32(addr));
+		if (page.has_value() && !watchedPages[*page]) {
+			watchedPages[*page] = true;
+
+			// VRAM isn't in the CPU page tables, so all CPU writes to it already go through write8
+			if (*page >= VRAM_PAGE_COUNT) {
+				setFcramPageWatched(*page - VRAM_PAGE_COUNT, true);
+			}
+		}
+	}
+
+	updateCPUMappings(pagesToRemap);
+	return writeTimestamp;
+}
+
+bool Memory::isPhysicalRangeDirty(u32 paddr, u32 size, u64 timestamp) {
+	std::scoped_lock lock(trackingMutex);
+	const u64 end = u64(paddr) + size;
+
+	for (u64 addr = paddr & ~pageMask; addr < end; addr += pageSize) {
+		auto page = getTrackedPage(u32(addr));
+		if (page.has_value() && pageWriteTimestamps[*page] > timestamp) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Memory::getDirtyPages(u32 paddr, u32 size, u64 timestamp, std::vector<u32>& pages) {
+	std::scoped_lock lock(trackingMutex);
+	const u64 end = u64(paddr) + size;
+
+	for (u64 addr = paddr & ~pageMask; addr < end; addr += pageSize) {
+		auto page = getTrackedPage(u32(addr));
+		if (page.has_value() && pageWriteTimestamps[*page] > timestamp) {
+			pages.push_back(u32(addr));
+		}
+	}
+}
+
+u64 Memory::getWriteTimestamp() {
+	std::scoped_lock lock(trackingMutex);
+	return writeTimestamp;
+}
+
+void Memory::invalidatePhysicalRange(u32 paddr, u32 size) {
+	std::scoped_lock lock(trackingMutex);
+	const u64 end = u64(paddr) + size;
+
+	// Pages that aren't watched were already written to after anyone looked at them, so there's nothing to update
+	for (u64 addr = paddr & ~pageMask; addr < end; addr += pageSize) {
+		auto page = getTrackedPage(u32(addr));
+		if (page.has_value() && watchedPages[*page]) {
+			invalidateTrackedPage(*page);
+		}
+	}
+}
+
 // Get the number of ms since Jan 1 1900
 u64 Memory::timeSince3DSEpoch() {
 	using namespace std::chrono;
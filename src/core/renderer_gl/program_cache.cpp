@@ -0,0 +1,153 @@
+#include "renderer_gl/program_cache.hpp"
+
+#include <cstring>
+#include <system_error>
+
+#include "PICA/pica_hash.hpp"
+
+void ProgramCache::open(const std::filesystem::path& cachePath, u64 driver) {
+	close();
+
+	path = cachePath;
+	driverHash = driver;
+	opened = true;
+	loader = std::thread(&ProgramCache::load, this);
+}
+
+void ProgramCache::close() {
+	if (!opened) {
+		return;
+	}
+
+	waitForLoad();
+	writer.close();
+	file.close();
+	entries.clear();
+	opened = false;
+}
+
+void ProgramCache::waitForLoad() {
+	if (loader.joinable()) {
+		loader.join();
+	}
+}
+
+// Start over with an empty cache file
+bool ProgramCache::createFile() {
+	file.close();
+	entries.clear();
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	const FileHeader header = {magic, version};
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	if (!out) {
+		Helpers::warn("ProgramCache: Failed to create %s", path.string().c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void ProgramCache::load() {
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+
+	const auto fileSize = std::filesystem::file_size(path, error);
+	if (error || fileSize <= sizeof(FileHeader) || !file.open(path)) {
+		createFile();
+		return;
+	}
+
+	const u8* data = file.data();
+	const usize size = file.getSink().size();
+
+	FileHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.magic != magic || header.version != version) {
+		createFile();
+		return;
+	}
+
+	usize offset = sizeof(FileHeader);
+	bool hasOtherDrivers = false;
+
+	while (size - offset >= sizeof(EntryHeader)) {
+		EntryHeader entry;
+		std::memcpy(&entry, data + offset, sizeof(entry));
+
+		const usize binaryOffset = offset + sizeof(EntryHeader);
+		if (entry.size > size - binaryOffset) {
+			break;  // Cut off
+		}
+
+		// Checking the checksum also reads the whole file in, so looking binaries up later doesn't stall on the disk
+		const char* binary = reinterpret_cast<const char*>(data + binaryOffset);
+		if (PICAHash::computeHash(binary, entry.size) != entry.checksum) {
+			break;  // Corrupted
+		}
+
+		if (entry.driverHash == driverHash) {
+			// Later entries replace earlier ones, eg if a binary got discarded and stored again
+			entries[entry.sourceHash] = Entry{entry.format, binaryOffset, entry.size};
+		} else {
+			hasOtherDrivers = true;
+		}
+
+		offset = binaryOffset + entry.size;
+	}
+
+	// If nothing in the file is for our driver, it was probably updated and the old binaries are useless. Don't keep them around forever
+	if (entries.empty() && hasOtherDrivers) {
+		createFile();
+		return;
+	}
+
+	if (offset != size) {
+		Helpers::warn("ProgramCache: Dropping %zu bytes of invalid data from the end of %s", size - offset, path.string().c_str());
+
+		// Binaries are referenced by offset, so they survive remapping the file
+		file.close();
+		std::filesystem::resize_file(path, offset, error);
+		if (error || !file.open(path)) {
+			createFile();
+		}
+	}
+}
+
+std::optional<ProgramCache::Binary> ProgramCache::find(u64 sourceHash) {
+	waitForLoad();
+
+	auto it = entries.find(sourceHash);
+	if (it == entries.end() || !file.exists()) {
+		return std::nullopt;
+	}
+
+	const Entry& entry = it->second;
+	return Binary{entry.format, std::span<const u8>(file.data() + entry.offset, entry.size)};
+}
+
+void ProgramCache::store(u64 sourceHash, u32 format, std::span<const u8> binary) {
+	waitForLoad();
+
+	if (!writer.is_open()) {
+		writer.open(path, std::ios::binary | std::ios::app);
+	}
+
+	EntryHeader entry;
+	entry.sourceHash = sourceHash;
+	entry.driverHash = driverHash;
+	entry.checksum = PICAHash::computeHash(reinterpret_cast<const char*>(binary.data()), binary.size());
+	entry.format = format;
+	entry.size = u32(binary.size());
+
+	writer.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+	writer.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+	// Flush every entry so we lose as little as possible if the emulator gets killed
+	writer.flush();
+}
+
+void ProgramCache::discard(u64 sourceHash) {
+	waitForLoad();
+	entries.erase(sourceHash);
+}
@@ -2,12 +2,17 @@
 
 #include <stb_image_write.h>
 
+#include <bit>
 #include <cmrc/cmrc.hpp>
 
 #include "PICA/float_types.hpp"
 #include "PICA/gpu.hpp"
+#include "PICA/pica_hash.hpp"
 #include "PICA/regs.hpp"
+#include "PICA/shader_decompiler.hpp"
+#include "PICA/texture_decoder.hpp"
 #include "math_util.hpp"
+#include "renderer_sw/fragment_pipeline.hpp"
 
 CMRC_DECLARE(RendererGL);
 
@@ -18,9 +23,13 @@ using namespace PICA;
 RendererGL::~RendererGL() {}
 
 void RendererGL::reset() {
+	batchVertices.clear();
 	depthBufferCache.reset();
 	colourBufferCache.reset();
 	textureCache.reset();
+	textureScratch.release();
+	textureDecodeQueue.clear();
+	pendingTextureDecodes.clear();
 
 	// Init the colour/depth buffer settings to some random defaults on reset
 	colourBufferLoc = 0;
@@ -54,21 +63,46 @@ void RendererGL::initGraphicsContextInternal() {
 	auto vertexShaderSource = gl_resources.open("opengl_vertex_shader.vert");
 	auto fragmentShaderSource = gl_resources.open("opengl_fragment_shader.frag");
 
-	OpenGL::Shader vert({vertexShaderSource.begin(), vertexShaderSource.size()}, OpenGL::Vertex);
+	triangleVertexShader.create({vertexShaderSource.begin(), vertexShaderSource.size()}, OpenGL::Vertex);
+	triangleVertexShaderHash = PICAHash::computeHash(vertexShaderSource.begin(), vertexShaderSource.size());
 	OpenGL::Shader frag({fragmentShaderSource.begin(), fragmentShaderSource.size()}, OpenGL::Fragment);
-	triangleProgram.create({vert, frag});
+	triangleProgram.create({triangleVertexShader, frag});
 	gl.useProgram(triangleProgram);
 
 	textureEnvSourceLoc = OpenGL::uniformLocation(triangleProgram, "u_textureEnvSource");
 	textureEnvOperandLoc = OpenGL::uniformLocation(triangleProgram, "u_textureEnvOperand");
 	textureEnvCombinerLoc = OpenGL::uniformLocation(triangleProgram, "u_textureEnvCombiner");
-	textureEnvColorLoc = OpenGL::uniformLocation(triangleProgram, "u_textureEnvColor");
 	textureEnvScaleLoc = OpenGL::uniformLocation(triangleProgram, "u_textureEnvScale");
 
 	depthScaleLoc = OpenGL::uniformLocation(triangleProgram, "u_depthScale");
 	depthOffsetLoc = OpenGL::uniformLocation(triangleProgram, "u_depthOffset");
 	depthmapEnableLoc = OpenGL::uniformLocation(triangleProgram, "u_depthmapEnable");
-	picaRegLoc = OpenGL::uniformLocation(triangleProgram, "u_picaRegs");
+	glUniformBlockBinding(triangleProgram.handle(), glGetUniformBlockIndex(triangleProgram.handle(), "PicaRegs"), picaRegsBinding);
+	glGenBuffers(2, picaRegsBuffers.data());
+	for (GLuint buffer : picaRegsBuffers) {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, (picaRegsEnd - picaRegsStart) * sizeof(u32), &regs[picaRegsStart], GL_DYNAMIC_DRAW);
+	}
+
+	// Both buffers start out with the current registers
+	for (auto& dirty : picaRegsDirty) {
+		dirty.fill(0);
+	}
+	currentPicaRegsBuffer = 0;
+	glBindBufferBase(GL_UNIFORM_BUFFER, picaRegsBinding, picaRegsBuffers[0]);
+
+	// Translated vertex shaders read float uniforms from here. We don't know what's in the buffers yet, so they're fully dirty
+	glGenBuffers(2, floatUniformsBuffers.data());
+	for (GLuint buffer : floatUniformsBuffers) {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(PICAShader::floatUniforms), nullptr, GL_DYNAMIC_DRAW);
+	}
+
+	for (auto& dirty : floatUniformsDirty) {
+		dirty.fill(~0ull);
+	}
+	currentFloatUniformsBuffer = 0;
+	glBindBufferBase(GL_UNIFORM_BUFFER, floatUniformsBinding, floatUniformsBuffers[0]);
 
 	// Init sampler objects. Texture 0 goes in texture unit 0, texture 1 in TU 1, texture 2 in TU 2, and the light maps go in TU 3
 	glUniform1i(OpenGL::uniformLocation(triangleProgram, "u_tex0"), 0);
@@ -86,8 +120,8 @@ void RendererGL::initGraphicsContextInternal() {
 	gl.useProgram(displayProgram);
 	glUniform1i(OpenGL::uniformLocation(displayProgram, "u_texture"), 0);  // Init sampler object
 
-	vbo.createFixedSize(sizeof(Vertex) * vertexBufferSize, GL_STREAM_DRAW);
-	gl.bindVBO(vbo);
+	vertexStream.create(GL_ARRAY_BUFFER, vertexStreamSize);
+	gl.bindVBO(vertexStream.getHandle());
 	vao.create();
 	gl.bindVAO(vao);
 
@@ -118,13 +152,60 @@ void RendererGL::initGraphicsContextInternal() {
 
 	dummyVBO.create();
 	dummyVAO.create();
+
+	// Objects for running vertex shaders on the GPU. Previously translated shaders died with the old context, if there was one
+	hwVertexVao.create();
+	hwVertexBuffer.create();
+	hwIndexBuffer.create();
+	hwEnabledAttributes = 0;
+	hardwareShaderCache.clear();
 	gl.disableScissor();
 
+	// Same goes for generated fragment shaders. Let the driver compile them on as many threads as it likes, if it supports that
+	generatedPrograms.clear();
+	programCompilesThisFrame = 0;
+	parallelShaderCompile = GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile;
+	if (GLAD_GL_KHR_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	} else if (GLAD_GL_ARB_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+	}
+
+	// Program binaries are only any good to the exact driver that produced them, so the cache needs to know which driver we're on
+	GLint binaryFormatCount = 0;
+	if (GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary || GLAD_GL_ES_VERSION_3_0) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+	}
+	programBinariesSupported = binaryFormatCount > 0;
+
+	std::string driverString;
+	for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+		const char* string = reinterpret_cast<const char*>(glGetString(name));
+		driverString += string != nullptr ? string : "";
+		driverString += '\n';
+	}
+	driverHash = PICAHash::computeHash(driverString.data(), driverString.size());
+	openProgramCache();
+
 	// Create texture and framebuffer for the 3DS screen
 	const u32 screenTextureWidth = 400;       // Top screen is 400 pixels wide, bottom is 320
 	const u32 screenTextureHeight = 2 * 240;  // Both screens are 240 pixels tall
 
+	// The lighting LUT texture never changes size, so allocate it once and only update parts of it after that
 	glGenTextures(1, &lightLUTTextureArray);
+	glBindTexture(GL_TEXTURE_1D_ARRAY, lightLUTTextureArray);
+	if (GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_storage) {
+		glTexStorage2D(GL_TEXTURE_1D_ARRAY, 1, GL_R16, 256, Lights::LUT_Count);
+	} else {
+		glTexImage2D(GL_TEXTURE_1D_ARRAY, 0, GL_R16, 256, Lights::LUT_Count, 0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+	}
+	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_1D_ARRAY, 0);
+	gpu.lightingLUTDirty.markAllDirty();  // The new texture is empty
+	glGenBuffers(1, &textureUploadBuffer);
 
 	auto prevTexture = OpenGL::getTex2D();
 
@@ -301,7 +382,6 @@ void RendererGL::setupTextureEnvState() {
 	u32 textureEnvSourceRegs[6];
 	u32 textureEnvOperandRegs[6];
 	u32 textureEnvCombinerRegs[6];
-	u32 textureEnvColourRegs[6];
 	u32 textureEnvScaleRegs[6];
 
 	for (int i = 0; i < 6; i++) {
@@ -310,42 +390,45 @@ void RendererGL::setupTextureEnvState() {
 		textureEnvSourceRegs[i] = regs[ioBase];
 		textureEnvOperandRegs[i] = regs[ioBase + 1];
 		textureEnvCombinerRegs[i] = regs[ioBase + 2];
-		textureEnvColourRegs[i] = regs[ioBase + 3];
 		textureEnvScaleRegs[i] = regs[ioBase + 4];
 	}
 
 	glUniform1uiv(textureEnvSourceLoc, 6, textureEnvSourceRegs);
 	glUniform1uiv(textureEnvOperandLoc, 6, textureEnvOperandRegs);
 	glUniform1uiv(textureEnvCombinerLoc, 6, textureEnvCombinerRegs);
-	glUniform1uiv(textureEnvColorLoc, 6, textureEnvColourRegs);
 	glUniform1uiv(textureEnvScaleLoc, 6, textureEnvScaleRegs);
 }
 
-void RendererGL::bindTexturesToSlots() {
+// Get the texture a texture unit is currently configured to use
+Texture RendererGL::getUnitTexture(u32 unit) {
 	static constexpr std::array<u32, 3> ioBases = {
 		PICA::InternalRegs::Tex0BorderColor,
 		PICA::InternalRegs::Tex1BorderColor,
 		PICA::InternalRegs::Tex2BorderColor,
 	};
 
+	const size_t ioBase = ioBases[unit];
+
+	const u32 dim = regs[ioBase + 1];
+	const u32 config = regs[ioBase + 2];
+	const u32 height = dim & 0x7ff;
+	const u32 width = getBits<16, 11>(dim);
+	const u32 addr = (regs[ioBase + 4] & 0x0FFFFFFF) << 3;
+	const u32 format = regs[ioBase + (unit == 0 ? 13 : 5)] & 0xF;
+
+	return Texture(addr, static_cast<PICA::TextureFmt>(format), width, height, config);
+}
+
+void RendererGL::bindTexturesToSlots() {
 	for (int i = 0; i < 3; i++) {
 		if ((regs[PICA::InternalRegs::TexUnitCfg] & (1 << i)) == 0) {
 			continue;
 		}
 
-		const size_t ioBase = ioBases[i];
-
-		const u32 dim = regs[ioBase + 1];
-		const u32 config = regs[ioBase + 2];
-		const u32 height = dim & 0x7ff;
-		const u32 width = getBits<16, 11>(dim);
-		const u32 addr = (regs[ioBase + 4] & 0x0FFFFFFF) << 3;
-		u32 format = regs[ioBase + (i == 0 ? 13 : 5)] & 0xF;
-
+		Texture targetTex = getUnitTexture(i);
 		glActiveTexture(GL_TEXTURE0 + i);
 
-		if (addr != 0) [[likely]] {
-			Texture targetTex(addr, static_cast<PICA::TextureFmt>(format), width, height, config);
+		if (targetTex.location != 0) [[likely]] {
 			OpenGL::Texture tex = getTexture(targetTex);
 			tex.bind();
 		} else {
@@ -362,38 +445,372 @@ void RendererGL::bindTexturesToSlots() {
 }
 
 void RendererGL::updateLightingLUT() {
-	gpu.lightingLUTDirty = false;
-	std::array<u16, GPU::LightingLutSize> u16_lightinglut;
-
-	for (int i = 0; i < gpu.lightingLUT.size(); i++) {
-		uint64_t value = gpu.lightingLUT[i] & ((1 << 12) - 1);
-		u16_lightinglut[i] = value * 65535 / 4095;
-	}
+	// Only convert and upload the parts of the LUTs that changed. Each LUT is one layer of the texture array
+	std::array<u16, 256> row;
 
 	glActiveTexture(GL_TEXTURE0 + 3);
 	glBindTexture(GL_TEXTURE_1D_ARRAY, lightLUTTextureArray);
-	glTexImage2D(GL_TEXTURE_1D_ARRAY, 0, GL_R16, 256, Lights::LUT_Count, 0, GL_RED, GL_UNSIGNED_SHORT, u16_lightinglut.data());
-	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	gpu.lightingLUTDirty.consume([&](u32 lut, u32 start, u32 end) {
+		const u32* entries = &gpu.lightingLUT[lut * 256];
+		for (u32 i = start; i < end; i++) {
+			const u64 value = entries[i] & ((1 << 12) - 1);
+			row[i] = u16(value * 65535 / 4095);
+		}
+
+		glTexSubImage2D(GL_TEXTURE_1D_ARRAY, 0, start, lut, end - start, 1, GL_RED, GL_UNSIGNED_SHORT, &row[start]);
+	});
+
 	glActiveTexture(GL_TEXTURE0);
 }
 
+// The fourth type is meant to be "Geometry primitive". TODO: Find out what that is
+static constexpr std::array<OpenGL::Primitives, 4> primTypes = {
+	OpenGL::Triangle,
+	OpenGL::TriangleStrip,
+	OpenGL::TriangleFan,
+	OpenGL::Triangle,
+};
+
+// Number of vertices a draw turns into once converted to a triangle list
+static usize getTriangleListSize(PICA::PrimType primType, usize vertexCount) {
+	switch (primType) {
+		case PICA::PrimType::TriangleStrip:
+		case PICA::PrimType::TriangleFan: return vertexCount < 3 ? 0 : (vertexCount - 2) * 3;
+		default: return vertexCount;
+	}
+}
+
+// The GPU sends every register write that can affect rendering our way via flushPendingDraws before it happens. So if there's a batch
+// pending, it was made with the exact same state as this draw and we can just add the draw to it
 void RendererGL::drawVertices(PICA::PrimType primType, std::span<const Vertex> vertices) {
-	// The fourth type is meant to be "Geometry primitive". TODO: Find out what that is
-	static constexpr std::array<OpenGL::Primitives, 4> primTypes = {
-		OpenGL::Triangle,
-		OpenGL::TriangleStrip,
-		OpenGL::TriangleFan,
-		OpenGL::Triangle,
+	const usize listSize = getTriangleListSize(primType, vertices.size());
+	if (batchVertices.size() + listSize > maxBatchVertices) {
+		flushPendingDraws();
+	}
+
+	// Draws too big to batch get drawn as-is
+	if (listSize > maxBatchVertices) {
+		prepareForDraw();
+		drawFromStream(primTypes[static_cast<usize>(primType)], vertices);
+		return;
+	}
+
+	// Turn strips and fans into lists, so that draws of any primitive type can go in the same batch
+	switch (primType) {
+		case PICA::PrimType::TriangleStrip:
+			for (usize i = 0; i + 2 < vertices.size(); i++) {
+				// Every other triangle of a strip has its first 2 vertices swapped, to keep the winding order the same
+				if (i & 1) {
+					batchVertices.insert(batchVertices.end(), {vertices[i + 1], vertices[i], vertices[i + 2]});
+				} else {
+					batchVertices.insert(batchVertices.end(), {vertices[i], vertices[i + 1], vertices[i + 2]});
+				}
+			}
+			break;
+
+		case PICA::PrimType::TriangleFan:
+			for (usize i = 1; i + 1 < vertices.size(); i++) {
+				batchVertices.insert(batchVertices.end(), {vertices[0], vertices[i], vertices[i + 1]});
+			}
+			break;
+
+		default: batchVertices.insert(batchVertices.end(), vertices.begin(), vertices.end()); break;
+	}
+}
+
+void RendererGL::flushPendingDraws() {
+	if (batchVertices.empty()) {
+		return;
+	}
+
+	prepareForDraw();
+	drawFromStream(OpenGL::Triangle, batchVertices);
+	batchVertices.clear();
+}
+
+// Copy vertices to our vertex stream and draw them. The vertex stream must be bound
+void RendererGL::drawFromStream(OpenGL::Primitives primitive, std::span<const Vertex> vertices) {
+	const u32 byteSize = u32(vertices.size_bytes());
+	const u32 offset = vertexStream.allocate(byteSize, sizeof(Vertex));
+	vertexStream.write(offset, vertices.data(), byteSize);
+	OpenGL::draw(primitive, GLint(offset / sizeof(Vertex)), GLsizei(vertices.size()));
+}
+
+void RendererGL::uploadPicaRegs() {
+	// Both copies of the buffer need the registers that changed since the last draw
+	for (usize i = 0; i < gpu.dirtyRegs.size(); i++) {
+		for (auto& dirty : picaRegsDirty) {
+			dirty[i] |= gpu.dirtyRegs[i];
+		}
+
+		gpu.dirtyRegs[i] = 0;
+	}
+
+	auto isDirty = [](const auto& dirty, u32 reg) { return (dirty[reg / 64] >> (reg % 64)) & 1; };
+	auto isBufferDirty = [](const auto& dirty) {
+		static_assert(picaRegsEnd % 64 == 0, "The last word of the dirty bits has to be fully in range");
+
+		// The first register isn't at the start of a word, so skip the bits of the registers before it
+		u64 bits = dirty[picaRegsStart / 64] & (~0ull << (picaRegsStart % 64));
+		for (u32 i = picaRegsStart / 64 + 1; i < picaRegsEnd / 64; i++) {
+			bits |= dirty[i];
+		}
+		return bits != 0;
 	};
 
-	const auto primitiveTopology = primTypes[static_cast<usize>(primType)];
+	// If the buffer we're using is up to date, keep using it
+	if (!isBufferDirty(picaRegsDirty[currentPicaRegsBuffer])) {
+		return;
+	}
+
+	currentPicaRegsBuffer ^= 1;
+	auto& dirty = picaRegsDirty[currentPicaRegsBuffer];
+	glBindBuffer(GL_UNIFORM_BUFFER, picaRegsBuffers[currentPicaRegsBuffer]);
+
+	// Upload every run of dirty registers. Runs with only a few clean registers between them get merged, as every upload has a fixed cost
+	static constexpr u32 maxGap = 8;
+	u32 reg = picaRegsStart;
+
+	while (reg < picaRegsEnd) {
+		if (!isDirty(dirty, reg)) {
+			reg++;
+			continue;
+		}
+
+		u32 lastDirty = reg;
+		for (u32 next = reg + 1; next < picaRegsEnd && next - lastDirty <= maxGap; next++) {
+			if (isDirty(dirty, next)) {
+				lastDirty = next;
+			}
+		}
+
+		const u32 count = lastDirty - reg + 1;
+		glBufferSubData(GL_UNIFORM_BUFFER, (reg - picaRegsStart) * sizeof(u32), count * sizeof(u32), &regs[reg]);
+		reg = lastDirty + 1;
+	}
+
+	dirty.fill(0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, picaRegsBinding, picaRegsBuffers[currentPicaRegsBuffer]);
+}
+
+void RendererGL::uploadFloatUniforms(PICAShader& shader) {
+	for (usize i = 0; i < shader.floatUniformsDirty.size(); i++) {
+		for (auto& dirty : floatUniformsDirty) {
+			dirty[i] |= shader.floatUniformsDirty[i];
+		}
+
+		shader.floatUniformsDirty[i] = 0;
+	}
+
+	if ((floatUniformsDirty[currentFloatUniformsBuffer][0] | floatUniformsDirty[currentFloatUniformsBuffer][1]) == 0) {
+		return;
+	}
+
+	currentFloatUniformsBuffer ^= 1;
+	auto& dirty = floatUniformsDirty[currentFloatUniformsBuffer];
+	glBindBuffer(GL_UNIFORM_BUFFER, floatUniformsBuffers[currentFloatUniformsBuffer]);
+
+	auto isDirty = [&](u32 index) { return (dirty[index / 64] >> (index % 64)) & 1; };
+	// Same as the register buffer, runs of dirty uniforms with small gaps between them get merged into one upload
+	static constexpr u32 maxGap = 4;
+	constexpr usize uniformSize = sizeof(shader.floatUniforms[0]);
+	u32 index = 0;
+
+	while (index < 96) {
+		if (!isDirty(index)) {
+			index++;
+			continue;
+		}
+
+		u32 lastDirty = index;
+		for (u32 next = index + 1; next < 96 && next - lastDirty <= maxGap; next++) {
+			if (isDirty(next)) {
+				lastDirty = next;
+			}
+		}
+
+		const u32 count = lastDirty - index + 1;
+		glBufferSubData(GL_UNIFORM_BUFFER, index * uniformSize, count * uniformSize, &shader.floatUniforms[index]);
+		index = lastDirty + 1;
+	}
+
+	dirty.fill(0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, floatUniformsBinding, floatUniformsBuffers[currentFloatUniformsBuffer]);
+}
+
+// Get the program to draw with for the current fragment configuration. This is the specialised program for the configuration if it's done
+// compiling, or the ubershader if it isn't, so we never have to wait for the driver to compile a shader
+const OpenGL::Program& RendererGL::getTriangleProgram() {
+	if (useUbershaders) {
+		return triangleProgram;
+	}
+
+	const auto config = PICA::FragmentConfig::fromRegs(regs);
+	auto it = generatedPrograms.find(config);
+	if (it == generatedPrograms.end()) {
+		// Spread out compiling a bunch of new shaders at once over multiple frames, drivers without parallel compilation block while compiling
+		if (programCompilesThisFrame >= maxProgramCompilesPerFrame) {
+			return triangleProgram;
+		}
+
+		it = generatedPrograms.emplace(config, GeneratedProgram{}).first;
+		compileGeneratedProgram(it->second, config);
+	}
+
+	GeneratedProgram& generated = it->second;
+	if (generated.state == GeneratedProgram::State::Compiling) {
+		pollGeneratedProgram(generated);
+	}
+
+	return generated.state == GeneratedProgram::State::Ready ? generated.program : triangleProgram;
+}
+
+void RendererGL::compileGeneratedProgram(GeneratedProgram& generated, const PICA::FragmentConfig& config) {
+	const std::string source = PICA::FragmentShaderGenerator::generate(config);
+	const GLchar* const sources[1] = {source.c_str()};
+	generated.sourceHash = std::rotl(triangleVertexShaderHash, 1) ^ PICAHash::computeHash(source.data(), source.size());
+
+	// Programs from the cache are ready to go straight away, and don't count towards the compile budget as loading them is cheap
+	if (auto cached = loadCachedProgram(generated.sourceHash); cached.has_value()) {
+		generated.program.m_handle = cached.value();
+		generated.state = GeneratedProgram::State::Ready;
+		setupGeneratedProgram(generated.program);
+		return;
+	}
+
+	// We don't check whether compiling and linking worked here, as that would wait for the driver to finish
+	programCompilesThisFrame++;
+	generated.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(generated.fragmentShader, 1, sources, nullptr);
+	glCompileShader(generated.fragmentShader);
+
+	const GLuint program = glCreateProgram();
+	if (programCache.isOpen()) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glAttachShader(program, triangleVertexShader.handle());
+	glAttachShader(program, generated.fragmentShader);
+	glLinkProgram(program);
+
+	generated.program.m_handle = program;
+	generated.submitFrame = frameCount;
+	generated.state = GeneratedProgram::State::Compiling;
+}
+
+void RendererGL::pollGeneratedProgram(GeneratedProgram& generated) {
+	const GLuint program = generated.program.handle();
+
+	if (parallelShaderCompile) {
+		GLint done;
+		glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+		if (done == GL_FALSE) {
+			return;
+		}
+	} else if (generated.submitFrame == frameCount) {
+		// We can't ask the driver whether it's done without potentially waiting for it, so give it until the next frame
+		return;
+	}
+
+	glDetachShader(program, generated.fragmentShader);
+	glDeleteShader(generated.fragmentShader);
+	generated.fragmentShader = 0;
+
+	GLint success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		char buf[4096];
+		glGetProgramInfoLog(program, 4096, nullptr, buf);
+		Helpers::warn("Failed to link generated fragment shader, falling back to the ubershader\nError: %s\n", buf);
+
+		glDeleteProgram(program);
+		generated.program.m_handle = 0;
+		generated.state = GeneratedProgram::State::Failed;
+		return;
+	}
+
+	storeCachedProgram(program, generated.sourceHash);
+	setupGeneratedProgram(generated.program);
+	generated.state = GeneratedProgram::State::Ready;
+}
+
+// Uniform block bindings and sampler uniforms aren't part of program binaries, so this is needed for cached programs too
+void RendererGL::setupGeneratedProgram(OpenGL::Program& program) {
+	const GLuint handle = program.handle();
+	glUniformBlockBinding(handle, glGetUniformBlockIndex(handle, "PicaRegs"), picaRegsBinding);
+	gl.useProgram(program);
+	glUniform1i(OpenGL::uniformLocation(program, "u_tex0"), 0);
+	glUniform1i(OpenGL::uniformLocation(program, "u_tex1"), 1);
+	glUniform1i(OpenGL::uniformLocation(program, "u_tex2"), 2);
+	glUniform1i(OpenGL::uniformLocation(program, "u_tex_lighting_lut"), 3);
+}
+
+void RendererGL::setShaderCachePath(const std::optional<std::filesystem::path>& path) {
+	shaderCachePath = path;
+	openProgramCache();
+}
+
+// (Re)opens the program cache for the current title. We need both a path and a GL context to know the driver, so this happens whenever
+// either of those changes
+void RendererGL::openProgramCache() {
+	if (shaderCachePath.has_value() && programBinariesSupported) {
+		programCache.open(shaderCachePath.value(), driverHash);
+	} else {
+		programCache.close();
+	}
+}
+
+std::optional<GLuint> RendererGL::loadCachedProgram(u64 sourceHash) {
+	if (!programCache.isOpen()) {
+		return std::nullopt;
+	}
+
+	auto binary = programCache.find(sourceHash);
+	if (!binary.has_value()) {
+		return std::nullopt;
+	}
+
+	const GLuint program = glCreateProgram();
+	glProgramBinary(program, binary->format, binary->data.data(), GLsizei(binary->data.size()));
+
+	// Drivers are allowed to reject binaries for any reason, in which case we compile the program like normal and store the new binary
+	GLint success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		glDeleteProgram(program);
+		programCache.discard(sourceHash);
+		return std::nullopt;
+	}
+
+	return program;
+}
+
+void RendererGL::storeCachedProgram(GLuint program, u64 sourceHash) {
+	if (!programCache.isOpen()) {
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+
+	std::vector<u8> binary(length);
+	GLenum format;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	programCache.store(sourceHash, u32(format), std::span<const u8>(binary.data(), usize(length)));
+}
+
+// Set up all the state for drawing the vertices in our vertex buffer with the triangle program
+void RendererGL::prepareForDraw() {
 	gl.disableScissor();
-	gl.bindVBO(vbo);
+	gl.bindVBO(vertexStream.getHandle());
 	gl.bindVAO(vao);
-	gl.useProgram(triangleProgram);
+
+	const OpenGL::Program& program = getTriangleProgram();
+	const bool usingUbershader = program.handle() == triangleProgram.handle();
+	gl.useProgram(program);
 
 	gl.enableClipPlane(0);  // Clipping plane 0 is always enabled
 	if (regs[PICA::InternalRegs::ClipEnable] & 1) {
@@ -403,6 +820,7 @@ void RendererGL::drawVertices(PICA::PrimType primType, std::span<const Vertex> v
 	setupBlending();
 	auto poop = getColourBuffer(colourBufferLoc, colourBufferFormat, fbSize[0], fbSize[1]);
 	poop->fbo.bind(OpenGL::DrawAndReadFramebuffer);
+	markColourBufferDirty(colourBufferLoc);
 
 	const u32 depthControl = regs[PICA::InternalRegs::DepthAndColorMask];
 	const bool depthWrite = regs[PICA::InternalRegs::DepthBufferWrite];
@@ -418,30 +836,32 @@ void RendererGL::drawVertices(PICA::PrimType primType, std::span<const Vertex> v
 	const float depthOffset = f24::fromRaw(regs[PICA::InternalRegs::DepthOffset] & 0xffffff).toFloat32();
 	const bool depthMapEnable = regs[PICA::InternalRegs::DepthmapEnable] & 1;
 
-	// Update depth uniforms
-	if (oldDepthScale != depthScale) {
-		oldDepthScale = depthScale;
-		glUniform1f(depthScaleLoc, depthScale);
-	}
+	// Generated shaders read the depth and TEV configuration straight from the PICA registers, only the ubershader needs uniforms for them
+	if (usingUbershader) {
+		if (oldDepthScale != depthScale) {
+			oldDepthScale = depthScale;
+			glUniform1f(depthScaleLoc, depthScale);
+		}
 
-	if (oldDepthOffset != depthOffset) {
-		oldDepthOffset = depthOffset;
-		glUniform1f(depthOffsetLoc, depthOffset);
-	}
+		if (oldDepthOffset != depthOffset) {
+			oldDepthOffset = depthOffset;
+			glUniform1f(depthOffsetLoc, depthOffset);
+		}
+
+		if (oldDepthmapEnable != depthMapEnable) {
+			oldDepthmapEnable = depthMapEnable;
+			glUniform1i(depthmapEnableLoc, depthMapEnable);
+		}
 
-	if (oldDepthmapEnable != depthMapEnable) {
-		oldDepthmapEnable = depthMapEnable;
-		glUniform1i(depthmapEnableLoc, depthMapEnable);
+		setupTextureEnvState();
 	}
 
-	setupTextureEnvState();
 	bindTexturesToSlots();
 
-	// Upload PICA Registers as a single uniform. The shader needs access to the rasterizer registers (for depth, starting from index 0x48)
-	// The texturing and the fragment lighting registers. Therefore we upload them all in one go to avoid multiple slow uniform updates
-	glUniform1uiv(picaRegLoc, 0x200 - 0x48, &regs[0x48]);
+	// The shaders need access to the rasterizer registers (for depth, starting from index 0x48), the texturing and fragment lighting registers
+	uploadPicaRegs();
 
-	if (gpu.lightingLUTDirty) {
+	if (gpu.lightingLUTDirty.isDirty()) {
 		updateLightingLUT();
 	}
 
@@ -478,12 +898,183 @@ void RendererGL::drawVertices(PICA::PrimType primType, std::span<const Vertex> v
 	}
 
 	setupStencilTest(stencilEnable);
+}
+
+RendererGL::HardwareShader* RendererGL::getHardwareShader(PICAShader& shader) {
+	const u32 outputCount = regs[PICA::InternalRegs::ShaderOutputCount] & 7;
+	std::array<u32, 7> outmaps;
+	for (int i = 0; i < 7; i++) {
+		outmaps[i] = regs[PICA::InternalRegs::ShaderOutmap0 + i];
+	}
+
+	// The entrypoint and output mapping get baked into the translated shader, so they're part of the key too
+	const u64 programHash = std::rotl(shader.getCodeHash(), 1) ^ shader.getOpdescHash();
+	std::array<u32, 11> keyData = {u32(programHash), u32(programHash >> 32), shader.entrypoint, outputCount};
+	std::copy(outmaps.begin(), outmaps.end(), keyData.begin() + 4);
+	const u64 key = PICAHash::computeHash(reinterpret_cast<const char*>(keyData.data()), sizeof(keyData));
+
+	auto it = hardwareShaderCache.find(key);
+	if (it == hardwareShaderCache.end()) {
+		it = hardwareShaderCache.emplace_hint(it, key, compileHardwareShader(shader, outputCount, outmaps));
+	}
+
+	return it->second.has_value() ? &it->second.value() : nullptr;
+}
+
+std::optional<RendererGL::HardwareShader> RendererGL::compileHardwareShader(PICAShader& shader, u32 outputCount, const std::array<u32, 7>& outmaps) {
+	auto source = ShaderDecompiler::decompile(shader, outputCount, outmaps);
+	if (!source.has_value()) {
+		log("Couldn't translate vertex shader, shading on the CPU\n");
+		return std::nullopt;
+	}
+
+	// The transform feedback setup is part of program binaries, so cached programs can be used as is
+	const u64 sourceHash = PICAHash::computeHash(source->data(), source->size());
+	std::optional<GLuint> program = loadCachedProgram(sourceHash);
+
+	if (!program.has_value()) {
+		OpenGL::Shader vert(source.value(), OpenGL::Vertex);
+		if (!vert.exists()) {
+			Helpers::warn("Failed to compile translated vertex shader");
+			return std::nullopt;
+		}
+
+		// We can't use OpenGL::Program::create here as the transform feedback outputs need to be specified before linking
+		program = glCreateProgram();
+		const GLchar* varyings[] = {"o_vertex"};
+		if (programCache.isOpen()) {
+			glProgramParameteri(program.value(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		glAttachShader(program.value(), vert.handle());
+		glTransformFeedbackVaryings(program.value(), 1, varyings, GL_INTERLEAVED_ATTRIBS);
+		glLinkProgram(program.value());
+		glDeleteShader(vert.handle());
+
+		GLint success;
+		glGetProgramiv(program.value(), GL_LINK_STATUS, &success);
+		if (!success) {
+			Helpers::warn("Failed to link translated vertex shader");
+			glDeleteProgram(program.value());
+			return std::nullopt;
+		}
+
+		storeCachedProgram(program.value(), sourceHash);
+	}
 
-	vbo.bufferVertsSub(vertices);
-	OpenGL::draw(primitiveTopology, GLsizei(vertices.size()));
+	HardwareShader hwShader;
+	hwShader.program.m_handle = program.value();
+	glUniformBlockBinding(program.value(), glGetUniformBlockIndex(program.value(), "FloatUniforms"), floatUniformsBinding);
+	hwShader.intUniformsLoc = OpenGL::uniformLocation(hwShader.program, "u_intUniforms");
+	hwShader.boolUniformLoc = OpenGL::uniformLocation(hwShader.program, "u_boolUniform");
+	return hwShader;
+}
+
+bool RendererGL::drawVerticesAccelerated(PICA::PrimType primType, const PICA::DrawAcceleration& accel) {
+	if (accel.vertexCount > vertexBufferSize) {
+		return false;
+	}
+
+	HardwareShader* hwShader = getHardwareShader(*accel.shader);
+	if (hwShader == nullptr) {
+		return false;
+	}
+
+	// Draws we've batched up so far have to go first
+	flushPendingDraws();
+
+	PICAShader& shader = *accel.shader;
+	gl.useProgram(hwShader->program);
+	uploadFloatUniforms(shader);
+
+	std::array<GLuint, 16> intUniforms;
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			intUniforms[i * 4 + j] = shader.intUniforms[i][j];
+		}
+	}
+
+	if (!hwShader->uniformsValid || intUniforms != hwShader->intUniforms) {
+		glUniform4uiv(hwShader->intUniformsLoc, 4, intUniforms.data());
+		hwShader->intUniforms = intUniforms;
+	}
+
+	if (!hwShader->uniformsValid || shader.boolUniform != hwShader->boolUniform) {
+		glUniform1ui(hwShader->boolUniformLoc, shader.boolUniform);
+		hwShader->boolUniform = shader.boolUniform;
+	}
+	hwShader->uniformsValid = true;
+
+	// Upload the raw vertex data and point each shader input register at its attribute
+	static constexpr std::array<GLenum, 4> attributeTypes = {GL_BYTE, GL_UNSIGNED_BYTE, GL_SHORT, GL_FLOAT};
+	gl.bindVAO(hwVertexVao);
+	gl.bindVBO(hwVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, accel.vertexDataSize, accel.vertexData, GL_STREAM_DRAW);
+
+	u32 enabledAttributes = 0;
+	for (u32 i = 0; i < accel.attributeCount; i++) {
+		const auto& attribute = accel.attributes[i];
+		const void* offset = reinterpret_cast<const void*>(uintptr_t(attribute.offset));
+
+		glVertexAttribPointer(attribute.inputRegister, attribute.componentCount, attributeTypes[attribute.type], GL_FALSE, attribute.stride, offset);
+		enabledAttributes |= 1u << attribute.inputRegister;
+	}
+
+	// Fixed attributes go in the generic attribute values, which is what GL reads for attributes that don't have an array enabled
+	for (u32 i = 0; i < accel.fixedAttributeCount; i++) {
+		const auto& attribute = accel.fixedAttributes[i];
+		glVertexAttrib4fv(attribute.inputRegister, attribute.value.data());
+	}
+
+	const u32 changedAttributes = enabledAttributes ^ hwEnabledAttributes;
+	for (u32 i = 0; i < 16; i++) {
+		if (changedAttributes & (1u << i)) {
+			if (enabledAttributes & (1u << i)) {
+				glEnableVertexAttribArray(i);
+			} else {
+				glDisableVertexAttribArray(i);
+			}
+		}
+	}
+	hwEnabledAttributes = enabledAttributes;
+
+	if (accel.indexed) {
+		// The element buffer binding is part of the VAO state
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, hwIndexBuffer.handle());
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, accel.vertexCount * (accel.shortIndex ? 2 : 1), accel.indexData, GL_STREAM_DRAW);
+	}
+
+	// Shade every vertex of the draw into our vertex stream, in draw order. Nothing gets rasterized in this pass
+	const u32 shadedSize = accel.vertexCount * u32(sizeof(Vertex));
+	gl.bindVBO(vertexStream.getHandle());
+	const u32 shadedOffset = vertexStream.allocate(shadedSize, sizeof(Vertex));
+
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vertexStream.getHandle(), shadedOffset, shadedSize);
+	glBeginTransformFeedback(GL_POINTS);
+
+	if (accel.indexed) {
+		// Offset the indices so that vertex #minIndex is the first vertex of the data we uploaded
+		const GLenum indexType = accel.shortIndex ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+		glDrawElementsBaseVertex(GL_POINTS, GLsizei(accel.vertexCount), indexType, nullptr, -GLint(accel.minIndex));
+	} else {
+		glDrawArrays(GL_POINTS, 0, GLsizei(accel.vertexCount));
+	}
+
+	glEndTransformFeedback();
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glDisable(GL_RASTERIZER_DISCARD);
+
+	// Now draw the shaded vertices exactly like the ones we shade on the CPU
+	prepareForDraw();
+	OpenGL::draw(primTypes[static_cast<usize>(primType)], GLint(shadedOffset / sizeof(Vertex)), GLsizei(accel.vertexCount));
+	return true;
 }
 
 void RendererGL::display() {
+	flushPendingDraws();
+	frameCount++;
+	programCompilesThisFrame = 0;
+
 	gl.disableScissor();
 	gl.disableBlend();
 	gl.disableDepth();
@@ -531,6 +1122,7 @@ void RendererGL::display() {
 
 void RendererGL::clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 control) {
 	log("GPU: Clear buffer\nStart: %08X End: %08X\nValue: %08X Control: %08X\n", startAddress, endAddress, value, control);
+	flushPendingDraws();
 	gl.disableScissor();
 
 	const auto color = colourBufferCache.findFromAddress(startAddress);
@@ -540,6 +1132,7 @@ void RendererGL::clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 co
 		const float b = getBits<8, 8>(value) / 255.0f;
 		const float a = (value & 0xff) / 255.0f;
 		color->get().fbo.bind(OpenGL::DrawFramebuffer);
+		color->get().dirty = true;
 
 		gl.setColourMask(true, true, true, true);
 		gl.setClearColour(r, g, b, a);
@@ -550,6 +1143,7 @@ void RendererGL::clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 co
 	const auto depth = depthBufferCache.findFromAddress(startAddress);
 	if (depth) {
 		depth->get().fbo.bind(OpenGL::DrawFramebuffer);
+		depth->get().dirty = true;
 
 		float depthVal;
 		const auto format = depth->get().format;
@@ -594,13 +1188,9 @@ void RendererGL::bindDepthBuffer() {
 	// Similar logic as the getColourFBO function
 	DepthBuffer sampleBuffer(depthBufferLoc, depthBufferFormat, fbSize[0], fbSize[1]);
 	auto buffer = depthBufferCache.find(sampleBuffer);
-	GLuint tex;
-
-	if (buffer.has_value()) {
-		tex = buffer.value().get().texture.m_handle;
-	} else {
-		tex = depthBufferCache.add(sampleBuffer).texture.m_handle;
-	}
+	DepthBuffer& depthBuffer = buffer.has_value() ? buffer.value().get() : depthBufferCache.add(sampleBuffer);
+	const GLuint tex = depthBuffer.texture.m_handle;
+	depthBuffer.dirty = true;
 
 	if (PICA::DepthFmt::Depth24Stencil8 != depthBufferFormat) {
 		Helpers::panicDev("TODO: Should we remove stencil attachment?");
@@ -612,18 +1202,148 @@ void RendererGL::bindDepthBuffer() {
 OpenGL::Texture RendererGL::getTexture(Texture& tex) {
 	// Similar logic as the getColourFBO/bindDepthBuffer functions
 	auto buffer = textureCache.find(tex);
+	Memory& mem = gpu.getMemory();
 
 	if (buffer.has_value()) {
-		return buffer.value().get().texture;
+		Texture& cached = buffer.value().get();
+		const u32 size = u32(cached.sizeInBytes());
+
+		// Nothing wrote to the texture's pages since we last looked at it, so it's still up to date
+		if (!mem.isPhysicalRangeDirty(cached.location, size, cached.writeTimestamp)) {
+			return cached.texture;
+		}
+
+		// Something wrote to the pages, but games often rewrite other data sharing a page with the texture, or upload the same
+		// texture again. Only decode and upload again if the data actually changed
+		const auto textureData = std::span{gpu.getPointerPhys<u8>(cached.location), size};
+		cached.writeTimestamp = mem.watchPhysicalRange(cached.location, size);
+
+		const u64 hash = hashTexture(cached, textureData);
+		if (hash != cached.hash) {
+			cached.hash = hash;
+			uploadTexture(cached, textureData);
+		}
+
+		return cached.texture;
 	} else {
 		const auto textureData = std::span{gpu.getPointerPhys<u8>(tex.location), tex.sizeInBytes()};  // Get pointer to the texture data in 3DS memory
 		Texture& newTex = textureCache.add(tex);
-		newTex.decodeTexture(textureData);
+		newTex.writeTimestamp = mem.watchPhysicalRange(newTex.location, u32(textureData.size()));
+		newTex.hash = hashTexture(newTex, textureData);
+		uploadTexture(newTex, textureData);
 
 		return newTex.texture;
 	}
 }
 
+// Width and height are at most 11 bits each, so the key is unique for every address/format/size combination
+static u64 getTextureKey(const Texture& tex) {
+	auto size = tex.size;  // The vector accessors aren't const
+	return u64(tex.location) | (u64(tex.format) << 32) | (u64(size.u()) << 36) | (u64(size.v()) << 48);
+}
+
+void RendererGL::uploadTexture(Texture& tex, std::span<const u8> data) {
+	const usize texelCount = usize(tex.size.u()) * usize(tex.size.v());
+
+	// Use the texels from the background decode if there's one for this exact data
+	if (auto it = pendingTextureDecodes.find(getTextureKey(tex)); it != pendingTextureDecodes.end()) {
+		TextureDecodeQueue::JobPtr job = std::move(it->second.job);
+		pendingTextureDecodes.erase(it);
+
+		if (job->hash == tex.hash) {
+			const auto& texels = textureDecodeQueue.wait(*job);
+			// Cancelled jobs don't have any texels
+			if (texels.size() == texelCount) {
+				tex.upload(texels.data(), textureUploadBuffer);
+				return;
+			}
+		} else {
+			textureDecodeQueue.cancel(*job);
+		}
+	}
+
+	u32* texels = textureScratch.allocate(texelCount);
+	PICA::TextureDecoder::decodeTexture(tex.format, tex.size.u(), tex.size.v(), data, texels);
+	tex.upload(texels, textureUploadBuffer);
+}
+
+// Textures only get hashed once if they were prefetched, as long as nothing wrote to them in between
+u64 RendererGL::hashTexture(const Texture& tex, std::span<const u8> data) {
+	if (auto it = pendingTextureDecodes.find(getTextureKey(tex)); it != pendingTextureDecodes.end()) {
+		if (!gpu.getMemory().isPhysicalRangeDirty(tex.location, u32(data.size()), it->second.writeTimestamp)) {
+			return it->second.job->hash;
+		}
+	}
+
+	return PICAHash::computeHash((const char*)data.data(), data.size());
+}
+
+void RendererGL::prefetchTexture(u32 unit) {
+	if (!textureDecodeQueue.isEnabled()) {
+		return;
+	}
+
+	Texture tex = getUnitTexture(unit);
+	auto size = tex.size;
+	if (tex.location == 0 || size.u() == 0 || size.v() == 0) {
+		return;
+	}
+
+	// The unit might not be fully configured yet and point anywhere, so make sure the texture is somewhere the GPU can read from first
+	const u32 byteSize = u32(tex.sizeInBytes());
+	const u64 end = u64(tex.location) + byteSize;
+	const bool inFCRAM = tex.location >= PhysicalAddrs::FCRAM && end <= PhysicalAddrs::FCRAMEnd;
+	const bool inVRAM = tex.location >= PhysicalAddrs::VRAM && end <= PhysicalAddrs::VRAMEnd;
+	if (!inFCRAM && !inVRAM) {
+		return;
+	}
+
+	const u8* data = gpu.getPointerPhys<u8>(tex.location, byteSize);
+	Memory& mem = gpu.getMemory();
+
+	// Nothing to do if the cached copy of the texture is still up to date
+	// Don't use the cache's find function for this, we don't want prefetches to count as uses of the texture
+	auto cached = textureCache.peek(tex);
+	if (cached.has_value() && !mem.isPhysicalRangeDirty(tex.location, byteSize, cached.value().get().writeTimestamp)) {
+		return;
+	}
+
+	// Same if we're already decoding it and nothing wrote to it since
+	const u64 key = getTextureKey(tex);
+	auto pending = pendingTextureDecodes.find(key);
+	if (pending != pendingTextureDecodes.end() && !mem.isPhysicalRangeDirty(tex.location, byteSize, pending->second.writeTimestamp)) {
+		return;
+	}
+
+	// Watch the pages before hashing, so writes that happen while we hash still make the hash stale
+	const u64 writeTimestamp = mem.watchPhysicalRange(tex.location, byteSize);
+	const u64 hash = PICAHash::computeHash((const char*)data, byteSize);
+
+	// The data got rewritten without changing. Bump the timestamps so the draw doesn't hash it again
+	if (cached.has_value() && cached.value().get().hash == hash) {
+		cached.value().get().writeTimestamp = writeTimestamp;
+		return;
+	}
+
+	if (pending != pendingTextureDecodes.end()) {
+		if (pending->second.job->hash == hash) {
+			pending->second.writeTimestamp = writeTimestamp;
+			return;
+		}
+
+		textureDecodeQueue.cancel(*pending->second.job);
+	}
+
+	// Prefetches that never got used pile up if games configure textures they don't draw with, so drop them every now and then
+	if (pendingTextureDecodes.size() >= maxPendingTextureDecodes) {
+		textureDecodeQueue.clear();
+		pendingTextureDecodes.clear();
+	}
+
+	auto job = textureDecodeQueue.submit(tex.format, size.u(), size.v(), hash, std::span(data, byteSize));
+	pendingTextureDecodes[key] = {std::move(job), writeTimestamp};
+}
+
 // NOTE: The GPU format has RGB5551 and RGB655 swapped compared to internal regs format
 PICA::ColorFmt ToColorFmt(u32 format) {
 	switch (format) {
@@ -634,6 +1354,7 @@ PICA::ColorFmt ToColorFmt(u32 format) {
 }
 
 void RendererGL::displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) {
+	flushPendingDraws();
 	const u32 inputWidth = inputSize & 0xffff;
 	const u32 inputHeight = inputSize >> 16;
 	const auto inputFormat = ToColorFmt(Helpers::getBits<8, 3>(flags));
@@ -673,6 +1394,7 @@ void RendererGL::displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u
 	// Blit the framebuffers
 	srcFramebuffer->fbo.bind(OpenGL::ReadFramebuffer);
 	destFramebuffer->fbo.bind(OpenGL::DrawFramebuffer);
+	markColourBufferDirty(destFramebuffer->location);
 	gl.disableScissor();
 
 	glBlitFramebuffer(
@@ -682,6 +1404,7 @@ void RendererGL::displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u
 }
 
 void RendererGL::textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32 inputSize, u32 outputSize, u32 flags) {
+	flushPendingDraws();
 	// Texture copy size is aligned to 16 byte units
 	const u32 copySize = totalBytes & ~0xf;
 	if (copySize == 0) {
@@ -752,6 +1475,7 @@ void RendererGL::textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32
 	// Blit the framebuffers
 	srcFramebuffer->fbo.bind(OpenGL::ReadFramebuffer);
 	destFramebuffer->fbo.bind(OpenGL::DrawFramebuffer);
+	markColourBufferDirty(destFramebuffer->location);
 	gl.disableScissor();
 
 	glBlitFramebuffer(
@@ -778,7 +1502,94 @@ std::optional<ColourBuffer> RendererGL::getColourBuffer(u32 addr, PICA::ColorFmt
 	return colourBufferCache.add(sampleBuffer);
 }
 
+void RendererGL::markColourBufferDirty(u32 address) {
+	if (auto buffer = colourBufferCache.peekFromAddress(address)) {
+		buffer->get().dirty = true;
+	}
+}
+
+void RendererGL::writebackColourBuffer(ColourBuffer& buffer) {
+	const u32 size = u32(buffer.sizeInBytes());
+	if (!buffer.dirty || !gpu.isPhysicalRangeValid(buffer.location, size)) {
+		return;
+	}
+
+	const u32 width = buffer.size.x();
+	const u32 height = buffer.size.y();
+	std::vector<SwRenderer::RGBA> pixels(usize(width) * height);
+
+	GLint oldReadFramebuffer;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &oldReadFramebuffer);
+	buffer.fbo.bind(OpenGL::ReadFramebuffer);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, oldReadFramebuffer);
+
+	// The buffer is tiled in memory, with the bottom row of the GL texture being the last row in memory
+	u8* output = gpu.getPointerPhys<u8>(buffer.location, size);
+	const u32 bytesPerPixel = PICA::sizePerPixel(buffer.format);
+	for (u32 y = 0; y < height; y++) {
+		for (u32 x = 0; x < width; x++) {
+			const u32 offset = PICA::TextureDecoder::getSwizzledOffset(x, height - 1 - y, width, bytesPerPixel);
+			SwRenderer::encodeColour(buffer.format, output + offset, pixels[y * width + x]);
+		}
+	}
+
+	gpu.getMemory().invalidatePhysicalRange(buffer.location, size);
+	buffer.dirty = false;
+}
+
+void RendererGL::writebackDepthBuffer(DepthBuffer& buffer) {
+	const u32 size = u32(buffer.sizeInBytes());
+	if (!buffer.dirty || !gpu.isPhysicalRangeValid(buffer.location, size)) {
+		return;
+	}
+
+	const u32 width = buffer.size.x();
+	const u32 height = buffer.size.y();
+	const bool hasStencil = buffer.format == DepthFmt::Depth24Stencil8;
+	// With stencil, we get the depth in the top 24 bits and the stencil in the bottom 8. Without, we get the depth normalized to 32 bits
+	std::vector<u32> pixels(usize(width) * height);
+
+	GLint oldReadFramebuffer;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &oldReadFramebuffer);
+	buffer.fbo.bind(OpenGL::ReadFramebuffer);
+	if (hasStencil) {
+		glReadPixels(0, 0, width, height, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, pixels.data());
+	} else {
+		glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, pixels.data());
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, oldReadFramebuffer);
+
+	u8* output = gpu.getPointerPhys<u8>(buffer.location, size);
+	const u32 bytesPerPixel = PICA::sizePerPixel(buffer.format);
+	for (u32 y = 0; y < height; y++) {
+		for (u32 x = 0; x < width; x++) {
+			u8* pixel = output + PICA::TextureDecoder::getSwizzledOffset(x, height - 1 - y, width, bytesPerPixel);
+			const u32 value = pixels[y * width + x];
+
+			// Same layout the software renderer uses: little endian depth, followed by the stencil for D24S8
+			if (buffer.format == DepthFmt::Depth16) {
+				const u32 depth = value >> 16;
+				pixel[0] = u8(depth);
+				pixel[1] = u8(depth >> 8);
+			} else {
+				const u32 depth = value >> 8;
+				pixel[0] = u8(depth);
+				pixel[1] = u8(depth >> 8);
+				pixel[2] = u8(depth >> 16);
+				if (hasStencil) {
+					pixel[3] = u8(value);
+				}
+			}
+		}
+	}
+
+	gpu.getMemory().invalidatePhysicalRange(buffer.location, size);
+	buffer.dirty = false;
+}
+
 void RendererGL::screenshot(const std::string& name) {
+	flushPendingDraws();
 	constexpr uint width = 400;
 	constexpr uint height = 2 * 240;
 
@@ -804,6 +1615,7 @@ void RendererGL::screenshot(const std::string& name) {
 }
 
 void RendererGL::deinitGraphicsContext() {
+	flushPendingDraws();
 	// Invalidate all surface caches since they'll no longer be valid
 	textureCache.reset();
 	depthBufferCache.reset();
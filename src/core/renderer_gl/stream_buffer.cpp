@@ -0,0 +1,136 @@
+#include "renderer_gl/stream_buffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void StreamBuffer::create(GLenum bufferTarget, u32 bufferSize) {
+	target = bufferTarget;
+	size = bufferSize;
+	regionSize = (size + regionCount - 1) / regionCount;
+	cursor = 0;
+	fenceStart = 0;
+	mapped = nullptr;
+	// Any fences we had belonged to the old context, if there was one
+	fences.fill(nullptr);
+
+	glGenBuffers(1, &handle);
+	glBindBuffer(target, handle);
+
+	if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) {
+		static constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(target, size, nullptr, flags);
+		mapped = static_cast<u8*>(glMapBufferRange(target, 0, size, flags));
+
+		if (mapped == nullptr) {
+			Helpers::warn("StreamBuffer: Failed to map buffer persistently, falling back to orphaning");
+			glDeleteBuffers(1, &handle);
+			glGenBuffers(1, &handle);
+			glBindBuffer(target, handle);
+		}
+	}
+
+	if (mapped == nullptr) {
+		glBufferData(target, size, nullptr, GL_STREAM_DRAW);
+	}
+}
+
+void StreamBuffer::free() {
+	for (auto& fence : fences) {
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	if (handle != 0) {
+		if (mapped != nullptr) {
+			glBindBuffer(target, handle);
+			glUnmapBuffer(target);
+			mapped = nullptr;
+		}
+
+		glDeleteBuffers(1, &handle);
+		handle = 0;
+	}
+}
+
+void StreamBuffer::fenceRegions(u32 start, u32 end) {
+	for (u32 region = start; region < end; region++) {
+		if (fences[region] != nullptr) {
+			glDeleteSync(fences[region]);
+		}
+
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+void StreamBuffer::waitRegions(u32 start, u32 end) {
+	for (u32 region = start; region < end; region++) {
+		GLsync& fence = fences[region];
+		if (fence == nullptr) {
+			continue;
+		}
+
+		GLenum result;
+		do {
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
+u32 StreamBuffer::allocate(u32 bytes, u32 alignment) {
+	// Empty allocations still take up a byte, which keeps the region math below simple
+	bytes = std::max(bytes, 1u);
+	if (bytes > size) [[unlikely]] {
+		Helpers::panic("StreamBuffer: Tried to allocate %u bytes from a %u byte buffer", bytes, size);
+	}
+
+	u32 offset = (cursor + alignment - 1) / alignment * alignment;
+
+	if (u64(offset) + bytes > size) {
+		// Wrap around. Everything from where we last placed fences to the end of the buffer is used by commands we've already submitted
+		if (mapped != nullptr) {
+			fenceRegions(fenceStart, regionCount);
+		} else {
+			// Without persistent mapping, give the driver a fresh buffer to write to instead of waiting for the GPU
+			glBufferData(target, size, nullptr, GL_STREAM_DRAW);
+		}
+
+		offset = 0;
+		fenceStart = 0;
+	}
+
+	if (mapped != nullptr) {
+		// Regions we moved past are done being written to, so fence them off. Then make sure the GPU is done with the regions we're about
+		// to overwrite, which were fenced off the last time we went through the buffer
+		const u32 startRegion = regionOf(offset);
+		fenceRegions(fenceStart, startRegion);
+		fenceStart = startRegion;
+
+		waitRegions(startRegion, regionOf(offset + bytes - 1) + 1);
+	}
+
+	cursor = offset + bytes;
+	return offset;
+}
+
+void StreamBuffer::write(u32 offset, const void* data, u32 bytes) {
+	if (mapped != nullptr) {
+		std::memcpy(mapped + offset, data, bytes);
+		return;
+	}
+
+	// We never reuse space without orphaning first, so there's nothing to synchronize with here
+	static constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+	void* pointer = glMapBufferRange(target, offset, bytes, flags);
+	if (pointer == nullptr) [[unlikely]] {
+		glBufferSubData(target, offset, bytes, data);
+		return;
+	}
+
+	std::memcpy(pointer, data, bytes);
+	glUnmapBuffer(target);
+}
@@ -0,0 +1,113 @@
+#include "renderer_gl/texture_decode_queue.hpp"
+
+#include "PICA/texture_decoder.hpp"
+
+TextureDecodeQueue::TextureDecodeQueue(u32 threadCount) {
+	workers.reserve(threadCount);
+	for (u32 i = 0; i < threadCount; i++) {
+		workers.emplace_back(&TextureDecodeQueue::workerLoop, this);
+	}
+}
+
+TextureDecodeQueue::~TextureDecodeQueue() {
+	{
+		std::unique_lock lock(mutex);
+		stopping = true;
+		queue.clear();
+	}
+
+	workAvailable.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+bool TextureDecodeQueue::claim(Job& job) {
+	auto expected = Job::State::Queued;
+	return job.state.compare_exchange_strong(expected, Job::State::Decoding, std::memory_order_acquire);
+}
+
+void TextureDecodeQueue::finish(Job& job) {
+	job.decoded.resize(usize(job.width) * job.height);
+	PICA::TextureDecoder::decodeTexture(job.format, job.width, job.height, job.source, job.decoded.data());
+
+	// We don't need the copy of the guest data anymore
+	job.source = std::vector<u8>();
+	job.state.store(Job::State::Done, std::memory_order_release);
+
+	// Take the lock so that a thread that just checked the job state can't miss the notification
+	std::unique_lock lock(mutex);
+	jobDone.notify_all();
+}
+
+void TextureDecodeQueue::workerLoop() {
+	while (true) {
+		JobPtr job;
+
+		{
+			std::unique_lock lock(mutex);
+			workAvailable.wait(lock, [&]() { return stopping || !queue.empty(); });
+
+			if (stopping) {
+				return;
+			}
+
+			job = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		// The job might have been taken over or cancelled by the renderer since it got queued up
+		if (claim(*job)) {
+			finish(*job);
+		}
+	}
+}
+
+TextureDecodeQueue::JobPtr TextureDecodeQueue::submit(PICA::TextureFmt format, u32 width, u32 height, u64 hash, std::span<const u8> data) {
+	auto job = std::make_shared<Job>();
+	job->format = format;
+	job->width = width;
+	job->height = height;
+	job->hash = hash;
+	job->source.assign(data.begin(), data.end());
+
+	// Without workers, the job just sits there until someone waits on it
+	if (!workers.empty()) {
+		{
+			std::unique_lock lock(mutex);
+			queue.push_back(job);
+		}
+
+		workAvailable.notify_one();
+	}
+
+	return job;
+}
+
+const std::vector<u32>& TextureDecodeQueue::wait(Job& job) {
+	if (claim(job)) {
+		finish(job);
+	} else if (job.state.load(std::memory_order_acquire) != Job::State::Done) {
+		std::unique_lock lock(mutex);
+		jobDone.wait(lock, [&]() { return job.state.load(std::memory_order_acquire) == Job::State::Done; });
+	}
+
+	return job.decoded;
+}
+
+void TextureDecodeQueue::cancel(Job& job) {
+	// If we manage to claim the job, no worker will touch it anymore. Otherwise it's already being decoded and will be done soon anyways
+	if (claim(job)) {
+		job.source = std::vector<u8>();
+		job.state.store(Job::State::Done, std::memory_order_release);
+	}
+}
+
+void TextureDecodeQueue::clear() {
+	std::unique_lock lock(mutex);
+	for (auto& job : queue) {
+		cancel(*job);
+	}
+
+	queue.clear();
+}
@@ -0,0 +1,779 @@
+#include "renderer_sw/fragment_pipeline.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "PICA/float_types.hpp"
+#include "PICA/texture_decoder.hpp"
+#include "colour.hpp"
+
+using namespace Helpers;
+using namespace SwRenderer;
+
+using vec3 = std::array<float, 3>;
+
+static RGBA unpackRGBA(u32 value) { return {u8(value), u8(value >> 8), u8(value >> 16), u8(value >> 24)}; }
+
+void FragmentState::loadRegisters(const u32* regs) {
+	using namespace PICA::InternalRegs;
+	this->regs = regs;
+
+	static constexpr std::array<u32, 6> ioBases = {
+		TexEnv0Source, TexEnv1Source, TexEnv2Source, TexEnv3Source, TexEnv4Source, TexEnv5Source,
+	};
+
+	for (int i = 0; i < 6; i++) {
+		const u32 ioBase = ioBases[i];
+		auto& stage = tevStages[i];
+
+		stage.source = regs[ioBase];
+		stage.operand = regs[ioBase + 1];
+		stage.combiner = regs[ioBase + 2];
+		stage.constColour = unpackRGBA(regs[ioBase + 3]);
+		stage.scale = regs[ioBase + 4];
+	}
+
+	tevBufferColour = unpackRGBA(regs[TexEnvBufferColor]);
+	tevUpdateBuffer = regs[TexEnvUpdateBuffer];
+	textureConfig = regs[TexUnitCfg];
+	lightingEnable = (regs[LightingEnable] & 1) != 0;
+
+	depthScale = Floats::f24::fromRaw(regs[DepthScale] & 0xffffff).toFloat32();
+	depthOffset = Floats::f24::fromRaw(regs[DepthOffset] & 0xffffff).toFloat32();
+	depthmapEnable = (regs[DepthmapEnable] & 1) != 0;
+
+	const u32 alphaControl = regs[AlphaTestConfig];
+	alphaTestEnable = (alphaControl & 1) != 0;
+	alphaTestFunc = getBits<4, 3>(alphaControl);
+	alphaTestReference = u8(getBits<8, 8>(alphaControl));
+
+	const bool depthStencilWrite = regs[DepthBufferWrite] != 0;
+	const u32 stencilConfig = regs[StencilTest];
+	stencilEnable = (stencilConfig & 1) != 0;
+	stencilFunc = getBits<4, 3>(stencilConfig);
+	stencilWriteMask = depthStencilWrite ? u8(getBits<8, 8>(stencilConfig)) : 0;
+	stencilReference = u8(getBits<16, 8>(stencilConfig));
+	stencilInputMask = u8(getBits<24, 8>(stencilConfig));
+
+	const u32 stencilOpConfig = regs[StencilOp];
+	stencilFailOp = getBits<0, 3>(stencilOpConfig);
+	depthFailOp = getBits<4, 3>(stencilOpConfig);
+	stencilPassOp = getBits<8, 3>(stencilOpConfig);
+
+	const u32 depthControl = regs[DepthAndColorMask];
+	depthTestEnable = (depthControl & 1) != 0;
+	depthFunc = getBits<4, 3>(depthControl);
+	colourWriteMask = getBits<8, 4>(depthControl);
+	depthWriteEnable = getBit<12>(depthControl) && depthStencilWrite;
+
+	blendEnable = (regs[ColourOperation] & (1 << 8)) != 0;
+	const u32 blendControl = regs[BlendFunc];
+	rgbEquation = blendControl & 0x7;
+	alphaEquation = getBits<8, 3>(blendControl);
+	rgbSourceFunc = getBits<16, 4>(blendControl);
+	rgbDestFunc = getBits<20, 4>(blendControl);
+	alphaSourceFunc = getBits<24, 4>(blendControl);
+	alphaDestFunc = getBits<28, 4>(blendControl);
+	blendColour = unpackRGBA(regs[BlendColour]);
+	logicOp = getBits<0, 4>(regs[LogicOp]);
+
+	runTev = interpretTev;
+	runBlend = interpretBlend;
+}
+
+// Returns the texel coordinate to use for the given wrapping mode, or -1 if we should read the border colour
+// The wrapping mode field is 3 bits, the bottom 4 undocumented wrapping modes are taken from Citra like in the GL renderer
+static s32 wrapCoordinate(s32 coord, s32 size, u32 mode) {
+	switch (mode) {
+		case 1:
+		case 5:  // Clamp to border
+			return (coord < 0 || coord >= size) ? -1 : coord;
+
+		case 2:
+		case 6:
+		case 7: {  // Repeat
+			const s32 wrapped = coord % size;
+			return wrapped < 0 ? wrapped + size : wrapped;
+		}
+
+		case 3: {  // Mirrored repeat
+			const s32 period = size * 2;
+			s32 wrapped = coord % period;
+			if (wrapped < 0) wrapped += period;
+
+			return wrapped < size ? wrapped : period - 1 - wrapped;
+		}
+
+		default: return std::clamp(coord, 0, size - 1);  // Clamp to edge
+	}
+}
+
+RGBA TextureUnit::fetch(s32 x, s32 y) const {
+	x = wrapCoordinate(x, s32(width), wrapS);
+	y = wrapCoordinate(y, s32(height), wrapT);
+
+	if (x < 0 || y < 0) {
+		return borderColour;
+	}
+
+	// PICA texture coordinates have t = 0 at the bottom of the texture, while our decoded texels start from the top row
+	return unpackRGBA(texels[(height - 1 - u32(y)) * width + u32(x)]);
+}
+
+RGBA TextureUnit::sample(float s, float t) const {
+	if (texels == nullptr) {
+		return {0, 0, 0, 0};
+	}
+
+	// Keep the coordinates in a range where converting them to integers can't overflow
+	if (std::isnan(s) || std::isnan(t)) {
+		s = t = 0.f;
+	}
+	const float x = std::clamp(s, -1024.f, 1024.f) * float(width);
+	const float y = std::clamp(t, -1024.f, 1024.f) * float(height);
+
+	if (!linearFilter) {
+		return fetch(s32(std::floor(x)), s32(std::floor(y)));
+	}
+
+	// Bilinear filtering with 8 bits of sub-texel precision
+	const float sampleX = x - 0.5f;
+	const float sampleY = y - 0.5f;
+	const float floorX = std::floor(sampleX);
+	const float floorY = std::floor(sampleY);
+	const s32 x0 = s32(floorX);
+	const s32 y0 = s32(floorY);
+	const u32 weightX = u32((sampleX - floorX) * 256.f);
+	const u32 weightY = u32((sampleY - floorY) * 256.f);
+
+	const RGBA t00 = fetch(x0, y0);
+	const RGBA t10 = fetch(x0 + 1, y0);
+	const RGBA t01 = fetch(x0, y0 + 1);
+	const RGBA t11 = fetch(x0 + 1, y0 + 1);
+
+	RGBA result;
+	for (int i = 0; i < 4; i++) {
+		const u32 row0 = t00[i] * (256 - weightX) + t10[i] * weightX;
+		const u32 row1 = t01[i] * (256 - weightX) + t11[i] * weightX;
+		result[i] = u8((row0 * (256 - weightY) + row1 * weightY + (1 << 15)) >> 16);
+	}
+
+	return result;
+}
+
+static float dot(const vec3& a, const vec3& b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+static vec3 add(const vec3& a, const vec3& b) { return {a[0] + b[0], a[1] + b[1], a[2] + b[2]}; }
+
+static vec3 normalize(const vec3& v) {
+	const float length = std::sqrt(dot(v, v));
+	if (length == 0.f) {
+		return v;
+	}
+
+	return {v[0] / length, v[1] / length, v[2] / length};
+}
+
+static vec3 regToColor(u32 reg) {
+	// Normalization scale to convert from [0...255] to [0.0...1.0]
+	constexpr float scale = 1.f / 255.f;
+	return {scale * float(getBits<20, 8>(reg)), scale * float(getBits<10, 8>(reg)), scale * float(getBits<0, 8>(reg))};
+}
+
+// Convert an arbitrary-width floating point literal to an f32
+static float decodeFP(u32 hex, u32 E, u32 M) {
+	const u32 width = M + E + 1;
+	const u32 bias = 128 - (1 << (E - 1));
+	u32 exponent = (hex >> M) & ((1 << E) - 1);
+	const u32 mantissa = hex & ((1 << M) - 1);
+	const u32 sign = (hex >> (E + M)) << 31;
+
+	if ((hex & ((1 << (width - 1)) - 1)) != 0) {
+		if (exponent == (1u << E) - 1) {
+			exponent = 255;
+		} else {
+			exponent += bias;
+		}
+
+		hex = sign | (mantissa << (23 - M)) | (exponent << 23);
+	} else {
+		hex = sign;
+	}
+
+	return std::bit_cast<float>(hex);
+}
+
+namespace LightingLUTs {
+	enum : u32 { D0 = 0, D1 = 1, SP = 2, FR = 3, RB = 4, RG = 5, RR = 6 };
+}
+
+// Sample a lighting LUT with linear filtering, the same way the GL renderer samples its LUT texture
+static float lutLookup(const u32* lightingLUT, u32 lut, u32 light, float value) {
+	static constexpr std::array<u32, 7> lutIDs = {
+		PICA::Lights::LUT_D0, PICA::Lights::LUT_D1, PICA::Lights::LUT_SP0, PICA::Lights::LUT_FR,
+		PICA::Lights::LUT_RB, PICA::Lights::LUT_RG, PICA::Lights::LUT_RR,
+	};
+
+	const u32 lutID = lut == LightingLUTs::SP ? PICA::Lights::LUT_SP0 + light : lutIDs[lut];
+	const float position = std::isnan(value) ? 0.f : std::clamp(value * 256.f - 0.5f, 0.f, 255.f);
+	const u32 index = u32(position);
+	const u32 nextIndex = std::min<u32>(index + 1, 255);
+
+	const float entry = float(lightingLUT[lutID * 256 + index] & 0xfff) / 4095.f;
+	const float nextEntry = float(lightingLUT[lutID * 256 + nextIndex] & 0xfff) / 4095.f;
+	return entry + (nextEntry - entry) * (position - float(index));
+}
+
+// Port of calcLighting from the GL renderer's fragment shader
+static void calcLighting(const FragmentState& state, const AttributeArray& attributes, RGBA& primaryOut, RGBA& secondaryOut) {
+	using namespace PICA::InternalRegs;
+	const u32* regs = state.regs;
+
+	const vec3 normal = normalize({attributes[Attributes::Normal], attributes[Attributes::Normal + 1], attributes[Attributes::Normal + 2]});
+	const vec3 viewAttribute = {attributes[Attributes::View], attributes[Attributes::View + 1], attributes[Attributes::View + 2]};
+	const vec3 view = normalize(viewAttribute);
+
+	const u32 numLights = (regs[LightingNumLights] & 0x7) + 1;
+	const u32 lightPermutation = regs[LightingLightPermutation];
+	const u32 lutInputAbs = regs[LightingLUTInputAbs];
+	const u32 lutInputSelect = regs[LightingLUTInputSelect];
+	const u32 lutInputScale = regs[LightingLUTInputScale];
+	const u32 config0 = regs[LightingConfig0];
+	const u32 config1 = regs[LightingConfig1];
+
+	vec3 primary = regToColor(regs[LightingAmbient]);
+	vec3 secondary = {0.f, 0.f, 0.f};
+	std::array<float, 7> d = {};
+
+	for (u32 i = 0; i < numLights; i++) {
+		const u32 lightID = (lightPermutation >> (i * 3)) & 7;
+		const u32* lightRegs = &regs[Light0Specular0 + 0x10 * lightID];
+		const u32 lightConfig = lightRegs[9];
+
+		const vec3 lightVector = normalize({
+			decodeFP(getBits<0, 16>(lightRegs[4]), 5, 10),
+			decodeFP(getBits<16, 16>(lightRegs[4]), 5, 10),
+			decodeFP(getBits<0, 16>(lightRegs[5]), 5, 10),
+		});
+
+		vec3 halfVector;
+		if ((lightConfig & 1) == 0) {  // Positional light
+			halfVector = normalize(add(normalize(add(lightVector, viewAttribute)), view));
+		} else {  // Directional light
+			halfVector = normalize(add(lightVector, view));
+		}
+
+		for (u32 c = 0; c < 7; c++) {
+			if (((config1 >> (16 + c)) & 1) != 0) {
+				d[c] = 1.f;
+				continue;
+			}
+
+			const u32 scaleID = (lutInputScale >> (c * 4)) & 7;
+			float scale = float(1u << scaleID);
+			if (scaleID >= 6) scale /= 256.f;
+
+			float input;
+			switch ((lutInputSelect >> (c * 4)) & 7) {
+				case 0: input = dot(normal, halfVector); break;
+				case 1: input = dot(view, halfVector); break;
+				case 2: input = dot(normal, view); break;
+				case 3: input = dot(lightVector, normal); break;
+				case 4: {
+					const vec3 spotlightVector = normalize({
+						decodeFP(getBits<0, 16>(lightRegs[6]), 1, 11),
+						decodeFP(getBits<16, 16>(lightRegs[6]), 1, 11),
+						decodeFP(getBits<0, 16>(lightRegs[7]), 1, 11),
+					});
+					input = -dot(lightVector, spotlightVector);  // -L dot P (aka Spotlight aka SP)
+					break;
+				}
+				default: input = 1.f; break;  // TODO: cos phi (aka CP)
+			}
+
+			d[c] = lutLookup(state.lightingLUT, c, lightID, input * 0.5f + 0.5f) * scale;
+			if (((lutInputAbs >> (2 * c)) & 1) != 0) d[c] = std::abs(d[c]);
+		}
+
+		using namespace LightingLUTs;
+		switch (getBits<4, 4>(lightConfig)) {
+			case 0:
+				d[D1] = 0.f;
+				d[FR] = 0.f;
+				d[RG] = d[RB] = d[RR];
+				break;
+			case 1:
+				d[D0] = 0.f;
+				d[D1] = 0.f;
+				d[RG] = d[RB] = d[RR];
+				break;
+			case 2:
+				d[FR] = 0.f;
+				d[SP] = 0.f;
+				d[RG] = d[RB] = d[RR];
+				break;
+			case 3:
+				d[SP] = 0.f;
+				d[RG] = d[RB] = d[RR] = 1.f;
+				break;
+			case 4: d[FR] = 0.f; break;
+			case 5: d[D1] = 0.f; break;
+			case 6: d[RG] = d[RB] = d[RR]; break;
+			default: break;
+		}
+
+		float NdotL = dot(normal, lightVector);
+		// Two sided diffuse
+		NdotL = getBit<1>(lightConfig) ? std::abs(NdotL) : std::max(0.f, NdotL);
+
+		const float lightFactor = d[SP];
+		const vec3 ambient = regToColor(lightRegs[3]);
+		const vec3 diffuse = regToColor(lightRegs[2]);
+		const vec3 specular0 = regToColor(lightRegs[0]);
+		const vec3 specular1 = regToColor(lightRegs[1]);
+		const vec3 reflection = {d[RR], d[RG], d[RB]};
+
+		for (int j = 0; j < 3; j++) {
+			primary[j] += lightFactor * (ambient[j] + diffuse[j] * NdotL);
+			secondary[j] += lightFactor * (specular0[j] * d[D0] + specular1[j] * d[D1] * reflection[j]);
+		}
+	}
+
+	auto toU8 = [](float value) { return u8(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f); };
+	primaryOut = {toU8(primary[0]), toU8(primary[1]), toU8(primary[2]), 255};
+	secondaryOut = {toU8(secondary[0]), toU8(secondary[1]), toU8(secondary[2]), 255};
+
+	// Fresnel outputs replace the alpha of the primary/secondary colour
+	if (getBit<2>(config0)) primaryOut[3] = toU8(d[LightingLUTs::FR]);
+	if (getBit<3>(config0)) secondaryOut[3] = toU8(d[LightingLUTs::FR]);
+}
+
+// OpenGL ES 1.1 reference pages for TEVs (this is what the PICA200 implements):
+// https://registry.khronos.org/OpenGL-Refpages/es1.1/xhtml/glTexEnv.xml
+static RGBA getTevOperands(const FragmentState::TevStage& stage, u32 index, const std::array<RGBA, 16>& sources) {
+	const RGBA& colourSource = sources[(stage.source >> (index * 4)) & 15];
+	const RGBA& alphaSource = sources[(stage.source >> (index * 4 + 16)) & 15];
+	const u32 colourOperand = (stage.operand >> (index * 4)) & 15;
+	const u32 alphaOperand = (stage.operand >> (12 + index * 4)) & 7;
+
+	// TODO: figure out what the undocumented values do
+	RGBA result = {0, 0, 0, 0};
+	auto setColour = [&](u8 r, u8 g, u8 b) { result[0] = r, result[1] = g, result[2] = b; };
+	auto setAll = [&](u8 value) { setColour(value, value, value); };
+
+	switch (colourOperand) {
+		case 0: setColour(colourSource[0], colourSource[1], colourSource[2]); break;                      // Source color
+		case 1: setColour(255 - colourSource[0], 255 - colourSource[1], 255 - colourSource[2]); break;  // One minus source color
+		case 2: setAll(colourSource[3]); break;                                                          // Source alpha
+		case 3: setAll(255 - colourSource[3]); break;                                                    // One minus source alpha
+		case 4: setAll(colourSource[0]); break;                                                          // Source red
+		case 5: setAll(255 - colourSource[0]); break;                                                    // One minus source red
+		case 8: setAll(colourSource[1]); break;                                                          // Source green
+		case 9: setAll(255 - colourSource[1]); break;                                                    // One minus source green
+		case 12: setAll(colourSource[2]); break;                                                         // Source blue
+		case 13: setAll(255 - colourSource[2]); break;                                                   // One minus source blue
+		default: break;
+	}
+
+	switch (alphaOperand) {
+		case 0: result[3] = alphaSource[3]; break;        // Source alpha
+		case 1: result[3] = 255 - alphaSource[3]; break;  // One minus source alpha
+		case 2: result[3] = alphaSource[0]; break;        // Source red
+		case 3: result[3] = 255 - alphaSource[0]; break;  // One minus source red
+		case 4: result[3] = alphaSource[1]; break;        // Source green
+		case 5: result[3] = 255 - alphaSource[1]; break;  // One minus source green
+		case 6: result[3] = alphaSource[2]; break;        // Source blue
+		case 7: result[3] = 255 - alphaSource[2]; break;  // One minus source blue
+	}
+
+	return result;
+}
+
+static u32 combine(u32 mode, u32 s0, u32 s1, u32 s2) {
+	switch (mode) {
+		case 0: return s0;                                                 // Replace
+		case 1: return s0 * s1 / 255;                                      // Modulate
+		case 2: return std::min<u32>(255, s0 + s1);                        // Add
+		case 3: return u32(std::clamp(s32(s0 + s1) - 128, 0, 255));        // Add signed
+		case 4: return (s0 * s2 + s1 * (255 - s2)) / 255;                  // Interpolate
+		case 5: return s0 > s1 ? s0 - s1 : 0;                              // Subtract
+		case 8: return std::min<u32>(255, s0 * s1 / 255 + s2);             // Multiply then add
+		case 9: return std::min<u32>(255, (s0 + s1) * s2 / 255);           // Add then multiply
+		default: return 255;                                               // TODO: figure out what the undocumented values do
+	}
+}
+
+static RGBA calculateCombiner(const FragmentState::TevStage& stage, const std::array<RGBA, 16>& sources) {
+	const RGBA source0 = getTevOperands(stage, 0, sources);
+	const RGBA source1 = getTevOperands(stage, 1, sources);
+	const RGBA source2 = getTevOperands(stage, 2, sources);
+
+	const u32 colourCombine = stage.combiner & 15;
+	const u32 alphaCombine = (stage.combiner >> 16) & 15;
+	std::array<u32, 4> result;
+
+	if (colourCombine == 6 || colourCombine == 7) {  // Dot3 RGB and Dot3 RGBA
+		s32 dot = 0;
+		for (int i = 0; i < 3; i++) {
+			dot += (s32(source0[i]) - 128) * (s32(source1[i]) - 128);
+		}
+
+		const u32 value = u32(std::clamp(dot * 4 / 255, 0, 255));
+		result = {value, value, value, value};
+	} else {
+		for (int i = 0; i < 3; i++) {
+			result[i] = combine(colourCombine, source0[i], source1[i], source2[i]);
+		}
+	}
+
+	// The color combiner also writes the alpha channel in the "Dot3 RGBA" mode
+	if (colourCombine != 7) {
+		result[3] = combine(alphaCombine, source0[3], source1[3], source2[3]);
+	}
+
+	const u32 colourScale = stage.scale & 3;
+	const u32 alphaScale = (stage.scale >> 16) & 3;
+
+	return {
+		u8(std::min<u32>(255, result[0] << colourScale)),
+		u8(std::min<u32>(255, result[1] << colourScale)),
+		u8(std::min<u32>(255, result[2] << colourScale)),
+		u8(std::min<u32>(255, result[3] << alphaScale)),
+	};
+}
+
+// Compare functions shared by the alpha, stencil and depth tests
+template <typename T>
+static bool compare(u32 func, T a, T b) {
+	switch (func) {
+		case 0: return false;    // Never
+		case 1: return true;     // Always
+		case 2: return a == b;   // Equal
+		case 3: return a != b;   // Not equal
+		case 4: return a < b;    // Less
+		case 5: return a <= b;   // Less or equal
+		case 6: return a > b;    // Greater
+		default: return a >= b;  // Greater or equal
+	}
+}
+
+static u8 applyStencilOp(u32 op, u8 value, u8 reference) {
+	switch (op) {
+		case 0: return value;                                     // Keep
+		case 1: return 0;                                         // Zero
+		case 2: return reference;                                 // Replace
+		case 3: return value == 0xff ? value : value + 1;         // Increment and saturate
+		case 4: return value == 0 ? value : value - 1;            // Decrement and saturate
+		case 5: return ~value;                                    // Invert
+		case 6: return value + 1;                                 // Increment and wrap
+		default: return value - 1;                                // Decrement and wrap
+	}
+}
+
+// Map of PICA blending funcs to the factor they produce for the given channel. Func = 15 is undocumented and stubbed to GL_ONE, like in the
+// GL renderer
+static u32 getBlendFactor(u32 func, u32 channel, const RGBA& source, const RGBA& dest, const RGBA& constant) {
+	switch (func) {
+		case 0: return 0;
+		case 1: return 255;
+		case 2: return source[channel];
+		case 3: return 255 - source[channel];
+		case 4: return dest[channel];
+		case 5: return 255 - dest[channel];
+		case 6: return source[3];
+		case 7: return 255 - source[3];
+		case 8: return dest[3];
+		case 9: return 255 - dest[3];
+		case 10: return constant[channel];
+		case 11: return 255 - constant[channel];
+		case 12: return constant[3];
+		case 13: return 255 - constant[3];
+		case 14: return channel == 3 ? 255 : std::min<u32>(source[3], 255 - dest[3]);  // Source alpha saturate
+		default: return 255;
+	}
+}
+
+// The unused blending equations are equivalent to equation 0 (add)
+static u8 blendChannel(u32 equation, u32 source, u32 sourceFactor, u32 dest, u32 destFactor) {
+	const s32 weightedSource = s32(source * sourceFactor);
+	const s32 weightedDest = s32(dest * destFactor);
+	s32 result;
+
+	switch (equation) {
+		case 1: result = weightedSource - weightedDest; break;  // Subtract
+		case 2: result = weightedDest - weightedSource; break;  // Reverse subtract
+		case 3: return u8(std::min(source, dest));              // Min
+		case 4: return u8(std::max(source, dest));              // Max
+		default: result = weightedSource + weightedDest; break;  // Add
+	}
+
+	return u8(std::clamp((result + 127) / 255, 0, 255));
+}
+
+static u8 applyLogicOp(u32 op, u8 s, u8 d) {
+	switch (op) {
+		case 0: return 0;            // Clear
+		case 1: return s & d;        // And
+		case 2: return s & ~d;       // And reverse
+		case 3: return s;            // Copy
+		case 4: return 0xff;         // Set
+		case 5: return ~s;           // Copy inverted
+		case 6: return d;            // No-op
+		case 7: return ~d;           // Invert
+		case 8: return ~(s & d);     // Nand
+		case 9: return s | d;        // Or
+		case 10: return ~(s | d);    // Nor
+		case 11: return s ^ d;       // Xor
+		case 12: return ~(s ^ d);    // Equivalent
+		case 13: return ~s & d;      // And inverted
+		case 14: return s | ~d;      // Or reverse
+		default: return ~s | d;      // Or inverted
+	}
+}
+
+u32 SwRenderer::getTiledPixelOffset(u32 x, u32 y, u32 width) {
+	// Framebuffers are tiled in 8x8 tiles with Morton order inside each tile, same as textures
+	return PICA::TextureDecoder::mortonInterleave(x, y) + (x & ~7) * 8 + (y & ~7) * width;
+}
+
+RGBA SwRenderer::decodeColour(PICA::ColorFmt format, const u8* pixel) {
+	switch (format) {
+		case PICA::ColorFmt::RGBA8: return {pixel[3], pixel[2], pixel[1], pixel[0]};
+		case PICA::ColorFmt::RGB8: return {pixel[2], pixel[1], pixel[0], 255};
+
+		case PICA::ColorFmt::RGBA5551: {
+			const u16 value = u16(pixel[0]) | (u16(pixel[1]) << 8);
+			return {
+				Colour::convert5To8Bit(getBits<11, 5, u8>(value)), Colour::convert5To8Bit(getBits<6, 5, u8>(value)),
+				Colour::convert5To8Bit(getBits<1, 5, u8>(value)), u8(getBit<0>(value) ? 255 : 0),
+			};
+		}
+
+		case PICA::ColorFmt::RGB565: {
+			const u16 value = u16(pixel[0]) | (u16(pixel[1]) << 8);
+			return {
+				Colour::convert5To8Bit(getBits<11, 5, u8>(value)), Colour::convert6To8Bit(getBits<5, 6, u8>(value)),
+				Colour::convert5To8Bit(getBits<0, 5, u8>(value)), 255,
+			};
+		}
+
+		case PICA::ColorFmt::RGBA4: {
+			const u16 value = u16(pixel[0]) | (u16(pixel[1]) << 8);
+			return {
+				Colour::convert4To8Bit(getBits<12, 4, u8>(value)), Colour::convert4To8Bit(getBits<8, 4, u8>(value)),
+				Colour::convert4To8Bit(getBits<4, 4, u8>(value)), Colour::convert4To8Bit(getBits<0, 4, u8>(value)),
+			};
+		}
+
+		default: return {0, 0, 0, 0};
+	}
+}
+
+void SwRenderer::encodeColour(PICA::ColorFmt format, u8* pixel, const RGBA& colour) {
+	const u32 r = colour[0], g = colour[1], b = colour[2], a = colour[3];
+	u16 value;
+
+	switch (format) {
+		case PICA::ColorFmt::RGBA8:
+			pixel[0] = u8(a);
+			pixel[1] = u8(b);
+			pixel[2] = u8(g);
+			pixel[3] = u8(r);
+			return;
+
+		case PICA::ColorFmt::RGB8:
+			pixel[0] = u8(b);
+			pixel[1] = u8(g);
+			pixel[2] = u8(r);
+			return;
+
+		case PICA::ColorFmt::RGBA5551: value = u16(((r >> 3) << 11) | ((g >> 3) << 6) | ((b >> 3) << 1) | (a >> 7)); break;
+		case PICA::ColorFmt::RGB565: value = u16(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3)); break;
+		case PICA::ColorFmt::RGBA4: value = u16(((r >> 4) << 12) | ((g >> 4) << 8) | ((b >> 4) << 4) | (a >> 4)); break;
+		default: return;
+	}
+
+	pixel[0] = u8(value);
+	pixel[1] = u8(value >> 8);
+}
+
+void SwRenderer::getFragmentSources(const FragmentState& state, const AttributeArray& attributes, FragmentSources& sources) {
+	// TODO: what do invalid sources and disabled textures read as? For now they read as 0
+	sources = {};
+
+	for (int i = 0; i < 4; i++) {
+		sources[0][i] = u8(std::clamp(attributes[Attributes::Colour + i], 0.f, 1.f) * 255.f + 0.5f);  // Primary/vertex colour
+	}
+
+	if (state.lightingEnable) {
+		calcLighting(state, attributes, sources[1], sources[2]);
+	} else {
+		sources[1] = sources[2] = {255, 255, 255, 255};
+	}
+
+	if (state.textureConfig & 1) {
+		sources[3] = state.textures[0].sample(attributes[Attributes::TexCoord0], attributes[Attributes::TexCoord0 + 1]);
+	}
+
+	if (state.textureConfig & 2) {
+		sources[4] = state.textures[1].sample(attributes[Attributes::TexCoord1], attributes[Attributes::TexCoord1 + 1]);
+	}
+
+	if (state.textureConfig & 4) {
+		const u32 coords = (state.textureConfig & (1 << 13)) ? Attributes::TexCoord1 : Attributes::TexCoord2;
+		sources[5] = state.textures[2].sample(attributes[coords], attributes[coords + 1]);
+	}
+}
+
+void SwRenderer::interpretTev(const FragmentState* state, FragmentBatch* batch, u32 count) {
+	for (u32 fragment = 0; fragment < count; fragment++) {
+		std::array<RGBA, 16> sources = {};
+		std::copy(batch->sources[fragment].begin(), batch->sources[fragment].end(), sources.begin());
+
+		// The "previous buffer" source lags one stage behind the buffer updates, same as the GL fragment shader
+		RGBA nextPreviousBuffer = state->tevBufferColour;
+		sources[15] = sources[0];  // Previous combiner
+
+		for (int i = 0; i < 6; i++) {
+			const auto& stage = state->tevStages[i];
+			sources[14] = stage.constColour;  // Constant colour
+			sources[15] = calculateCombiner(stage, sources);
+			sources[13] = nextPreviousBuffer;
+
+			if (i < 4) {
+				if (state->tevUpdateBuffer & (0x100 << i)) {
+					nextPreviousBuffer[0] = sources[15][0];
+					nextPreviousBuffer[1] = sources[15][1];
+					nextPreviousBuffer[2] = sources[15][2];
+				}
+
+				if (state->tevUpdateBuffer & (0x1000 << i)) {
+					nextPreviousBuffer[3] = sources[15][3];
+				}
+			}
+		}
+
+		const RGBA& colour = sources[15];
+		batch->colours[fragment] = colour;
+		batch->alive[fragment] = !state->alphaTestEnable || compare<u8>(state->alphaTestFunc, colour[3], state->alphaTestReference);
+	}
+}
+
+void SwRenderer::interpretBlend(const FragmentState* state, FragmentBatch* batch, u32 count) {
+	for (u32 fragment = 0; fragment < count; fragment++) {
+		const RGBA& colour = batch->colours[fragment];
+		const RGBA& dest = batch->dest[fragment];
+		RGBA output;
+
+		if (state->blendEnable) {
+			for (u32 i = 0; i < 4; i++) {
+				const bool isAlpha = i == 3;
+				const u32 equation = isAlpha ? state->alphaEquation : state->rgbEquation;
+				const u32 sourceFactor = getBlendFactor(isAlpha ? state->alphaSourceFunc : state->rgbSourceFunc, i, colour, dest, state->blendColour);
+				const u32 destFactor = getBlendFactor(isAlpha ? state->alphaDestFunc : state->rgbDestFunc, i, colour, dest, state->blendColour);
+
+				output[i] = blendChannel(equation, colour[i], sourceFactor, dest[i], destFactor);
+			}
+		} else {
+			for (u32 i = 0; i < 4; i++) {
+				output[i] = applyLogicOp(state->logicOp, colour[i], dest[i]);
+			}
+		}
+
+		for (u32 i = 0; i < 4; i++) {
+			if ((state->colourWriteMask & (1 << i)) == 0) {
+				output[i] = dest[i];
+			}
+		}
+
+		batch->colours[fragment] = output;
+	}
+}
+
+// Returns whether the fragment passes the stencil and depth tests, and updates the depth/stencil buffer
+static bool depthStencilTest(const FragmentState& state, u8* depthPixel, float depth) {
+	const bool hasStencil = state.depthFormat == PICA::DepthFmt::Depth24Stencil8;
+	const bool stencilEnable = hasStencil && state.stencilEnable;
+
+	u32 storedDepth;
+	u32 depthValue;
+	if (state.depthFormat == PICA::DepthFmt::Depth16) {
+		storedDepth = u32(depthPixel[0]) | (u32(depthPixel[1]) << 8);
+		depthValue = u32(depth * 65535.f);
+	} else {
+		storedDepth = u32(depthPixel[0]) | (u32(depthPixel[1]) << 8) | (u32(depthPixel[2]) << 16);
+		depthValue = u32(depth * 16777215.f);
+	}
+
+	auto updateStencil = [&](u32 op) {
+		const u8 stencil = depthPixel[3];
+		const u8 newStencil = applyStencilOp(op, stencil, state.stencilReference);
+		depthPixel[3] = (stencil & ~state.stencilWriteMask) | (newStencil & state.stencilWriteMask);
+	};
+
+	if (stencilEnable) {
+		const u8 reference = state.stencilReference & state.stencilInputMask;
+		const u8 stencil = depthPixel[3] & state.stencilInputMask;
+
+		if (!compare<u8>(state.stencilFunc, reference, stencil)) {
+			updateStencil(state.stencilFailOp);
+			return false;
+		}
+	}
+
+	if (state.depthTestEnable && !compare<u32>(state.depthFunc, depthValue, storedDepth)) {
+		if (stencilEnable) updateStencil(state.depthFailOp);
+		return false;
+	}
+
+	if (stencilEnable) updateStencil(state.stencilPassOp);
+
+	if (state.depthWriteEnable) {
+		depthPixel[0] = u8(depthValue);
+		depthPixel[1] = u8(depthValue >> 8);
+		if (state.depthFormat != PICA::DepthFmt::Depth16) {
+			depthPixel[2] = u8(depthValue >> 16);
+		}
+	}
+
+	return true;
+}
+
+void SwRenderer::processFragments(const FragmentState& state, FragmentBatch& batch, u32 y, u32 count) {
+	state.runTev(&state, &batch, count);
+
+	// The framebuffer is laid out from bottom to top in memory
+	const u32 memoryY = state.height - 1 - y;
+	const usize colourSize = PICA::sizePerPixel(state.colourFormat);
+	const usize depthSize = PICA::sizePerPixel(state.depthFormat);
+	const bool writeColour = state.colourWriteMask != 0;
+
+	for (u32 i = 0; i < count; i++) {
+		if (!batch.alive[i]) {
+			continue;
+		}
+
+		const u32 pixelOffset = getTiledPixelOffset(batch.x[i], memoryY, state.width);
+		if (state.depthBuffer != nullptr && !depthStencilTest(state, state.depthBuffer + pixelOffset * depthSize, batch.depth[i])) {
+			batch.alive[i] = 0;
+			continue;
+		}
+
+		if (writeColour) {
+			batch.dest[i] = decodeColour(state.colourFormat, state.colourBuffer + pixelOffset * colourSize);
+		}
+	}
+
+	if (!writeColour) {
+		return;
+	}
+
+	state.runBlend(&state, &batch, count);
+
+	for (u32 i = 0; i < count; i++) {
+		if (batch.alive[i]) {
+			const u32 pixelOffset = getTiledPixelOffset(batch.x[i], memoryY, state.width);
+			encodeColour(state.colourFormat, state.colourBuffer + pixelOffset * colourSize, batch.colours[i]);
+		}
+	}
+}
@@ -0,0 +1,79 @@
+#include "renderer_sw/fragment_rec.hpp"
+
+#include <array>
+
+#include "PICA/pica_hash.hpp"
+
+#ifdef PANDA3DS_X64_HOST
+#include "renderer_sw/fragment_rec_emitter_x64.hpp"
+#elif defined(PANDA3DS_ARM64_HOST)
+#include "renderer_sw/fragment_rec_emitter_arm64.hpp"
+#endif
+
+u64 FragmentJIT::getHash(const SwRenderer::FragmentState& state) {
+	// Serialize the relevant fields one by one so that struct padding and runtime-read values don't end up in the hash
+	std::array<u32, 6 * 4 + 12> data;
+	usize i = 0;
+
+	for (const auto& stage : state.tevStages) {
+		data[i++] = stage.source;
+		data[i++] = stage.operand;
+		data[i++] = stage.combiner;
+		data[i++] = stage.scale;
+	}
+
+	data[i++] = state.tevUpdateBuffer;
+	data[i++] = state.alphaTestEnable ? 1 : 0;
+	data[i++] = state.alphaTestFunc;
+	data[i++] = state.blendEnable ? 1 : 0;
+	data[i++] = state.rgbEquation;
+	data[i++] = state.alphaEquation;
+	data[i++] = state.rgbSourceFunc;
+	data[i++] = state.rgbDestFunc;
+	data[i++] = state.alphaSourceFunc;
+	data[i++] = state.alphaDestFunc;
+	data[i++] = state.logicOp;
+	data[i++] = state.colourWriteMask;
+
+	return PICAHash::computeHash(reinterpret_cast<const char*>(data.data()), sizeof(data));
+}
+
+#ifdef PANDA3DS_FRAGMENT_JIT_SUPPORTED
+FragmentJIT::FragmentJIT() = default;
+FragmentJIT::~FragmentJIT() = default;
+
+void FragmentJIT::reset() {
+	cache.clear();
+	activePipeline = nullptr;
+	activeHash = 0;
+}
+
+bool FragmentJIT::prepare(SwRenderer::FragmentState& state) {
+	if (!FragmentEmitter::isSupported()) {
+		return false;
+	}
+
+	const u64 hash = getHash(state);
+	// Consecutive draws very often share the same pipeline configuration
+	if (activePipeline == nullptr || hash != activeHash) {
+		auto it = cache.find(hash);
+
+		if (it == cache.end()) {
+			if (cache.size() >= maxCacheSize) {
+				cache.clear();
+			}
+
+			auto emitter = std::make_unique<FragmentEmitter>();
+			emitter->compile(state);
+			it = cache.emplace(hash, std::move(emitter)).first;
+		}
+
+		activePipeline = it->second.get();
+		activeHash = hash;
+	}
+
+	state.runTev = activePipeline->getTevCallback();
+	state.runBlend = activePipeline->getBlendCallback();
+	return true;
+}
+#endif  // PANDA3DS_FRAGMENT_JIT_SUPPORTED
@@ -0,0 +1,595 @@
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_ARM64_HOST)
+#include "renderer_sw/fragment_rec_emitter_arm64.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+using namespace oaknut;
+using namespace oaknut::util;
+using namespace SwRenderer;
+
+// Register allocation. Both of our functions take (state, batch, count) in X0-X2 and everything else we touch is volatile
+static constexpr XReg statePointer = X0;
+static constexpr XReg batchPointer = X1;
+static constexpr WReg count = W2;
+static constexpr XReg sourcesPointer = X3;  // Pointers to the current fragment's entries in the batch. Advanced after each fragment
+static constexpr XReg coloursPointer = X4;
+static constexpr XReg destPointer = X5;
+static constexpr XReg alivePointer = X6;
+static constexpr WReg scratch1 = W10;
+static constexpr WReg scratch2 = W11;
+
+// Colours are kept as 4 32-bit lanes (RGBA) so that products and sums don't overflow
+static constexpr QReg operand0 = Q0;
+static constexpr QReg operand1 = Q1;
+static constexpr QReg operand2 = Q2;
+static constexpr QReg temp1 = Q3;
+static constexpr QReg temp2 = Q4;
+static constexpr QReg previous = Q5;  // Output of the previous TEV stage
+static constexpr QReg previousBuffer = Q6;
+static constexpr QReg nextPreviousBuffer = Q7;
+static constexpr QReg alphaResult = Q24;  // Alpha combiner output, when it differs from the colour combiner
+
+// Registers used by blending
+static constexpr QReg sourceColour = Q0;
+static constexpr QReg destColour = Q1;
+static constexpr QReg constantColour = Q2;
+static constexpr QReg sourceFactor = Q3;
+static constexpr QReg destFactor = Q4;
+static constexpr QReg blendResult = Q5;
+static constexpr QReg alphaBlendResult = Q6;
+static constexpr QReg blendTemp = Q7;
+
+// Constants, loaded from the constant pool at the start of both functions
+static constexpr QReg constant255 = Q16;
+static constexpr QReg constant128 = Q17;
+static constexpr QReg constant127 = Q18;
+static constexpr QReg constantOne = Q19;
+static constexpr QReg maxProduct = Q20;  // Largest value we can divide by 255 exactly with our shift trick, and also a result of 256
+static constexpr QReg maxDot = Q21;      // Dot3 results at or above this are clamped to 255 anyways
+static constexpr QReg rgbMask = Q22;
+static constexpr QReg zero = Q23;
+
+static constexpr u32 batchSourcesOffset = offsetof(FragmentBatch, sources);
+static constexpr u32 batchColoursOffset = offsetof(FragmentBatch, colours);
+static constexpr u32 batchDestOffset = offsetof(FragmentBatch, dest);
+static constexpr u32 batchAliveOffset = offsetof(FragmentBatch, alive);
+static_assert(batchAliveOffset < 4096 && batchDestOffset < 4096, "Batch offsets must fit in an ADD immediate");
+
+static constexpr u32 constColourOffset(u32 stage) {
+	return u32(offsetof(FragmentState, tevStages) + stage * sizeof(FragmentState::TevStage) + offsetof(FragmentState::TevStage, constColour));
+}
+
+// LDR S uses an immediate offset scaled by 4
+static_assert(constColourOffset(0) % 4 == 0 && sizeof(FragmentState::TevStage) % 4 == 0, "Constant colours must be 4-byte aligned");
+static_assert(offsetof(FragmentState, tevBufferColour) % 4 == 0, "Buffer colour must be 4-byte aligned");
+static_assert(offsetof(FragmentState, blendColour) % 4 == 0, "Blend colour must be 4-byte aligned");
+
+void FragmentEmitter::compile(const FragmentState& state) {
+	oaknut::CodeBlock::unprotect();  // Unprotect the memory before writing to it
+	emitConstants();
+
+	Label tevLabel, blendLabel;
+	align(16);
+	l(tevLabel);
+	tevCallback = getLabelPointer<FragmentCallback>(tevLabel);
+	emitTev(state);
+
+	align(16);
+	l(blendLabel);
+	blendCallback = getLabelPointer<FragmentCallback>(blendLabel);
+	emitBlend(state);
+
+	// Protect the memory and invalidate icache before executing the code
+	oaknut::CodeBlock::protect();
+	oaknut::CodeBlock::invalidate_all();
+}
+
+void FragmentEmitter::emitConstants() {
+	static constexpr std::array<u32, 6> values = {255, 128, 127, 1, 65280, 16320};
+
+	align(16);
+	l(constants);
+	for (u32 value : values) {
+		for (int i = 0; i < 4; i++) {
+			dw(value);
+		}
+	}
+
+	// RGB mask
+	dw(0xFFFFFFFF);
+	dw(0xFFFFFFFF);
+	dw(0xFFFFFFFF);
+	dw(0);
+}
+
+void FragmentEmitter::loadConstants() {
+	u8* pointer = getLabelPointer<u8*>(constants);
+	LDR(constant255, pointer);
+	LDR(constant128, pointer + 16);
+	LDR(constant127, pointer + 32);
+	LDR(constantOne, pointer + 48);
+	LDR(maxProduct, pointer + 64);
+	LDR(maxDot, pointer + 80);
+	LDR(rgbMask, pointer + 96);
+	MOVI(zero.S4(), 0);
+}
+
+// Loads an RGBA8 colour and widens each channel to 32 bits
+void FragmentEmitter::loadRGBA(QReg dest, XReg pointer) {
+	LDR(SReg(dest.index()), pointer);
+	UXTL(dest.H8(), dest.B8());
+	UXTL(dest.S4(), dest.H4());
+}
+
+// floor(value / 255) for values in [0, 65534], which is all we ever divide
+void FragmentEmitter::emitDivideBy255(QReg value, QReg temp) {
+	USHR(temp.S4(), value.S4(), 8);
+	ADD(value.S4(), value.S4(), temp.S4());
+	ADD(value.S4(), value.S4(), constantOne.S4());
+	USHR(value.S4(), value.S4(), 8);
+}
+
+// A stage that outputs the previous stage's output unchanged. Games leave the stages they don't use configured like this
+static bool isPassthroughStage(const FragmentState::TevStage& stage) {
+	return (stage.source & 0xF000F) == 0xF000F && (stage.operand & 0x700F) == 0 && (stage.combiner & 0xF000F) == 0 && (stage.scale & 0x30003) == 0;
+}
+
+// How many operands each combiner mode reads
+static u32 operandsRead(u32 mode) {
+	switch (mode) {
+		case 0: return 1;
+		case 1:
+		case 2:
+		case 3:
+		case 5:
+		case 6:
+		case 7: return 2;
+		case 4:
+		case 8:
+		case 9: return 3;
+		default: return 0;
+	}
+}
+
+void FragmentEmitter::emitTev(const FragmentState& state) {
+	Label loop, end;
+
+	// If no stage reads the previous buffer, we don't need to keep track of it at all
+	bool usesBuffer = false;
+	for (const auto& stage : state.tevStages) {
+		for (u32 i = 0; i < 3; i++) {
+			usesBuffer |= ((stage.source >> (i * 4)) & 15) == 13 || ((stage.source >> (i * 4 + 16)) & 15) == 13;
+		}
+	}
+
+	CBZ(count, end);
+	loadConstants();
+	ADD(sourcesPointer, batchPointer, batchSourcesOffset);
+	ADD(coloursPointer, batchPointer, batchColoursOffset);
+	ADD(alivePointer, batchPointer, batchAliveOffset);
+
+	l(loop);
+	// The previous combiner starts out as the primary colour
+	loadRGBA(previous, sourcesPointer);
+	if (usesBuffer) {
+		MOVI(previousBuffer.S4(), 0);
+		ADD(X9, statePointer, offsetof(FragmentState, tevBufferColour));
+		loadRGBA(nextPreviousBuffer, X9);
+	}
+
+	for (u32 i = 0; i < 6; i++) {
+		emitTevStage(state, i, usesBuffer);
+	}
+
+	if (!state.alphaTestEnable || state.alphaTestFunc == 1) {
+		MOV(scratch1, 1);
+	} else if (state.alphaTestFunc == 0) {
+		MOV(scratch1, 0);
+	} else {
+		MOV(scratch1, previous.Selem()[3]);
+		LDRB(scratch2, statePointer, offsetof(FragmentState, alphaTestReference));
+		CMP(scratch1, scratch2);
+
+		switch (state.alphaTestFunc) {
+			case 2: CSET(scratch1, EQ); break;
+			case 3: CSET(scratch1, NE); break;
+			case 4: CSET(scratch1, LO); break;
+			case 5: CSET(scratch1, LS); break;
+			case 6: CSET(scratch1, HI); break;
+			default: CSET(scratch1, HS); break;
+		}
+	}
+	STRB(scratch1, alivePointer);
+
+	// Write out the final colour as RGBA8. Every lane is in [0, 255] at this point, so narrowing doesn't change anything
+	XTN(previous.H4(), previous.S4());
+	XTN(previous.B8(), previous.H8());
+	STR(SReg(previous.index()), coloursPointer);
+
+	ADD(sourcesPointer, sourcesPointer, sizeof(FragmentSources));
+	ADD(coloursPointer, coloursPointer, sizeof(RGBA));
+	ADD(alivePointer, alivePointer, sizeof(u8));
+	SUBS(count, count, 1);
+	B(NE, loop);
+
+	l(end);
+	RET();
+}
+
+void FragmentEmitter::emitTevStage(const FragmentState& state, u32 index, bool usesBuffer) {
+	const auto& stage = state.tevStages[index];
+
+	if (!isPassthroughStage(stage)) {
+		const u32 colourCombine = stage.combiner & 15;
+		const u32 alphaCombine = (stage.combiner >> 16) & 15;
+		const u32 colourScale = stage.scale & 3;
+		const u32 alphaScale = (stage.scale >> 16) & 3;
+		const bool isDot3 = colourCombine == 6 || colourCombine == 7;
+
+		static constexpr std::array<QReg, 3> operands = {operand0, operand1, operand2};
+		const u32 operandCount = std::max(operandsRead(colourCombine), operandsRead(alphaCombine));
+		for (u32 i = 0; i < operandCount; i++) {
+			emitOperand(operands[i], stage, index, i);
+		}
+
+		// The operands are all loaded, so we can overwrite the previous stage's output now
+		if (colourCombine == alphaCombine && !isDot3) {
+			emitCombine(previous, colourCombine);
+		} else {
+			if (isDot3) {
+				emitDot3(previous);
+			} else {
+				emitCombine(previous, colourCombine);
+			}
+
+			// Dot3 RGBA also writes the alpha channel
+			if (colourCombine != 7) {
+				emitCombine(alphaResult, alphaCombine);
+				MOV(previous.Selem()[3], alphaResult.Selem()[3]);
+			}
+		}
+
+		if (colourScale == alphaScale) {
+			if (colourScale != 0) {
+				SHL(previous.S4(), previous.S4(), colourScale);
+			}
+		} else {
+			MOV(temp1.B16(), previous.B16());
+			if (colourScale != 0) {
+				SHL(previous.S4(), previous.S4(), colourScale);
+			}
+			if (alphaScale != 0) {
+				SHL(temp1.S4(), temp1.S4(), alphaScale);
+			}
+			MOV(previous.Selem()[3], temp1.Selem()[3]);
+		}
+
+		if (colourScale != 0 || alphaScale != 0) {
+			SMIN(previous.S4(), previous.S4(), constant255.S4());
+		}
+	}
+
+	if (usesBuffer) {
+		MOV(previousBuffer.B16(), nextPreviousBuffer.B16());
+
+		if (index < 4) {
+			const bool updateColour = (state.tevUpdateBuffer & (0x100 << index)) != 0;
+			const bool updateAlpha = (state.tevUpdateBuffer & (0x1000 << index)) != 0;
+
+			if (updateColour && updateAlpha) {
+				MOV(nextPreviousBuffer.B16(), previous.B16());
+			} else if (updateColour) {
+				for (int i = 0; i < 3; i++) {
+					MOV(nextPreviousBuffer.Selem()[i], previous.Selem()[i]);
+				}
+			} else if (updateAlpha) {
+				MOV(nextPreviousBuffer.Selem()[3], previous.Selem()[3]);
+			}
+		}
+	}
+}
+
+void FragmentEmitter::loadSource(QReg dest, u32 source, u32 stageIndex) {
+	switch (source) {
+		case 0:
+		case 1:
+		case 2:
+		case 3:
+		case 4:
+		case 5:
+			LDR(SReg(dest.index()), sourcesPointer, source * sizeof(RGBA));
+			UXTL(dest.H8(), dest.B8());
+			UXTL(dest.S4(), dest.H4());
+			break;
+
+		case 13: MOV(dest.B16(), previousBuffer.B16()); break;
+		case 14:
+			LDR(SReg(dest.index()), statePointer, constColourOffset(stageIndex));
+			UXTL(dest.H8(), dest.B8());
+			UXTL(dest.S4(), dest.H4());
+			break;
+
+		case 15: MOV(dest.B16(), previous.B16()); break;
+		// TODO: Procedural textures and the undocumented sources read as 0, same as in the interpreter
+		default: MOVI(dest.S4(), 0); break;
+	}
+}
+
+void FragmentEmitter::emitOperand(QReg dest, const TevStage& stage, u32 stageIndex, u32 index) {
+	const u32 colourSource = (stage.source >> (index * 4)) & 15;
+	const u32 alphaSource = (stage.source >> (index * 4 + 16)) & 15;
+	const u32 colourOperand = (stage.operand >> (index * 4)) & 15;
+	const u32 alphaOperand = (stage.operand >> (12 + index * 4)) & 7;
+
+	loadSource(temp1, colourSource, stageIndex);
+
+	// Operands that use a single channel of the source broadcast it
+	const int colourChannel = (colourOperand < 4) ? 3 : (colourOperand < 8) ? 0 : (colourOperand < 12) ? 1 : 2;
+	switch (colourOperand) {
+		case 0: MOV(dest.B16(), temp1.B16()); break;
+		case 1: SUB(dest.S4(), constant255.S4(), temp1.S4()); break;
+
+		case 2:
+		case 4:
+		case 8:
+		case 12: DUP(dest.S4(), temp1.Selem()[colourChannel]); break;
+
+		case 3:
+		case 5:
+		case 9:
+		case 13:
+			DUP(temp2.S4(), temp1.Selem()[colourChannel]);
+			SUB(dest.S4(), constant255.S4(), temp2.S4());
+			break;
+
+		// TODO: figure out what the undocumented values do
+		default: MOVI(dest.S4(), 0); break;
+	}
+
+	if (alphaSource != colourSource) {
+		loadSource(temp1, alphaSource, stageIndex);
+	}
+
+	// Alpha operands 0/1 read alpha, 2/3 red, 4/5 green and 6/7 blue. The odd ones are inverted
+	static constexpr std::array<int, 4> alphaChannels = {3, 0, 1, 2};
+	if (alphaOperand & 1) {
+		SUB(temp2.S4(), constant255.S4(), temp1.S4());
+		MOV(dest.Selem()[3], temp2.Selem()[alphaChannels[alphaOperand >> 1]]);
+	} else {
+		MOV(dest.Selem()[3], temp1.Selem()[alphaChannels[alphaOperand >> 1]]);
+	}
+}
+
+void FragmentEmitter::emitCombine(QReg dest, u32 mode) {
+	switch (mode) {
+		case 0: MOV(dest.B16(), operand0.B16()); break;  // Replace
+
+		case 1:  // Modulate
+			MUL(dest.S4(), operand0.S4(), operand1.S4());
+			emitDivideBy255(dest, temp2);
+			break;
+
+		case 2:  // Add
+			ADD(dest.S4(), operand0.S4(), operand1.S4());
+			SMIN(dest.S4(), dest.S4(), constant255.S4());
+			break;
+
+		case 3:  // Add signed
+			ADD(dest.S4(), operand0.S4(), operand1.S4());
+			SUB(dest.S4(), dest.S4(), constant128.S4());
+			SMAX(dest.S4(), dest.S4(), zero.S4());
+			SMIN(dest.S4(), dest.S4(), constant255.S4());
+			break;
+
+		case 4:  // Interpolate
+			SUB(temp1.S4(), constant255.S4(), operand2.S4());
+			MUL(temp1.S4(), temp1.S4(), operand1.S4());
+			MUL(dest.S4(), operand0.S4(), operand2.S4());
+			ADD(dest.S4(), dest.S4(), temp1.S4());
+			emitDivideBy255(dest, temp2);
+			break;
+
+		case 5:  // Subtract
+			SUB(dest.S4(), operand0.S4(), operand1.S4());
+			SMAX(dest.S4(), dest.S4(), zero.S4());
+			break;
+
+		case 8:  // Multiply then add
+			MUL(dest.S4(), operand0.S4(), operand1.S4());
+			emitDivideBy255(dest, temp2);
+			ADD(dest.S4(), dest.S4(), operand2.S4());
+			SMIN(dest.S4(), dest.S4(), constant255.S4());
+			break;
+
+		case 9:  // Add then multiply. The product can go up to 510 * 255, so clamp it before dividing
+			ADD(dest.S4(), operand0.S4(), operand1.S4());
+			MUL(dest.S4(), dest.S4(), operand2.S4());
+			SMIN(dest.S4(), dest.S4(), maxProduct.S4());
+			emitDivideBy255(dest, temp2);
+			SMIN(dest.S4(), dest.S4(), constant255.S4());
+			break;
+
+		// TODO: figure out what the undocumented values do
+		default: MOV(dest.B16(), constant255.B16()); break;
+	}
+}
+
+void FragmentEmitter::emitDot3(QReg dest) {
+	SUB(temp1.S4(), operand0.S4(), constant128.S4());
+	SUB(temp2.S4(), operand1.S4(), constant128.S4());
+	MUL(temp1.S4(), temp1.S4(), temp2.S4());
+
+	// Sum the RGB products and broadcast the sum to every lane
+	AND(temp1.B16(), temp1.B16(), rgbMask.B16());
+	ADDV(SReg(temp1.index()), temp1.S4());
+	DUP(temp1.S4(), temp1.Selem()[0]);
+
+	SMAX(temp1.S4(), temp1.S4(), zero.S4());
+	SMIN(temp1.S4(), temp1.S4(), maxDot.S4());
+	SHL(temp1.S4(), temp1.S4(), 2);
+	emitDivideBy255(temp1, temp2);
+	SMIN(dest.S4(), temp1.S4(), constant255.S4());
+}
+
+void FragmentEmitter::emitBlend(const FragmentState& state) {
+	Label loop, end;
+
+	CBZ(count, end);
+	ADD(coloursPointer, batchPointer, batchColoursOffset);
+	ADD(destPointer, batchPointer, batchDestOffset);
+
+	if (state.blendEnable) {
+		loadConstants();
+		ADD(X9, statePointer, offsetof(FragmentState, blendColour));
+		loadRGBA(constantColour, X9);
+	}
+
+	l(loop);
+	if (state.blendEnable) {
+		loadRGBA(sourceColour, coloursPointer);
+		loadRGBA(destColour, destPointer);
+
+		emitBlendFactor(sourceFactor, state.rgbSourceFunc);
+		emitBlendFactor(destFactor, state.rgbDestFunc);
+		emitBlendEquation(blendResult, state.rgbEquation);
+
+		const bool separateAlpha = state.alphaEquation != state.rgbEquation || state.alphaSourceFunc != state.rgbSourceFunc ||
+								   state.alphaDestFunc != state.rgbDestFunc;
+		if (separateAlpha) {
+			emitBlendFactor(sourceFactor, state.alphaSourceFunc);
+			emitBlendFactor(destFactor, state.alphaDestFunc);
+			emitBlendEquation(alphaBlendResult, state.alphaEquation);
+			MOV(blendResult.Selem()[3], alphaBlendResult.Selem()[3]);
+		}
+
+		XTN(blendResult.H4(), blendResult.S4());
+		XTN(blendResult.B8(), blendResult.H8());
+		MOV(scratch1, blendResult.Selem()[0]);
+	} else {
+		// Logic ops work on each bit separately, so we can apply them to all 4 channels at once in a GPR
+		LDR(scratch1, coloursPointer);
+		LDR(scratch2, destPointer);
+		emitLogicOp(state.logicOp);
+	}
+
+	if (state.colourWriteMask != 0xF) {
+		u32 mask = 0;
+		for (u32 i = 0; i < 4; i++) {
+			if (state.colourWriteMask & (1 << i)) {
+				mask |= 0xFFu << (i * 8);
+			}
+		}
+
+		// Not every mask is encodable as a logical immediate, so materialize it in W9
+		LDR(scratch2, destPointer);
+		MOV(W9, mask);
+		AND(scratch1, scratch1, W9);
+		BIC(scratch2, scratch2, W9);
+		ORR(scratch1, scratch1, scratch2);
+	}
+
+	STR(scratch1, coloursPointer);
+
+	ADD(coloursPointer, coloursPointer, sizeof(RGBA));
+	ADD(destPointer, destPointer, sizeof(RGBA));
+	SUBS(count, count, 1);
+	B(NE, loop);
+
+	l(end);
+	RET();
+}
+
+void FragmentEmitter::emitBlendFactor(QReg dest, u32 func) {
+	switch (func) {
+		case 0: MOVI(dest.S4(), 0); break;
+		case 2: MOV(dest.B16(), sourceColour.B16()); break;
+		case 3: SUB(dest.S4(), constant255.S4(), sourceColour.S4()); break;
+		case 4: MOV(dest.B16(), destColour.B16()); break;
+		case 5: SUB(dest.S4(), constant255.S4(), destColour.S4()); break;
+		case 6: DUP(dest.S4(), sourceColour.Selem()[3]); break;
+		case 7:
+			DUP(blendTemp.S4(), sourceColour.Selem()[3]);
+			SUB(dest.S4(), constant255.S4(), blendTemp.S4());
+			break;
+		case 8: DUP(dest.S4(), destColour.Selem()[3]); break;
+		case 9:
+			DUP(blendTemp.S4(), destColour.Selem()[3]);
+			SUB(dest.S4(), constant255.S4(), blendTemp.S4());
+			break;
+		case 10: MOV(dest.B16(), constantColour.B16()); break;
+		case 11: SUB(dest.S4(), constant255.S4(), constantColour.S4()); break;
+		case 12: DUP(dest.S4(), constantColour.Selem()[3]); break;
+		case 13:
+			DUP(blendTemp.S4(), constantColour.Selem()[3]);
+			SUB(dest.S4(), constant255.S4(), blendTemp.S4());
+			break;
+
+		case 14:  // Source alpha saturate. The alpha channel's factor is 1
+			DUP(blendTemp.S4(), destColour.Selem()[3]);
+			SUB(dest.S4(), constant255.S4(), blendTemp.S4());
+			DUP(blendTemp.S4(), sourceColour.Selem()[3]);
+			SMIN(dest.S4(), dest.S4(), blendTemp.S4());
+			MOV(dest.Selem()[3], constant255.Selem()[3]);
+			break;
+
+		// Func 15 is undocumented and stubbed to 1, like in the interpreter
+		default: MOV(dest.B16(), constant255.B16()); break;
+	}
+}
+
+// Blends the source & dest colours with the factors in sourceFactor and destFactor. Clobbers destFactor
+void FragmentEmitter::emitBlendEquation(QReg dest, u32 equation) {
+	switch (equation) {
+		case 3: SMIN(dest.S4(), sourceColour.S4(), destColour.S4()); return;  // Min
+		case 4: SMAX(dest.S4(), sourceColour.S4(), destColour.S4()); return;  // Max
+		default: break;
+	}
+
+	MUL(dest.S4(), sourceColour.S4(), sourceFactor.S4());
+	MUL(destFactor.S4(), destColour.S4(), destFactor.S4());
+
+	switch (equation) {
+		case 1: SUB(dest.S4(), dest.S4(), destFactor.S4()); break;  // Subtract
+		case 2: SUB(dest.S4(), destFactor.S4(), dest.S4()); break;  // Reverse subtract
+		default: ADD(dest.S4(), dest.S4(), destFactor.S4()); break;  // Add. The unused equations behave like it too
+	}
+
+	// Round, then clamp to [0, 255]. Clamping the sum before dividing keeps it in the range where our division is exact
+	ADD(dest.S4(), dest.S4(), constant127.S4());
+	SMAX(dest.S4(), dest.S4(), zero.S4());
+	SMIN(dest.S4(), dest.S4(), maxProduct.S4());
+	emitDivideBy255(dest, destFactor);
+	SMIN(dest.S4(), dest.S4(), constant255.S4());
+}
+
+// Applies the logic op to the source colour in scratch1 and the dest colour in scratch2, leaving the result in scratch1
+void FragmentEmitter::emitLogicOp(u32 op) {
+	switch (op) {
+		case 0: MOV(scratch1, WZR); break;                   // Clear
+		case 1: AND(scratch1, scratch1, scratch2); break;    // And
+		case 2: BIC(scratch1, scratch1, scratch2); break;    // And reverse
+		case 3: break;                                       // Copy
+		case 4: MOV(scratch1, 0xFFFFFFFF); break;            // Set
+		case 5: MVN(scratch1, scratch1); break;              // Copy inverted
+		case 6: MOV(scratch1, scratch2); break;              // No-op
+		case 7: MVN(scratch1, scratch2); break;              // Invert
+		case 8:                                              // Nand
+			AND(scratch1, scratch1, scratch2);
+			MVN(scratch1, scratch1);
+			break;
+		case 9: ORR(scratch1, scratch1, scratch2); break;  // Or
+		case 10:                                           // Nor
+			ORR(scratch1, scratch1, scratch2);
+			MVN(scratch1, scratch1);
+			break;
+		case 11: EOR(scratch1, scratch1, scratch2); break;  // Xor
+		case 12: EON(scratch1, scratch1, scratch2); break;  // Equivalent
+		case 13: BIC(scratch1, scratch2, scratch1); break;  // And inverted
+		case 14: ORN(scratch1, scratch1, scratch2); break;  // Or reverse
+		default: ORN(scratch1, scratch2, scratch1); break;  // Or inverted
+	}
+}
+
+#endif  // arm64 recompiler check
@@ -0,0 +1,623 @@
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_X64_HOST)
+#include "renderer_sw/fragment_rec_emitter_x64.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+using namespace Xbyak;
+using namespace Xbyak::util;
+using namespace SwRenderer;
+
+// Register allocation. Both of our functions take (state, batch, count). Everything here except for xmm6-xmm8 on Windows is volatile
+static const Reg64 statePointer = arg1.cvt64();
+static const Reg64 batchPointer = arg2.cvt64();
+static const Reg32 count = arg3;
+static constexpr Reg64 fragmentIndex = rax;
+static constexpr Reg64 sourcesOffset = r10;  // Offset of the current fragment's TEV sources from the start of the sources array
+static constexpr Reg32 scratch1 = r11d;
+static constexpr Reg32 scratch2 = r9d;
+
+// Colours are kept as 4 32-bit lanes (RGBA) so that products and sums don't overflow
+static constexpr Xmm operand0 = xmm0;
+static constexpr Xmm operand1 = xmm1;
+static constexpr Xmm operand2 = xmm2;
+static constexpr Xmm temp1 = xmm3;
+static constexpr Xmm temp2 = xmm4;
+static constexpr Xmm previous = xmm5;  // Output of the previous TEV stage
+static constexpr Xmm previousBuffer = xmm6;
+static constexpr Xmm nextPreviousBuffer = xmm7;
+static constexpr Xmm alphaResult = xmm8;  // Alpha combiner output, when it differs from the colour combiner
+
+// Registers used by blending
+static constexpr Xmm sourceColour = xmm0;
+static constexpr Xmm destColour = xmm1;
+static constexpr Xmm constantColour = xmm2;
+static constexpr Xmm sourceFactor = xmm3;
+static constexpr Xmm destFactor = xmm4;
+static constexpr Xmm blendResult = xmm5;
+static constexpr Xmm alphaBlendResult = xmm6;
+static constexpr Xmm blendTemp = xmm7;
+
+static constexpr int savedXmmCount = 3;  // xmm6 to xmm8 are callee-saved in the MS ABI
+
+static constexpr u32 batchSourcesOffset = offsetof(FragmentBatch, sources);
+static constexpr u32 batchColoursOffset = offsetof(FragmentBatch, colours);
+static constexpr u32 batchDestOffset = offsetof(FragmentBatch, dest);
+static constexpr u32 batchAliveOffset = offsetof(FragmentBatch, alive);
+static_assert(sizeof(FragmentSources) == 32, "The TEV JIT indexes sources with a shift by 5");
+
+static constexpr u32 constColourOffset(u32 stage) {
+	return u32(offsetof(FragmentState, tevStages) + stage * sizeof(FragmentState::TevStage) + offsetof(FragmentState::TevStage, constColour));
+}
+
+bool FragmentEmitter::isSupported() {
+	static const bool supported = Cpu().has(Cpu::tSSE41);
+	return supported;
+}
+
+void FragmentEmitter::compile(const FragmentState& state) {
+	emitConstants();
+
+	align(16);
+	tevCallback = getCurr<FragmentCallback>();
+	emitTev(state);
+
+	align(16);
+	blendCallback = getCurr<FragmentCallback>();
+	emitBlend(state);
+}
+
+void FragmentEmitter::emitConstants() {
+	auto emitVector = [&](Label& label, u32 value) {
+		L(label);
+		for (int i = 0; i < 4; i++) {
+			dd(value);
+		}
+	};
+
+	// SSE instructions with memory operands need them to be 16-byte aligned
+	align(16);
+	emitVector(constant255, 255);
+	emitVector(constant128, 128);
+	emitVector(constant127, 127);
+	emitVector(constantOne, 1);
+	emitVector(maxProduct, 65280);  // Largest product we can divide by 255 exactly with our shift trick, and also a result of 256
+	emitVector(maxDot, 16320);      // Dot3 results at or above this are clamped to 255 anyways
+
+	L(rgbMask);
+	dd(0xFFFFFFFF);
+	dd(0xFFFFFFFF);
+	dd(0xFFFFFFFF);
+	dd(0);
+}
+
+void FragmentEmitter::emitPrologue() {
+	if constexpr (isWindows()) {
+		sub(rsp, savedXmmCount * 16 + 8);
+		for (int i = 0; i < savedXmmCount; i++) {
+			movdqu(xword[rsp + i * 16], Xmm(6 + i));
+		}
+	}
+}
+
+void FragmentEmitter::emitEpilogue() {
+	if constexpr (isWindows()) {
+		for (int i = 0; i < savedXmmCount; i++) {
+			movdqu(Xmm(6 + i), xword[rsp + i * 16]);
+		}
+		add(rsp, savedXmmCount * 16 + 8);
+	}
+}
+
+// floor(value / 255) for values in [0, 65534], which is all we ever divide
+void FragmentEmitter::emitDivideBy255(const Xmm& value, const Xmm& temp) {
+	movdqa(temp, value);
+	psrld(temp, 8);
+	paddd(value, temp);
+	paddd(value, xword[rip + constantOne]);
+	psrld(value, 8);
+}
+
+// A stage that outputs the previous stage's output unchanged. Games leave the stages they don't use configured like this
+static bool isPassthroughStage(const FragmentState::TevStage& stage) {
+	return (stage.source & 0xF000F) == 0xF000F && (stage.operand & 0x700F) == 0 && (stage.combiner & 0xF000F) == 0 && (stage.scale & 0x30003) == 0;
+}
+
+// How many operands each combiner mode reads
+static u32 operandsRead(u32 mode) {
+	switch (mode) {
+		case 0: return 1;
+		case 1:
+		case 2:
+		case 3:
+		case 5:
+		case 6:
+		case 7: return 2;
+		case 4:
+		case 8:
+		case 9: return 3;
+		default: return 0;
+	}
+}
+
+void FragmentEmitter::emitTev(const FragmentState& state) {
+	Label loop, end;
+
+	// If no stage reads the previous buffer, we don't need to keep track of it at all
+	bool usesBuffer = false;
+	for (const auto& stage : state.tevStages) {
+		for (u32 i = 0; i < 3; i++) {
+			usesBuffer |= ((stage.source >> (i * 4)) & 15) == 13 || ((stage.source >> (i * 4 + 16)) & 15) == 13;
+		}
+	}
+
+	emitPrologue();
+	test(count, count);
+	jz(end, T_NEAR);
+	xor_(fragmentIndex.cvt32(), fragmentIndex.cvt32());
+
+	L(loop);
+	mov(sourcesOffset, fragmentIndex);
+	shl(sourcesOffset, 5);
+
+	// The previous combiner starts out as the primary colour
+	pmovzxbd(previous, dword[batchPointer + sourcesOffset + batchSourcesOffset]);
+	if (usesBuffer) {
+		pxor(previousBuffer, previousBuffer);
+		pmovzxbd(nextPreviousBuffer, dword[statePointer + offsetof(FragmentState, tevBufferColour)]);
+	}
+
+	for (u32 i = 0; i < 6; i++) {
+		emitTevStage(state, i, usesBuffer);
+	}
+
+	// Write out the final colour as RGBA8. Every lane is in [0, 255] at this point, so the saturating packs don't change anything
+	packusdw(previous, previous);
+	packuswb(previous, previous);
+	movd(dword[batchPointer + fragmentIndex * 4 + batchColoursOffset], previous);
+
+	const Address alive = byte[batchPointer + fragmentIndex + batchAliveOffset];
+	if (!state.alphaTestEnable || state.alphaTestFunc == 1) {
+		mov(alive, 1);
+	} else if (state.alphaTestFunc == 0) {
+		mov(alive, 0);
+	} else {
+		movd(scratch1, previous);
+		shr(scratch1, 24);
+		cmp(scratch1.cvt8(), byte[statePointer + offsetof(FragmentState, alphaTestReference)]);
+
+		switch (state.alphaTestFunc) {
+			case 2: sete(alive); break;
+			case 3: setne(alive); break;
+			case 4: setb(alive); break;
+			case 5: setbe(alive); break;
+			case 6: seta(alive); break;
+			default: setae(alive); break;
+		}
+	}
+
+	inc(fragmentIndex.cvt32());
+	cmp(fragmentIndex.cvt32(), count);
+	jb(loop, T_NEAR);
+
+	L(end);
+	emitEpilogue();
+	ret();
+}
+
+void FragmentEmitter::emitTevStage(const FragmentState& state, u32 index, bool usesBuffer) {
+	const auto& stage = state.tevStages[index];
+
+	if (!isPassthroughStage(stage)) {
+		const u32 colourCombine = stage.combiner & 15;
+		const u32 alphaCombine = (stage.combiner >> 16) & 15;
+		const u32 colourScale = stage.scale & 3;
+		const u32 alphaScale = (stage.scale >> 16) & 3;
+		const bool isDot3 = colourCombine == 6 || colourCombine == 7;
+
+		static constexpr std::array<Xmm, 3> operands = {operand0, operand1, operand2};
+		const u32 operandCount = std::max(operandsRead(colourCombine), operandsRead(alphaCombine));
+		for (u32 i = 0; i < operandCount; i++) {
+			emitOperand(operands[i], stage, index, i);
+		}
+
+		// The operands are all loaded, so we can overwrite the previous stage's output now
+		if (colourCombine == alphaCombine && !isDot3) {
+			emitCombine(previous, colourCombine);
+		} else {
+			if (isDot3) {
+				emitDot3(previous);
+			} else {
+				emitCombine(previous, colourCombine);
+			}
+
+			// Dot3 RGBA also writes the alpha channel
+			if (colourCombine != 7) {
+				emitCombine(alphaResult, alphaCombine);
+				blendps(previous, alphaResult, 0b1000);
+			}
+		}
+
+		if (colourScale == alphaScale) {
+			if (colourScale != 0) {
+				pslld(previous, u8(colourScale));
+			}
+		} else {
+			movdqa(temp1, previous);
+			pslld(previous, u8(colourScale));
+			pslld(temp1, u8(alphaScale));
+			blendps(previous, temp1, 0b1000);
+		}
+
+		if (colourScale != 0 || alphaScale != 0) {
+			pminsd(previous, xword[rip + constant255]);
+		}
+	}
+
+	if (usesBuffer) {
+		movdqa(previousBuffer, nextPreviousBuffer);
+
+		if (index < 4) {
+			const bool updateColour = (state.tevUpdateBuffer & (0x100 << index)) != 0;
+			const bool updateAlpha = (state.tevUpdateBuffer & (0x1000 << index)) != 0;
+
+			if (updateColour && updateAlpha) {
+				movdqa(nextPreviousBuffer, previous);
+			} else if (updateColour) {
+				blendps(nextPreviousBuffer, previous, 0b0111);
+			} else if (updateAlpha) {
+				blendps(nextPreviousBuffer, previous, 0b1000);
+			}
+		}
+	}
+}
+
+void FragmentEmitter::loadSource(const Xmm& dest, u32 source, u32 stageIndex) {
+	switch (source) {
+		case 0:
+		case 1:
+		case 2:
+		case 3:
+		case 4:
+		case 5: pmovzxbd(dest, dword[batchPointer + sourcesOffset + batchSourcesOffset + source * sizeof(RGBA)]); break;
+		case 13: movdqa(dest, previousBuffer); break;
+		case 14: pmovzxbd(dest, dword[statePointer + constColourOffset(stageIndex)]); break;
+		case 15: movdqa(dest, previous); break;
+		// TODO: Procedural textures and the undocumented sources read as 0, same as in the interpreter
+		default: pxor(dest, dest); break;
+	}
+}
+
+void FragmentEmitter::emitOperand(const Xmm& dest, const TevStage& stage, u32 stageIndex, u32 index) {
+	const u32 colourSource = (stage.source >> (index * 4)) & 15;
+	const u32 alphaSource = (stage.source >> (index * 4 + 16)) & 15;
+	const u32 colourOperand = (stage.operand >> (index * 4)) & 15;
+	const u32 alphaOperand = (stage.operand >> (12 + index * 4)) & 7;
+
+	loadSource(temp1, colourSource, stageIndex);
+
+	// Operands that use a single channel of the source broadcast it. The shuffle picks the channel
+	const u8 colourShuffle = (colourOperand < 4) ? 0xFF : (colourOperand < 8) ? 0x00 : (colourOperand < 12) ? 0x55 : 0xAA;
+	switch (colourOperand) {
+		case 0: movdqa(dest, temp1); break;
+		case 1:
+			movdqa(dest, xword[rip + constant255]);
+			psubd(dest, temp1);
+			break;
+
+		case 2:
+		case 4:
+		case 8:
+		case 12: pshufd(dest, temp1, colourShuffle); break;
+
+		case 3:
+		case 5:
+		case 9:
+		case 13:
+			pshufd(temp2, temp1, colourShuffle);
+			movdqa(dest, xword[rip + constant255]);
+			psubd(dest, temp2);
+			break;
+
+		// TODO: figure out what the undocumented values do
+		default: pxor(dest, dest); break;
+	}
+
+	if (alphaSource != colourSource) {
+		loadSource(temp1, alphaSource, stageIndex);
+	}
+
+	// Alpha operands 0/1 read alpha, 2/3 red, 4/5 green and 6/7 blue. The odd ones are inverted
+	static constexpr std::array<u8, 4> alphaShuffles = {0xFF, 0x00, 0x55, 0xAA};
+	pshufd(temp2, temp1, alphaShuffles[alphaOperand >> 1]);
+
+	if (alphaOperand & 1) {
+		movdqa(temp1, xword[rip + constant255]);
+		psubd(temp1, temp2);
+		blendps(dest, temp1, 0b1000);
+	} else {
+		blendps(dest, temp2, 0b1000);
+	}
+}
+
+void FragmentEmitter::emitCombine(const Xmm& dest, u32 mode) {
+	switch (mode) {
+		case 0: movdqa(dest, operand0); break;  // Replace
+
+		case 1:  // Modulate
+			movdqa(dest, operand0);
+			pmulld(dest, operand1);
+			emitDivideBy255(dest, temp2);
+			break;
+
+		case 2:  // Add
+			movdqa(dest, operand0);
+			paddd(dest, operand1);
+			pminsd(dest, xword[rip + constant255]);
+			break;
+
+		case 3:  // Add signed
+			movdqa(dest, operand0);
+			paddd(dest, operand1);
+			psubd(dest, xword[rip + constant128]);
+			pxor(temp1, temp1);
+			pmaxsd(dest, temp1);
+			pminsd(dest, xword[rip + constant255]);
+			break;
+
+		case 4:  // Interpolate
+			movdqa(temp1, xword[rip + constant255]);
+			psubd(temp1, operand2);
+			pmulld(temp1, operand1);
+			movdqa(dest, operand0);
+			pmulld(dest, operand2);
+			paddd(dest, temp1);
+			emitDivideBy255(dest, temp2);
+			break;
+
+		case 5:  // Subtract
+			movdqa(dest, operand0);
+			psubd(dest, operand1);
+			pxor(temp1, temp1);
+			pmaxsd(dest, temp1);
+			break;
+
+		case 8:  // Multiply then add
+			movdqa(dest, operand0);
+			pmulld(dest, operand1);
+			emitDivideBy255(dest, temp2);
+			paddd(dest, operand2);
+			pminsd(dest, xword[rip + constant255]);
+			break;
+
+		case 9:  // Add then multiply. The product can go up to 510 * 255, so clamp it before dividing
+			movdqa(dest, operand0);
+			paddd(dest, operand1);
+			pmulld(dest, operand2);
+			pminsd(dest, xword[rip + maxProduct]);
+			emitDivideBy255(dest, temp2);
+			pminsd(dest, xword[rip + constant255]);
+			break;
+
+		// TODO: figure out what the undocumented values do
+		default: movdqa(dest, xword[rip + constant255]); break;
+	}
+}
+
+void FragmentEmitter::emitDot3(const Xmm& dest) {
+	movdqa(temp1, operand0);
+	psubd(temp1, xword[rip + constant128]);
+	movdqa(temp2, operand1);
+	psubd(temp2, xword[rip + constant128]);
+	pmulld(temp1, temp2);
+
+	// Sum the RGB products. After 2 horizontal adds, every lane holds the sum
+	pand(temp1, xword[rip + rgbMask]);
+	phaddd(temp1, temp1);
+	phaddd(temp1, temp1);
+
+	pxor(temp2, temp2);
+	pmaxsd(temp1, temp2);
+	pminsd(temp1, xword[rip + maxDot]);
+	pslld(temp1, 2);
+	emitDivideBy255(temp1, temp2);
+	pminsd(temp1, xword[rip + constant255]);
+	movdqa(dest, temp1);
+}
+
+void FragmentEmitter::emitBlend(const FragmentState& state) {
+	Label loop, end;
+	const Address colour = dword[batchPointer + fragmentIndex * 4 + batchColoursOffset];
+	const Address dest = dword[batchPointer + fragmentIndex * 4 + batchDestOffset];
+
+	emitPrologue();
+	test(count, count);
+	jz(end, T_NEAR);
+	xor_(fragmentIndex.cvt32(), fragmentIndex.cvt32());
+
+	if (state.blendEnable) {
+		pmovzxbd(constantColour, dword[statePointer + offsetof(FragmentState, blendColour)]);
+	}
+
+	L(loop);
+	if (state.blendEnable) {
+		pmovzxbd(sourceColour, colour);
+		pmovzxbd(destColour, dest);
+
+		emitBlendFactor(sourceFactor, state.rgbSourceFunc);
+		emitBlendFactor(destFactor, state.rgbDestFunc);
+		emitBlendEquation(blendResult, state.rgbEquation);
+
+		const bool separateAlpha = state.alphaEquation != state.rgbEquation || state.alphaSourceFunc != state.rgbSourceFunc ||
+								   state.alphaDestFunc != state.rgbDestFunc;
+		if (separateAlpha) {
+			emitBlendFactor(sourceFactor, state.alphaSourceFunc);
+			emitBlendFactor(destFactor, state.alphaDestFunc);
+			emitBlendEquation(alphaBlendResult, state.alphaEquation);
+			blendps(blendResult, alphaBlendResult, 0b1000);
+		}
+
+		packusdw(blendResult, blendResult);
+		packuswb(blendResult, blendResult);
+		movd(scratch1, blendResult);
+	} else {
+		// Logic ops work on each bit separately, so we can apply them to all 4 channels at once in a GPR
+		mov(scratch1, colour);
+		mov(scratch2, dest);
+		emitLogicOp(state.logicOp);
+	}
+
+	if (state.colourWriteMask != 0xF) {
+		u32 mask = 0;
+		for (u32 i = 0; i < 4; i++) {
+			if (state.colourWriteMask & (1 << i)) {
+				mask |= 0xFFu << (i * 8);
+			}
+		}
+
+		mov(scratch2, dest);
+		and_(scratch1, mask);
+		and_(scratch2, ~mask);
+		or_(scratch1, scratch2);
+	}
+
+	mov(colour, scratch1);
+
+	inc(fragmentIndex.cvt32());
+	cmp(fragmentIndex.cvt32(), count);
+	jb(loop, T_NEAR);
+
+	L(end);
+	emitEpilogue();
+	ret();
+}
+
+void FragmentEmitter::emitBlendFactor(const Xmm& dest, u32 func) {
+	// dest = 255 - value
+	auto invert = [&](const Xmm& value) {
+		movdqa(dest, xword[rip + constant255]);
+		psubd(dest, value);
+	};
+
+	switch (func) {
+		case 0: pxor(dest, dest); break;
+		case 2: movdqa(dest, sourceColour); break;
+		case 3: invert(sourceColour); break;
+		case 4: movdqa(dest, destColour); break;
+		case 5: invert(destColour); break;
+		case 6: pshufd(dest, sourceColour, 0xFF); break;
+		case 7:
+			pshufd(blendTemp, sourceColour, 0xFF);
+			invert(blendTemp);
+			break;
+		case 8: pshufd(dest, destColour, 0xFF); break;
+		case 9:
+			pshufd(blendTemp, destColour, 0xFF);
+			invert(blendTemp);
+			break;
+		case 10: movdqa(dest, constantColour); break;
+		case 11: invert(constantColour); break;
+		case 12: pshufd(dest, constantColour, 0xFF); break;
+		case 13:
+			pshufd(blendTemp, constantColour, 0xFF);
+			invert(blendTemp);
+			break;
+
+		case 14:  // Source alpha saturate. The alpha channel's factor is 1
+			pshufd(blendTemp, destColour, 0xFF);
+			invert(blendTemp);
+			pshufd(blendTemp, sourceColour, 0xFF);
+			pminsd(dest, blendTemp);
+			blendps(dest, xword[rip + constant255], 0b1000);
+			break;
+
+		// Func 15 is undocumented and stubbed to 1, like in the interpreter
+		default: movdqa(dest, xword[rip + constant255]); break;
+	}
+}
+
+// Blends the source & dest colours with the factors in sourceFactor and destFactor. Clobbers destFactor
+void FragmentEmitter::emitBlendEquation(const Xmm& dest, u32 equation) {
+	switch (equation) {
+		case 3:  // Min
+			movdqa(dest, sourceColour);
+			pminsd(dest, destColour);
+			return;
+
+		case 4:  // Max
+			movdqa(dest, sourceColour);
+			pmaxsd(dest, destColour);
+			return;
+
+		default: break;
+	}
+
+	movdqa(dest, sourceColour);
+	pmulld(dest, sourceFactor);
+	pmulld(destFactor, destColour);
+
+	switch (equation) {
+		case 1: psubd(dest, destFactor); break;  // Subtract
+		case 2:                                  // Reverse subtract
+			psubd(destFactor, dest);
+			movdqa(dest, destFactor);
+			break;
+		default: paddd(dest, destFactor); break;  // Add. The unused equations behave like it too
+	}
+
+	// Round, then clamp to [0, 255]. Clamping the sum before dividing keeps it in the range where our division is exact
+	paddd(dest, xword[rip + constant127]);
+	pxor(destFactor, destFactor);
+	pmaxsd(dest, destFactor);
+	pminsd(dest, xword[rip + maxProduct]);
+	emitDivideBy255(dest, destFactor);
+	pminsd(dest, xword[rip + constant255]);
+}
+
+// Applies the logic op to the source colour in scratch1 and the dest colour in scratch2, leaving the result in scratch1
+void FragmentEmitter::emitLogicOp(u32 op) {
+	switch (op) {
+		case 0: xor_(scratch1, scratch1); break;  // Clear
+		case 1: and_(scratch1, scratch2); break;  // And
+		case 2:                                   // And reverse
+			not_(scratch2);
+			and_(scratch1, scratch2);
+			break;
+		case 3: break;                             // Copy
+		case 4: mov(scratch1, 0xFFFFFFFF); break;  // Set
+		case 5: not_(scratch1); break;             // Copy inverted
+		case 6: mov(scratch1, scratch2); break;    // No-op
+		case 7:                                    // Invert
+			mov(scratch1, scratch2);
+			not_(scratch1);
+			break;
+		case 8:  // Nand
+			and_(scratch1, scratch2);
+			not_(scratch1);
+			break;
+		case 9: or_(scratch1, scratch2); break;  // Or
+		case 10:                                 // Nor
+			or_(scratch1, scratch2);
+			not_(scratch1);
+			break;
+		case 11: xor_(scratch1, scratch2); break;  // Xor
+		case 12:                                   // Equivalent
+			xor_(scratch1, scratch2);
+			not_(scratch1);
+			break;
+		case 13:  // And inverted
+			not_(scratch1);
+			and_(scratch1, scratch2);
+			break;
+		case 14:  // Or reverse
+			not_(scratch2);
+			or_(scratch1, scratch2);
+			break;
+		default:  // Or inverted
+			not_(scratch1);
+			or_(scratch1, scratch2);
+			break;
+	}
+}
+
+#endif  // x64 recompiler check
@@ -0,0 +1,259 @@
+#include "renderer_sw/rasterizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace SwRenderer;
+
+namespace {
+	// A clipping plane. Points with dot(plane, position) + offset >= 0 are inside it
+	struct ClipPlane {
+		std::array<float, 4> plane;
+		float offset;
+	};
+}  // namespace
+
+// The PICA clips z to [-w, 0] instead of [-w, w]. We also clip against a tiny positive w so that we never divide by 0
+static constexpr std::array<ClipPlane, 7> viewVolumePlanes = {{
+	{{1.f, 0.f, 0.f, 1.f}, 0.f},   // x >= -w
+	{{-1.f, 0.f, 0.f, 1.f}, 0.f},  // x <= w
+	{{0.f, 1.f, 0.f, 1.f}, 0.f},   // y >= -w
+	{{0.f, -1.f, 0.f, 1.f}, 0.f},  // y <= w
+	{{0.f, 0.f, 1.f, 1.f}, 0.f},   // z >= -w
+	{{0.f, 0.f, -1.f, 0.f}, 0.f},  // z <= 0
+	{{0.f, 0.f, 0.f, 1.f}, -0.00001f},  // w >= epsilon
+}};
+
+static float planeDistance(const ClipPlane& plane, const Vertex& vertex) {
+	const auto& pos = vertex.position;
+	return plane.plane[0] * pos[0] + plane.plane[1] * pos[1] + plane.plane[2] * pos[2] + plane.plane[3] * pos[3] + plane.offset;
+}
+
+static Vertex lerp(const Vertex& a, const Vertex& b, float t) {
+	Vertex result;
+	for (usize i = 0; i < 4; i++) {
+		result.position[i] = a.position[i] + (b.position[i] - a.position[i]) * t;
+	}
+
+	for (usize i = 0; i < Attributes::Count; i++) {
+		result.attributes[i] = a.attributes[i] + (b.attributes[i] - a.attributes[i]) * t;
+	}
+
+	return result;
+}
+
+usize SwRenderer::clipTriangle(
+	const Vertex& v0, const Vertex& v1, const Vertex& v2, const std::array<float, 4>* userClipPlane, std::array<Vertex, maxClippedVertices>& output
+) {
+	std::array<ClipPlane, 8> planes;
+	usize planeCount = 0;
+	for (const auto& plane : viewVolumePlanes) {
+		planes[planeCount++] = plane;
+	}
+
+	if (userClipPlane != nullptr) {
+		planes[planeCount++] = {*userClipPlane, 0.f};
+	}
+
+	// Fast path for the common case of triangles that are entirely inside the view volume
+	bool allInside = true;
+	for (usize i = 0; i < planeCount && allInside; i++) {
+		allInside = planeDistance(planes[i], v0) >= 0.f && planeDistance(planes[i], v1) >= 0.f && planeDistance(planes[i], v2) >= 0.f;
+	}
+
+	if (allInside) {
+		output[0] = v0;
+		output[1] = v1;
+		output[2] = v2;
+		return 3;
+	}
+
+	// Sutherland-Hodgman clipping. Every plane can add at most 1 vertex to the polygon, so the buffers can't overflow
+	std::array<Vertex, maxClippedVertices> temp;
+	Vertex* input = temp.data();
+	Vertex* clipped = output.data();
+	usize count = 3;
+
+	input[0] = v0;
+	input[1] = v1;
+	input[2] = v2;
+
+	for (usize p = 0; p < planeCount; p++) {
+		usize clippedCount = 0;
+
+		for (usize i = 0; i < count; i++) {
+			const Vertex& current = input[i];
+			const Vertex& next = input[(i + 1) % count];
+			const float currentDistance = planeDistance(planes[p], current);
+			const float nextDistance = planeDistance(planes[p], next);
+
+			if (currentDistance >= 0.f) {
+				clipped[clippedCount++] = current;
+			}
+
+			if ((currentDistance >= 0.f) != (nextDistance >= 0.f)) {
+				clipped[clippedCount++] = lerp(current, next, currentDistance / (currentDistance - nextDistance));
+			}
+		}
+
+		std::swap(input, clipped);
+		count = clippedCount;
+
+		if (count < 3) {
+			return 0;
+		}
+	}
+
+	if (input != output.data()) {
+		std::copy(input, input + count, output.begin());
+	}
+
+	return count;
+}
+
+bool SwRenderer::setupTriangle(Triangle& out, const Vertex& v0, const Vertex& v1, const Vertex& v2, const Viewport& viewport, u32 width, u32 height) {
+	const std::array<const Vertex*, 3> vertices = {&v0, &v1, &v2};
+	std::array<s64, 3> x, y;
+	std::array<float, 3> z, invW;
+
+	// Perspective division and viewport transform. Window coordinates are converted to fixed point with 4 fractional bits
+	for (int i = 0; i < 3; i++) {
+		const auto& pos = vertices[i]->position;
+		invW[i] = 1.f / pos[3];
+		z[i] = pos[2] * invW[i];
+
+		const float windowX = viewport.x + (pos[0] * invW[i] + 1.f) * viewport.halfWidth;
+		const float windowY = viewport.y + (pos[1] * invW[i] + 1.f) * viewport.halfHeight;
+		x[i] = std::lround(windowX * 16.f);
+		y[i] = std::lround(windowY * 16.f);
+	}
+
+	s64 area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area == 0) {
+		return false;
+	}
+
+	// Make the triangle counter-clockwise. We don't do face culling, so the winding order doesn't matter otherwise
+	std::array<int, 3> order = {0, 1, 2};
+	if (area < 0) {
+		std::swap(order[1], order[2]);
+		area = -area;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		const int vertex = order[i];
+		const int j = order[(i + 1) % 3];
+		const int k = order[(i + 2) % 3];
+
+		// Edge from vertex j to vertex k, with the inside of the triangle to its left
+		out.a[i] = y[j] - y[k];
+		out.b[i] = x[k] - x[j];
+		out.c[i] = -(out.a[i] * x[j] + out.b[i] * y[j]);
+		// Top-left fill rule: Left edges go down and top edges are horizontal and go left
+		out.bias[i] = (out.a[i] > 0 || (out.a[i] == 0 && out.b[i] < 0)) ? 0 : -1;
+
+		out.z[i] = z[vertex];
+		out.invW[i] = invW[vertex];
+		for (usize attr = 0; attr < Attributes::Count; attr++) {
+			out.attributes[i][attr] = vertices[vertex]->attributes[attr] * invW[vertex];
+		}
+	}
+
+	out.invArea = 1.f / float(area);
+	out.minX = std::max<s32>(0, s32(std::min({x[0], x[1], x[2]}) >> 4));
+	out.minY = std::max<s32>(0, s32(std::min({y[0], y[1], y[2]}) >> 4));
+	out.maxX = std::min<s32>(s32(width) - 1, s32(std::max({x[0], x[1], x[2]}) >> 4));
+	out.maxY = std::min<s32>(s32(height) - 1, s32(std::max({y[0], y[1], y[2]}) >> 4));
+
+	return out.minX <= out.maxX && out.minY <= out.maxY;
+}
+
+static s64 floorDiv(s64 numerator, s64 denominator) {
+	const s64 quotient = numerator / denominator;
+	return (numerator % denominator != 0 && ((numerator < 0) != (denominator < 0))) ? quotient - 1 : quotient;
+}
+
+static s64 ceilDiv(s64 numerator, s64 denominator) { return -floorDiv(-numerator, denominator); }
+
+void SwRenderer::rasterizeTriangle(const Triangle& triangle, const FragmentState& state, s32 minX, s32 minY, s32 maxX, s32 maxY) {
+	minX = std::max(minX, triangle.minX);
+	minY = std::max(minY, triangle.minY);
+	maxX = std::min(maxX, triangle.maxX);
+	maxY = std::min(maxY, triangle.maxY);
+
+	if (minX > maxX || minY > maxY) {
+		return;
+	}
+
+	const auto& t = triangle;
+	AttributeArray attributes;
+	FragmentBatch batch;
+
+	for (s32 y = minY; y <= maxY; y++) {
+		// Sample at pixel centers
+		const s64 sampleX = s64(minX) * 16 + 8;
+		const s64 sampleY = s64(y) * 16 + 8;
+		std::array<s64, 3> edges;
+
+		// Find the span of pixels in this row that are inside all 3 edges, rather than testing every pixel of the bounding box
+		s64 spanStart = 0;
+		s64 spanEnd = maxX - minX;
+
+		for (int i = 0; i < 3; i++) {
+			edges[i] = t.a[i] * sampleX + t.b[i] * sampleY + t.c[i];
+			const s64 value = edges[i] + t.bias[i];
+			const s64 step = t.a[i] * 16;
+
+			if (step > 0) {
+				spanStart = std::max(spanStart, ceilDiv(-value, step));
+			} else if (step < 0) {
+				spanEnd = std::min(spanEnd, floorDiv(value, -step));
+			} else if (value < 0) {
+				spanEnd = -1;
+			}
+		}
+
+		if (spanStart > spanEnd) {
+			continue;
+		}
+
+		for (int i = 0; i < 3; i++) {
+			edges[i] += t.a[i] * 16 * spanStart;
+		}
+
+		u32 batchSize = 0;
+		for (s64 x = minX + spanStart; x <= minX + spanEnd; x++) {
+			const float l0 = float(edges[0]) * t.invArea;
+			const float l1 = float(edges[1]) * t.invArea;
+			const float l2 = float(edges[2]) * t.invArea;
+
+			const float w = 1.f / (l0 * t.invW[0] + l1 * t.invW[1] + l2 * t.invW[2]);
+			for (usize attr = 0; attr < Attributes::Count; attr++) {
+				attributes[attr] = (l0 * t.attributes[0][attr] + l1 * t.attributes[1][attr] + l2 * t.attributes[2][attr]) * w;
+			}
+
+			float depth = (l0 * t.z[0] + l1 * t.z[1] + l2 * t.z[2]) * state.depthScale + state.depthOffset;
+			// Multiply by w if depthmap enable == 0 (ie using W-buffering)
+			if (!state.depthmapEnable) {
+				depth *= w;
+			}
+
+			batch.x[batchSize] = u32(x);
+			batch.depth[batchSize] = std::clamp(depth, 0.f, 1.f);
+			getFragmentSources(state, attributes, batch.sources[batchSize]);
+
+			if (++batchSize == FragmentBatch::maxSize) {
+				processFragments(state, batch, u32(y), batchSize);
+				batchSize = 0;
+			}
+
+			for (int i = 0; i < 3; i++) {
+				edges[i] += t.a[i] * 16;
+			}
+		}
+
+		if (batchSize != 0) {
+			processFragments(state, batch, u32(y), batchSize);
+		}
+	}
+}
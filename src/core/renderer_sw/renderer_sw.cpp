@@ -1,26 +1,585 @@
 #include "renderer_sw/renderer_sw.hpp"
 
-RendererSw::RendererSw(GPU& gpu, const std::array<u32, regNum>& internalRegs, const std::array<u32, extRegNum>& externalRegs)
-	: Renderer(gpu, internalRegs, externalRegs) {}
+#include <glad/gl.h>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "PICA/float_types.hpp"
+#include "PICA/gpu.hpp"
+#include "PICA/pica_hash.hpp"
+#include "PICA/texture_decoder.hpp"
+
+using namespace Floats;
+using namespace Helpers;
+using namespace PICA;
+
+RendererSw::RendererSw(GPU& gpu, const std::array<u32, regNum>& internalRegs, const std::array<u32, extRegNum>& externalRegs, u32 threadCount,
+					   bool fragmentJitEnabled)
+	: Renderer(gpu, internalRegs, externalRegs), fragmentJitEnabled(fragmentJitEnabled) {
+	// With 0 threads, everything gets rasterized on the emulator thread
+	if (threadCount > 0) {
+		threadPool = std::make_unique<ThreadPool>(threadCount);
+	}
+
+	screenImage.resize(screenWidth * screenHeight * 4, 0);
+}
+
 RendererSw::~RendererSw() {}
 
-void RendererSw::reset() { printf("RendererSW: Unimplemented reset call\n"); }
-void RendererSw::display() { printf("RendererSW: Unimplemented display call\n"); }
+void RendererSw::reset() {
+	textureCache.clear();
+	fragmentJIT.reset();
+	std::fill(screenImage.begin(), screenImage.end(), 0);
+}
+
+void RendererSw::initGraphicsContext(SDL_Window* window) {
+	// The SDL frontend creates a GL context for us to present with. Other frontends (eg headless ones) pass nullptr and only read
+	// the output through screenshots
+	presentWithGL = window != nullptr;
+}
+
+void RendererSw::deinitGraphicsContext() {
+	// The GL objects die along with the context, so we just forget about them and recreate them once we get a new one
+	screenTexture = 0;
+	screenFramebuffer = 0;
+	presentWithGL = false;
+	textureCache.clear();
+}
+
+u8* RendererSw::getPointer(u32 paddr, u32 size) {
+	const u64 end = u64(paddr) + size;
+	const bool inFCRAM = paddr >= PhysicalAddrs::FCRAM && end <= PhysicalAddrs::FCRAMEnd;
+	const bool inVRAM = paddr >= PhysicalAddrs::VRAM && end <= PhysicalAddrs::VRAMEnd;
+
+	if (!inFCRAM && !inVRAM) {
+		return nullptr;
+	}
+
+	return gpu.getPointerPhys<u8>(paddr, size);
+}
+
+u8* RendererSw::getWritePointer(u32 paddr, u32 size) {
+	u8* pointer = getPointer(paddr, size);
+	if (pointer != nullptr) {
+		gpu.getMemory().invalidatePhysicalRange(paddr, size);
+	}
+
+	return pointer;
+}
+
+const u32* RendererSw::getTexture(u32 addr, TextureFmt format, u32 width, u32 height) {
+	const u64 size = TextureDecoder::sizeInBytes(format, width, height);
+	const u8* data = getPointer(addr, u32(size));
+	if (data == nullptr) {
+		Helpers::warn("RendererSW: Texture at invalid address %08X", addr);
+		return nullptr;
+	}
+
+	// Width and height are at most 11 bits each, so the key is unique for every address/format/size combination
+	const u64 key = u64(addr) | (u64(format) << 32) | (u64(width) << 36) | (u64(height) << 48);
+	auto& texture = textureCache[key];
+	Memory& mem = gpu.getMemory();
+
+	const bool isNew = texture.texels.empty();
+	if (!isNew && !mem.isPhysicalRangeDirty(addr, u32(size), texture.writeTimestamp)) {
+		return texture.texels.data();
+	}
+
+	texture.writeTimestamp = mem.watchPhysicalRange(addr, u32(size));
+	const u64 hash = PICAHash::computeHash((const char*)data, size);
+
+	if (isNew || texture.hash != hash) {
+		texture.hash = hash;
+		texture.texels.resize(usize(width) * height);
+		TextureDecoder::decodeTexture(format, width, height, std::span(data, size), texture.texels.data());
+	}
+
+	return texture.texels.data();
+}
+
+bool RendererSw::setupFragmentState() {
+	using namespace PICA::InternalRegs;
+	auto& state = fragmentState;
+
+	state.loadRegisters(regs.data());
+	// The registers point the TEV and blending stages to the interpreter. Swap in recompiled ones if we can
+	if (fragmentJitEnabled) {
+		fragmentJIT.prepare(state);
+	}
+	state.lightingLUT = gpu.lightingLUT.data();
+
+	const u32 width = fbSize[0];
+	const u32 height = fbSize[1];
+	if (width == 0 || height == 0) {
+		return false;
+	}
+
+	state.width = width;
+	state.height = height;
+	state.colourFormat = colourBufferFormat;
+	state.depthFormat = depthBufferFormat;
+	state.colourBuffer = getPointer(colourBufferLoc, width * height * sizePerPixel(colourBufferFormat));
+
+	if (state.colourBuffer == nullptr) {
+		Helpers::warn("RendererSW: Colour buffer at invalid address %08X", colourBufferLoc);
+		return false;
+	}
+
+	// Only look up the depth buffer if the draw actually touches it, as games often leave a garbage depth buffer address around otherwise
+	const bool needDepthBuffer = state.depthTestEnable || state.depthWriteEnable || state.stencilEnable;
+	state.depthBuffer = needDepthBuffer ? getPointer(depthBufferLoc, width * height * sizePerPixel(depthBufferFormat)) : nullptr;
+
+	if (textureCache.size() > maxCachedTextures) {
+		textureCache.clear();
+	}
+
+	static constexpr std::array<u32, 3> ioBases = {Tex0BorderColor, Tex1BorderColor, Tex2BorderColor};
+	for (int i = 0; i < 3; i++) {
+		auto& unit = state.textures[i];
+		unit.texels = nullptr;
+
+		if ((state.textureConfig & (1 << i)) == 0) {
+			continue;
+		}
+
+		const u32 ioBase = ioBases[i];
+		const u32 borderColour = regs[ioBase];
+		const u32 dim = regs[ioBase + 1];
+		const u32 config = regs[ioBase + 2];
+		const u32 addr = (regs[ioBase + 4] & 0x0FFFFFFF) << 3;
+		const u32 format = regs[ioBase + (i == 0 ? 13 : 5)] & 0xF;
+
+		unit.height = dim & 0x7ff;
+		unit.width = getBits<16, 11>(dim);
+		unit.linearFilter = getBit<1>(config);
+		unit.wrapT = getBits<8, 3>(config);
+		unit.wrapS = getBits<12, 3>(config);
+		unit.borderColour = {u8(borderColour), u8(borderColour >> 8), u8(borderColour >> 16), u8(borderColour >> 24)};
+
+		// Textures at address 0 and invalid formats read as transparent black
+		if (addr != 0 && unit.width != 0 && unit.height != 0 && format <= u32(TextureFmt::ETC1A4)) {
+			unit.texels = getTexture(addr, static_cast<TextureFmt>(format), unit.width, unit.height);
+		}
+	}
+
+	return true;
+}
+
+static void convertVertex(const PICA::Vertex& input, SwRenderer::Vertex& output) {
+	using namespace SwRenderer;
+	auto& attr = output.attributes;
+
+	for (int i = 0; i < 4; i++) {
+		output.position[i] = input.s.positions[i].toFloat32();
+		attr[Attributes::Colour + i] = std::min(std::abs(input.s.colour[i].toFloat32()), 1.f);
+	}
+
+	for (int i = 0; i < 2; i++) {
+		attr[Attributes::TexCoord0 + i] = input.s.texcoord0[i].toFloat32();
+		attr[Attributes::TexCoord1 + i] = input.s.texcoord1[i].toFloat32();
+		attr[Attributes::TexCoord2 + i] = input.s.texcoord2[i].toFloat32();
+	}
+
+	// Rotate (0, 0, 1) by the quaternion to get the normal, same as the GL vertex shader. It gets normalized per fragment
+	const float qx = input.s.quaternion[0].toFloat32();
+	const float qy = input.s.quaternion[1].toFloat32();
+	const float qz = input.s.quaternion[2].toFloat32();
+	const float qw = input.s.quaternion[3].toFloat32();
+	attr[Attributes::Normal + 0] = 2.f * (qx * qz + qw * qy);
+	attr[Attributes::Normal + 1] = 2.f * (qy * qz - qw * qx);
+	attr[Attributes::Normal + 2] = qw * qw + qz * qz - qx * qx - qy * qy;
+
+	for (int i = 0; i < 3; i++) {
+		attr[Attributes::View + i] = input.s.view[i].toFloat32();
+	}
+}
+
+void RendererSw::drawVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices) {
+	using namespace PICA::InternalRegs;
+	using namespace SwRenderer;
+
+	if (vertices.size() < 3 || !setupFragmentState()) {
+		return;
+	}
+
+	const auto& state = fragmentState;
+	const s32 width = s32(state.width);
+	const s32 height = s32(state.height);
+
+	const u32 viewportXY = regs[ViewportXY];
+	const Viewport viewport = {
+		float(viewportXY & 0x3ff),
+		float((viewportXY >> 16) & 0x3ff),
+		f24::fromRaw(regs[ViewportWidth] & 0xffffff).toFloat32(),
+		f24::fromRaw(regs[ViewportHeight] & 0xffffff).toFloat32(),
+	};
+
+	const bool userClipEnable = (regs[ClipEnable] & 1) != 0;
+	std::array<float, 4> userClipPlane;
+	for (int i = 0; i < 4; i++) {
+		userClipPlane[i] = f24::fromRaw(regs[ClipData0 + i] & 0xffffff).toFloat32();
+	}
+
+	clipVertices.resize(vertices.size());
+	for (usize i = 0; i < vertices.size(); i++) {
+		convertVertex(vertices[i], clipVertices[i]);
+	}
+
+	// Clip every primitive and split the resulting polygons back into triangles
+	triangles.clear();
+	u64 drawArea = 0;
+	std::array<SwRenderer::Vertex, maxClippedVertices> polygon;
+
+	auto addTriangle = [&](const SwRenderer::Vertex& v0, const SwRenderer::Vertex& v1, const SwRenderer::Vertex& v2) {
+		const usize count = clipTriangle(v0, v1, v2, userClipEnable ? &userClipPlane : nullptr, polygon);
+
+		for (usize i = 2; i < count; i++) {
+			Triangle& triangle = triangles.emplace_back();
+			if (!setupTriangle(triangle, polygon[0], polygon[i - 1], polygon[i], viewport, state.width, state.height)) {
+				triangles.pop_back();
+				continue;
+			}
+
+			drawArea += u64(triangle.maxX - triangle.minX + 1) * u64(triangle.maxY - triangle.minY + 1);
+		}
+	};
+
+	const usize count = clipVertices.size();
+	switch (primType) {
+		case PrimType::TriangleStrip:
+			for (usize i = 2; i < count; i++) {
+				addTriangle(clipVertices[i - 2], clipVertices[i - 1], clipVertices[i]);
+			}
+			break;
 
-void RendererSw::initGraphicsContext(SDL_Window* window) { printf("RendererSW: Unimplemented initGraphicsContext call\n"); }
-void RendererSw::clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 control) { printf("RendererSW: Unimplemented clearBuffer call\n"); }
+		case PrimType::TriangleFan:
+			for (usize i = 2; i < count; i++) {
+				addTriangle(clipVertices[0], clipVertices[i - 1], clipVertices[i]);
+			}
+			break;
+
+		// Geometry primitives are drawn as a triangle list, like in the GL renderer
+		default:
+			for (usize i = 2; i < count; i += 3) {
+				addTriangle(clipVertices[i - 2], clipVertices[i - 1], clipVertices[i]);
+			}
+			break;
+	}
+
+	if (triangles.empty()) {
+		return;
+	}
+
+	// Games render to textures, so let the write tracking know we're writing to the buffers, whichever way we end up rasterizing.
+	// The textures this draw samples were already checked against guest memory in setupFragmentState, so this can't affect them
+	Memory& mem = gpu.getMemory();
+	mem.invalidatePhysicalRange(colourBufferLoc, state.width * state.height * sizePerPixel(state.colourFormat));
+	if (state.depthBuffer != nullptr) {
+		mem.invalidatePhysicalRange(depthBufferLoc, state.width * state.height * sizePerPixel(state.depthFormat));
+	}
+
+	// Small draws aren't worth splitting across threads
+	if (!threadPool || drawArea < minParallelDrawArea) {
+		for (const auto& triangle : triangles) {
+			rasterizeTriangle(triangle, state, 0, 0, width - 1, height - 1);
+		}
+		return;
+	}
+
+	// Bin the triangles into tiles. Each tile is only ever touched by 1 thread, so we don't need any synchronization between them
+	const s32 tilesX = (width + tileSize - 1) / tileSize;
+	const s32 tilesY = (height + tileSize - 1) / tileSize;
+	if (tileBins.size() < usize(tilesX * tilesY)) {
+		tileBins.resize(tilesX * tilesY);
+	}
+
+	activeTiles.clear();
+	for (u32 i = 0; i < triangles.size(); i++) {
+		const auto& triangle = triangles[i];
+
+		for (s32 tileY = triangle.minY / tileSize; tileY <= triangle.maxY / tileSize; tileY++) {
+			for (s32 tileX = triangle.minX / tileSize; tileX <= triangle.maxX / tileSize; tileX++) {
+				const u32 tile = u32(tileY * tilesX + tileX);
+				auto& bin = tileBins[tile];
+
+				if (bin.empty()) {
+					activeTiles.push_back(tile);
+				}
+				bin.push_back(i);
+			}
+		}
+	}
+
+	threadPool->parallelFor(u32(activeTiles.size()), [&](u32 job) {
+		const u32 tile = activeTiles[job];
+		const s32 minX = s32(tile % tilesX) * tileSize;
+		const s32 minY = s32(tile / tilesX) * tileSize;
+		const s32 maxX = std::min(minX + tileSize, width) - 1;
+		const s32 maxY = std::min(minY + tileSize, height) - 1;
+
+		for (u32 index : tileBins[tile]) {
+			rasterizeTriangle(triangles[index], state, minX, minY, maxX, maxY);
+		}
+	});
+
+	for (u32 tile : activeTiles) {
+		tileBins[tile].clear();
+	}
+}
+
+void RendererSw::clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 control) {
+	if (endAddress <= startAddress) {
+		return;
+	}
+
+	const u32 size = endAddress - startAddress;
+	u8* buffer = getWritePointer(startAddress, size);
+	if (buffer == nullptr) {
+		Helpers::warn("RendererSW: Clearing invalid memory range %08X-%08X", startAddress, endAddress);
+		return;
+	}
+
+	// Bit 8 of the control value selects 24-bit fills and bit 9 32-bit fills. Otherwise the fill value is 16 bits
+	if (getBit<8>(control)) {
+		const u8 bytes[3] = {u8(value), u8(value >> 8), u8(value >> 16)};
+		for (u32 i = 0; i + 3 <= size; i += 3) {
+			std::memcpy(&buffer[i], bytes, sizeof(bytes));
+		}
+	} else if (getBit<9>(control)) {
+		for (u32 i = 0; i + 4 <= size; i += 4) {
+			std::memcpy(&buffer[i], &value, sizeof(u32));
+		}
+	} else {
+		const u16 value16 = u16(value);
+		for (u32 i = 0; i + 2 <= size; i += 2) {
+			std::memcpy(&buffer[i], &value16, sizeof(u16));
+		}
+	}
+}
+
+// Display transfer formats use the same values as colour buffer formats, but they're 3 bits wide so games can pass invalid ones
+static bool isValidTransferFormat(u32 format) { return format <= u32(ColorFmt::RGBA4); }
 
 void RendererSw::displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) {
-	printf("RendererSW: Unimplemented displayTransfer call\n");
+	const u32 inputWidth = inputSize & 0xffff;
+	const u32 inputHeight = inputSize >> 16;
+	const u32 inputFormatRaw = getBits<8, 3>(flags);
+	const u32 outputFormatRaw = getBits<12, 3>(flags);
+
+	if (!isValidTransferFormat(inputFormatRaw) || !isValidTransferFormat(outputFormatRaw)) {
+		Helpers::warn("RendererSW: Display transfer with invalid formats (input: %d, output: %d)", inputFormatRaw, outputFormatRaw);
+		return;
+	}
+
+	const auto inputFormat = static_cast<ColorFmt>(inputFormatRaw);
+	const auto outputFormat = static_cast<ColorFmt>(outputFormatRaw);
+	const bool flipVertically = getBit<0>(flags);
+	const bool inputLinear = getBit<1>(flags);
+	const bool dontSwizzle = getBit<5>(flags);
+	const u32 scaling = getBits<24, 2>(flags);
+
+	if (scaling == 3) {
+		Helpers::warn("RendererSW: Display transfer with invalid scaling mode");
+		return;
+	}
+
+	// Scaling mode 1 halves the width, and mode 2 halves both the width and the height
+	const u32 horizontalScale = scaling != 0 ? 1 : 0;
+	const u32 verticalScale = scaling == 2 ? 1 : 0;
+	const u32 outputWidth = (outputSize & 0xffff) >> horizontalScale;
+	const u32 outputHeight = (outputSize >> 16) >> verticalScale;
+
+	const u32 inputBpp = u32(sizePerPixel(inputFormat));
+	const u32 outputBpp = u32(sizePerPixel(outputFormat));
+	const u8* input = getPointer(inputAddr, inputWidth * inputHeight * inputBpp);
+	u8* output = getWritePointer(outputAddr, outputWidth * outputHeight * outputBpp);
+
+	if (input == nullptr || output == nullptr) {
+		Helpers::warn("RendererSW: Display transfer with invalid addresses (input: %08X, output: %08X)", inputAddr, outputAddr);
+		return;
+	}
+
+	// The input height can be smaller than the output height, in which case we only copy what's there
+	const u32 copyHeight = std::min(outputHeight, inputHeight >> verticalScale);
+	const u32 copyWidth = std::min(outputWidth, inputWidth >> horizontalScale);
+
+	for (u32 y = 0; y < copyHeight; y++) {
+		for (u32 x = 0; x < copyWidth; x++) {
+			const u32 inputX = x << horizontalScale;
+			const u32 inputY = y << verticalScale;
+			const u32 outputY = flipVertically ? (outputHeight - y - 1) : y;
+			u32 inputOffset, outputOffset;
+
+			if (inputLinear) {
+				inputOffset = inputX + inputY * inputWidth;
+				// Linear to tiled, or linear to linear if the dont swizzle flag is set
+				outputOffset = dontSwizzle ? (x + outputY * outputWidth) : SwRenderer::getTiledPixelOffset(x, outputY, outputWidth);
+			} else {
+				inputOffset = SwRenderer::getTiledPixelOffset(inputX, inputY, inputWidth);
+				// Tiled to linear, or tiled to tiled if the dont swizzle flag is set
+				outputOffset = dontSwizzle ? SwRenderer::getTiledPixelOffset(x, outputY, outputWidth) : (x + outputY * outputWidth);
+			}
+
+			const u8* inputPixel = input + inputOffset * inputBpp;
+			auto colour = SwRenderer::decodeColour(inputFormat, inputPixel);
+
+			// Downscaling averages neighbouring pixels, which are adjacent in memory thanks to the Morton order of tiled buffers
+			if (scaling != 0) {
+				const u32 sampleCount = scaling == 2 ? 4 : 2;
+				std::array<u32, 4> sum = {colour[0], colour[1], colour[2], colour[3]};
+
+				for (u32 i = 1; i < sampleCount; i++) {
+					const auto sample = SwRenderer::decodeColour(inputFormat, inputPixel + i * inputBpp);
+					for (int c = 0; c < 4; c++) {
+						sum[c] += sample[c];
+					}
+				}
+
+				for (int c = 0; c < 4; c++) {
+					colour[c] = u8(sum[c] / sampleCount);
+				}
+			}
+
+			SwRenderer::encodeColour(outputFormat, output + outputOffset * outputBpp, colour);
+		}
+	}
 }
 
 void RendererSw::textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32 inputSize, u32 outputSize, u32 flags) {
-	printf("RendererSW: Unimplemented textureCopy call\n");
+	// Texture copy size is aligned to 16 byte units
+	u32 remainingSize = totalBytes & ~0xf;
+	if (remainingSize == 0) {
+		printf("TextureCopy total bytes less than 16!\n");
+		return;
+	}
+
+	// The width and gap are provided in 16-byte units. A gap of 0 means that the data is contiguous, whatever the width is
+	const u32 inputGap = (inputSize >> 16) << 4;
+	const u32 outputGap = (outputSize >> 16) << 4;
+	const u32 inputWidth = inputGap == 0 ? remainingSize : (inputSize & 0xffff) << 4;
+	const u32 outputWidth = outputGap == 0 ? remainingSize : (outputSize & 0xffff) << 4;
+
+	if (inputWidth == 0 || outputWidth == 0) {
+		Helpers::warn("RendererSW: Texture copy with a width of 0");
+		return;
+	}
+
+	// Total size of the input and output including the gaps, rounded up to a whole line
+	const u64 inputLines = (remainingSize + inputWidth - 1) / inputWidth;
+	const u64 outputLines = (remainingSize + outputWidth - 1) / outputWidth;
+	const u64 inputTotal = inputLines * (inputWidth + inputGap);
+	const u64 outputTotal = outputLines * (outputWidth + outputGap);
+
+	const u8* input = inputTotal <= 0xffffffff ? getPointer(inputAddr, u32(inputTotal)) : nullptr;
+	u8* output = outputTotal <= 0xffffffff ? getWritePointer(outputAddr, u32(outputTotal)) : nullptr;
+
+	if (input == nullptr || output == nullptr) {
+		Helpers::warn("RendererSW: Texture copy with invalid addresses (input: %08X, output: %08X)", inputAddr, outputAddr);
+		return;
+	}
+
+	u32 remainingInput = inputWidth;
+	u32 remainingOutput = outputWidth;
+
+	while (remainingSize > 0) {
+		const u32 copySize = std::min({remainingInput, remainingOutput, remainingSize});
+		std::memmove(output, input, copySize);
+
+		input += copySize;
+		output += copySize;
+		remainingInput -= copySize;
+		remainingOutput -= copySize;
+		remainingSize -= copySize;
+
+		if (remainingInput == 0) {
+			remainingInput = inputWidth;
+			input += inputGap;
+		}
+
+		if (remainingOutput == 0) {
+			remainingOutput = outputWidth;
+			output += outputGap;
+		}
+	}
 }
 
-void RendererSw::drawVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices) {
-	printf("RendererSW: Unimplemented drawVertices call\n");
+void RendererSw::composeScreen(u32 addr, u32 config, u32 stride, u32 screenX, u32 screenY, u32 width) {
+	static constexpr u32 height = 240;
+	u32 format = config & 7;
+
+	if (!isValidTransferFormat(format)) {
+		Helpers::warn("RendererSW: Invalid LCD framebuffer format %d", format);
+		format = u32(ColorFmt::RGBA8);
+	}
+
+	const auto colourFormat = static_cast<ColorFmt>(format);
+	const u32 bpp = u32(sizePerPixel(colourFormat));
+	// Framebuffers that don't fit in memory just show up as black
+	const u8* framebuffer = stride != 0 ? getPointer(addr, stride * (width - 1) + height * bpp) : nullptr;
+
+	// LCD framebuffers are rotated by 90 degrees: Every line in memory is a column of the screen, starting from the bottom
+	for (u32 x = 0; x < width; x++) {
+		for (u32 y = 0; y < height; y++) {
+			u8* pixel = &screenImage[((screenY + y) * screenWidth + screenX + x) * 4];
+
+			if (framebuffer == nullptr) {
+				pixel[0] = pixel[1] = pixel[2] = 0;
+			} else {
+				const auto colour = SwRenderer::decodeColour(colourFormat, framebuffer + x * stride + (height - 1 - y) * bpp);
+				pixel[0] = colour[0];
+				pixel[1] = colour[1];
+				pixel[2] = colour[2];
+			}
+
+			pixel[3] = 255;
+		}
+	}
+}
+
+void RendererSw::display() {
+	using namespace PICA::ExternalRegs;
+
+	const u32 topActiveFb = externalRegs[Framebuffer0Select] & 1;
+	const u32 topScreenAddr = externalRegs[topActiveFb == 0 ? Framebuffer0AFirstAddr : Framebuffer0ASecondAddr];
+	composeScreen(topScreenAddr, externalRegs[Framebuffer0Config], externalRegs[Framebuffer0Stride], 0, 0, 400);
+
+	const u32 bottomActiveFb = externalRegs[Framebuffer1Select] & 1;
+	const u32 bottomScreenAddr = externalRegs[bottomActiveFb == 0 ? Framebuffer1AFirstAddr : Framebuffer1ASecondAddr];
+	composeScreen(bottomScreenAddr, externalRegs[Framebuffer1Config], externalRegs[Framebuffer1Stride], 40, 240, 320);
+
+	if (presentWithGL) {
+		presentScreen();
+	}
 }
 
-void RendererSw::screenshot(const std::string& name) { printf("RendererSW: Unimplemented screenshot call\n"); }
-void RendererSw::deinitGraphicsContext() { printf("RendererSW: Unimplemented DeinitGraphicsContext call\n"); }
\ No newline at end of file
+void RendererSw::presentScreen() {
+	if (screenTexture == 0) {
+		glGenTextures(1, &screenTexture);
+		glBindTexture(GL_TEXTURE_2D, screenTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, screenWidth, screenHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		glGenFramebuffers(1, &screenFramebuffer);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, screenFramebuffer);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screenTexture, 0);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, screenTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, screenWidth, screenHeight, GL_RGBA, GL_UNSIGNED_BYTE, screenImage.data());
+
+	// The screen image is stored top row first while GL wants the bottom row first, so flip it while blitting
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, screenFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, screenWidth, screenHeight, 0, outputWindowHeight, outputWindowWidth, 0, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+}
+
+void RendererSw::screenshot(const std::string& name) {
+	if (stbi_write_png(name.c_str(), screenWidth, screenHeight, 4, screenImage.data(), 0) == 0) {
+		Helpers::warn("RendererSW: Failed to write screenshot to %s", name.c_str());
+	}
+}
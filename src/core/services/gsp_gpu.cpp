@@ -2,6 +2,7 @@
 #include "PICA/regs.hpp"
 #include "ipc.hpp"
 #include "kernel.hpp"
+#include "scheduler.hpp"
 
 // Commands used with SendSyncRequest targetted to the GSP::GPU service
 namespace ServiceCommands {
@@ -42,6 +43,7 @@ void GPUService::reset() {
 	interruptEvent = std::nullopt;
 	gspThreadCount = 0;
 	sharedMem = nullptr;
+	pendingInterrupts.clear();
 }
 
 void GPUService::handleSyncRequest(u32 messagePointer) {
@@ -157,6 +159,41 @@ void GPUService::requestInterrupt(GPUInterrupt type) {
 	}
 }
 
+void GPUService::runCommand(const GPUThread::Command& command, GPUInterrupt type) {
+	const u64 sequence = gpu.submitCommand(command);
+
+	// Commands that already ran get their interrupt right away, unless there's interrupts from earlier commands that need to go first
+	if (sequence == 0 && pendingInterrupts.empty()) {
+		requestInterrupt(type);
+		return;
+	}
+
+	Scheduler& scheduler = kernel.getScheduler();
+	const u64 timestamp = scheduler.currentTimestamp + commandLatency;
+	if (pendingInterrupts.empty()) {
+		scheduler.addEvent(Scheduler::EventType::GSPInterrupts, timestamp);
+	}
+
+	pendingInterrupts.push_back(PendingInterrupt{.sequence = sequence, .timestamp = timestamp, .type = type});
+}
+
+void GPUService::sendPendingInterrupts() {
+	Scheduler& scheduler = kernel.getScheduler();
+
+	while (!pendingInterrupts.empty() && pendingInterrupts.front().timestamp <= scheduler.currentTimestamp) {
+		const PendingInterrupt interrupt = pendingInterrupts.front();
+		pendingInterrupts.pop_front();
+
+		// Games can look at the results of the command as soon as they get the interrupt
+		gpu.waitForCommand(interrupt.sequence);
+		requestInterrupt(interrupt.type);
+	}
+
+	if (!pendingInterrupts.empty()) {
+		scheduler.addEvent(Scheduler::EventType::GSPInterrupts, pendingInterrupts.front().timestamp);
+	}
+}
+
 void GPUService::readHwRegs(u32 messagePointer) {
 	u32 ioAddr = mem.read32(messagePointer + 4);      // GPU address based at 0x1EB00000, word aligned
 	const u32 size = mem.read32(messagePointer + 8);  // Size in bytes
@@ -179,6 +216,9 @@ void GPUService::readHwRegs(u32 messagePointer) {
 	}
 
 	ioAddr += 0x1EB00000;
+	// The registers need to be up to date with every command we've sent to the GPU thread
+	gpu.syncThread();
+
 	// Read the PICA registers and write them to the output buffer
 	for (u32 i = 0; i < size; i += 4) {
 		const u32 value = gpu.readReg(ioAddr);
@@ -216,7 +256,8 @@ void GPUService::writeHwRegs(u32 messagePointer) {
 	ioAddr += 0x1EB00000;
 	for (u32 i = 0; i < size; i += 4) {
 		const u32 value = mem.read32(dataPointer);
-		gpu.writeReg(ioAddr, value);
+		// Register writes can kick off draws and such, so they go through the GPU thread like GX commands
+		gpu.submitCommand(GPUThread::Command{.type = GPUThread::CommandType::WriteReg, .args = {ioAddr, value, 0xffffffff}});
 		dataPointer += 4;
 		ioAddr += 4;
 	}
@@ -252,13 +293,11 @@ void GPUService::writeHwRegsWithMask(u32 messagePointer) {
 
 	ioAddr += 0x1EB00000;
 	for (u32 i = 0; i < size; i += 4) {
-		const u32 current = gpu.readReg(ioAddr);
 		const u32 data = mem.read32(dataPointer);
 		const u32 mask = mem.read32(maskPointer);
 
-		u32 newValue = (current & ~mask) | (data & mask);
-
-		gpu.writeReg(ioAddr, newValue);
+		// The GPU does the read-modify-write, as the register can still change on the GPU thread
+		gpu.submitCommand(GPUThread::Command{.type = GPUThread::CommandType::WriteReg, .args = {ioAddr, data, mask}});
 		maskPointer += 4;
 		dataPointer += 4;
 		ioAddr += 4;
@@ -407,14 +446,13 @@ void GPUService::memoryFill(u32* cmd) {
 	u32 end1 = cmd[6];
 	u32 control1 = control >> 16;
 
+	using enum GPUThread::CommandType;
 	if (start0 != 0) {
-		gpu.clearBuffer(VaddrToPaddr(start0), VaddrToPaddr(end0), value0, control0);
-		requestInterrupt(GPUInterrupt::PSC0);
+		runCommand({.type = MemoryFill, .args = {VaddrToPaddr(start0), VaddrToPaddr(end0), value0, control0}}, GPUInterrupt::PSC0);
 	}
 
 	if (start1 != 0) {
-		gpu.clearBuffer(VaddrToPaddr(start1), VaddrToPaddr(end1), value1, control1);
-		requestInterrupt(GPUInterrupt::PSC1);
+		runCommand({.type = MemoryFill, .args = {VaddrToPaddr(start1), VaddrToPaddr(end1), value1, control1}}, GPUInterrupt::PSC1);
 	}
 }
 
@@ -426,8 +464,10 @@ void GPUService::triggerDisplayTransfer(u32* cmd) {
 	const u32 flags = cmd[5];
 
 	log("GSP::GPU::TriggerDisplayTransfer (Stubbed)\n");
-	gpu.displayTransfer(inputAddr, outputAddr, inputSize, outputSize, flags);
-	requestInterrupt(GPUInterrupt::PPF); // Send "Display transfer finished" interrupt
+	// Send "Display transfer finished" interrupt once it's done
+	runCommand(
+		{.type = GPUThread::CommandType::DisplayTransfer, .args = {inputAddr, outputAddr, inputSize, outputSize, flags}}, GPUInterrupt::PPF
+	);
 }
 
 void GPUService::triggerDMARequest(u32* cmd) {
@@ -437,8 +477,7 @@ void GPUService::triggerDMARequest(u32* cmd) {
 	const bool flush = cmd[7] == 1;
 
 	log("GSP::GPU::TriggerDMARequest (source = %08X, dest = %08X, size = %08X)\n", source, dest, size);
-	gpu.fireDMA(dest, source, size);
-	requestInterrupt(GPUInterrupt::DMA);
+	runCommand({.type = GPUThread::CommandType::DMA, .args = {dest, source, size}}, GPUInterrupt::DMA);
 }
 
 void GPUService::flushCacheRegions(u32* cmd) {
@@ -488,8 +527,8 @@ void GPUService::processCommandList(u32* cmd) {
 	[[maybe_unused]] const bool flushBuffer = cmd[7] == 1; // Flush buffer (0 = don't flush, 1 = flush)
 
 	log("GPU::GSP::processCommandList. Address: %08X, size in bytes: %08X\n", address, size);
-	gpu.startCommandList(address, size);
-	requestInterrupt(GPUInterrupt::P3D); // Send an IRQ when command list processing is over
+	// Send an IRQ when command list processing is over
+	runCommand({.type = GPUThread::CommandType::CommandList, .args = {address, size}}, GPUInterrupt::P3D);
 }
 
 // TODO: Emulate the transfer engine & its registers
@@ -503,10 +542,12 @@ void GPUService::triggerTextureCopy(u32* cmd) {
 	const u32 flags = cmd[6];
 
 	log("GSP::GPU::TriggerTextureCopy (Stubbed)\n");
-	gpu.textureCopy(inputAddr, outputAddr, totalBytes, inputSize, outputSize, flags);
 	// This uses the transfer engine and thus needs to fire a PPF interrupt.
 	// NSMB2 relies on this
-	requestInterrupt(GPUInterrupt::PPF);
+	runCommand(
+		{.type = GPUThread::CommandType::TextureCopy, .args = {inputAddr, outputAddr, totalBytes, inputSize, outputSize, flags}},
+		GPUInterrupt::PPF
+	);
 }
 
 // Used when transitioning from the app to an OS applet, such as software keyboard, mii maker, mii selector, etc
@@ -4,8 +4,12 @@
 #include <SDL_filesystem.h>
 #endif
 
+#include <cstdio>
+#include <ctime>
 #include <fstream>
 
+#include "profiler.hpp"
+
 #ifdef _WIN32
 #include <windows.h>
 
@@ -16,14 +20,22 @@ __declspec(dllexport) DWORD AmdPowerXpressRequestHighPerformance = 1;
 }
 #endif
 
-Emulator::Emulator()
-	: config(getConfigPath()), kernel(cpu, memory, gpu, config), cpu(memory, kernel, *this), gpu(memory, config), memory(cpu.getTicksRef(), config),
+Emulator::Emulator() : Emulator(EmulatorConfig(getConfigPath())) {}
+
+Emulator::Emulator(const EmulatorConfig& initialConfig)
+	: config(initialConfig), kernel(cpu, memory, gpu, config), cpu(memory, kernel, *this), gpu(memory, config), memory(cpu.getTicksRef(), config),
 	  cheats(memory, kernel.getServiceManager().getHID()), lua(*this), running(false)
 #ifdef PANDA3DS_ENABLE_HTTP_SERVER
 	  ,
 	  httpServer(this)
 #endif
 {
+	// The GPU thread hands memory watches over to the CPU thread, which could be running guest code or waiting on the GPU thread
+	memory.setWatchRequestCallback([this]() {
+		cpu.requestHalt();
+		gpu.wakeThreadWaits();
+	});
+
 	DSPService& dspService = kernel.getServiceManager().getDSP();
 
 	dsp = Audio::makeDSPCore(config.dspType, memory, scheduler, dspService);
@@ -42,7 +54,9 @@ Emulator::Emulator()
 }
 
 Emulator::~Emulator() {
-	config.save();
+	if (!config.filePath.empty()) {
+		config.save();
+	}
 	lua.close();
 
 #ifdef PANDA3DS_ENABLE_DISCORD_RPC
@@ -122,7 +136,12 @@ void Emulator::togglePause() { running ? pause() : resume(); }
 
 void Emulator::runFrame() {
 	if (running) {
-		cpu.runFrame(); // Run 1 frame of instructions
+		gpu.beginFrame();
+		{
+			PROFILE_SCOPE(CPU);
+			cpu.runFrame(); // Run 1 frame of instructions
+		}
+		gpu.endFrame();
 		gpu.display();  // Display graphics
 
 		// Run cheats if any are loaded
@@ -136,6 +155,14 @@ void Emulator::runFrame() {
 	}
 }
 
+void Emulator::startGPUTrace(u32 frameCount) {
+	const std::time_t now = std::time(nullptr);
+	char name[64];
+	std::strftime(name, sizeof(name), "%Y-%m-%d_%H-%M-%S.pica", std::localtime(&now));
+
+	gpu.startTrace(getAppDataRoot() / "GPUTraces" / name, frameCount);
+}
+
 void Emulator::pollScheduler() {
 	auto& events = scheduler.events;
 
@@ -164,7 +191,9 @@ void Emulator::pollScheduler() {
 			}
 
 			case Scheduler::EventType::UpdateTimers: kernel.pollTimers(); break;
+			case Scheduler::EventType::GSPInterrupts: kernel.getServiceManager().sendPendingGPUInterrupts(); break;
 			case Scheduler::EventType::RunDSP: {
+				PROFILE_SCOPE(DSP);
 				dsp->runAudioFrame();
 				break;
 			}
@@ -240,6 +269,16 @@ bool Emulator::loadROM(const std::filesystem::path& path) {
 		success = false;
 	}
 
+	// Compiled host shaders get cached per title, keyed by the program ID. Homebrew without one doesn't get a cache
+	const auto programID = memory.getProgramID();
+	if (success && config.shaderCacheEnabled && programID.has_value()) {
+		char filename[32];
+		std::snprintf(filename, sizeof(filename), "%016llX.bin", (unsigned long long)programID.value());
+		gpu.setShaderCachePath(appDataPath / "ShaderCache" / filename);
+	} else {
+		gpu.setShaderCachePath(std::nullopt);
+	}
+
 	if (success) {
 		romPath = path;
 #ifdef PANDA3DS_ENABLE_DISCORD_RPC
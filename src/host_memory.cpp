@@ -0,0 +1,348 @@
+#include "host_memory.hpp"
+
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <iterator>
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <string>
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+HostMemory::HostMemory(usize backingSize, bool enableFastmem) : backingSize(backingSize) {
+	// Only bother with a shared memory object if we're going to map it into an arena
+	if (enableFastmem && createBacking()) {
+		sharedBacking = true;
+
+		if (!reserveArena()) {
+			Helpers::warn("Fastmem: Failed to reserve host address space, falling back to page table accesses");
+		}
+	} else {
+		if (enableFastmem) {
+			Helpers::warn("Fastmem: Failed to create shared memory backing, falling back to page table accesses");
+		}
+
+		backingBase = new u8[backingSize]();
+	}
+}
+
+HostMemory::~HostMemory() {
+	freeArena();
+
+	if (!sharedBacking) {
+		delete[] backingBase;
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(backingBase);
+	CloseHandle(mappingHandle);
+#else
+	munmap(backingBase, backingSize);
+	close(fd);
+#endif
+}
+
+#ifdef _WIN32
+bool HostMemory::createBacking() {
+	const u64 size = backingSize;
+	mappingHandle = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size), nullptr);
+	if (mappingHandle == nullptr) {
+		return false;
+	}
+
+	backingBase = static_cast<u8*>(MapViewOfFile(mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, backingSize));
+	if (backingBase == nullptr) {
+		CloseHandle(mappingHandle);
+		mappingHandle = nullptr;
+		return false;
+	}
+
+	// Fresh file mappings are zero-filled, same as the FCRAM we'd get from new u8[]()
+	return true;
+}
+
+// Placeholders need Windows 10 1803 or newer, so load the functions at runtime and fall back to the page table if they're missing
+#ifndef MEM_RESERVE_PLACEHOLDER
+#define MEM_RESERVE_PLACEHOLDER 0x00040000
+#endif
+#ifndef MEM_REPLACE_PLACEHOLDER
+#define MEM_REPLACE_PLACEHOLDER 0x00004000
+#endif
+#ifndef MEM_PRESERVE_PLACEHOLDER
+#define MEM_PRESERVE_PLACEHOLDER 0x00000002
+#endif
+#ifndef MEM_COALESCE_PLACEHOLDERS
+#define MEM_COALESCE_PLACEHOLDERS 0x00000001
+#endif
+
+namespace {
+	using VirtualAlloc2Function = PVOID(WINAPI*)(HANDLE, PVOID, SIZE_T, ULONG, ULONG, void*, ULONG);
+	using MapViewOfFile3Function = PVOID(WINAPI*)(HANDLE, HANDLE, PVOID, ULONG64, SIZE_T, ULONG, ULONG, void*, ULONG);
+	using UnmapViewOfFile2Function = BOOL(WINAPI*)(HANDLE, PVOID, ULONG);
+
+	VirtualAlloc2Function virtualAlloc2 = nullptr;
+	MapViewOfFile3Function mapViewOfFile3 = nullptr;
+	UnmapViewOfFile2Function unmapViewOfFile2 = nullptr;
+
+	bool loadPlaceholderFunctions() {
+		HMODULE kernelBase = GetModuleHandleW(L"kernelbase.dll");
+		if (kernelBase == nullptr) {
+			kernelBase = LoadLibraryW(L"kernelbase.dll");
+		}
+
+		if (kernelBase == nullptr) {
+			return false;
+		}
+
+		virtualAlloc2 = reinterpret_cast<VirtualAlloc2Function>(GetProcAddress(kernelBase, "VirtualAlloc2"));
+		mapViewOfFile3 = reinterpret_cast<MapViewOfFile3Function>(GetProcAddress(kernelBase, "MapViewOfFile3"));
+		unmapViewOfFile2 = reinterpret_cast<UnmapViewOfFile2Function>(GetProcAddress(kernelBase, "UnmapViewOfFile2"));
+		return virtualAlloc2 != nullptr && mapViewOfFile3 != nullptr && unmapViewOfFile2 != nullptr;
+	}
+}  // namespace
+
+bool HostMemory::reserveArena() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+
+	if (info.dwPageSize != 4096 || !loadPlaceholderFunctions()) {
+		return false;
+	}
+
+	void* pointer = virtualAlloc2(GetCurrentProcess(), nullptr, arenaSize, MEM_RESERVE | MEM_RESERVE_PLACEHOLDER, PAGE_NOACCESS, nullptr, 0);
+	if (pointer == nullptr) {
+		return false;
+	}
+
+	arenaBase = static_cast<u8*>(pointer);
+	placeholders[0] = arenaSize;
+	return true;
+}
+
+void HostMemory::freeArena() {
+	if (arenaBase == nullptr) {
+		return;
+	}
+
+	unmapAll();
+	for (const auto& [start, end] : placeholders) {
+		VirtualFree(arenaBase + start, 0, MEM_RELEASE);
+	}
+
+	placeholders.clear();
+	arenaBase = nullptr;
+}
+
+// If a placeholder straddles "address", split it in 2 so that a placeholder starts there
+void HostMemory::splitPlaceholder(u64 address) {
+	auto it = placeholders.upper_bound(address);
+	if (it == placeholders.begin()) {
+		return;
+	}
+
+	--it;
+	const u64 start = it->first;
+	const u64 end = it->second;
+
+	if (start < address && address < end) {
+		if (!VirtualFree(arenaBase + start, address - start, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER)) {
+			Helpers::panic("Fastmem: Failed to split placeholder at %08X", u32(address));
+		}
+
+		it->second = address;
+		placeholders[address] = end;
+	}
+}
+
+// Map a view of the backing over [start, end), which must not have any views in it
+void HostMemory::mapView(u64 start, u64 end, u64 offset, bool writable) {
+	// Turn the range into exactly one placeholder, so the view can replace it
+	splitPlaceholder(start);
+	splitPlaceholder(end);
+
+	auto first = placeholders.find(start);
+	if (first->second != end) {
+		if (!VirtualFree(arenaBase + start, end - start, MEM_RELEASE | MEM_COALESCE_PLACEHOLDERS)) {
+			Helpers::panic("Fastmem: Failed to coalesce placeholders at %08X", u32(start));
+		}
+
+		placeholders.erase(first, placeholders.lower_bound(end));
+	} else {
+		placeholders.erase(first);
+	}
+
+	void* result = mapViewOfFile3(
+		mappingHandle, GetCurrentProcess(), arenaBase + start, offset, end - start, MEM_REPLACE_PLACEHOLDER, writable ? PAGE_READWRITE : PAGE_READONLY,
+		nullptr, 0
+	);
+
+	if (result == nullptr) {
+		Helpers::panic("Fastmem: Failed to map %08X bytes at vaddr %08X", u32(end - start), u32(start));
+	}
+
+	views[start] = View{.end = end, .offset = offset, .writable = writable};
+}
+
+// Turn [start, end) back into placeholders. Views that only partially overlap the range are unmapped whole and the parts outside it get remapped
+void HostMemory::unmapRange(u64 start, u64 end) {
+	auto it = views.upper_bound(start);
+	if (it != views.begin() && std::prev(it)->second.end > start) {
+		--it;
+	}
+
+	std::vector<std::pair<u64, View>> remaps;
+	while (it != views.end() && it->first < end) {
+		const u64 viewStart = it->first;
+		const View view = it->second;
+
+		if (!unmapViewOfFile2(GetCurrentProcess(), arenaBase + viewStart, MEM_PRESERVE_PLACEHOLDER)) {
+			Helpers::panic("Fastmem: Failed to unmap view at vaddr %08X", u32(viewStart));
+		}
+
+		placeholders[viewStart] = view.end;
+		if (viewStart < start) {
+			remaps.push_back({viewStart, View{.end = start, .offset = view.offset, .writable = view.writable}});
+		}
+
+		if (view.end > end) {
+			remaps.push_back({end, View{.end = view.end, .offset = view.offset + (end - viewStart), .writable = view.writable}});
+		}
+
+		it = views.erase(it);
+	}
+
+	for (const auto& [remapStart, view] : remaps) {
+		mapView(remapStart, view.end, view.offset, view.writable);
+	}
+}
+
+void HostMemory::map(u32 vaddr, usize offset, usize size, bool readable, bool writable) {
+	if (arenaBase == nullptr || size == 0) {
+		return;
+	}
+
+	unmapRange(vaddr, u64(vaddr) + size);
+	// Windows has no write-only pages, so those are mapped read-write, same as PROT_WRITE on most POSIX hosts
+	if (readable || writable) {
+		mapView(vaddr, u64(vaddr) + size, offset, writable);
+	}
+}
+
+void HostMemory::unmap(u32 vaddr, usize size) {
+	if (arenaBase == nullptr || size == 0) {
+		return;
+	}
+
+	unmapRange(vaddr, u64(vaddr) + size);
+}
+
+void HostMemory::unmapAll() {
+	if (arenaBase != nullptr) {
+		unmapRange(0, arenaSize);
+	}
+}
+
+#else
+bool HostMemory::createBacking() {
+#if defined(__linux__) && defined(SYS_memfd_create)
+	fd = int(syscall(SYS_memfd_create, "Panda3DS-FCRAM", 0));
+#else
+	// No memfd, so create a POSIX shared memory object and immediately unlink it so it goes away with us
+	const std::string name = "/panda3ds-" + std::to_string(getpid());
+	fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd != -1) {
+		shm_unlink(name.c_str());
+	}
+#endif
+
+	if (fd == -1) {
+		return false;
+	}
+
+	if (ftruncate(fd, off_t(backingSize)) != 0) {
+		close(fd);
+		fd = -1;
+		return false;
+	}
+
+	void* pointer = mmap(nullptr, backingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (pointer == MAP_FAILED) {
+		close(fd);
+		fd = -1;
+		return false;
+	}
+
+	backingBase = static_cast<u8*>(pointer);
+	return true;
+}
+
+bool HostMemory::reserveArena() {
+	// Our arena mirrors the guest page table at a 4KB granularity, which we can't do with bigger host pages (eg Apple Silicon)
+	if (sysconf(_SC_PAGESIZE) != 4096) {
+		return false;
+	}
+
+	void* pointer = mmap(nullptr, arenaSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (pointer == MAP_FAILED) {
+		return false;
+	}
+
+	arenaBase = static_cast<u8*>(pointer);
+	return true;
+}
+
+void HostMemory::freeArena() {
+	if (arenaBase != nullptr) {
+		munmap(arenaBase, arenaSize);
+		arenaBase = nullptr;
+	}
+}
+
+void HostMemory::map(u32 vaddr, usize offset, usize size, bool readable, bool writable) {
+	if (arenaBase == nullptr || size == 0) {
+		return;
+	}
+
+	if (!readable && !writable) {
+		unmap(vaddr, size);
+		return;
+	}
+
+	const int prot = (readable ? PROT_READ : 0) | (writable ? PROT_WRITE : 0);
+	void* result = mmap(arenaBase + vaddr, size, prot, MAP_SHARED | MAP_FIXED, fd, off_t(offset));
+
+	if (result == MAP_FAILED) {
+		Helpers::panic("Fastmem: Failed to map %08X bytes at vaddr %08X", u32(size), vaddr);
+	}
+}
+
+void HostMemory::unmap(u32 vaddr, usize size) {
+	if (arenaBase == nullptr || size == 0) {
+		return;
+	}
+
+	// Replace the view with an inaccessible anonymous mapping instead of munmapping, so the reservation stays ours
+	void* result = mmap(arenaBase + vaddr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+	if (result == MAP_FAILED) {
+		Helpers::panic("Fastmem: Failed to unmap %08X bytes at vaddr %08X", u32(size), vaddr);
+	}
+}
+
+void HostMemory::unmapAll() {
+	if (arenaBase != nullptr) {
+		unmap(0, arenaSize);
+	}
+}
+#endif
@@ -29,10 +29,14 @@ uniform sampler2D u_tex1;
 uniform sampler2D u_tex2;
 uniform sampler1DArray u_tex_lighting_lut;
 
-uniform uint u_picaRegs[0x200 - 0x48];
+// PICA registers 0x48 to 0x1FF, packed 4 to a vector so that the std140 layout matches the register file
+layout(std140) uniform PicaRegs { uvec4 u_picaRegs[(0x200 - 0x48) / 4]; };
 
 // Helper so that the implementation of u_pica_regs can be changed later
-uint readPicaReg(uint reg_addr) { return u_picaRegs[reg_addr - 0x48u]; }
+uint readPicaReg(uint reg_addr) {
+	uint index = reg_addr - 0x48u;
+	return u_picaRegs[index >> 2][index & 3u];
+}
 
 vec4 tevSources[16];
 vec4 tevNextPreviousBuffer;
@@ -145,8 +149,10 @@ vec4 tevCalculateCombiner(int tev_id) {
 #define RR_LUT 6u
 
 float lutLookup(uint lut, uint light, float value) {
-	if (lut >= FR_LUT && lut <= RR_LUT) lut -= 1;
-	if (lut == SP_LUT) lut = light + 8;
+	if (lut == SP_LUT)
+		lut = light + 8;
+	else if (lut >= FR_LUT && lut <= RR_LUT)
+		lut -= 1;
 	return texture(u_tex_lighting_lut, vec2(value, lut)).r;
 }
 
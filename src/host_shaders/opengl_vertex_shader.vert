@@ -22,12 +22,14 @@ flat out vec4 v_textureEnvBufferColor;
 
 out float gl_ClipDistance[2];
 
-// TEV uniforms
-uniform uint u_textureEnvColor[6];
-uniform uint u_picaRegs[0x200 - 0x48];
+// PICA registers 0x48 to 0x1FF, packed 4 to a vector so that the std140 layout matches the register file
+layout(std140) uniform PicaRegs { uvec4 u_picaRegs[(0x200 - 0x48) / 4]; };
 
 // Helper so that the implementation of u_pica_regs can be changed later
-uint readPicaReg(uint reg_addr) { return u_picaRegs[reg_addr - 0x48u]; }
+uint readPicaReg(uint reg_addr) {
+	uint index = reg_addr - 0x48u;
+	return u_picaRegs[index >> 2][index & 3u];
+}
 
 vec4 abgr8888ToVec4(uint abgr) {
 	const float scale = 1.0 / 255.0;
@@ -77,8 +79,10 @@ void main() {
 	v_tangent = normalize(rotateVec3ByQuaternion(vec3(1.0, 0.0, 0.0), a_quaternion));
 	v_bitangent = normalize(rotateVec3ByQuaternion(vec3(0.0, 1.0, 0.0), a_quaternion));
 
+	// The constant colour registers of the 6 TEV stages
+	const uint textureEnvColorRegs[6] = uint[](0xC3u, 0xCBu, 0xD3u, 0xDBu, 0xF3u, 0xFBu);
 	for (int i = 0; i < 6; i++) {
-		v_textureEnvColor[i] = abgr8888ToVec4(u_textureEnvColor[i]);
+		v_textureEnvColor[i] = abgr8888ToVec4(readPicaReg(textureEnvColorRegs[i]));
 	}
 
 	v_textureEnvBufferColor = abgr8888ToVec4(readPicaReg(0xFDu));
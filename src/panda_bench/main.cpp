@@ -0,0 +1,312 @@
+// Headless benchmarking frontend. Runs a ROM for a number of frames as fast as possible and prints a JSON report with frame times and how
+// long each subsystem took, for tracking performance across builds
+// Usage: Alber-bench <rom> [--frames N] [--warmup N] [--renderer null|software|opengl] [--input file] [--output report.json] [--no-fastmem]
+//
+// Input files list which buttons are held from a given frame onwards, one frame per line, eg "120 A Up". A frame number with no buttons
+// releases everything. Lines starting with # are ignored
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "emulator.hpp"
+#include "profiler.hpp"
+#include "services/hid.hpp"
+
+#if defined(PANDA3DS_FRONTEND_SDL) && defined(PANDA3DS_ENABLE_OPENGL)
+#include <SDL.h>
+#include <glad/gl.h>
+#define ALBER_BENCH_OPENGL
+#endif
+
+struct InputEvent {
+	u64 frame;
+	u32 buttons;
+};
+
+static std::optional<u32> buttonFromName(const std::string& name) {
+	using namespace HID::Keys;
+	static constexpr std::pair<const char*, u32> buttons[] = {
+		{"A", A}, {"B", B}, {"X", X}, {"Y", Y}, {"L", L}, {"R", R}, {"Start", Start}, {"Select", Select},
+		{"Up", Up}, {"Down", Down}, {"Left", Left}, {"Right", Right},
+	};
+
+	for (const auto& [buttonName, mask] : buttons) {
+		if (name == buttonName) {
+			return mask;
+		}
+	}
+
+	return std::nullopt;
+}
+
+static bool loadInputScript(const char* path, std::vector<InputEvent>& events) {
+	std::ifstream file(path);
+	if (!file) {
+		printf("Failed to open input file %s\n", path);
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+
+		std::istringstream stream(line);
+		InputEvent event = {0, 0};
+		if (!(stream >> event.frame)) {
+			printf("Invalid input file line: %s\n", line.c_str());
+			return false;
+		}
+
+		std::string name;
+		while (stream >> name) {
+			auto button = buttonFromName(name);
+			if (!button.has_value()) {
+				printf("Unknown button in input file: %s\n", name.c_str());
+				return false;
+			}
+
+			event.buttons |= button.value();
+		}
+
+		events.push_back(event);
+	}
+
+	std::stable_sort(events.begin(), events.end(), [](const InputEvent& a, const InputEvent& b) { return a.frame < b.frame; });
+	return true;
+}
+
+static std::string escapeJSON(const std::string& string) {
+	std::string escaped;
+	for (char c : string) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+
+	return escaped;
+}
+
+static double toMilliseconds(u64 nanoseconds) { return double(nanoseconds) / 1'000'000.0; }
+
+static u64 percentile(const std::vector<u64>& sorted, double p) {
+	return sorted[std::min(sorted.size() - 1, usize(p * double(sorted.size())))];
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		printf("Usage: %s <rom> [--frames N] [--warmup N] [--renderer null|software|opengl] [--input file] [--output report.json] [--no-fastmem]\n", argv[0]);
+		return 1;
+	}
+
+	const std::filesystem::path romPath = std::filesystem::current_path() / argv[1];
+	const char* inputPath = nullptr;
+	const char* outputPath = nullptr;
+	RendererType rendererType = RendererType::Null;
+	u64 frameCount = 600;
+	u64 warmupFrames = 60;
+	bool fastmem = true;
+
+	for (int i = 2; i < argc; i++) {
+		const bool hasValue = i + 1 < argc;
+
+		if (std::strcmp(argv[i], "--frames") == 0 && hasValue) {
+			frameCount = std::max<u64>(1, std::strtoull(argv[++i], nullptr, 10));
+		} else if (std::strcmp(argv[i], "--warmup") == 0 && hasValue) {
+			warmupFrames = std::strtoull(argv[++i], nullptr, 10);
+		} else if (std::strcmp(argv[i], "--renderer") == 0 && hasValue) {
+			auto type = Renderer::typeFromString(argv[++i]);
+			if (!type.has_value() || type.value() == RendererType::Vulkan) {
+				printf("Unsupported renderer: %s\n", argv[i]);
+				return 1;
+			}
+			rendererType = type.value();
+		} else if (std::strcmp(argv[i], "--input") == 0 && hasValue) {
+			inputPath = argv[++i];
+		} else if (std::strcmp(argv[i], "--output") == 0 && hasValue) {
+			outputPath = argv[++i];
+		} else if (std::strcmp(argv[i], "--no-fastmem") == 0) {
+			// For comparing against the CPU going through the page table for every access
+			fastmem = false;
+		} else {
+			printf("Unknown option: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	std::vector<InputEvent> inputEvents;
+	if (inputPath != nullptr && !loadInputScript(inputPath, inputEvents)) {
+		return 1;
+	}
+
+	// Start from the user's settings, but don't let anything throttle us or write the overrides back to the config file
+	// The profiler can only see the emulator thread, so keep the GPU on it
+	EmulatorConfig config(std::filesystem::current_path() / "config.toml");
+	config.filePath.clear();
+	config.rendererType = rendererType;
+	config.audioEnabled = false;
+	config.vsyncEnabled = false;
+	config.threadedGPU = false;
+	config.discordRpcEnabled = false;
+	config.fastmemEnabled = config.fastmemEnabled && fastmem;
+
+	auto emu = std::make_unique<Emulator>(config);
+
+#ifdef ALBER_BENCH_OPENGL
+	SDL_Window* window = nullptr;
+	SDL_GLContext glContext = nullptr;
+
+	if (rendererType == RendererType::OpenGL) {
+		if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+			Helpers::panic("Failed to initialize SDL2");
+		}
+
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+		window = SDL_CreateWindow("Alber-bench", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 400, 480, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+		if (window == nullptr) {
+			Helpers::panic("Window creation failed: %s", SDL_GetError());
+		}
+
+		glContext = SDL_GL_CreateContext(window);
+		if (glContext == nullptr) {
+			Helpers::panic("OpenGL context creation failed: %s", SDL_GetError());
+		}
+
+		if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(SDL_GL_GetProcAddress))) {
+			Helpers::panic("OpenGL init failed");
+		}
+
+		SDL_GL_SetSwapInterval(0);
+	}
+
+	emu->initGraphicsContext(window);
+#else
+	if (rendererType == RendererType::OpenGL) {
+		printf("This build of Alber-bench can't benchmark with OpenGL\n");
+		return 1;
+	}
+
+	emu->initGraphicsContext(nullptr);
+#endif
+
+	if (!emu->loadROM(romPath)) {
+		printf("Failed to load ROM file: %s\n", romPath.string().c_str());
+		return 1;
+	}
+
+	HIDService& hid = emu->getServiceManager().getHID();
+	usize nextInputEvent = 0;
+	u32 heldButtons = 0;
+
+	std::vector<u64> frameTimes;
+	frameTimes.reserve(frameCount);
+	std::chrono::steady_clock::time_point benchStart;
+
+	for (u64 frame = 0; frame < warmupFrames + frameCount; frame++) {
+		if (frame == warmupFrames) {
+			Profiler::enable();
+			benchStart = std::chrono::steady_clock::now();
+		}
+
+		while (nextInputEvent < inputEvents.size() && inputEvents[nextInputEvent].frame <= frame) {
+			const u32 buttons = inputEvents[nextInputEvent++].buttons;
+			hid.releaseKey(heldButtons & ~buttons);
+			hid.pressKey(buttons);
+			heldButtons = buttons;
+		}
+
+		const auto frameStart = std::chrono::steady_clock::now();
+		emu->runFrame();
+		hid.updateInputs(emu->getTicks());
+#ifdef ALBER_BENCH_OPENGL
+		if (window != nullptr) {
+			SDL_GL_SwapWindow(window);
+		}
+#endif
+
+		if (frame >= warmupFrames) {
+			const auto elapsed = std::chrono::steady_clock::now() - frameStart;
+			frameTimes.push_back(u64(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+		}
+	}
+
+	Profiler::disable();
+	const u64 totalTime = u64(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - benchStart).count());
+
+	std::vector<u64> sortedFrameTimes = frameTimes;
+	std::sort(sortedFrameTimes.begin(), sortedFrameTimes.end());
+	u64 frameTimeSum = 0;
+	for (u64 time : frameTimes) {
+		frameTimeSum += time;
+	}
+
+	std::ostringstream report;
+	report.precision(4);
+	report << std::fixed;
+	report << "{\n";
+	report << "  \"rom\": \"" << escapeJSON(romPath.string()) << "\",\n";
+	report << "  \"renderer\": \"" << Renderer::typeToString(rendererType) << "\",\n";
+	// Fastmem can be enabled but unavailable if the host couldn't reserve the address space for it
+	report << "  \"fastmem\": " << (emu->getMemory().getFastmemArenaBase() != nullptr ? "true" : "false") << ",\n";
+	report << "  \"frames\": " << frameCount << ",\n";
+	report << "  \"warmup_frames\": " << warmupFrames << ",\n";
+	report << "  \"total_seconds\": " << double(totalTime) / 1'000'000'000.0 << ",\n";
+	report << "  \"fps\": " << double(frameCount) * 1'000'000'000.0 / double(std::max<u64>(totalTime, 1)) << ",\n";
+	report << "  \"frame_time_ms\": {\n";
+	report << "    \"mean\": " << toMilliseconds(frameTimeSum / frameCount) << ",\n";
+	report << "    \"min\": " << toMilliseconds(sortedFrameTimes.front()) << ",\n";
+	report << "    \"p50\": " << toMilliseconds(percentile(sortedFrameTimes, 0.5)) << ",\n";
+	report << "    \"p90\": " << toMilliseconds(percentile(sortedFrameTimes, 0.9)) << ",\n";
+	report << "    \"p99\": " << toMilliseconds(percentile(sortedFrameTimes, 0.99)) << ",\n";
+	report << "    \"max\": " << toMilliseconds(sortedFrameTimes.back()) << "\n";
+	report << "  },\n";
+
+	// Time per subsystem, in milliseconds and as a share of the whole run
+	report << "  \"subsystems\": {\n";
+	for (usize i = 0; i < usize(Profiler::Category::Count); i++) {
+		const u64 time = Profiler::getTotal(Profiler::Category(i));
+		report << "    \"" << Profiler::categoryNames[i] << "\": {\"ms\": " << toMilliseconds(time)
+			   << ", \"percent\": " << double(time) * 100.0 / double(std::max<u64>(totalTime, 1)) << "}";
+		report << (i + 1 < usize(Profiler::Category::Count) ? ",\n" : "\n");
+	}
+	report << "  },\n";
+
+	const ShaderJIT::CacheStats& jitStats = emu->getGPU().getShaderJITStats();
+	report << "  \"shader_jit\": {\"enabled\": " << (config.shaderJitEnabled && ShaderJIT::isAvailable() ? "true" : "false")
+		   << ", \"hits\": " << jitStats.hits << ", \"misses\": " << jitStats.misses << ", \"evictions\": " << jitStats.evictions
+		   << ", \"specialised\": " << jitStats.specialisedCompiles << ", \"cached_shaders\": " << jitStats.shaderCount
+		   << ", \"code_bytes\": " << jitStats.codeBytes << "}\n";
+	report << "}\n";
+
+	if (outputPath != nullptr) {
+		std::ofstream output(outputPath);
+		output << report.str();
+		if (!output) {
+			printf("Failed to write report to %s\n", outputPath);
+			return 1;
+		}
+	} else {
+		printf("%s", report.str().c_str());
+	}
+
+	emu.reset();
+#ifdef ALBER_BENCH_OPENGL
+	if (glContext != nullptr) {
+		SDL_GL_DeleteContext(glContext);
+		SDL_DestroyWindow(window);
+	}
+#endif
+
+	return 0;
+}
@@ -51,6 +51,9 @@ FrontendSDL::FrontendSDL() : keyboardMappings(InputMappings::defaultKeyboardMapp
 		}
 
 		SDL_GL_SetSwapInterval(config.vsyncEnabled ? 1 : 0);
+		emu.setGPUContextCallbacks(
+			[this]() { SDL_GL_MakeCurrent(window, glContext); }, [this]() { SDL_GL_MakeCurrent(window, nullptr); }
+		);
 	}
 
 #ifdef PANDA3DS_ENABLE_VULKAN
@@ -130,6 +133,12 @@ void FrontendSDL::run() {
 								emu.reset(Emulator::ReloadOption::Reload);
 								break;
 							}
+
+							// Use F6 to record a GPU trace of the next second of gameplay
+							case SDLK_F6: {
+								emu.startGPUTrace(60);
+								break;
+							}
 						}
 					}
 					break;
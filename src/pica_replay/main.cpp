@@ -0,0 +1,205 @@
+// Replays GPU traces recorded by the emulator and reports how long the GPU took on every frame and draw
+// Usage: pica_replay <trace> [--renderer null|software|opengl] [--loops N] [--screenshot file.png] [--quiet]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "PICA/gpu.hpp"
+#include "PICA/gpu_trace.hpp"
+#include "config.hpp"
+#include "memory.hpp"
+
+#if defined(PANDA3DS_FRONTEND_SDL) && defined(PANDA3DS_ENABLE_OPENGL)
+#include <SDL.h>
+#include <glad/gl.h>
+#define PICA_REPLAY_OPENGL
+#endif
+
+static double toMilliseconds(u64 nanoseconds) { return double(nanoseconds) / 1'000'000.0; }
+
+// Returns the value at the given percentile of a sorted list
+static u64 percentile(const std::vector<u64>& sorted, double p) {
+	if (sorted.empty()) {
+		return 0;
+	}
+
+	return sorted[std::min(sorted.size() - 1, usize(p * double(sorted.size())))];
+}
+
+static void printTimings(const char* name, std::vector<u64>& timings) {
+	if (timings.empty()) {
+		return;
+	}
+
+	std::sort(timings.begin(), timings.end());
+	u64 total = 0;
+	for (u64 time : timings) {
+		total += time;
+	}
+
+	printf(
+		"%s: %zu, mean %.3f ms, median %.3f ms, p99 %.3f ms, min %.3f ms, max %.3f ms\n", name, timings.size(),
+		toMilliseconds(total / timings.size()), toMilliseconds(percentile(timings, 0.5)), toMilliseconds(percentile(timings, 0.99)),
+		toMilliseconds(timings.front()), toMilliseconds(timings.back())
+	);
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		printf("Usage: %s <trace> [--renderer null|software|opengl] [--loops N] [--screenshot file.png] [--quiet]\n", argv[0]);
+		return 1;
+	}
+
+	const char* tracePath = argv[1];
+	const char* screenshotPath = nullptr;
+	RendererType rendererType = RendererType::Software;
+	int loops = 1;
+	bool quiet = false;
+
+	for (int i = 2; i < argc; i++) {
+		const bool hasValue = i + 1 < argc;
+
+		if (std::strcmp(argv[i], "--renderer") == 0 && hasValue) {
+			auto type = Renderer::typeFromString(argv[++i]);
+			if (!type.has_value() || type.value() == RendererType::Vulkan) {
+				printf("Unsupported renderer: %s\n", argv[i]);
+				return 1;
+			}
+			rendererType = type.value();
+		} else if (std::strcmp(argv[i], "--loops") == 0 && hasValue) {
+			loops = std::max(1, std::atoi(argv[++i]));
+		} else if (std::strcmp(argv[i], "--screenshot") == 0 && hasValue) {
+			screenshotPath = argv[++i];
+		} else if (std::strcmp(argv[i], "--quiet") == 0) {
+			quiet = true;
+		} else {
+			printf("Unknown option: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	// Use the emulator's settings for everything but the renderer, so the replay runs with the same GPU options as the game would
+	EmulatorConfig config(std::filesystem::current_path() / "config.toml");
+	config.rendererType = rendererType;
+	config.threadedGPU = false;
+
+	u64 cpuTicks = 0;
+	Memory mem(cpuTicks, config);
+	GPU gpu(mem, config);
+
+#ifdef PICA_REPLAY_OPENGL
+	SDL_Window* window = nullptr;
+	SDL_GLContext glContext = nullptr;
+
+	if (rendererType == RendererType::OpenGL) {
+		if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+			Helpers::panic("Failed to initialize SDL2");
+		}
+
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+		window = SDL_CreateWindow("pica_replay", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 400, 480, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+		if (window == nullptr) {
+			Helpers::panic("Window creation failed: %s", SDL_GetError());
+		}
+
+		glContext = SDL_GL_CreateContext(window);
+		if (glContext == nullptr) {
+			Helpers::panic("OpenGL context creation failed: %s", SDL_GetError());
+		}
+
+		if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(SDL_GL_GetProcAddress))) {
+			Helpers::panic("OpenGL init failed");
+		}
+
+		SDL_GL_SetSwapInterval(0);
+	}
+
+	gpu.initGraphicsContext(window);
+#else
+	if (rendererType == RendererType::OpenGL) {
+		printf("This build of pica_replay can't replay with OpenGL\n");
+		return 1;
+	}
+#endif
+
+	gpu.reset();
+
+	PICA::Trace::Player player;
+	if (!player.open(tracePath)) {
+		return 1;
+	}
+
+	std::vector<u64> frameTimings;
+	std::vector<u64> drawTimings;
+	u32 commandListCount = 0;
+	gpu.drawTimings = &drawTimings;
+
+	printf("Replaying %s with the %s renderer\n", tracePath, Renderer::typeToString(rendererType));
+	for (int loop = 0; loop < loops; loop++) {
+		player.restart(gpu);
+
+		PICA::Trace::Player::FrameInfo info;
+		usize drawsBefore = drawTimings.size();
+		u32 frame = 0;
+
+		while (true) {
+			const auto startTime = std::chrono::steady_clock::now();
+			const bool frameDone = player.runFrame(gpu, info);
+			if (!frameDone) {
+				break;
+			}
+
+			// Presenting is part of the frame's work, and makes the OpenGL renderer wait for the host GPU to catch up
+			gpu.display();
+#ifdef PICA_REPLAY_OPENGL
+			if (window != nullptr) {
+				SDL_GL_SwapWindow(window);
+			}
+#endif
+			const auto elapsed = std::chrono::steady_clock::now() - startTime;
+			const u64 frameTime = u64(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+			frameTimings.push_back(frameTime);
+			commandListCount += info.commandListCount;
+
+			if (!quiet) {
+				printf(
+					"Frame %u: %.3f ms (commands %.3f ms), %u commands, %zu draws, %u pages loaded\n", frame, toMilliseconds(frameTime),
+					toMilliseconds(info.commandTime), info.commandCount, drawTimings.size() - drawsBefore, info.pagesLoaded
+				);
+			}
+
+			drawsBefore = drawTimings.size();
+			frame++;
+		}
+	}
+
+	printTimings("Frames", frameTimings);
+	printTimings("Draws", drawTimings);
+
+	// Every game draws something from its command lists, so a trace that runs them without drawing anything didn't replay properly
+	const bool replayedDraws = commandListCount == 0 || !drawTimings.empty();
+	if (!replayedDraws) {
+		printf("The trace ran %u command lists but didn't draw anything\n", commandListCount);
+	}
+
+	if (screenshotPath != nullptr) {
+		gpu.screenshot(screenshotPath);
+	}
+
+	gpu.drawTimings = nullptr;
+#ifdef PICA_REPLAY_OPENGL
+	if (glContext != nullptr) {
+		gpu.deinitGraphicsContext();
+		SDL_GL_DeleteContext(glContext);
+		SDL_DestroyWindow(window);
+	}
+#endif
+
+	return replayedDraws ? 0 : 1;
+}
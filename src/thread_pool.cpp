@@ -0,0 +1,86 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(u32 threadCount) {
+	workers.reserve(threadCount);
+	for (u32 i = 0; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock lock(mutex);
+		stopping = true;
+	}
+
+	workAvailable.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::runJobs() {
+	while (true) {
+		const u32 job = nextJob.fetch_add(1, std::memory_order_relaxed);
+		if (job >= jobCount) {
+			break;
+		}
+
+		(*currentJob)(job);
+	}
+}
+
+void ThreadPool::workerLoop() {
+	u64 lastGeneration = 0;
+
+	while (true) {
+		{
+			std::unique_lock lock(mutex);
+			workAvailable.wait(lock, [&]() { return stopping || generation != lastGeneration; });
+
+			if (stopping) {
+				return;
+			}
+
+			lastGeneration = generation;
+		}
+
+		runJobs();
+
+		std::unique_lock lock(mutex);
+		if (--busyWorkers == 0) {
+			workDone.notify_one();
+		}
+	}
+}
+
+void ThreadPool::parallelFor(u32 count, const std::function<void(u32)>& func) {
+	if (count == 0) {
+		return;
+	}
+
+	// Not worth waking anyone up for a single job
+	if (workers.empty() || count == 1) {
+		for (u32 i = 0; i < count; i++) {
+			func(i);
+		}
+		return;
+	}
+
+	{
+		std::unique_lock lock(mutex);
+		currentJob = &func;
+		jobCount = count;
+		nextJob.store(0, std::memory_order_relaxed);
+		busyWorkers = u32(workers.size());
+		generation++;
+	}
+
+	workAvailable.notify_all();
+	runJobs();
+
+	// Wait for every worker to be done, not just for the jobs to be claimed, so that func can safely go out of scope
+	std::unique_lock lock(mutex);
+	workDone.wait(lock, [&]() { return busyWorkers == 0; });
+	currentJob = nullptr;
+}
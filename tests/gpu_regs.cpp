@@ -0,0 +1,223 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "PICA/gpu.hpp"
+#include "PICA/gpu_trace.hpp"
+#include "PICA/lut_tracker.hpp"
+#include "config.hpp"
+#include "memory.hpp"
+
+using namespace PICA::InternalRegs;
+
+template <usize rowCount, usize rowSize>
+static std::vector<std::tuple<u32, u32, u32>> consumeRanges(PICA::LUTTracker<rowCount, rowSize>& tracker) {
+	std::vector<std::tuple<u32, u32, u32>> ranges;
+	tracker.consume([&](u32 row, u32 start, u32 end) { ranges.emplace_back(row, start, end); });
+	return ranges;
+}
+
+TEST_CASE("LUT tracker ranges", "[lut_tracker]") {
+	PICA::LUTTracker<24, 256> tracker;
+	REQUIRE(!tracker.isDirty());
+	REQUIRE(consumeRanges(tracker).empty());
+
+	tracker.markDirty(3, 10);
+	tracker.markDirty(3, 11);
+	tracker.markDirty(3, 5);
+	tracker.markDirty(20, 255);
+	REQUIRE(tracker.isDirty());
+
+	using Range = std::tuple<u32, u32, u32>;
+	REQUIRE(consumeRanges(tracker) == std::vector<Range>{{3, 5, 12}, {20, 255, 256}});
+
+	// Consuming marks everything as clean, and old ranges don't stick around for the next time a row gets dirty
+	REQUIRE(!tracker.isDirty());
+	REQUIRE(consumeRanges(tracker).empty());
+
+	tracker.markDirty(3, 100);
+	REQUIRE(consumeRanges(tracker) == std::vector<Range>{{3, 100, 101}});
+}
+
+TEST_CASE("LUT tracker marking everything", "[lut_tracker]") {
+	PICA::LUTTracker<64, 16> tracker;
+	tracker.markDirty(1, 4);
+	tracker.markAllDirty();
+
+	const auto ranges = consumeRanges(tracker);
+	REQUIRE(ranges.size() == 64);
+	for (u32 row = 0; row < 64; row++) {
+		REQUIRE(ranges[row] == std::tuple<u32, u32, u32>{row, 0, 16});
+	}
+}
+
+// Runs the same register writes through the bulk command list path on one GPU and one value at a time through writeInternalReg on another,
+// so that the register classification table and the burst handling can be checked against the plain register write handler
+class CommandProcessorTest {
+	u64 cpuTicks = 0;
+	EmulatorConfig config;
+	std::unique_ptr<Memory> mem;
+
+  public:
+	std::unique_ptr<GPU> bulk;
+	std::unique_ptr<GPU> single;
+	std::mt19937 rng{0x1234};
+
+	CommandProcessorTest() : config(std::filesystem::temp_directory_path() / "alber_tests_config.toml") {
+		config.rendererType = RendererType::Null;
+		config.threadedGPU = false;
+
+		mem = std::make_unique<Memory>(cpuTicks, config);
+		bulk = std::make_unique<GPU>(*mem, config);
+		single = std::make_unique<GPU>(*mem, config);
+		bulk->reset();
+		single->reset();
+	}
+
+	void write(u32 index, const std::vector<u32>& values, u32 mask = 0xffffffff, u32 increment = 1) {
+		bulk->writeInternalRegs(index, values.data(), u32(values.size()), mask, increment);
+		for (u32 i = 0; i < values.size(); i++) {
+			single->writeInternalReg(index + i * increment, values[i], mask);
+		}
+	}
+
+	void write(u32 index, u32 value) { write(index, std::vector<u32>{value}); }
+
+	std::vector<u32> randomValues(usize count) {
+		std::vector<u32> values(count);
+		for (u32& value : values) {
+			value = u32(rng());
+		}
+
+		return values;
+	}
+
+	void requireSameState() {
+		auto bulkState = std::make_unique<PICA::Trace::State>();
+		auto singleState = std::make_unique<PICA::Trace::State>();
+		bulk->saveTraceState(*bulkState);
+		single->saveTraceState(*singleState);
+
+		REQUIRE(bulkState->regs == singleState->regs);
+		REQUIRE(bulkState->lightingLUT == singleState->lightingLUT);
+		REQUIRE(bulkState->shaderCode == singleState->shaderCode);
+		REQUIRE(bulkState->operandDescriptors == singleState->operandDescriptors);
+		// Compare the uniforms bit by bit, as random data makes NaNs
+		REQUIRE(std::memcmp(&bulkState->floatUniforms, &singleState->floatUniforms, sizeof(bulkState->floatUniforms)) == 0);
+		REQUIRE(consumeRanges(bulk->lightingLUTDirty) == consumeRanges(single->lightingLUTDirty));
+
+		// Bulk writes can mark registers as dirty without them changing, but never miss one that changed
+		for (usize i = 0; i < bulk->dirtyRegs.size(); i++) {
+			REQUIRE((single->dirtyRegs[i] & ~bulk->dirtyRegs[i]) == 0);
+		}
+	}
+};
+
+TEST_CASE("Bulk register writes", "[command_processor]") {
+	CommandProcessorTest test;
+
+	SECTION("Consecutive runs") {
+		// Crosses from registers before the render state range into it
+		test.write(0x20, test.randomValues(0x40));
+		test.write(0x80, test.randomValues(0x40));
+		test.requireSameState();
+	}
+
+	SECTION("Writing the same value again") {
+		const auto values = test.randomValues(16);
+		test.write(0x100, values);
+		test.write(0x100, values);
+		test.requireSameState();
+	}
+
+	SECTION("Repeated writes to one register") {
+		test.write(0x100, test.randomValues(10), 0xffffffff, 0);
+		test.requireSameState();
+	}
+
+	SECTION("Masked writes") {
+		test.write(0x80, test.randomValues(0x20));
+		test.write(0x80, test.randomValues(0x20), 0x00ff00ff);
+		test.write(0x90, test.randomValues(4), 0xff000000, 0);
+		test.requireSameState();
+	}
+
+	SECTION("Random writes to the render state registers") {
+		for (int i = 0; i < 200; i++) {
+			const u32 index = RenderStateStart + test.rng() % (RenderStateEnd - RenderStateStart);
+			const u32 count = 1 + test.rng() % std::min<u32>(16, RenderStateEnd - index);
+			const u32 mask = (test.rng() % 4 == 0) ? u32(test.rng()) : 0xffffffff;
+			const u32 increment = (test.rng() % 4 == 0) ? 0 : 1;
+
+			test.write(index, test.randomValues(count), mask, increment);
+		}
+		test.requireSameState();
+	}
+}
+
+TEST_CASE("Bulk lighting LUT writes", "[command_processor]") {
+	CommandProcessorTest test;
+
+	SECTION("Bursts to one data port") {
+		test.write(LightingLUTIndex, (2 << 8) | 10);
+		test.write(LightingLUTData0, test.randomValues(20), 0xffffffff, 0);
+		test.requireSameState();
+	}
+
+	SECTION("Bursts that wrap around the end of the LUT") {
+		test.write(LightingLUTIndex, (5 << 8) | 250);
+		test.write(LightingLUTData0, test.randomValues(16), 0xffffffff, 0);
+		test.requireSameState();
+	}
+
+	SECTION("Consecutive writes across the data ports and past them") {
+		test.write(LightingLUTIndex, (7 << 8) | 0);
+		test.write(LightingLUTData3, test.randomValues(12));
+		test.requireSameState();
+	}
+
+	SECTION("Masked and invalid LUT writes") {
+		test.write(LightingLUTIndex, (1 << 8) | 30);
+		test.write(LightingLUTData0, test.randomValues(4), 0x0000ffff, 0);
+		test.write(LightingLUTIndex, (30 << 8) | 0);
+		test.write(LightingLUTData0, test.randomValues(4), 0xffffffff, 0);
+		test.requireSameState();
+	}
+}
+
+TEST_CASE("Bulk shader writes", "[command_processor]") {
+	CommandProcessorTest test;
+
+	SECTION("Float uniforms") {
+		// f32 uniforms take 4 words each and f24 ones take 3
+		test.write(VertexFloatUniformIndex, 0x80000000 | 4);
+		test.write(VertexFloatUniformData0, test.randomValues(32), 0xffffffff, 0);
+		test.write(VertexFloatUniformIndex, 20);
+		test.write(VertexFloatUniformData0, test.randomValues(8));
+		test.write(VertexFloatUniformData0, test.randomValues(13), 0xffffffff, 0);
+		test.requireSameState();
+	}
+
+	SECTION("Shader code and operand descriptors") {
+		test.write(VertexShaderTransferIndex, 0);
+		test.write(VertexShaderData0, test.randomValues(100), 0xffffffff, 0);
+		test.write(VertexShaderOpDescriptorIndex, 0);
+		test.write(VertexShaderOpDescriptorData0, test.randomValues(40), 0xffffffff, 0);
+
+		// Goes through the shader code ports, the descriptor index, the descriptor ports and the plain registers after them
+		test.write(VertexShaderData0, test.randomValues(24));
+		test.write(VertexShaderTransferEnd, 1);
+		test.requireSameState();
+	}
+
+	SECTION("Masked writes to the shader ports") {
+		test.write(VertexShaderTransferIndex, 0);
+		test.write(VertexShaderData0, test.randomValues(6), 0x00ffffff, 0);
+		test.write(VertexShaderTransferEnd, 1);
+		test.requireSameState();
+	}
+}
@@ -0,0 +1,140 @@
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+#include "PICA/gpu_thread.hpp"
+#include "config.hpp"
+#include "memory.hpp"
+
+class MemoryTest {
+	u64 cpuTicks = 0;
+	EmulatorConfig config;
+
+  public:
+	std::unique_ptr<Memory> mem;
+	u32 vaddr = 0;
+	u32 paddr = 0;  // Physical address of the allocation
+	static constexpr u32 pageCount = 16;
+
+	MemoryTest() : config(std::filesystem::temp_directory_path() / "alber_tests_config.toml") {
+		config.fastmemEnabled = true;
+		mem = std::make_unique<Memory>(cpuTicks, config);
+		mem->reset();
+
+		// Linear heap allocations are at linear heap base + FCRAM offset, so we know which physical pages they use
+		vaddr = mem->allocateMemory(0, 0, pageCount * Memory::pageSize, true, true, true, false, true).value();
+		paddr = PhysicalAddrs::FCRAM + (vaddr - mem->getLinearHeapVaddr());
+	}
+
+	// Watched pages stay readable in the fastmem arena, so reads through it have to see the same data as the slow path at all times
+	void requireArenaMatches() {
+		const u8* arena = mem->getFastmemArenaBase();
+		if (arena == nullptr) {
+			return;  // Fastmem isn't available on this host
+		}
+
+		for (u32 page = 0; page < pageCount; page++) {
+			const u32 address = vaddr + page * Memory::pageSize;
+			REQUIRE(*reinterpret_cast<const u32*>(arena + address) == mem->read32(address));
+		}
+	}
+};
+
+TEST_CASE("Watching and writing to FCRAM ranges", "[memory]") {
+	MemoryTest test;
+	Memory& mem = *test.mem;
+
+	for (u32 page = 0; page < MemoryTest::pageCount; page++) {
+		mem.write32(test.vaddr + page * Memory::pageSize, page);
+	}
+
+	const u32 size = MemoryTest::pageCount * Memory::pageSize;
+	const u64 timestamp = mem.watchPhysicalRange(test.paddr, size);
+	REQUIRE(!mem.isPhysicalRangeDirty(test.paddr, size, timestamp));
+	test.requireArenaMatches();
+
+	// Writing to a watched page only dirties that page, and gives the CPU its fast path back for it
+	mem.write32(test.vaddr + 5 * Memory::pageSize, 0x1234);
+	REQUIRE(mem.isPhysicalRangeDirty(test.paddr + 5 * Memory::pageSize, Memory::pageSize, timestamp));
+	REQUIRE(!mem.isPhysicalRangeDirty(test.paddr, 5 * Memory::pageSize, timestamp));
+	REQUIRE(!mem.isPhysicalRangeDirty(test.paddr + 6 * Memory::pageSize, 10 * Memory::pageSize, timestamp));
+	REQUIRE(mem.read32(test.vaddr + 5 * Memory::pageSize) == 0x1234);
+	test.requireArenaMatches();
+
+	// Watching the range again only has the written page left to watch, and writes to the others still get seen
+	const u64 newTimestamp = mem.watchPhysicalRange(test.paddr, size);
+	mem.write32(test.vaddr + 15 * Memory::pageSize, 0x5678);
+	REQUIRE(mem.isPhysicalRangeDirty(test.paddr, size, newTimestamp));
+	REQUIRE(!mem.isPhysicalRangeDirty(test.paddr, 15 * Memory::pageSize, newTimestamp));
+	test.requireArenaMatches();
+
+	for (u32 page = 0; page < MemoryTest::pageCount; page++) {
+		const u32 expected = (page == 5) ? 0x1234 : (page == 15) ? 0x5678 : page;
+		REQUIRE(mem.read32(test.vaddr + page * Memory::pageSize) == expected);
+	}
+}
+
+TEST_CASE("Watching FCRAM from another thread", "[memory]") {
+	MemoryTest test;
+	Memory& mem = *test.mem;
+	const u32 size = MemoryTest::pageCount * Memory::pageSize;
+
+	// The other thread can't watch FCRAM pages on its own, it has to wait for this thread to do it
+	std::atomic<u32> requests = 0;
+	mem.setWatchRequestCallback([&]() { requests++; });
+	mem.setConcurrentTracking(true);
+
+	std::atomic<bool> watched = false;
+	u64 timestamp = 0;
+	std::thread watcher([&]() {
+		timestamp = mem.watchPhysicalRange(test.paddr, size);
+		watched = true;
+	});
+
+	while (!watched) {
+		mem.applyWatchRequests();
+		std::this_thread::yield();
+	}
+	watcher.join();
+
+	REQUIRE(requests == 1);
+	REQUIRE(!mem.isPhysicalRangeDirty(test.paddr, size, timestamp));
+	mem.write32(test.vaddr + 3 * Memory::pageSize, 1);
+	REQUIRE(mem.isPhysicalRangeDirty(test.paddr, size, timestamp));
+	test.requireArenaMatches();
+
+	// Pages that are all watched already don't need this thread
+	std::thread([&]() { mem.watchPhysicalRange(test.paddr + 4 * Memory::pageSize, Memory::pageSize); }).join();
+	REQUIRE(requests == 1);
+	mem.setConcurrentTracking(false);
+}
+
+TEST_CASE("GPU thread commands that watch memory", "[memory]") {
+	MemoryTest test;
+	Memory& mem = *test.mem;
+	const u32 size = MemoryTest::pageCount * Memory::pageSize;
+
+	// Waiting on the GPU thread has to watch memory for it while we wait, or we'd both be stuck waiting on each other
+	GPUThread thread;
+	u64 timestamp = 0;
+	thread.start(
+		[&](const GPUThread::Command& command, std::span<u32>) { timestamp = mem.watchPhysicalRange(command.args[0], command.args[1]); },
+		{}, {}, [&]() { mem.applyWatchRequests(); }
+	);
+	mem.setWatchRequestCallback([&]() { thread.wakeWaiters(); });
+	mem.setConcurrentTracking(true);
+
+	thread.wait(thread.submit(GPUThread::Command{.type = GPUThread::CommandType::MemoryFill, .args = {test.paddr, size}}));
+	REQUIRE(!mem.isPhysicalRangeDirty(test.paddr, size, timestamp));
+	mem.write32(test.vaddr, 1);
+	REQUIRE(mem.isPhysicalRangeDirty(test.paddr, size, timestamp));
+
+	// Stopping the thread waits for its work the same way
+	mem.write32(test.vaddr + Memory::pageSize, 2);
+	thread.submit(GPUThread::Command{.type = GPUThread::CommandType::MemoryFill, .args = {test.paddr, size}});
+	thread.stop();
+	mem.setConcurrentTracking(false);
+	test.requireArenaMatches();
+}
@@ -6,8 +6,11 @@
 #include <catch2/catch_template_test_macros.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <initializer_list>
+#include <bit>
 #include <memory>
+#include <random>
 #include <span>
+#include <vector>
 
 using namespace Floats;
 static const nihstro::SourceRegister input0 = nihstro::SourceRegister::MakeInput(0);
@@ -36,6 +39,42 @@ static std::unique_ptr<PICAShader> assembleVertexShader(std::initializer_list<ni
 	return newShader;
 }
 
+// For tests that need flow control or specific operand descriptors, which are easier to write out by hand than through nihstro
+namespace RawShader {
+	static constexpr u32 identitySwizzle = 0x1B;  // xyzw
+
+	// Operand descriptor with the given write mask (bit 3 = x) that doesn't swizzle or negate any source
+	static constexpr u32 descriptor(u32 writeMask) { return writeMask | (identitySwizzle << 5) | (identitySwizzle << 14) | (identitySwizzle << 23); }
+
+	// Registers use the source numbering: 0x00-0x0F are inputs, 0x10-0x1F are temporaries and 0x20 onwards are float uniforms.
+	// Destinations 0x00-0x0F are outputs
+	static constexpr u32 format1(u32 opcode, u32 dest, u32 src1, u32 src2, u32 descriptorIndex) {
+		return (opcode << 26) | (dest << 21) | (src1 << 12) | (src2 << 7) | descriptorIndex;
+	}
+
+	static constexpr u32 mad(u32 dest, u32 src1, u32 src2, u32 src3, u32 descriptorIndex) {
+		return (ShaderOpcodes::MAD << 26) | (dest << 24) | (src1 << 17) | (src2 << 10) | (src3 << 5) | descriptorIndex;
+	}
+
+	// IFU, CALLU, JMPU and LOOP. "uniform" is the bool uniform for the first 3, or the int uniform for LOOP
+	static constexpr u32 flowControl(u32 opcode, u32 uniform, u32 dest, u32 num) { return (opcode << 26) | (uniform << 22) | (dest << 10) | num; }
+	static constexpr u32 end() { return ShaderOpcodes::END << 26; }
+}  // namespace RawShader
+
+static std::unique_ptr<PICAShader> assembleRawVertexShader(std::span<const u32> code, std::span<const u32> descriptors) {
+	auto newShader = std::make_unique<PICAShader>(ShaderType::Vertex);
+	newShader->reset();
+
+	for (u32 instruction : code) {
+		newShader->uploadWord(instruction);
+	}
+	for (u32 descriptor : descriptors) {
+		newShader->uploadDescriptor(descriptor);
+	}
+	newShader->finalize();
+	return newShader;
+}
+
 class ShaderInterpreterTest {
   protected:
 	std::unique_ptr<PICAShader> shader = {};
@@ -43,7 +82,17 @@ class ShaderInterpreterTest {
 	virtual void runShader() { shader->run(); }
 
   public:
+	// The interpreter always computes every output, while the JIT's results are only valid for the live output components
+	static constexpr bool skipsDeadOutputs = false;
+	// Whether DP3, DP4 and MAD round like ReferenceShader below. The JIT uses dpps and FMA for them, which round differently
+	static constexpr bool exactDotProducts = true;
+
 	explicit ShaderInterpreterTest(std::initializer_list<nihstro::InlineAsm> code) : shader(assembleVertexShader(code)) {}
+	explicit ShaderInterpreterTest(std::unique_ptr<PICAShader> shader) : shader(std::move(shader)) {}
+	virtual ~ShaderInterpreterTest() = default;
+
+	// Which output components the test is going to look at, in the format of ShaderAnalysis::getLiveOutputs
+	virtual void setLiveOutputs(u64 liveOutputs) {}
 
 	std::span<const std::array<Floats::f24, 4>> runTest(std::span<const std::array<Floats::f24, 4>> inputs) {
 		std::copy(inputs.begin(), inputs.end(), shader->inputs.begin());
@@ -78,21 +127,41 @@ class ShaderInterpreterTest {
 	static std::unique_ptr<ShaderInterpreterTest> assembleTest(std::initializer_list<nihstro::InlineAsm> code) {
 		return std::make_unique<ShaderInterpreterTest>(code);
 	}
+
+	static std::unique_ptr<ShaderInterpreterTest> assembleRawTest(std::span<const u32> code, std::span<const u32> descriptors) {
+		return std::make_unique<ShaderInterpreterTest>(assembleRawVertexShader(code, descriptors));
+	}
 };
 
 #if defined(PANDA3DS_SHADER_JIT_SUPPORTED)
 class ShaderJITTest final : public ShaderInterpreterTest {
   private:
 	ShaderJIT shaderJit = {};
+	u64 liveOutputs = ~0ull;
 
-	void runShader() override { shaderJit.run(*shader); }
+	// Prepare before every run like the GPU does before every draw, so uniform changes get picked up
+	void runShader() override {
+		shaderJit.prepare(*shader, liveOutputs);
+		shaderJit.run(*shader);
+	}
 
   public:
-	explicit ShaderJITTest(std::initializer_list<nihstro::InlineAsm> code) : ShaderInterpreterTest(code) { shaderJit.prepare(*shader); }
+	static constexpr bool skipsDeadOutputs = true;
+	static constexpr bool exactDotProducts = false;
+
+	explicit ShaderJITTest(std::initializer_list<nihstro::InlineAsm> code) : ShaderInterpreterTest(code) {}
+	explicit ShaderJITTest(std::unique_ptr<PICAShader> shader) : ShaderInterpreterTest(std::move(shader)) {}
+
+	void setLiveOutputs(u64 outputs) override { liveOutputs = outputs; }
+	const ShaderJIT::CacheStats& getCacheStats() const { return shaderJit.getCacheStats(); }
 
 	static std::unique_ptr<ShaderJITTest> assembleTest(std::initializer_list<nihstro::InlineAsm> code) {
 		return std::make_unique<ShaderJITTest>(code);
 	}
+
+	static std::unique_ptr<ShaderJITTest> assembleRawTest(std::span<const u32> code, std::span<const u32> descriptors) {
+		return std::make_unique<ShaderJITTest>(assembleRawVertexShader(code, descriptors));
+	}
 };
 #define SHADER_TEST_CASE(NAME, TAG) TEMPLATE_TEST_CASE(NAME, TAG, ShaderInterpreterTest, ShaderJITTest)
 #else
@@ -364,4 +433,470 @@ SHADER_TEST_CASE("Address Register Offset", "[video_core][shader][shader_jit]")
 	REQUIRE(shader->runVector({-73.f}) == floatUniforms[95]);
 	REQUIRE(shader->runVector({-127.f}) == floatUniforms[41]);
 	REQUIRE(shader->runVector({-129.f}) == floatUniforms[40]);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Live outputs from the output map", "[shader][analysis]") {
+	// o0.xyzw -> position, o1.xy -> texcoord 0, o1.zw unused (0x1F)
+	std::array<u32, 7> outmaps = {0x03020100, 0x1F1F0D0C};
+	REQUIRE(ShaderAnalysis::getLiveOutputs(2, outmaps.data()) == 0x3F);
+	// Only the first output counts, even if the second one has outmaps
+	REQUIRE(ShaderAnalysis::getLiveOutputs(1, outmaps.data()) == 0xF);
+
+	// When two components map to the same attribute, the last one wins
+	outmaps[1] = 0x1F1F0100;
+	REQUIRE(ShaderAnalysis::getLiveOutputs(2, outmaps.data()) == 0x3C);
+}
+
+TEST_CASE("Dead output writes", "[shader][analysis]") {
+	using namespace RawShader;
+	const std::array<u32, 3> code = {
+		format1(ShaderOpcodes::MOV, 0, 0x0, 0, 0),  // mov o0, v0
+		format1(ShaderOpcodes::MOV, 1, 0x1, 0, 0),  // mov o1, v1
+		end(),
+	};
+	const std::array<u32, 1> descriptors = {descriptor(0xF)};
+	const auto shader = assembleRawVertexShader(code, descriptors);
+
+	ShaderAnalysis analysis;
+	analysis.analyze(*shader, 0, 0xF);
+	REQUIRE(analysis.liveWriteMasks[0] == 0xF);
+	REQUIRE(analysis.liveWriteMasks[1] == 0);
+	REQUIRE(analysis.deadInstructionCount == 1);
+
+	// With o1 used too, nothing is dead
+	analysis.analyze(*shader, 0, 0xFF);
+	REQUIRE(analysis.liveWriteMasks[1] == 0xF);
+	REQUIRE(analysis.deadInstructionCount == 0);
+}
+
+TEST_CASE("Partially live outputs", "[shader][analysis]") {
+	using namespace RawShader;
+	const std::array<u32, 4> code = {
+		format1(ShaderOpcodes::MUL, 0x10, 0x0, 0x1, 0),  // mul r0, v0, v1
+		format1(ShaderOpcodes::MOV, 0, 0x10, 0, 0),      // mov o0, r0
+		format1(ShaderOpcodes::MOV, 0x11, 0x0, 0, 0),    // mov r1, v0 (never read)
+		end(),
+	};
+	const std::array<u32, 1> descriptors = {descriptor(0xF)};
+	const auto shader = assembleRawVertexShader(code, descriptors);
+
+	// Only o0.xy is used, so only the x and y of r0 need computing. Write masks have x in bit 3
+	ShaderAnalysis analysis;
+	analysis.analyze(*shader, 0, 0b0011);
+	REQUIRE(analysis.liveWriteMasks[0] == 0b1100);
+	REQUIRE(analysis.liveWriteMasks[1] == 0b1100);
+	REQUIRE(analysis.liveWriteMasks[2] == 0);
+	REQUIRE(analysis.deadInstructionCount == 1);
+
+	// Just o0.w
+	analysis.analyze(*shader, 0, 0b1000);
+	REQUIRE(analysis.liveWriteMasks[0] == 0b0001);
+	REQUIRE(analysis.liveWriteMasks[1] == 0b0001);
+}
+
+TEST_CASE("Temporaries that are live after a break", "[shader][analysis]") {
+	using namespace RawShader;
+	const std::array<u32, 7> code = {
+		flowControl(ShaderOpcodes::LOOP, 0, 4, 0),      // loop i0, 4
+		format1(ShaderOpcodes::MOV, 0x10, 0x0, 0, 0),  // mov r0, v0
+		flowControl(ShaderOpcodes::BREAKC, 0, 0, 0),   // breakc
+		format1(ShaderOpcodes::MOV, 0x10, 0x1, 0, 0),  // mov r0, v1
+		format1(ShaderOpcodes::MOV, 0x10, 0x1, 0, 0),  // mov r0, v1
+		format1(ShaderOpcodes::MOV, 0, 0x10, 0, 0),    // mov o0, r0
+		end(),
+	};
+	const std::array<u32, 1> descriptors = {descriptor(0xF)};
+	const auto shader = assembleRawVertexShader(code, descriptors);
+
+	// The loop body always overwrites r0 before the end of the loop, but the break jumps straight to the mov o0, r0 after it
+	ShaderAnalysis analysis;
+	analysis.analyze(*shader, 0, 0xF);
+	REQUIRE(analysis.liveWriteMasks[1] == 0xF);
+	REQUIRE(analysis.liveWriteMasks[3] == 0);
+	REQUIRE(analysis.liveWriteMasks[4] == 0xF);
+}
+
+SHADER_TEST_CASE("Output liveness", "[shader][vertex][liveness]") {
+	using namespace RawShader;
+	const std::array<u32, 5> code = {
+		format1(ShaderOpcodes::MUL, 0x10, 0x0, 0x1, 0),  // mul r0, v0, v1
+		format1(ShaderOpcodes::ADD, 0, 0x10, 0x1, 0),    // add o0, r0, v1
+		format1(ShaderOpcodes::MOV, 1, 0x0, 0, 0),       // mov o1, v0
+		format1(ShaderOpcodes::MOV, 2, 0x10, 0, 1),      // mov o2.x, r0
+		end(),
+	};
+	const std::array<u32, 2> descriptors = {descriptor(0xF), descriptor(0b1000)};
+	auto shader = TestType::assembleRawTest(code, descriptors);
+
+	const auto vec = [](float x, float y, float z, float w) {
+		return std::array<f24, 4>{f24::fromFloat32(x), f24::fromFloat32(y), f24::fromFloat32(z), f24::fromFloat32(w)};
+	};
+	const std::array<std::array<f24, 4>, 2> inputs = {vec(1.0f, 2.0f, 3.0f, 4.0f), vec(0.5f, -1.0f, 2.0f, 0.25f)};
+
+	// o0.xz and o2.x are live, o1 is dead
+	shader->setLiveOutputs(0b0101 | (0b0001 << 8));
+	auto outputs = shader->runTest(inputs);
+	REQUIRE(outputs[0][0].toFloat32() == 1.0f);
+	REQUIRE(outputs[0][2].toFloat32() == 8.0f);
+	REQUIRE(outputs[2][0].toFloat32() == 0.5f);
+
+	// Changing the live outputs must not reuse the shader compiled for the old ones
+	shader->setLiveOutputs(0b1010 | (0b1111 << 4));
+	outputs = shader->runTest(inputs);
+	REQUIRE(outputs[0][1].toFloat32() == -3.0f);
+	REQUIRE(outputs[0][3].toFloat32() == 1.25f);
+	REQUIRE(outputs[1] == inputs[0]);
+
+	if constexpr (!TestType::skipsDeadOutputs) {
+		REQUIRE(outputs[0] == vec(1.0f, -3.0f, 8.0f, 1.25f));
+	}
+}
+
+// Shaders that branch or loop on uniforms get specialised on their values by the JIT, so changing the uniforms must not reuse stale code
+static const std::array<u32, 4> ifUniformCode = {
+	RawShader::flowControl(ShaderOpcodes::IFU, 0, 2, 1),   // ifu b0
+	RawShader::format1(ShaderOpcodes::MOV, 0, 0x0, 0, 0),  //     mov o0, v0
+	RawShader::format1(ShaderOpcodes::MOV, 0, 0x1, 0, 0),  // else mov o0, v1
+	RawShader::end(),
+};
+
+static const std::array<u32, 5> loopUniformCode = {
+	RawShader::format1(ShaderOpcodes::MOV, 0x10, 0x1, 0, 0),      // mov r0, v1
+	RawShader::flowControl(ShaderOpcodes::LOOP, 0, 2, 0),         // loop i0
+	RawShader::format1(ShaderOpcodes::ADD, 0x10, 0x10, 0x0, 0),  //     add r0, r0, v0
+	RawShader::format1(ShaderOpcodes::MOV, 0, 0x10, 0, 0),        // mov o0, r0
+	RawShader::end(),
+};
+
+static const std::array<u32, 1> uniformTestDescriptors = {RawShader::descriptor(0xF)};
+
+SHADER_TEST_CASE("Bool uniform branches", "[shader][vertex][uniform]") {
+	auto shader = TestType::assembleRawTest(ifUniformCode, uniformTestDescriptors);
+
+	// Flip b0 back and forth, so each value gets run again after the other one was compiled
+	for (int i = 0; i < 4; i++) {
+		shader->boolUniforms() = 1;
+		REQUIRE(shader->runScalar({1.0f, 2.0f}) == 1.0f);
+		shader->boolUniforms() = 0;
+		REQUIRE(shader->runScalar({1.0f, 2.0f}) == 2.0f);
+	}
+
+	// Other bool uniforms don't matter
+	shader->boolUniforms() = 0xFFFE;
+	REQUIRE(shader->runScalar({1.0f, 2.0f}) == 2.0f);
+}
+
+SHADER_TEST_CASE("Int uniform loops", "[shader][vertex][uniform]") {
+	auto shader = TestType::assembleRawTest(loopUniformCode, uniformTestDescriptors);
+
+	// Run more different trip counts than we specialise on, then go back to the first ones
+	for (int round = 0; round < 2; round++) {
+		for (u8 count = 0; count < 2 * ShaderJIT::maxSpecialisedVariants; count++) {
+			shader->intUniforms()[0] = {count, 0, 1, 0};
+			REQUIRE(shader->runScalar({1.0f, 0.0f}) == float(count + 1));
+		}
+	}
+}
+
+#if defined(PANDA3DS_SHADER_JIT_SUPPORTED)
+TEST_CASE("Uniform specialisation falls back to the generic shader", "[shader][shader_jit][uniform]") {
+	auto shader = ShaderJITTest::assembleRawTest(loopUniformCode, uniformTestDescriptors);
+
+	for (u8 count = 0; count < ShaderJIT::maxSpecialisedVariants; count++) {
+		shader->intUniforms()[0] = {count, 0, 1, 0};
+		REQUIRE(shader->runScalar({1.0f, 0.0f}) == float(count + 1));
+	}
+	REQUIRE(shader->getCacheStats().specialisedCompiles == ShaderJIT::maxSpecialisedVariants);
+
+	// Out of variants, so this compiles the generic version, which has to read the new trip count at runtime
+	shader->intUniforms()[0] = {20, 0, 1, 0};
+	REQUIRE(shader->runScalar({1.0f, 0.0f}) == 21.0f);
+	shader->intUniforms()[0] = {30, 0, 1, 0};
+	REQUIRE(shader->runScalar({1.0f, 0.0f}) == 31.0f);
+	REQUIRE(shader->getCacheStats().specialisedCompiles == ShaderJIT::maxSpecialisedVariants);
+	REQUIRE(shader->getCacheStats().shaderCount == ShaderJIT::maxSpecialisedVariants + 1);
+
+	// Values we already have a variant for still use it
+	const u64 hits = shader->getCacheStats().hits;
+	shader->intUniforms()[0] = {3, 0, 1, 0};
+	REQUIRE(shader->runScalar({1.0f, 0.0f}) == 4.0f);
+	REQUIRE(shader->getCacheStats().hits == hits + 1);
+}
+
+TEST_CASE("Uniforms that are all 0 get specialised too", "[shader][shader_jit][uniform]") {
+	auto shader = ShaderJITTest::assembleRawTest(ifUniformCode, uniformTestDescriptors);
+
+	shader->boolUniforms() = 0;
+	REQUIRE(shader->runScalar({1.0f, 2.0f}) == 2.0f);
+	REQUIRE(shader->getCacheStats().specialisedCompiles == 1);
+
+	shader->boolUniforms() = 1;
+	REQUIRE(shader->runScalar({1.0f, 2.0f}) == 1.0f);
+	REQUIRE(shader->getCacheStats().specialisedCompiles == 2);
+	REQUIRE(shader->getCacheStats().shaderCount == 2);
+}
+#endif
+
+// A subroutine call, with code around it that nothing reaches. Only the reachable part gets decoded or compiled
+static const std::array<u32, 7> callCode = {
+	RawShader::flowControl(ShaderOpcodes::CALL, 0, 4, 1),     // call 4, 1
+	RawShader::format1(ShaderOpcodes::MOV, 0, 0x10, 0, 0),    // mov o0, r0
+	RawShader::end(),
+	RawShader::format1(ShaderOpcodes::MOV, 1, 0x1, 0, 0),     // mov o1, v1 (unreachable)
+	RawShader::format1(ShaderOpcodes::MOV, 0x10, 0x0, 0, 0),  // mov r0, v0 (the subroutine)
+	RawShader::end(),
+	RawShader::format1(ShaderOpcodes::MOV, 2, 0x1, 0, 0),     // mov o2, v1 (unreachable)
+};
+
+TEST_CASE("Reachable code", "[shader][analysis]") {
+	const auto shader = assembleRawVertexShader(callCode, uniformTestDescriptors);
+
+	ShaderAnalysis analysis;
+	analysis.findReachableCode(*shader, 0);
+	for (u32 pc : {0, 1, 2, 4, 5}) {
+		REQUIRE(analysis.isReachable(pc));
+	}
+	REQUIRE(!analysis.isReachable(3));
+	REQUIRE(!analysis.isReachable(6));
+	REQUIRE(analysis.reachableCount == 5);
+	REQUIRE(analysis.endPC == 6);
+
+	// The subroutine returns once it gets to its end, before running the END there
+	REQUIRE(analysis.isReturnPC(5));
+	REQUIRE(!analysis.isReturnPC(2));
+
+	// Starting from the subroutine instead only reaches the subroutine
+	analysis.findReachableCode(*shader, 4);
+	REQUIRE(analysis.reachableCount == 2);
+	REQUIRE(!analysis.isReachable(0));
+}
+
+SHADER_TEST_CASE("Subroutine calls", "[shader][vertex]") {
+	auto shader = TestType::assembleRawTest(callCode, uniformTestDescriptors);
+	REQUIRE(shader->runScalar({3.0f, 5.0f}) == 3.0f);
+	REQUIRE(shader->runScalar({-1.5f, 5.0f}) == -1.5f);
+}
+
+#if defined(PANDA3DS_SHADER_JIT_SUPPORTED)
+TEST_CASE("Shader cache eviction", "[shader][shader_jit]") {
+	using namespace RawShader;
+
+	// Shaders this big each need most of the smallest code arena we allow, so compiling one of them evicts the other
+	const auto makeShader = [](u32 input) {
+		std::vector<u32> code(4000, format1(ShaderOpcodes::MOV, 0, 0x0, 0, 0));  // mov o0, v0
+		code.push_back(format1(ShaderOpcodes::MOV, 0, input, 0, 0));            // mov o0, v(input)
+		code.push_back(end());
+		return assembleRawVertexShader(code, uniformTestDescriptors);
+	};
+
+	auto shaderA = makeShader(0);
+	auto shaderB = makeShader(1);
+	ShaderJIT jit;
+	jit.setCacheBudget(0);
+
+	const auto run = [&](PICAShader& shader) {
+		shader.inputs[0] = {f24::fromFloat32(1.0f), f24::zero(), f24::zero(), f24::zero()};
+		shader.inputs[1] = {f24::fromFloat32(2.0f), f24::zero(), f24::zero(), f24::zero()};
+		jit.prepare(shader);
+		jit.run(shader);
+		return shader.outputs[0][0].toFloat32();
+	};
+	const ShaderJIT::CacheStats& stats = jit.getCacheStats();
+
+	REQUIRE(run(*shaderA) == 1.0f);
+	REQUIRE(stats.evictions == 0);
+	REQUIRE(run(*shaderB) == 2.0f);
+	REQUIRE(stats.evictions == 1);
+	REQUIRE(stats.shaderCount == 1);
+	REQUIRE(stats.codeBytes <= stats.budget);
+
+	// The first shader has to be compiled again after getting evicted, and it has to be the right shader
+	REQUIRE(run(*shaderA) == 1.0f);
+	REQUIRE(stats.evictions == 2);
+	REQUIRE(stats.misses == 3);
+
+	const u64 hits = stats.hits;
+	REQUIRE(run(*shaderA) == 1.0f);
+	REQUIRE(stats.hits == hits + 1);
+	REQUIRE(stats.codeBytes <= stats.budget);
+}
+#endif
+
+// Straightforward implementation of the arithmetic instructions, operating on the raw instructions and operand descriptors like the
+// interpreter did before it decoded programs. The random program test checks the interpreter and the JIT against it
+class ReferenceShader {
+	using vec4 = std::array<f24, 4>;
+
+	std::span<const u32> code;
+	std::span<const u32> descriptors;
+
+	vec4 getSource(u32 source, u32 descriptor, int index) const {
+		const vec4& value = source < 0x10 ? inputs[source] : source < 0x20 ? temps[source - 0x10] : uniforms[source - 0x20];
+		// Each source has a negate bit followed by 8 bits of swizzle, starting at bit 4
+		const u32 swizzle = (descriptor >> (5 + index * 9)) & 0xFF;
+		const bool negate = ((descriptor >> (4 + index * 9)) & 1) != 0;
+
+		vec4 result;
+		for (int i = 0; i < 4; i++) {
+			result[i] = value[(swizzle >> (6 - 2 * i)) & 3];
+			if (negate) {
+				result[i] = -result[i];
+			}
+		}
+		return result;
+	}
+
+  public:
+	std::array<vec4, 16> inputs;
+	std::array<vec4, 16> outputs;
+	std::array<vec4, 16> temps;
+	std::array<vec4, 96> uniforms;
+
+	ReferenceShader(std::span<const u32> code, std::span<const u32> descriptors) : code(code), descriptors(descriptors) {}
+
+	void run() {
+		for (u32 instruction : code) {
+			const u32 opcode = instruction >> 26;
+			if (opcode == ShaderOpcodes::END) {
+				return;
+			}
+
+			const bool isMAD = opcode >= ShaderOpcodes::MAD;
+			const u32 descriptor = descriptors[isMAD ? (instruction & 0x1f) : (instruction & 0x7f)];
+			vec4 src1, src2, src3, result;
+			u32 dest;
+
+			if (isMAD) {
+				src1 = getSource(Helpers::getBits<17, 5>(instruction), descriptor, 0);
+				src2 = getSource(Helpers::getBits<10, 7>(instruction), descriptor, 1);
+				src3 = getSource(Helpers::getBits<5, 5>(instruction), descriptor, 2);
+				dest = Helpers::getBits<24, 5>(instruction);
+			} else {
+				src1 = getSource(Helpers::getBits<12, 7>(instruction), descriptor, 0);
+				src2 = getSource(Helpers::getBits<7, 5>(instruction), descriptor, 1);
+				dest = Helpers::getBits<21, 5>(instruction);
+			}
+
+			const f24 dp3 = src1[0] * src2[0] + src1[1] * src2[1] + src1[2] * src2[2];
+			const f24 dp4 = dp3 + src1[3] * src2[3];
+
+			for (int i = 0; i < 4; i++) {
+				const f24 a = src1[i];
+				const f24 b = src2[i];
+
+				switch (isMAD ? ShaderOpcodes::MAD : opcode) {
+					case ShaderOpcodes::ADD: result[i] = a + b; break;
+					case ShaderOpcodes::MUL: result[i] = a * b; break;
+					case ShaderOpcodes::DP3: result[i] = dp3; break;
+					case ShaderOpcodes::DP4: result[i] = dp4; break;
+					case ShaderOpcodes::MOV: result[i] = a; break;
+					case ShaderOpcodes::FLR: result[i] = f24::fromFloat32(std::floor(a.toFloat32())); break;
+					case ShaderOpcodes::SLT: result[i] = a < b ? f24::fromFloat32(1.0f) : f24::zero(); break;
+					case ShaderOpcodes::SGE: result[i] = a >= b ? f24::fromFloat32(1.0f) : f24::zero(); break;
+					case ShaderOpcodes::MAD: result[i] = a * b + src3[i]; break;
+
+					// max(NaN, 2) = NaN and max(2, NaN) = 2, with infinities in the second source always winning
+					case ShaderOpcodes::MAX: {
+						const float x = a.toFloat32(), y = b.toFloat32();
+						result[i] = f24::fromFloat32(std::isinf(y) ? y : std::max(y, x));
+						break;
+					}
+
+					case ShaderOpcodes::MIN: result[i] = f24::fromFloat32(std::min(b.toFloat32(), a.toFloat32())); break;
+					default: FAIL("Reference shader: Unimplemented opcode " << opcode); break;
+				}
+			}
+
+			vec4& destination = dest < 0x10 ? outputs[dest] : temps[dest - 0x10];
+			for (int i = 0; i < 4; i++) {
+				if (descriptor & (8 >> i)) {
+					destination[i] = result[i];
+				}
+			}
+		}
+	}
+};
+
+SHADER_TEST_CASE("Random programs", "[shader][vertex][random]") {
+	std::mt19937 rng(1234);
+	const auto randomInt = [&](u32 count) { return u32(std::uniform_int_distribution<u32>(0, count - 1)(rng)); };
+	const auto randomVector = [&]() {
+		std::uniform_real_distribution<float> distribution(-4.0f, 4.0f);
+		return std::array<f24, 4>{
+			f24::fromFloat32(distribution(rng)),
+			f24::fromFloat32(distribution(rng)),
+			f24::fromFloat32(distribution(rng)),
+			f24::fromFloat32(distribution(rng)),
+		};
+	};
+
+	std::vector<u32> opcodes = {
+		ShaderOpcodes::ADD, ShaderOpcodes::MUL, ShaderOpcodes::MAX, ShaderOpcodes::MIN,
+		ShaderOpcodes::MOV, ShaderOpcodes::FLR, ShaderOpcodes::SLT, ShaderOpcodes::SGE,
+	};
+	if constexpr (TestType::exactDotProducts) {
+		opcodes.insert(opcodes.end(), {ShaderOpcodes::DP3, ShaderOpcodes::DP4, ShaderOpcodes::MAD});
+	}
+
+	// Inputs, temporaries and the first few float uniforms. Only the 7-bit source fields can read uniforms
+	const auto randomSource = [&](bool canReadUniforms) {
+		const u32 type = randomInt(canReadUniforms ? 3 : 2);
+		return (type == 0 ? 0x0 : type == 1 ? 0x10 : 0x20) + randomInt(4);
+	};
+	// Outputs or temporaries
+	const auto randomDest = [&]() { return (randomInt(2) == 0 ? 0x0 : 0x10) + randomInt(4); };
+
+	for (int program = 0; program < 400; program++) {
+		// Descriptor 0 writes everything without swizzling, the rest are random, always writing something
+		std::vector<u32> descriptors = {RawShader::descriptor(0xF)};
+		for (int i = 1; i < 32; i++) {
+			descriptors.push_back((u32(rng()) & ~0xFu) | (1 + randomInt(15)));
+		}
+
+		// Start by writing every register we use, so the results don't depend on what the last program left in them
+		std::vector<u32> code;
+		for (u32 i = 0; i < 4; i++) {
+			code.push_back(RawShader::format1(ShaderOpcodes::MOV, i, i, 0, 0));
+			code.push_back(RawShader::format1(ShaderOpcodes::MOV, 0x10 + i, i, 0, 0));
+		}
+
+		const u32 length = 1 + randomInt(24);
+		for (u32 i = 0; i < length; i++) {
+			const u32 opcode = opcodes[randomInt(u32(opcodes.size()))];
+			const u32 descriptor = randomInt(32);
+
+			if (opcode == ShaderOpcodes::MAD) {
+				code.push_back(RawShader::mad(randomDest(), randomSource(false), randomSource(true), randomSource(false), descriptor));
+			} else {
+				// MAX and MIN don't support relative addressing, which we don't use anyway
+				code.push_back(RawShader::format1(opcode, randomDest(), randomSource(true), randomSource(false), descriptor));
+			}
+		}
+		code.push_back(RawShader::end());
+
+		auto shader = TestType::assembleRawTest(code, descriptors);
+		ReferenceShader reference(code, descriptors);
+
+		std::array<std::array<f24, 4>, 4> inputs;
+		for (auto& input : inputs) {
+			input = randomVector();
+		}
+		for (u32 i = 0; i < 4; i++) {
+			const auto uniform = randomVector();
+			shader->floatUniforms()[i] = uniform;
+			reference.uniforms[i] = uniform;
+		}
+
+		std::copy(inputs.begin(), inputs.end(), reference.inputs.begin());
+		reference.run();
+		const auto outputs = shader->runTest(inputs);
+
+		INFO("Program " << program);
+		for (u32 i = 0; i < 4; i++) {
+			for (u32 j = 0; j < 4; j++) {
+				// Compare the bits, so that we catch different zero signs and NaNs too
+				REQUIRE(std::bit_cast<u32>(outputs[i][j].toFloat32()) == std::bit_cast<u32>(reference.outputs[i][j].toFloat32()));
+			}
+		}
+	}
+}
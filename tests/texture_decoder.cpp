@@ -0,0 +1,102 @@
+#include <PICA/texture_decoder.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+#include <vector>
+
+using namespace PICA;
+
+static constexpr TextureFmt allFormats[] = {
+	TextureFmt::RGBA8, TextureFmt::RGB8, TextureFmt::RGBA5551, TextureFmt::RGB565, TextureFmt::RGBA4,  TextureFmt::IA8, TextureFmt::RG8,
+	TextureFmt::I8,	   TextureFmt::A8,	 TextureFmt::IA4,	   TextureFmt::I4,	   TextureFmt::A4,	   TextureFmt::ETC1, TextureFmt::ETC1A4,
+};
+
+static std::vector<u8> randomTextureData(TextureFmt format, u32 width, u32 height, u32 seed) {
+	std::mt19937 rng(seed);
+	std::vector<u8> data(TextureDecoder::sizeInBytes(format, width, height));
+	for (u8& byte : data) {
+		byte = u8(rng());
+	}
+
+	return data;
+}
+
+// The tile decoders (and their SIMD paths) have to give the same results as decoding every texel on its own
+TEST_CASE("Tile decoding matches texel decoding", "[texture_decoder]") {
+	constexpr u32 width = 32;
+	constexpr u32 height = 16;
+
+	for (TextureFmt format : allFormats) {
+		INFO("Format " << static_cast<int>(format));
+		const std::vector<u8> data = randomTextureData(format, width, height, static_cast<u32>(format));
+
+		std::vector<u32> decoded(width * height);
+		TextureDecoder::decodeTexture(format, width, height, data, decoded.data());
+
+		for (u32 v = 0; v < height; v++) {
+			for (u32 u = 0; u < width; u++) {
+				INFO("Texel " << u << ", " << v);
+				REQUIRE(decoded[v * width + u] == TextureDecoder::decodeTexel(u, v, format, width, data));
+			}
+		}
+	}
+}
+
+TEST_CASE("Textures that aren't made of whole tiles", "[texture_decoder]") {
+	// Sizes that aren't multiples of 8 go texel by texel, and have to give the same texels as the tile path for the part they share
+	for (TextureFmt format : {TextureFmt::RGBA8, TextureFmt::RGB565, TextureFmt::I4, TextureFmt::ETC1}) {
+		INFO("Format " << static_cast<int>(format));
+		const std::vector<u8> data = randomTextureData(format, 16, 16, 1);
+
+		std::vector<u32> full(16 * 16);
+		std::vector<u32> partial(16 * 12);
+		TextureDecoder::decodeTexture(format, 16, 16, data, full.data());
+		TextureDecoder::decodeTexture(format, 16, 12, data, partial.data());
+
+		for (u32 v = 0; v < 12; v++) {
+			for (u32 u = 0; u < 16; u++) {
+				REQUIRE(partial[v * 16 + u] == full[v * 16 + u]);
+			}
+		}
+	}
+}
+
+TEST_CASE("Texture sizes", "[texture_decoder]") {
+	REQUIRE(TextureDecoder::sizeInBytes(TextureFmt::RGBA8, 8, 8) == 256);
+	REQUIRE(TextureDecoder::sizeInBytes(TextureFmt::RGB8, 8, 8) == 192);
+	REQUIRE(TextureDecoder::sizeInBytes(TextureFmt::RGB565, 16, 8) == 256);
+	REQUIRE(TextureDecoder::sizeInBytes(TextureFmt::I8, 8, 8) == 64);
+	REQUIRE(TextureDecoder::sizeInBytes(TextureFmt::A4, 8, 8) == 32);
+	REQUIRE(TextureDecoder::sizeInBytes(TextureFmt::ETC1, 8, 8) == 32);
+	REQUIRE(TextureDecoder::sizeInBytes(TextureFmt::ETC1A4, 8, 8) == 64);
+}
+
+TEST_CASE("Texel formats", "[texture_decoder]") {
+	// The first texel of a texture is always at the start of its data. RGBA8 is stored as ABGR
+	const std::vector<u8> rgba8 = {0x44, 0x33, 0x22, 0x11};
+	REQUIRE(TextureDecoder::decodeTexel(0, 0, TextureFmt::RGBA8, 8, rgba8) == 0x44332211);
+
+	const std::vector<u8> rgb565 = {0x1F, 0xF8};  // Red in the top 5 bits, blue in the bottom 5
+	REQUIRE(TextureDecoder::decodeTexel(0, 0, TextureFmt::RGB565, 8, rgb565) == 0xFFFF00FF);
+
+	const std::vector<u8> i8 = {0x80};
+	REQUIRE(TextureDecoder::decodeTexel(0, 0, TextureFmt::I8, 8, i8) == 0xFF808080);
+
+	const std::vector<u8> a8 = {0x40};
+	REQUIRE(TextureDecoder::decodeTexel(0, 0, TextureFmt::A8, 8, a8) == 0x40000000);
+
+	// 4bpp formats have the even texel in the low nibble
+	const std::vector<u8> a4 = {0xF0};
+	REQUIRE(TextureDecoder::decodeTexel(0, 0, TextureFmt::A4, 8, a4) == 0x00000000);
+	REQUIRE(TextureDecoder::decodeTexel(1, 0, TextureFmt::A4, 8, a4) == 0xFF000000);
+}
+
+TEST_CASE("Morton interleave", "[texture_decoder]") {
+	REQUIRE(TextureDecoder::mortonInterleave(0, 0) == 0);
+	REQUIRE(TextureDecoder::mortonInterleave(1, 0) == 1);
+	REQUIRE(TextureDecoder::mortonInterleave(0, 1) == 2);
+	REQUIRE(TextureDecoder::mortonInterleave(7, 7) == 63);
+
+	// Texels in the second tile of a line come after the whole first tile
+	REQUIRE(TextureDecoder::getSwizzledOffset(8, 0, 16, 4) == 64 * 4);
+	REQUIRE(TextureDecoder::getSwizzledOffset(0, 8, 16, 4) == 16 * 8 * 4);
+}